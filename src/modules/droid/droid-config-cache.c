@@ -0,0 +1,483 @@
+/*
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core.h>
+#include <pulsecore/card.h>
+#include <pulsecore/core-error.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/modargs.h>
+
+#include "droid-config-cache.h"
+
+/* Cache file layout, all integers in host byte order:
+ *
+ *   "PADC"                   magic
+ *   u32                      CACHE_VERSION
+ *   u32                      CACHE_LAYOUT
+ *   u64, u64, u64            mtime seconds, mtime nanoseconds and size
+ *                            of the configuration file
+ *   string                   path of the configuration file
+ *   u32, u32                 payload length and checksum
+ *   payload                  the parsed configuration
+ *
+ * Strings are stored as u32 length followed by the characters. */
+
+#define CACHE_MAGIC             "PADC"
+/* Bump when the payload format changes. */
+#define CACHE_VERSION           (1)
+/* Config structure properties the payload depends on. */
+#define CACHE_LAYOUT            ((AUDIO_MAX_SAMPLING_RATES << 8) | AUDIO_API_VERSION_MAJ)
+
+typedef struct cache_writer {
+    uint8_t *data;
+    size_t length;
+    size_t allocated;
+} cache_writer;
+
+typedef struct cache_reader {
+    const uint8_t *data;
+    const uint8_t *end;
+    bool failed;
+} cache_reader;
+
+static uint32_t hash_data(const void *data, size_t length) {
+    const uint8_t *p = data;
+    uint32_t h = 2166136261U;
+    size_t i;
+
+    /* FNV-1a */
+    for (i = 0; i < length; i++) {
+        h ^= p[i];
+        h *= 16777619U;
+    }
+
+    return h;
+}
+
+static char *cache_path(const char *filename) {
+    char *fn, *path;
+
+    fn = pa_sprintf_malloc("droid-config-%08x.cache", hash_data(filename, strlen(filename)));
+    path = pa_state_path(fn, true);
+    pa_xfree(fn);
+
+    return path;
+}
+
+static void write_data(cache_writer *w, const void *data, size_t length) {
+    if (length == 0)
+        return;
+
+    if (w->length + length > w->allocated) {
+        w->allocated = PA_MAX(w->allocated * 2, w->length + length);
+        w->data = pa_xrealloc(w->data, w->allocated);
+    }
+
+    memcpy(w->data + w->length, data, length);
+    w->length += length;
+}
+
+static void write_u32(cache_writer *w, uint32_t v) {
+    write_data(w, &v, sizeof(v));
+}
+
+static void write_u64(cache_writer *w, uint64_t v) {
+    write_data(w, &v, sizeof(v));
+}
+
+static void write_string(cache_writer *w, const char *s) {
+    uint32_t length = s ? strlen(s) : 0;
+
+    write_u32(w, length);
+    write_data(w, s, length);
+}
+
+static void write_global(cache_writer *w, const pa_droid_config_global *global) {
+    write_u32(w, global->audio_hal_version);
+    write_u32(w, global->attached_output_devices);
+    write_u32(w, global->default_output_device);
+    write_u32(w, global->attached_input_devices);
+}
+
+static void write_rates(cache_writer *w, const uint32_t *rates) {
+    unsigned i;
+
+    for (i = 0; i < AUDIO_MAX_SAMPLING_RATES; i++)
+        write_u32(w, rates[i]);
+}
+
+static void write_config(cache_writer *w, const pa_droid_config_audio *config) {
+    const pa_droid_config_hw_module *module;
+    const pa_droid_config_output *output;
+    const pa_droid_config_input *input;
+    uint32_t n;
+
+    write_global(w, config->global_config);
+
+    for (n = 0, module = config->hw_modules; module; module = module->next)
+        n++;
+    write_u32(w, n);
+
+    for (module = config->hw_modules; module; module = module->next) {
+        write_string(w, module->name);
+
+        write_u32(w, !!module->global_config);
+        if (module->global_config)
+            write_global(w, module->global_config);
+
+        for (n = 0, output = module->outputs; output; output = output->next)
+            n++;
+        write_u32(w, n);
+
+        for (output = module->outputs; output; output = output->next) {
+            write_string(w, output->name);
+            write_rates(w, output->sampling_rates);
+            write_u32(w, output->channel_masks);
+            write_u32(w, output->formats);
+            write_u32(w, output->devices);
+            write_u32(w, output->flags);
+        }
+
+        for (n = 0, input = module->inputs; input; input = input->next)
+            n++;
+        write_u32(w, n);
+
+        for (input = module->inputs; input; input = input->next) {
+            write_string(w, input->name);
+            write_rates(w, input->sampling_rates);
+            write_u32(w, input->channel_masks);
+            write_u32(w, input->formats);
+            write_u32(w, input->devices);
+#if AUDIO_API_VERSION_MAJ >= 3
+            write_u32(w, input->flags);
+#endif
+        }
+    }
+}
+
+static bool read_data(cache_reader *r, void *data, size_t length) {
+    if (r->failed || (size_t) (r->end - r->data) < length) {
+        r->failed = true;
+        return false;
+    }
+
+    memcpy(data, r->data, length);
+    r->data += length;
+
+    return true;
+}
+
+static uint32_t read_u32(cache_reader *r) {
+    uint32_t v = 0;
+
+    read_data(r, &v, sizeof(v));
+
+    return v;
+}
+
+static uint64_t read_u64(cache_reader *r) {
+    uint64_t v = 0;
+
+    read_data(r, &v, sizeof(v));
+
+    return v;
+}
+
+static char *read_string(cache_reader *r) {
+    uint32_t length;
+    char *s;
+
+    length = read_u32(r);
+
+    if (r->failed || (size_t) (r->end - r->data) < length) {
+        r->failed = true;
+        return NULL;
+    }
+
+    s = pa_xnew(char, length + 1);
+    memcpy(s, r->data, length);
+    s[length] = '\0';
+    r->data += length;
+
+    return s;
+}
+
+static void read_global(cache_reader *r, pa_droid_config_global *global) {
+    global->audio_hal_version = read_u32(r);
+    global->attached_output_devices = read_u32(r);
+    global->default_output_device = read_u32(r);
+    global->attached_input_devices = read_u32(r);
+}
+
+static void read_rates(cache_reader *r, uint32_t *rates) {
+    unsigned i;
+
+    for (i = 0; i < AUDIO_MAX_SAMPLING_RATES; i++)
+        rates[i] = read_u32(r);
+}
+
+/* Returns NULL if the payload is truncated. Counts are not checked
+ * separately, reading past the end fails before they matter. */
+static pa_droid_config_audio *read_config(cache_reader *r) {
+    pa_droid_config_audio *config;
+    pa_droid_config_hw_module *module, **module_tail;
+    pa_droid_config_output *output, **output_tail;
+    pa_droid_config_input *input, **input_tail;
+    uint32_t n_modules, n, i, j;
+
+    config = pa_xnew0(pa_droid_config_audio, 1);
+    config->global_config = pa_xnew0(pa_droid_config_global, 1);
+    read_global(r, config->global_config);
+
+    module_tail = &config->hw_modules;
+    n_modules = read_u32(r);
+
+    for (i = 0; i < n_modules && !r->failed; i++) {
+        module = pa_xnew0(pa_droid_config_hw_module, 1);
+        module->config = config;
+        *module_tail = module;
+        module_tail = &module->next;
+
+        module->name = read_string(r);
+
+        if (read_u32(r)) {
+            module->global_config = pa_xnew0(pa_droid_config_global, 1);
+            read_global(r, module->global_config);
+        }
+
+        output_tail = &module->outputs;
+        n = read_u32(r);
+
+        for (j = 0; j < n && !r->failed; j++) {
+            output = pa_xnew0(pa_droid_config_output, 1);
+            output->module = module;
+            *output_tail = output;
+            output_tail = &output->next;
+
+            output->name = read_string(r);
+            read_rates(r, output->sampling_rates);
+            output->channel_masks = read_u32(r);
+            output->formats = read_u32(r);
+            output->devices = read_u32(r);
+            output->flags = read_u32(r);
+        }
+
+        input_tail = &module->inputs;
+        n = read_u32(r);
+
+        for (j = 0; j < n && !r->failed; j++) {
+            input = pa_xnew0(pa_droid_config_input, 1);
+            input->module = module;
+            *input_tail = input;
+            input_tail = &input->next;
+
+            input->name = read_string(r);
+            read_rates(r, input->sampling_rates);
+            input->channel_masks = read_u32(r);
+            input->formats = read_u32(r);
+            input->devices = read_u32(r);
+#if AUDIO_API_VERSION_MAJ >= 3
+            input->flags = read_u32(r);
+#endif
+        }
+    }
+
+    if (r->failed || r->data != r->end) {
+        pa_droid_config_free(config);
+        return NULL;
+    }
+
+    return config;
+}
+
+static pa_droid_config_audio *parse_cache(cache_reader *r, const char *filename, const struct stat *st) {
+    char magic[4];
+    char *path;
+    uint32_t length, checksum;
+    bool match;
+
+    if (!read_data(r, magic, sizeof(magic)) || memcmp(magic, CACHE_MAGIC, sizeof(magic)) != 0) {
+        pa_log_debug("Cache file isn't a droid config cache.");
+        return NULL;
+    }
+
+    if (read_u32(r) != CACHE_VERSION || read_u32(r) != CACHE_LAYOUT) {
+        pa_log_debug("Cache file is from a different version.");
+        return NULL;
+    }
+
+    match = read_u64(r) == (uint64_t) st->st_mtim.tv_sec;
+    match = read_u64(r) == (uint64_t) st->st_mtim.tv_nsec && match;
+    match = read_u64(r) == (uint64_t) st->st_size && match;
+
+    path = read_string(r);
+    match = path && pa_streq(path, filename) && match;
+    pa_xfree(path);
+
+    if (r->failed || !match) {
+        pa_log_debug("Cache file is stale.");
+        return NULL;
+    }
+
+    length = read_u32(r);
+    checksum = read_u32(r);
+
+    if (r->failed || (size_t) (r->end - r->data) != length || hash_data(r->data, length) != checksum) {
+        pa_log_debug("Cache file is corrupted.");
+        return NULL;
+    }
+
+    return read_config(r);
+}
+
+pa_droid_config_audio *pa_droid_config_cache_load(const char *filename) {
+    pa_droid_config_audio *config = NULL;
+    struct stat st, cache_st;
+    cache_reader r;
+    char *path;
+    void *data = MAP_FAILED;
+    int fd = -1;
+
+    pa_assert(filename);
+
+    if (stat(filename, &st) < 0)
+        return NULL;
+
+    if (!(path = cache_path(filename)))
+        return NULL;
+
+    if ((fd = pa_open_cloexec(path, O_RDONLY, 0)) < 0) {
+        if (errno != ENOENT)
+            pa_log_debug("Failed to open %s: %s", path, pa_cstrerror(errno));
+        goto finish;
+    }
+
+    if (fstat(fd, &cache_st) < 0 || cache_st.st_size <= 0)
+        goto finish;
+
+    if ((data = mmap(NULL, cache_st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+        pa_log_debug("Failed to map %s: %s", path, pa_cstrerror(errno));
+        goto finish;
+    }
+
+    r.data = data;
+    r.end = r.data + cache_st.st_size;
+    r.failed = false;
+
+    config = parse_cache(&r, filename, &st);
+
+finish:
+    if (data != MAP_FAILED)
+        munmap(data, cache_st.st_size);
+
+    if (fd >= 0)
+        pa_close(fd);
+
+    pa_xfree(path);
+
+    return config;
+}
+
+void pa_droid_config_cache_save(const char *filename, const pa_droid_config_audio *config) {
+    cache_writer payload, w;
+    struct stat st;
+    char *path = NULL, *tmp = NULL;
+    int fd = -1;
+
+    pa_assert(filename);
+    pa_assert(config);
+
+    pa_zero(payload);
+    pa_zero(w);
+
+    if (stat(filename, &st) < 0)
+        return;
+
+    if (!(path = cache_path(filename)))
+        return;
+
+    write_config(&payload, config);
+
+    write_data(&w, CACHE_MAGIC, strlen(CACHE_MAGIC));
+    write_u32(&w, CACHE_VERSION);
+    write_u32(&w, CACHE_LAYOUT);
+    write_u64(&w, st.st_mtim.tv_sec);
+    write_u64(&w, st.st_mtim.tv_nsec);
+    write_u64(&w, st.st_size);
+    write_string(&w, filename);
+    write_u32(&w, payload.length);
+    write_u32(&w, hash_data(payload.data, payload.length));
+    write_data(&w, payload.data, payload.length);
+
+    /* Write to a temporary file and rename, so that a concurrently
+     * starting daemon never sees a partial cache file. */
+    tmp = pa_sprintf_malloc("%s.tmp", path);
+
+    if ((fd = pa_open_cloexec(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+        pa_log_debug("Failed to create %s: %s", tmp, pa_cstrerror(errno));
+        goto finish;
+    }
+
+    if (pa_loop_write(fd, w.data, w.length, NULL) != (ssize_t) w.length) {
+        pa_log_debug("Failed to write %s: %s", tmp, pa_cstrerror(errno));
+        goto fail;
+    }
+
+    if (pa_close(fd) < 0) {
+        fd = -1;
+        pa_log_debug("Failed to write %s: %s", tmp, pa_cstrerror(errno));
+        goto fail;
+    }
+
+    fd = -1;
+
+    if (rename(tmp, path) < 0) {
+        pa_log_debug("Failed to rename %s: %s", tmp, pa_cstrerror(errno));
+        goto fail;
+    }
+
+    pa_log_debug("Wrote configuration cache %s for %s.", path, filename);
+    goto finish;
+
+fail:
+    if (fd >= 0)
+        pa_close(fd);
+    fd = -1;
+    unlink(tmp);
+
+finish:
+    pa_xfree(payload.data);
+    pa_xfree(w.data);
+    pa_xfree(tmp);
+    pa_xfree(path);
+}
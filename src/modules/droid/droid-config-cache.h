@@ -0,0 +1,34 @@
+#ifndef foodroidconfigcachefoo
+#define foodroidconfigcachefoo
+
+/*
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#include "droid-util.h"
+
+/* Binary cache of parsed audio policy configuration files, kept in the
+ * PulseAudio state directory. A cache entry is only used if the path,
+ * modification time and size of the configuration file match the ones
+ * recorded when the entry was written, and the entry was written by a
+ * build with the same cache format and config structures. */
+
+/* Returns NULL if there is no valid cache entry for filename. */
+pa_droid_config_audio *pa_droid_config_cache_load(const char *filename);
+/* Failures are logged but otherwise ignored, the cache is an optimization. */
+void pa_droid_config_cache_save(const char *filename, const pa_droid_config_audio *config);
+
+#endif
@@ -34,12 +34,14 @@
 
 #include <pulse/rtclock.h>
 #include <pulse/timeval.h>
+#include <pulse/format.h>
 #include <pulse/volume.h>
 #include <pulse/xmalloc.h>
 
 #include <pulsecore/core.h>
 #include <pulsecore/i18n.h>
 #include <pulsecore/module.h>
+#include <pulsecore/namereg.h>
 #include <pulsecore/memchunk.h>
 #include <pulsecore/sink.h>
 #include <pulsecore/modargs.h>
@@ -54,6 +56,10 @@
 #include <pulsecore/time-smoother.h>
 #include <pulsecore/hashmap.h>
 #include <pulsecore/core-subscribe.h>
+#include <pulsecore/asyncq.h>
+#include <pulsecore/fdsem.h>
+#include <pulsecore/flist.h>
+#include <pulsecore/atomic.h>
 
 #include "droid-sink.h"
 #include "droid-util.h"
@@ -75,7 +81,26 @@ struct userdata {
     size_t buffer_size;
     pa_usec_t buffer_time;
     pa_usec_t write_time;
-    pa_usec_t write_threshold;
+
+    /* Playback clock. The smoother maps system time to the HAL's playback
+     * position, so that we can wake up just before the HAL needs the next
+     * buffer. */
+    pa_smoother *smoother;
+    uint64_t write_count;
+    bool hal_position;
+    uint64_t hal_frames;
+    uint64_t played_frames;
+    pa_usec_t hal_latency;
+    pa_usec_t render_margin;
+    pa_usec_t next_due;
+    uint64_t wakeups;
+    uint64_t early_wakeups;
+    uint64_t late_wakeups;
+    /* Wakeups moved to the shared wakeup clock of the hw module. */
+    bool wakeup_clock;
+    uint64_t aligned_wakeups;
+    unsigned silence_writes;
+
     audio_devices_t prewrite_devices;
     uint32_t prewrite_silence;
     pa_hook_slot *sink_put_hook_slot;
@@ -98,17 +123,91 @@ struct userdata {
     pa_hook_slot *sink_input_put_hook_slot;
     pa_hook_slot *sink_input_unlink_hook_slot;
     pa_hook_slot *sink_proplist_changed_hook_slot;
+    pa_hook_slot *sink_state_changed_hook_slot;
     pa_hashmap *parameters;
 
     pa_droid_card_data *card_data;
     pa_droid_hw_module *hw_module;
     pa_droid_stream *stream;
+
+    /* HAL writer thread. When enabled, the IO thread only renders and
+     * hands the buffers over through writer_queue, and the blocking
+     * HAL writes happen in writer_thread. */
+    pa_thread *writer_thread;
+    pa_asyncq *writer_queue;
+    pa_fdsem *writer_done;
+    pa_rtpoll_item *writer_done_item;
+    uint32_t writer_buffers;
+    pa_atomic_t writer_queued;
+    pa_atomic_t writer_drop;
+
+    /* Compressed offload. While a passthrough sink input plays, its
+     * IEC61937 framing is stripped and the encoded frames are written to
+     * offload_stream instead of the PCM stream. offload_stream and
+     * offload_buffer are owned by the main thread, which hands them to
+     * the IO thread with SINK_MESSAGE_OFFLOAD_START and gets them back
+     * with SINK_MESSAGE_OFFLOAD_DRAIN. offload_drain_thread then waits
+     * for the HAL to play out the stream and reports back with
+     * SINK_MESSAGE_OFFLOAD_DRAINED. */
+    bool offload_rate_pending;
+    pa_droid_stream *offload_stream;
+    pa_sink_input *offload_input;
+    /* Set from FIXATE until PUT, so that the stream can be released if
+     * the sink input is never put. */
+    bool offload_unclaimed;
+    pa_defer_event *offload_unclaimed_event;
+    pa_thread *offload_drain_thread;
+    pa_hook_slot *offload_input_new_hook_slot;
+    pa_hook_slot *offload_input_fixate_hook_slot;
+    pa_hook_slot *offload_input_put_hook_slot;
+    pa_hook_slot *offload_input_unlink_hook_slot;
+    uint8_t *offload_buffer;
+    size_t offload_size;
+    /* IO thread */
+    pa_droid_stream *offload_thread_stream;
+    size_t offload_fill;
+    size_t offload_payload;
+    unsigned offload_header;
+    bool offload_paused;
+    pa_usec_t offload_next;
+};
+
+enum {
+    SINK_MESSAGE_GET_WAKEUPS = PA_SINK_MESSAGE_MAX,
+    SINK_MESSAGE_GET_STREAM_STATS,
+    SINK_MESSAGE_OFFLOAD_START,
+    SINK_MESSAGE_OFFLOAD_STOP,
+    /* Posted from the IO thread to the main thread. */
+    SINK_MESSAGE_OFFLOAD_DRAIN,
+    /* Posted from the drain thread to the main thread. */
+    SINK_MESSAGE_OFFLOAD_DRAINED,
 };
 
 #define DEFAULT_MODULE_ID "primary"
 
+/* How much before the HAL needs the next buffer we wake up to render it. */
+#define RENDER_MARGIN_USEC      (2 * PA_USEC_PER_MSEC)
+
+#define DEFAULT_WRITER_BUFFERS  (2)
+#define MAX_WRITER_BUFFERS      (2)
+/* Enough for MAX_WRITER_BUFFERS and the quit marker, needs to be a power of two. */
+#define WRITER_QUEUE_SIZE       (4)
+
+PA_STATIC_FLIST_DECLARE(droid_sink_chunks, 0, pa_xfree);
+
+/* Pushed to writer_queue to stop the writer thread. */
+static pa_memchunk writer_quit;
+
+/* Offloaded streams are rendered this much at a time. The HAL buffers
+ * seconds of encoded audio, so there's no need to wake up more often. */
+#define OFFLOAD_PERIOD_USEC     (100 * PA_USEC_PER_MSEC)
+
+#define IEC61937_SYNC1          (0xF872)
+#define IEC61937_SYNC2          (0x4E1F)
+
 /* sink properties */
 #define PROP_DROID_PARAMETER_PREFIX "droid.parameter."
+#define PROP_DROID_STATS "droid.stats.write"
 typedef struct droid_parameter_mapping {
     char *key;
     char *value;
@@ -127,6 +226,10 @@ typedef struct droid_parameter_mapping {
 static void parameter_free(droid_parameter_mapping *m);
 static void userdata_free(struct userdata *u);
 static void set_voice_volume(struct userdata *u, pa_sink_input *i);
+#ifdef DROID_HAVE_COMPRESS_OFFLOAD
+static void offload_drain(struct userdata *u, pa_droid_stream *s);
+static void offload_drained(struct userdata *u, pa_droid_stream *s);
+#endif
 
 static void set_primary_devices(struct userdata *u, audio_devices_t devices) {
     pa_assert(u);
@@ -210,7 +313,9 @@ static void do_routing(struct userdata *u) {
     else
         routing = u->primary_devices | u->extra_devices;
 
-    pa_droid_stream_set_route(u->stream, routing);
+    /* Routing may take long on some HALs, let the routing worker wait for
+     * it so that the IO thread can keep writing meanwhile. */
+    pa_droid_stream_set_route_async(u->stream, routing);
 }
 
 static bool parse_device_list(const char *str, audio_devices_t *dst) {
@@ -256,10 +361,13 @@ static int thread_write_silence(struct userdata *u) {
     pa_memblock_release(u->silence.memblock);
 
     u->write_time = pa_rtclock_now() - u->write_time;
+    u->silence_writes++;
 
     if (wrote < 0)
         return -1;
 
+    u->write_count += wrote;
+
     return 0;
 }
 
@@ -301,9 +409,103 @@ static int thread_write(struct userdata *u) {
     }
 
     u->write_time = pa_rtclock_now() - u->write_time;
+    u->write_count += u->buffer_size;
 
     return 0;
 }
+
+/* Called from IO context */
+static void thread_reset_clock(struct userdata *u) {
+    pa_usec_t timestamp;
+
+    u->write_count = 0;
+    u->played_frames = 0;
+    u->next_due = 0;
+    u->hal_latency = pa_droid_stream_get_latency(u->stream);
+    u->hal_position = pa_droid_stream_get_position(u->stream, &u->hal_frames, &timestamp) == 0;
+
+    pa_smoother_reset(u->smoother, pa_rtclock_now(), false);
+}
+
+/* Called from IO context */
+static void thread_update_clock(struct userdata *u, pa_usec_t now) {
+    size_t frame_size = pa_frame_size(&u->sink->sample_spec);
+    pa_usec_t timestamp = now;
+    pa_usec_t played, written;
+    uint64_t frames;
+
+    written = pa_bytes_to_usec(u->write_count, &u->sink->sample_spec);
+
+    if (u->hal_position && pa_droid_stream_get_position(u->stream, &frames, &timestamp) == 0) {
+        if (frames >= u->hal_frames)
+            u->played_frames += frames - u->hal_frames;
+        else
+            /* The HAL reset its counter, e.g. when leaving standby. */
+            u->played_frames += frames;
+
+        u->hal_frames = frames;
+        u->played_frames = PA_MIN(u->played_frames, u->write_count / frame_size);
+
+        played = pa_bytes_to_usec(u->played_frames * frame_size, &u->sink->sample_spec);
+    } else {
+        /* A blocking write returns once the HAL has room for the next
+         * buffer, so all but its latency worth of data has been played. */
+        played = written > u->hal_latency ? written - u->hal_latency : 0;
+    }
+
+    pa_smoother_put(u->smoother, timestamp, played);
+}
+
+/* Called from IO context */
+static pa_usec_t thread_get_latency(struct userdata *u) {
+    pa_usec_t played, written;
+
+    written = pa_bytes_to_usec(u->write_count, &u->sink->sample_spec);
+    played = pa_smoother_get(u->smoother, pa_rtclock_now());
+
+    return (written > played ? written - played : 0) +
+           pa_bytes_to_usec(pa_memblockq_get_length(u->memblockq), &u->sink->sample_spec);
+}
+
+/* Called from IO context. Accounts the wakeup that just happened at
+ * wakeup and returns when to wake up next. */
+static pa_usec_t thread_schedule(struct userdata *u, pa_usec_t wakeup) {
+    pa_usec_t now, played, written, queued, target, sleep_y, sleep_x, next, aligned;
+
+    u->wakeups++;
+
+    if (u->next_due > 0 && wakeup > u->next_due)
+        /* The HAL was ready for the next buffer before we were. */
+        u->late_wakeups++;
+    else if (u->write_time > 2 * u->render_margin)
+        /* We blocked in write for longer than needed. */
+        u->early_wakeups++;
+
+    now = pa_rtclock_now();
+    thread_update_clock(u, now);
+
+    written = pa_bytes_to_usec(u->write_count, &u->sink->sample_spec);
+    played = pa_smoother_get(u->smoother, now);
+    queued = written > played ? written - played : 0;
+
+    /* The HAL accepts the next buffer once it has room for it. */
+    target = u->hal_latency > u->buffer_time ? u->hal_latency - u->buffer_time : 0;
+
+    sleep_y = queued > target + u->render_margin ? queued - target - u->render_margin : 0;
+    sleep_x = pa_smoother_translate(u->smoother, now, sleep_y);
+
+    next = now + PA_MIN(sleep_x, sleep_y);
+    u->next_due = next + u->render_margin;
+
+    if (!u->wakeup_clock)
+        return next;
+
+    /* Waking up early only makes the write block a bit longer. */
+    if ((aligned = pa_droid_hw_wakeup_clock_align(u->hw_module, next, now, true)) != next)
+        u->aligned_wakeups++;
+
+    return aligned;
+}
 static void thread_render(struct userdata *u) {
     size_t length;
     size_t missing;
@@ -319,6 +521,203 @@ static void thread_render(struct userdata *u) {
     }
 }
 
+/* Called from writer thread */
+static void writer_thread_func(void *userdata) {
+    struct userdata *u = userdata;
+    pa_memchunk *c;
+    const void *p;
+    ssize_t wrote;
+
+    pa_assert(u);
+
+    pa_log_debug("Writer thread starting up.");
+
+    if (u->core->realtime_scheduling)
+        pa_make_realtime(u->core->realtime_priority);
+
+    while ((c = pa_asyncq_pop(u->writer_queue, true)) != &writer_quit) {
+        pa_assert(c);
+
+        while (c->length > 0 && !pa_atomic_load(&u->writer_drop)) {
+            p = pa_memblock_acquire_chunk(c);
+            wrote = pa_droid_stream_write(u->stream, p, c->length);
+            pa_memblock_release(c->memblock);
+
+            if (wrote < 0) {
+                pa_log("failed to write stream (%d)", wrote);
+                break;
+            }
+
+            c->index += wrote;
+            c->length -= wrote;
+        }
+
+        pa_atomic_sub(&u->writer_queued, (int) u->buffer_size);
+        pa_memblock_unref(c->memblock);
+
+        if (pa_flist_push(PA_STATIC_FLIST_GET(droid_sink_chunks), c) < 0)
+            pa_xfree(c);
+
+        pa_fdsem_post(u->writer_done);
+    }
+
+    pa_log_debug("Writer thread shutting down.");
+}
+
+/* Called from IO context. Keeps writer_buffers buffers queued for the
+ * writer thread. */
+static void thread_render_queue(struct userdata *u) {
+    pa_memchunk *c;
+
+    while (pa_atomic_load(&u->writer_queued) < (int) (u->writer_buffers * u->buffer_size)) {
+        if (!(c = pa_flist_pop(PA_STATIC_FLIST_GET(droid_sink_chunks))))
+            c = pa_xnew(pa_memchunk, 1);
+
+        pa_sink_render_full(u->sink, u->buffer_size, c);
+
+        pa_atomic_add(&u->writer_queued, (int) u->buffer_size);
+        pa_assert_se(pa_asyncq_push(u->writer_queue, c, false) == 0);
+    }
+}
+
+/* Called from IO context. Drops everything queued for the writer
+ * thread and waits until it is idle. */
+static void writer_flush(struct userdata *u) {
+    pa_atomic_store(&u->writer_drop, 1);
+
+    while (pa_atomic_load(&u->writer_queued) > 0)
+        pa_fdsem_wait(u->writer_done);
+
+    pa_atomic_store(&u->writer_drop, 0);
+}
+
+static void writer_stop(struct userdata *u) {
+    if (u->writer_thread) {
+        pa_assert_se(pa_asyncq_push(u->writer_queue, &writer_quit, true) == 0);
+        pa_thread_free(u->writer_thread);
+        u->writer_thread = NULL;
+    }
+}
+
+static void writer_chunk_free(pa_memchunk *c) {
+    pa_memblock_unref(c->memblock);
+    pa_xfree(c);
+}
+
+#ifdef DROID_HAVE_COMPRESS_OFFLOAD
+/* Called from IO context. Strips the IEC61937 framing from data and
+ * appends the payload of the data bursts to offload_buffer. The payload
+ * is stored as big endian 16 bit words. */
+static void offload_unwrap(struct userdata *u, const uint8_t *data, size_t length) {
+    size_t i;
+    uint16_t w;
+
+    for (i = 0; i + 1 < length; i += 2) {
+        w = (uint16_t) (data[i] | (data[i + 1] << 8));
+
+        if (u->offload_payload > 0) {
+            if (PA_UNLIKELY(u->offload_fill + 2 > u->offload_size)) {
+                pa_log_debug("Offload buffer overflow, dropping burst.");
+                u->offload_payload = 0;
+                continue;
+            }
+
+            u->offload_buffer[u->offload_fill++] = w >> 8;
+            u->offload_payload--;
+
+            if (u->offload_payload > 0) {
+                u->offload_buffer[u->offload_fill++] = w & 0xff;
+                u->offload_payload--;
+            }
+
+            continue;
+        }
+
+        /* Burst preamble Pa, Pb, Pc (data type) and Pd (length in bits).
+         * Anything else between the bursts is stuffing. */
+        switch (u->offload_header) {
+            case 0:
+                if (w == IEC61937_SYNC1)
+                    u->offload_header = 1;
+                break;
+            case 1:
+                u->offload_header = w == IEC61937_SYNC2 ? 2 : (w == IEC61937_SYNC1 ? 1 : 0);
+                break;
+            case 2:
+                u->offload_header = 3;
+                break;
+            case 3:
+                u->offload_payload = (w + 7) / 8;
+                u->offload_header = 0;
+                break;
+        }
+    }
+}
+
+/* Called from IO context */
+static void thread_write_offload(struct userdata *u) {
+    size_t done = 0;
+    ssize_t r;
+
+    while (done < u->offload_fill) {
+        if ((r = pa_droid_stream_write(u->offload_thread_stream, u->offload_buffer + done, u->offload_fill - done)) <= 0) {
+            pa_log("Failed to write to offload stream. (err %zd)", r);
+            break;
+        }
+
+        done += r;
+    }
+
+    u->offload_fill = 0;
+}
+
+/* Called from IO context. Renders one period of the passthrough stream
+ * and returns when to wake up for the next one. IEC61937 frames take as
+ * long to play as the PCM frames they replace, so the period can be
+ * measured in sink frames. */
+static pa_usec_t thread_render_offload(struct userdata *u) {
+    pa_memchunk c;
+    pa_usec_t now;
+    void *p;
+
+    pa_sink_render_full(u->sink, pa_usec_to_bytes(OFFLOAD_PERIOD_USEC, &u->sink->sample_spec), &c);
+
+    p = pa_memblock_acquire(c.memblock);
+    offload_unwrap(u, (const uint8_t *) p + c.index, c.length);
+    pa_memblock_release(c.memblock);
+    pa_memblock_unref(c.memblock);
+
+    thread_write_offload(u);
+    u->wakeups++;
+
+    now = pa_rtclock_now();
+    u->offload_next += OFFLOAD_PERIOD_USEC;
+
+    /* Don't try to catch up after stalling. */
+    if (u->offload_next + OFFLOAD_PERIOD_USEC < now)
+        u->offload_next = now;
+
+    return u->offload_next;
+}
+
+/* Called from IO context */
+static void thread_offload_set_paused(struct userdata *u, bool paused) {
+    if (!u->offload_thread_stream || u->offload_paused == paused)
+        return;
+
+    if (pa_droid_stream_pause(u->offload_thread_stream, paused) < 0)
+        pa_log_debug("Offload stream doesn't support %s.", paused ? "pause" : "resume");
+
+    u->offload_paused = paused;
+    u->offload_next = pa_rtclock_now();
+}
+#endif
+
+/* Called from IO context. The stream audio is currently written to. */
+static pa_droid_stream *thread_stream(struct userdata *u) {
+    return u->offload_thread_stream ? u->offload_thread_stream : u->stream;
+}
+
 static void process_rewind(struct userdata *u) {
     size_t rewind_nbytes;
     size_t max_rewind_nbytes;
@@ -379,16 +778,27 @@ static void thread_func(void *userdata) {
             if (PA_UNLIKELY(u->sink->thread_info.rewind_requested))
                 process_rewind(u);
 
-            if (pa_rtpoll_timer_elapsed(u->rtpoll)) {
-                pa_usec_t sleept = 0;
+#ifdef DROID_HAVE_COMPRESS_OFFLOAD
+            if (u->offload_thread_stream) {
+                if (u->offload_paused)
+                    pa_rtpoll_set_timer_disabled(u->rtpoll);
+                else if (pa_rtpoll_timer_elapsed(u->rtpoll))
+                    pa_rtpoll_set_timer_absolute(u->rtpoll, thread_render_offload(u));
+            } else
+#endif
+            if (u->writer_thread) {
+                /* We are woken up through writer_done whenever the
+                 * writer thread has finished with a buffer. */
+                u->wakeups++;
+                thread_render_queue(u);
+                pa_rtpoll_set_timer_disabled(u->rtpoll);
+            } else if (pa_rtpoll_timer_elapsed(u->rtpoll)) {
+                pa_usec_t wakeup = pa_rtclock_now();
 
                 thread_render(u);
                 thread_write(u);
 
-                if (u->write_time > u->write_threshold)
-                    sleept = u->buffer_time;
-
-                pa_rtpoll_set_timer_relative(u->rtpoll, sleept);
+                pa_rtpoll_set_timer_absolute(u->rtpoll, thread_schedule(u, wakeup));
             }
         } else
             pa_rtpoll_set_timer_disabled(u->rtpoll);
@@ -419,7 +829,16 @@ static int suspend(struct userdata *u) {
     pa_assert(u);
     pa_assert(u->sink);
 
-    ret = pa_droid_stream_suspend(u->stream, true);
+    if (u->writer_thread)
+        writer_flush(u);
+
+    ret = pa_droid_stream_suspend(thread_stream(u), true);
+
+    pa_smoother_pause(u->smoother, pa_rtclock_now());
+
+    if (u->wakeups > 0)
+        pa_log_info("Wakeups %" PRIu64 ", early %" PRIu64 ", late %" PRIu64 ", aligned %" PRIu64 ".",
+                    u->wakeups, u->early_wakeups, u->late_wakeups, u->aligned_wakeups);
 
     if (ret == 0) {
         pa_sink_set_max_request_within_thread(u->sink, 0);
@@ -445,6 +864,14 @@ static int unsuspend(struct userdata *u) {
 
     pa_log_info("Resuming...");
 
+    thread_reset_clock(u);
+
+    if (u->offload_thread_stream) {
+        u->offload_next = pa_rtclock_now();
+        pa_droid_stream_suspend(u->offload_thread_stream, false);
+        return 0;
+    }
+
     if (u->prewrite_silence &&
         (u->primary_devices | u->extra_devices) & u->prewrite_devices &&
         pa_droid_output_stream_any_active(u->stream) == 0) {
@@ -464,10 +891,108 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
     switch (code) {
 
         case PA_SINK_MESSAGE_GET_LATENCY: {
-            *((pa_usec_t*) data) = pa_droid_stream_get_latency(u->stream);
+            pa_usec_t r;
+
+            if (u->writer_thread)
+                /* Buffers rendered but not yet written to the HAL */
+                r = pa_droid_stream_get_latency(u->stream) +
+                    pa_bytes_to_usec(pa_atomic_load(&u->writer_queued), &u->sink->sample_spec);
+            else if (PA_SINK_IS_OPENED(u->sink->thread_info.state))
+                r = thread_get_latency(u);
+            else
+                r = pa_droid_stream_get_latency(u->stream);
+
+            *((pa_usec_t*) data) = r;
             return 0;
         }
 
+        case SINK_MESSAGE_GET_WAKEUPS: {
+            *((uint64_t*) data) = u->wakeups;
+            return 0;
+        }
+
+        case SINK_MESSAGE_GET_STREAM_STATS: {
+            pa_droid_stream_stats *stats = data;
+
+            pa_droid_stream_get_stats(u->stream, stats);
+            stats->silence_writes = u->silence_writes;
+            return 0;
+        }
+
+#ifdef DROID_HAVE_COMPRESS_OFFLOAD
+        case SINK_MESSAGE_OFFLOAD_START: {
+            bool opened = PA_SINK_IS_OPENED(u->sink->thread_info.state);
+
+            pa_assert(!u->offload_thread_stream);
+
+            if (u->writer_thread)
+                writer_flush(u);
+
+            if (opened)
+                pa_droid_stream_suspend(u->stream, true);
+
+            u->offload_thread_stream = data;
+            u->offload_fill = 0;
+            u->offload_payload = 0;
+            u->offload_header = 0;
+            u->offload_paused = false;
+            u->offload_next = pa_rtclock_now();
+
+            if (opened) {
+                pa_droid_stream_suspend(u->offload_thread_stream, false);
+                pa_rtpoll_set_timer_absolute(u->rtpoll, u->offload_next);
+            }
+
+            pa_sink_set_fixed_latency_within_thread(u->sink, pa_droid_stream_get_latency(u->offload_thread_stream) + OFFLOAD_PERIOD_USEC);
+            return 0;
+        }
+
+        case SINK_MESSAGE_OFFLOAD_STOP: {
+            pa_droid_stream *s = u->offload_thread_stream;
+            bool opened = PA_SINK_IS_OPENED(u->sink->thread_info.state);
+
+            if (!s)
+                return 0;
+
+            thread_write_offload(u);
+
+            /* A paused stream is dropped, and when the sink is suspended
+             * the stream already is as well. Otherwise the HAL plays what
+             * it has buffered while the PCM stream takes over, the drain
+             * is waited for outside of this thread. */
+            if (u->offload_paused) {
+                pa_droid_stream_flush(s);
+                if (opened)
+                    pa_droid_stream_suspend(s, true);
+            }
+
+            if (opened) {
+                pa_droid_stream_suspend(u->stream, false);
+                thread_reset_clock(u);
+                pa_rtpoll_set_timer_absolute(u->rtpoll, pa_rtclock_now());
+            }
+
+            u->offload_thread_stream = NULL;
+            pa_sink_set_fixed_latency_within_thread(u->sink, pa_droid_stream_get_latency(u->stream) +
+                                                             (u->writer_thread ? u->writer_buffers * u->buffer_time : 0));
+
+            pa_asyncmsgq_post(u->thread_mq.outq, PA_MSGOBJECT(u->sink),
+                              opened && !u->offload_paused ? SINK_MESSAGE_OFFLOAD_DRAIN : SINK_MESSAGE_OFFLOAD_DRAINED,
+                              s, 0, NULL, NULL);
+            return 0;
+        }
+
+        case SINK_MESSAGE_OFFLOAD_DRAIN:
+            /* Called from main context */
+            offload_drain(u, data);
+            return 0;
+
+        case SINK_MESSAGE_OFFLOAD_DRAINED:
+            /* Called from main context */
+            offload_drained(u, data);
+            return 0;
+#endif
+
         case PA_SINK_MESSAGE_SET_STATE: {
             switch ((pa_sink_state_t) PA_PTR_TO_UINT(data)) {
                 case PA_SINK_SUSPENDED: {
@@ -489,7 +1014,13 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
                     if (u->sink->thread_info.state == PA_SINK_SUSPENDED) {
                         if ((r = unsuspend(u)) < 0)
                             return r;
-                    }
+                    } else if (u->sink->thread_info.state == PA_SINK_INIT)
+                        thread_reset_clock(u);
+
+#ifdef DROID_HAVE_COMPRESS_OFFLOAD
+                    /* The passthrough stream was corked or uncorked. */
+                    thread_offload_set_paused(u, PA_PTR_TO_UINT(data) == PA_SINK_IDLE);
+#endif
 
                     pa_rtpoll_set_timer_absolute(u->rtpoll, pa_rtclock_now());
                     break;
@@ -737,6 +1268,59 @@ void pa_droid_sink_set_voice_control(pa_sink* sink, bool enable) {
     }
 }
 
+/* Called from main thread */
+uint64_t pa_droid_sink_get_wakeups(pa_sink *sink) {
+    uint64_t wakeups = 0;
+
+    pa_sink_assert_ref(sink);
+    pa_assert_ctl_context();
+    pa_assert(pa_sink_is_droid_sink(sink));
+
+    if (PA_SINK_IS_LINKED(pa_sink_get_state(sink)))
+        pa_assert_se(pa_asyncmsgq_send(sink->asyncmsgq, PA_MSGOBJECT(sink), SINK_MESSAGE_GET_WAKEUPS, &wakeups, 0, NULL) == 0);
+
+    return wakeups;
+}
+
+/* Called from main thread */
+void pa_droid_sink_get_stream_stats(pa_sink *sink, pa_droid_stream_stats *stats) {
+    struct userdata *u;
+
+    pa_sink_assert_ref(sink);
+    pa_assert_ctl_context();
+    pa_assert(pa_sink_is_droid_sink(sink));
+    pa_assert(stats);
+
+    u = sink->userdata;
+
+    if (PA_SINK_IS_LINKED(pa_sink_get_state(sink)))
+        pa_assert_se(pa_asyncmsgq_send(sink->asyncmsgq, PA_MSGOBJECT(sink), SINK_MESSAGE_GET_STREAM_STATS, stats, 0, NULL) == 0);
+    else
+        pa_droid_stream_get_stats(u->stream, stats);
+}
+
+/* Publish the HAL write statistics whenever the sink suspends, so they
+ * can be read with pactl list sinks. */
+static pa_hook_result_t sink_state_changed_hook_cb(pa_core *c, pa_sink *sink, struct userdata *u) {
+    pa_droid_stream_stats stats;
+    pa_proplist *p;
+
+    pa_assert(sink);
+    pa_assert(u);
+
+    if (u->sink != sink || pa_sink_get_state(sink) != PA_SINK_SUSPENDED)
+        return PA_HOOK_OK;
+
+    pa_droid_sink_get_stream_stats(sink, &stats);
+
+    p = pa_proplist_new();
+    pa_droid_stream_stats_to_proplist(&stats, p, PROP_DROID_STATS);
+    pa_sink_update_proplist(sink, PA_UPDATE_REPLACE, p);
+    pa_proplist_free(p);
+
+    return PA_HOOK_OK;
+}
+
 /* When sink-input with proper proplist variable appears, do extra routing configuration
  * for the lifetime of that sink-input. */
 static pa_hook_result_t sink_input_put_hook_cb(pa_core *c, pa_sink_input *sink_input, struct userdata *u) {
@@ -854,7 +1438,7 @@ static pa_hook_result_t sink_proplist_changed_hook_cb(pa_core *c, pa_sink *sink,
             pa_assert(parameter);
             tmp = pa_sprintf_malloc("%s=%s;", parameter->key, parameter->value);
             pa_log_debug("set_parameters(): %s", tmp);
-            pa_droid_stream_set_parameters(u->stream, tmp);
+            pa_droid_stream_set_parameters_async(u->stream, tmp);
             pa_xfree(tmp);
         }
     }
@@ -954,6 +1538,245 @@ static void setup_track_primary(struct userdata *u) {
     }
 }
 
+#ifdef DROID_HAVE_COMPRESS_OFFLOAD
+static pa_idxset *sink_get_formats_cb(pa_sink *s) {
+    struct userdata *u = s->userdata;
+    pa_idxset *formats;
+    pa_format_info *f;
+
+    formats = pa_idxset_new(NULL, NULL);
+
+    f = pa_format_info_new();
+    f->encoding = PA_ENCODING_PCM;
+    pa_idxset_put(formats, f, NULL);
+
+    /* Only one passthrough stream can be offloaded at a time, others
+     * have to be decoded by the client. */
+    if (!u->offload_stream) {
+        f = pa_format_info_new();
+        f->encoding = PA_ENCODING_MPEG_IEC61937;
+        pa_idxset_put(formats, f, NULL);
+
+        f = pa_format_info_new();
+        f->encoding = PA_ENCODING_MPEG2_AAC_IEC61937;
+        pa_idxset_put(formats, f, NULL);
+    }
+
+    return formats;
+}
+
+/* Called from main thread while the sink is suspended. The PCM stream
+ * always runs at its own rate, other rates are only accepted for the
+ * passthrough stream about to be offloaded. */
+static int sink_update_rate_cb(pa_sink *s, uint32_t rate) {
+    struct userdata *u = s->userdata;
+
+    if (rate != u->stream->output->sample_spec.rate && !u->offload_rate_pending)
+        return -1;
+
+    u->offload_rate_pending = false;
+    s->sample_spec.rate = rate;
+
+    return 0;
+}
+
+static void offload_restore_rate(struct userdata *u) {
+    if (u->sink->sample_spec.rate != u->stream->output->sample_spec.rate)
+        pa_sink_update_rate(u->sink, u->stream->output->sample_spec.rate, true);
+}
+
+/* Negotiation picks the first requested format the sink supports, so
+ * find out before it does whether that will be a passthrough format. */
+static pa_hook_result_t offload_input_new_hook_cb(pa_core *c, pa_sink_input_new_data *data, struct userdata *u) {
+    pa_sink *sink;
+    pa_format_info *f;
+    uint32_t idx;
+
+    u->offload_rate_pending = false;
+
+    if (!(sink = data->sink))
+        sink = pa_namereg_get(c, NULL, PA_NAMEREG_SINK);
+
+    if (sink != u->sink || u->offload_stream || !data->req_formats)
+        return PA_HOOK_OK;
+
+    PA_IDXSET_FOREACH(f, data->req_formats, idx) {
+        if (pa_sink_check_format(u->sink, f)) {
+            u->offload_rate_pending = !pa_format_info_is_pcm(f);
+            break;
+        }
+    }
+
+    return PA_HOOK_OK;
+}
+
+/* Called from main thread */
+static void offload_release(struct userdata *u) {
+    pa_droid_stream_unref(u->offload_stream);
+    u->offload_stream = NULL;
+    pa_xfree(u->offload_buffer);
+    u->offload_buffer = NULL;
+
+    offload_restore_rate(u);
+}
+
+static bool offload_open(struct userdata *u, pa_encoding_t encoding, const pa_sample_spec *ss) {
+    pa_assert(!u->offload_stream);
+
+    if (!(u->offload_stream = pa_droid_open_offload_stream(u->hw_module, encoding, ss->rate, u->stream->output->flags,
+                                                           pa_droid_stream_get_device(u->stream)))) {
+        pa_log("Failed to open offload stream for %s.", pa_encoding_to_string(encoding));
+        offload_restore_rate(u);
+        return false;
+    }
+
+    u->offload_size = pa_usec_to_bytes(OFFLOAD_PERIOD_USEC, ss);
+    u->offload_buffer = pa_xmalloc(u->offload_size);
+
+    return true;
+}
+
+/* Runs once the main loop is idle again after FIXATE. Creating a sink
+ * input may still fail after FIXATE, or its creator may never put it,
+ * and then UNLINK doesn't fire either. All sink inputs that are put are
+ * put before the main loop gets here, so a stream that is still
+ * unclaimed now belongs to no sink input. */
+static void offload_unclaimed_cb(pa_mainloop_api *a, pa_defer_event *e, void *userdata) {
+    struct userdata *u = userdata;
+
+    a->defer_free(e);
+    u->offload_unclaimed_event = NULL;
+
+    if (!u->offload_unclaimed)
+        return;
+
+    pa_log_info("Passthrough sink input was not created, closing offload stream.");
+
+    u->offload_unclaimed = false;
+    offload_release(u);
+}
+
+/* Open the offload stream before the sink input is created, so that
+ * clients get an error instead of a silent stream if the HAL refuses. */
+static pa_hook_result_t offload_input_fixate_hook_cb(pa_core *c, pa_sink_input_new_data *data, struct userdata *u) {
+    u->offload_rate_pending = false;
+
+    if (data->sink != u->sink || !pa_sink_input_new_data_is_passthrough(data))
+        return PA_HOOK_OK;
+
+    if (u->offload_stream) {
+        pa_log_info("Offload stream is busy.");
+        return PA_HOOK_CANCEL;
+    }
+
+    if (!offload_open(u, data->format->encoding, &data->sample_spec))
+        return PA_HOOK_CANCEL;
+
+    u->offload_unclaimed = true;
+    if (!u->offload_unclaimed_event)
+        u->offload_unclaimed_event = c->mainloop->defer_new(c->mainloop, offload_unclaimed_cb, u);
+
+    return PA_HOOK_OK;
+}
+
+static void offload_kill_cb(pa_mainloop_api *a, void *userdata) {
+    pa_sink_input *i = userdata;
+
+    if (PA_SINK_INPUT_IS_LINKED(i->state))
+        pa_sink_input_kill(i);
+
+    pa_sink_input_unref(i);
+}
+
+static pa_hook_result_t offload_input_put_hook_cb(pa_core *c, pa_sink_input *i, struct userdata *u) {
+    if (i->sink != u->sink || !pa_sink_input_is_passthrough(i) || u->offload_input)
+        return PA_HOOK_OK;
+
+    /* Only if the sink input wasn't put right after it was created. */
+    if (!u->offload_unclaimed && (u->offload_stream || !offload_open(u, i->format->encoding, &i->sample_spec))) {
+        pa_log("No offload stream for %s stream, killing it.", pa_encoding_to_string(i->format->encoding));
+        pa_mainloop_api_once(c->mainloop, offload_kill_cb, pa_sink_input_ref(i));
+        return PA_HOOK_OK;
+    }
+
+    pa_log_info("Offloading %s stream at %u Hz.", pa_encoding_to_string(i->format->encoding), i->sample_spec.rate);
+
+    u->offload_unclaimed = false;
+    u->offload_input = i;
+    pa_asyncmsgq_send(u->sink->asyncmsgq, PA_MSGOBJECT(u->sink), SINK_MESSAGE_OFFLOAD_START, u->offload_stream, 0, NULL);
+
+    return PA_HOOK_OK;
+}
+
+static pa_hook_result_t offload_input_unlink_hook_cb(pa_core *c, pa_sink_input *i, struct userdata *u) {
+    if (i != u->offload_input)
+        return PA_HOOK_OK;
+
+    /* The stream is handed back with SINK_MESSAGE_OFFLOAD_DRAIN or
+     * SINK_MESSAGE_OFFLOAD_DRAINED, until then the offload output stays
+     * busy. */
+    pa_asyncmsgq_post(u->sink->asyncmsgq, PA_MSGOBJECT(u->sink), SINK_MESSAGE_OFFLOAD_STOP, NULL, 0, NULL, NULL);
+    u->offload_input = NULL;
+
+    return PA_HOOK_OK;
+}
+
+/* Called from the drain thread. A HAL drain can take as long as the
+ * HAL has compressed audio buffered, which is seconds. */
+static void offload_drain_thread_func(void *userdata) {
+    struct userdata *u = userdata;
+    pa_droid_stream *s = u->offload_stream;
+
+    if (pa_droid_stream_drain(s) < 0)
+        pa_log_debug("Offload stream doesn't support drain.");
+
+    pa_droid_stream_suspend(s, true);
+
+    pa_asyncmsgq_post(u->thread_mq.outq, PA_MSGOBJECT(u->sink), SINK_MESSAGE_OFFLOAD_DRAINED, s, 0, NULL, NULL);
+}
+
+/* Called from main thread, when the IO thread has stopped using s */
+static void offload_drain(struct userdata *u, pa_droid_stream *s) {
+    pa_assert(s == u->offload_stream);
+    pa_assert(!u->offload_drain_thread);
+
+    if (!(u->offload_drain_thread = pa_thread_new("droid-drain", offload_drain_thread_func, u))) {
+        pa_log("Failed to create drain thread, dropping offloaded audio.");
+        pa_droid_stream_flush(s);
+        pa_droid_stream_suspend(s, true);
+        offload_drained(u, s);
+    }
+}
+
+/* Called from main thread */
+static void offload_drained(struct userdata *u, pa_droid_stream *s) {
+    pa_assert(s == u->offload_stream);
+
+    if (u->offload_drain_thread) {
+        pa_thread_free(u->offload_drain_thread);
+        u->offload_drain_thread = NULL;
+    }
+
+    pa_log_info("Offload stream drained.");
+
+    offload_release(u);
+}
+
+static void setup_offload(struct userdata *u) {
+    u->sink->get_formats = sink_get_formats_cb;
+    u->sink->update_rate = sink_update_rate_cb;
+
+    u->offload_input_new_hook_slot = pa_hook_connect(&u->core->hooks[PA_CORE_HOOK_SINK_INPUT_NEW], PA_HOOK_LATE,
+            (pa_hook_cb_t) offload_input_new_hook_cb, u);
+    u->offload_input_fixate_hook_slot = pa_hook_connect(&u->core->hooks[PA_CORE_HOOK_SINK_INPUT_FIXATE], PA_HOOK_LATE,
+            (pa_hook_cb_t) offload_input_fixate_hook_cb, u);
+    u->offload_input_put_hook_slot = pa_hook_connect(&u->core->hooks[PA_CORE_HOOK_SINK_INPUT_PUT], PA_HOOK_NORMAL,
+            (pa_hook_cb_t) offload_input_put_hook_cb, u);
+    u->offload_input_unlink_hook_slot = pa_hook_connect(&u->core->hooks[PA_CORE_HOOK_SINK_INPUT_UNLINK], PA_HOOK_NORMAL,
+            (pa_hook_cb_t) offload_input_unlink_hook_cb, u);
+}
+#endif
+
 static bool parse_prewrite_on_resume(struct userdata *u, const char *prewrite_resume, const char *name) {
     const char *state = NULL;
     char *entry = NULL;
@@ -1040,6 +1863,9 @@ pa_sink *pa_droid_sink_new(pa_module *m,
     uint32_t sink_buffer = 0;
     const char *prewrite_resume = NULL;
     bool mix_route = false;
+    bool wakeup_clock = false;
+    bool writer_thread = false;
+    uint32_t writer_buffers = DEFAULT_WRITER_BUFFERS;
 
     pa_assert(m);
     pa_assert(ma);
@@ -1108,6 +1934,22 @@ pa_sink *pa_droid_sink_new(pa_module *m,
         goto fail;
     }
 
+    if (pa_modargs_get_value_boolean(ma, "sink_writer_thread", &writer_thread) < 0) {
+        pa_log("Failed to parse sink_writer_thread, expects boolean argument.");
+        goto fail;
+    }
+
+    if (pa_modargs_get_value_boolean(ma, "wakeup_clock", &wakeup_clock) < 0) {
+        pa_log("Failed to parse wakeup_clock, expects boolean argument.");
+        goto fail;
+    }
+
+    if (pa_modargs_get_value_u32(ma, "sink_writer_buffers", &writer_buffers) < 0 ||
+        writer_buffers < 1 || writer_buffers > MAX_WRITER_BUFFERS) {
+        pa_log("Failed to parse sink_writer_buffers. Needs to be integer between 1 and %u.", MAX_WRITER_BUFFERS);
+        goto fail;
+    }
+
     u = pa_xnew0(struct userdata, 1);
     u->core = m->core;
     u->module = m;
@@ -1184,7 +2026,8 @@ pa_sink *pa_droid_sink_new(pa_module *m,
     }
 
     u->buffer_time = pa_bytes_to_usec(u->buffer_size, &u->stream->output->sample_spec);
-    u->write_threshold = u->buffer_time - u->buffer_time / 6;
+    u->render_margin = PA_MIN(RENDER_MARGIN_USEC, u->buffer_time / 4);
+    u->smoother = pa_smoother_new(PA_USEC_PER_SEC, PA_USEC_PER_SEC * 2, true, true, 10, pa_rtclock_now(), true);
 
     pa_silence_memchunk_get(&u->core->silence_cache, u->core->mempool, &u->silence, &u->stream->output->sample_spec, u->buffer_size);
     u->memblockq = pa_memblockq_new("droid-sink", 0, u->buffer_size, u->buffer_size, &u->stream->output->sample_spec, 1, 0, 0, &u->silence);
@@ -1260,6 +2103,33 @@ pa_sink *pa_droid_sink_new(pa_module *m,
     /* Rewind internal memblockq */
     pa_sink_set_max_rewind(u->sink, 0);
 
+    if (writer_thread) {
+        u->writer_buffers = writer_buffers;
+        u->writer_queue = pa_asyncq_new(WRITER_QUEUE_SIZE);
+        u->writer_done = pa_fdsem_new();
+        u->writer_done_item = pa_rtpoll_item_new_fdsem(u->rtpoll, PA_RTPOLL_NORMAL, u->writer_done);
+
+        if (am)
+            thread_name = pa_sprintf_malloc("droid-writer-%s", am->output->name);
+        else
+            thread_name = pa_sprintf_malloc("droid-writer-%s", module_id);
+        if (!(u->writer_thread = pa_thread_new(thread_name, writer_thread_func, u))) {
+            pa_log("Failed to create writer thread.");
+            goto fail;
+        }
+        pa_xfree(thread_name);
+        thread_name = NULL;
+
+        pa_log_info("Using HAL writer thread with %u buffers of lookahead.", u->writer_buffers);
+    }
+
+    /* The writer thread paces itself with blocking writes, so there is
+     * no timer to align. */
+    if (wakeup_clock && !writer_thread) {
+        pa_droid_hw_wakeup_clock_join(u->hw_module, u->buffer_time);
+        u->wakeup_clock = true;
+    }
+
     if (am)
         thread_name = pa_sprintf_malloc("droid-sink-%s", am->output->name);
     else
@@ -1273,6 +2143,8 @@ pa_sink *pa_droid_sink_new(pa_module *m,
 
     /* HAL latencies are in milliseconds. */
     latency = pa_droid_stream_get_latency(u->stream);
+    if (u->writer_thread)
+        latency += u->writer_buffers * u->buffer_time;
     pa_sink_set_fixed_latency(u->sink, latency);
     pa_log_debug("Set fixed latency %llu usec", latency);
     pa_sink_set_max_request(u->sink, u->buffer_size);
@@ -1288,12 +2160,19 @@ pa_sink *pa_droid_sink_new(pa_module *m,
             (pa_hook_cb_t) sink_input_unlink_hook_cb, u);
     u->sink_proplist_changed_hook_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_PROPLIST_CHANGED], PA_HOOK_EARLY,
             (pa_hook_cb_t) sink_proplist_changed_hook_cb, u);
+    u->sink_state_changed_hook_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_STATE_CHANGED], PA_HOOK_NORMAL,
+            (pa_hook_cb_t) sink_state_changed_hook_cb, u);
 
     update_volumes(u);
 
     if (!pa_droid_stream_is_primary(u->stream))
         setup_track_primary(u);
 
+#ifdef DROID_HAVE_COMPRESS_OFFLOAD
+    if (u->stream->output->flags & AUDIO_OUTPUT_FLAG_COMPRESS_OFFLOAD)
+        setup_offload(u);
+#endif
+
     pa_droid_stream_suspend(u->stream, false);
     pa_droid_stream_set_data(u->stream, u->sink);
     pa_sink_put(u->sink);
@@ -1351,6 +2230,27 @@ static void userdata_free(struct userdata *u) {
         pa_thread_free(u->thread);
     }
 
+    writer_stop(u);
+
+    if (u->writer_done_item)
+        pa_rtpoll_item_free(u->writer_done_item);
+
+    if (u->writer_queue)
+        pa_asyncq_free(u->writer_queue, (pa_free_cb_t) writer_chunk_free);
+
+    if (u->writer_done)
+        pa_fdsem_free(u->writer_done);
+
+#ifdef DROID_HAVE_COMPRESS_OFFLOAD
+    /* It may still post SINK_MESSAGE_OFFLOAD_DRAINED, which is then
+     * dropped with the message queue. */
+    if (u->offload_drain_thread)
+        pa_thread_free(u->offload_drain_thread);
+
+    if (u->offload_unclaimed_event)
+        u->core->mainloop->defer_free(u->offload_unclaimed_event);
+#endif
+
     pa_thread_mq_done(&u->thread_mq);
 
     if (u->sink_input_put_hook_slot)
@@ -1365,6 +2265,28 @@ static void userdata_free(struct userdata *u) {
     if (u->sink_proplist_changed_hook_slot)
         pa_hook_slot_free(u->sink_proplist_changed_hook_slot);
 
+    if (u->sink_state_changed_hook_slot)
+        pa_hook_slot_free(u->sink_state_changed_hook_slot);
+
+    if (u->offload_input_new_hook_slot)
+        pa_hook_slot_free(u->offload_input_new_hook_slot);
+
+    if (u->offload_input_fixate_hook_slot)
+        pa_hook_slot_free(u->offload_input_fixate_hook_slot);
+
+    if (u->offload_input_put_hook_slot)
+        pa_hook_slot_free(u->offload_input_put_hook_slot);
+
+    if (u->offload_input_unlink_hook_slot)
+        pa_hook_slot_free(u->offload_input_unlink_hook_slot);
+
+    /* The IO and drain threads are gone, so a stream they didn't get to
+     * hand back can be freed here. */
+    if (u->offload_stream)
+        pa_droid_stream_unref(u->offload_stream);
+
+    pa_xfree(u->offload_buffer);
+
     if (u->sink)
         pa_sink_unref(u->sink);
 
@@ -1377,9 +2299,15 @@ static void userdata_free(struct userdata *u) {
     if (u->memblockq)
         pa_memblockq_free(u->memblockq);
 
+    if (u->smoother)
+        pa_smoother_free(u->smoother);
+
     if (u->silence.memblock)
         pa_memblock_unref(u->silence.memblock);
 
+    if (u->wakeup_clock)
+        pa_droid_hw_wakeup_clock_leave(u->hw_module);
+
     if (u->hw_module)
         pa_droid_hw_module_unref(u->hw_module);
 
@@ -54,4 +54,13 @@ void pa_droid_sink_free(pa_sink *s);
 
 void pa_droid_sink_set_voice_control(pa_sink* sink, bool enable);
 
+/* Number of times the sink IO thread has woken up to render since the
+ * sink was created. */
+uint64_t pa_droid_sink_get_wakeups(pa_sink *sink);
+
+/* Statistics of the HAL write() calls of the sink since it was created.
+ * They are also set as droid.stats.write.* properties whenever the sink
+ * suspends. */
+void pa_droid_sink_get_stream_stats(pa_sink *sink, pa_droid_stream_stats *stats);
+
 #endif
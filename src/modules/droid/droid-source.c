@@ -55,6 +55,8 @@
 #include "droid-source.h"
 #include "droid-util.h"
 
+#define CAPTURE_RING_SIZE 4
+
 struct userdata {
     pa_core *core;
     pa_module *module;
@@ -74,8 +76,25 @@ struct userdata {
 
     pa_hook_slot *input_buffer_size_changed_slot;
     pa_hook_slot *input_channel_map_changed_slot;
+    pa_hook_slot *source_state_changed_slot;
     pa_resampler *resampler;
 
+    /* Blocks posted to the source, reused once nobody else holds a
+     * reference. When a resampler is used, u->memchunk is the block the
+     * HAL reads into. */
+    pa_memblock *ring[CAPTURE_RING_SIZE];
+    unsigned ring_index;
+
+    uint64_t reads;
+    uint64_t allocations;
+    pa_usec_t stats_start;
+
+    /* Wakeups, and those moved to the shared wakeup clock of the hw
+     * module. */
+    bool wakeup_clock;
+    uint64_t wakeups;
+    uint64_t aligned_wakeups;
+
     pa_droid_card_data *card_data;
     pa_droid_hw_module *hw_module;
     pa_droid_stream *stream;
@@ -89,6 +108,7 @@ enum {
 
 #define DROID_AUDIO_SOURCE "droid.audio_source"
 #define DROID_AUDIO_SOURCE_UNDEFINED "undefined"
+#define PROP_DROID_STATS "droid.stats.read"
 #define PULSEAUDIO_VERSION 8
 
 static void userdata_free(struct userdata *u);
@@ -142,20 +162,98 @@ static bool parse_device_list(const char *str, audio_devices_t *dst) {
     return true;
 }
 
+/* Called from IO context. Returns a block of at least length bytes that
+ * only we hold a reference to. */
+static pa_memblock *ring_get(struct userdata *u, size_t length) {
+    pa_memblock **b;
+
+    b = &u->ring[u->ring_index];
+    u->ring_index = (u->ring_index + 1) % CAPTURE_RING_SIZE;
+
+    if (*b && (pa_memblock_get_length(*b) < length || !pa_memblock_ref_is_one(*b))) {
+        pa_memblock_unref(*b);
+        *b = NULL;
+    }
+
+    if (!*b) {
+        *b = pa_memblock_new(u->core->mempool, length);
+        u->allocations++;
+    }
+
+    return *b;
+}
+
+static void ring_clear(struct userdata *u) {
+    unsigned i;
+
+    for (i = 0; i < CAPTURE_RING_SIZE; i++) {
+        if (u->ring[i]) {
+            pa_memblock_unref(u->ring[i]);
+            u->ring[i] = NULL;
+        }
+    }
+
+    if (u->memchunk.memblock) {
+        pa_memblock_unref(u->memchunk.memblock);
+        pa_memchunk_reset(&u->memchunk);
+    }
+}
+
+/* Called from IO context */
+static void log_stats(struct userdata *u) {
+    double secs;
+
+    secs = (double) (pa_rtclock_now() - u->stats_start) / PA_USEC_PER_SEC;
+
+    if (u->reads == 0 || secs <= 0)
+        return;
+
+    /* Without the ring every read allocated a block, and another one
+     * when the data was resampled. */
+    pa_log_debug("%" PRIu64 " reads, %" PRIu64 " block allocations in %0.1f s (%0.1f/s, %0.1f/s without reuse)",
+                 u->reads, u->allocations, secs,
+                 (double) u->allocations / secs,
+                 (double) u->reads * (u->resampler ? 2 : 1) / secs);
+
+    pa_log_info("Wakeups %" PRIu64 " (%0.1f/s), aligned %" PRIu64 ".",
+                u->wakeups, (double) u->wakeups / secs, u->aligned_wakeups);
+}
+
+/* Called from IO context */
+static void reset_stats(struct userdata *u) {
+    u->reads = 0;
+    u->allocations = 0;
+    u->wakeups = 0;
+    u->aligned_wakeups = 0;
+    u->stats_start = pa_rtclock_now();
+}
+
 static int thread_read(struct userdata *u) {
     void *p;
     ssize_t readd;
     pa_memchunk chunk;
 
-    chunk.memblock = pa_memblock_new(u->core->mempool, (size_t) u->buffer_size);
+    if (u->resampler) {
+        if (!u->memchunk.memblock || pa_memblock_get_length(u->memchunk.memblock) < u->buffer_size) {
+            if (u->memchunk.memblock)
+                pa_memblock_unref(u->memchunk.memblock);
+            u->memchunk.memblock = pa_memblock_new(u->core->mempool, u->buffer_size);
+            u->allocations++;
+        }
+
+        chunk.memblock = u->memchunk.memblock;
+    } else
+        chunk.memblock = ring_get(u, u->buffer_size);
 
     p = pa_memblock_acquire(chunk.memblock);
-    readd = pa_droid_stream_read(u->stream, p, pa_memblock_get_length(chunk.memblock));
+    readd = pa_droid_stream_read(u->stream, p, u->buffer_size);
     pa_memblock_release(chunk.memblock);
 
+    u->reads++;
+
     if (readd < 0) {
         pa_log("Failed to read from stream. (err %i)", readd);
-        goto end;
+        return 0;
     }
 
     u->timestamp += pa_bytes_to_usec(readd, &u->source->sample_spec);
@@ -163,25 +261,22 @@ static int thread_read(struct userdata *u) {
     chunk.index = 0;
     chunk.length = readd;
 
+    if (chunk.length == 0)
+        return 0;
+
     if (u->resampler) {
         pa_memchunk rchunk;
 
-        pa_resampler_run(u->resampler, &chunk, &rchunk);
+        rchunk.memblock = ring_get(u, pa_resampler_result(u->resampler, chunk.length));
+        rchunk.index = 0;
+
+        pa_resampler_run_into(u->resampler, &chunk, &rchunk);
 
         if (rchunk.length > 0)
             pa_source_post(u->source, &rchunk);
-        if (rchunk.memblock)
-            pa_memblock_unref(rchunk.memblock);
-
-        goto end;
-    }
-
-    if (chunk.length > 0)
+    } else
         pa_source_post(u->source, &chunk);
 
-end:
-    pa_memblock_unref(chunk.memblock);
-
     return 0;
 }
 
@@ -199,14 +294,26 @@ static void thread_func(void *userdata) {
     pa_thread_mq_install(&u->thread_mq);
 
     u->timestamp = pa_rtclock_now();
+    reset_stats(u);
 
     for (;;) {
         int ret;
 
         if (PA_SOURCE_IS_OPENED(u->source->thread_info.state)) {
+            pa_usec_t next;
+
             thread_read(u);
+            u->wakeups++;
+
+            next = u->timestamp;
 
-            pa_rtpoll_set_timer_absolute(u->rtpoll, u->timestamp);
+            /* Reading late only leaves the data in the HAL for a while
+             * longer, see update_latency(). */
+            if (u->wakeup_clock &&
+                (next = pa_droid_hw_wakeup_clock_align(u->hw_module, u->timestamp, pa_rtclock_now(), false)) != u->timestamp)
+                u->aligned_wakeups++;
+
+            pa_rtpoll_set_timer_absolute(u->rtpoll, next);
         } else
             pa_rtpoll_set_timer_disabled(u->rtpoll);
 
@@ -230,6 +337,7 @@ fail:
     pa_asyncmsgq_wait_for(u->thread_mq.inq, PA_MESSAGE_SHUTDOWN);
 
 finish:
+    ring_clear(u);
     pa_log_debug("Thread shutting down.");
 }
 
@@ -242,8 +350,10 @@ static int suspend(struct userdata *u) {
 
     ret = pa_droid_stream_suspend(u->stream, true);
 
-    if (ret == 0)
+    if (ret == 0) {
         pa_log_info("Device suspended.");
+        log_stats(u);
+    }
 
     return ret;
 }
@@ -254,6 +364,7 @@ static void unsuspend(struct userdata *u) {
     pa_assert(u->stream);
 
     pa_droid_stream_suspend(u->stream, false);
+    reset_stats(u);
     pa_log_info("Resuming...");
 }
 
@@ -426,6 +537,8 @@ static void source_set_mute_control(struct userdata *u) {
 
 /* Called from main and IO context */
 static void update_latency(struct userdata *u) {
+    pa_usec_t latency;
+
     pa_assert(u);
     pa_assert(u->source);
     pa_assert(u->stream);
@@ -438,12 +551,18 @@ static void update_latency(struct userdata *u) {
     } else
         pa_log_info("Using buffer size %u.", u->buffer_size);
 
+    latency = pa_bytes_to_usec(u->buffer_size, &u->stream->input->sample_spec);
+
+    /* With the shared wakeup clock reads can be up to one period late. */
+    if (u->wakeup_clock)
+        latency *= 2;
+
     if (pa_thread_mq_get())
-        pa_source_set_fixed_latency_within_thread(u->source, pa_bytes_to_usec(u->buffer_size, &u->stream->input->sample_spec));
+        pa_source_set_fixed_latency_within_thread(u->source, latency);
     else
-        pa_source_set_fixed_latency(u->source, pa_bytes_to_usec(u->buffer_size, &u->stream->input->sample_spec));
+        pa_source_set_fixed_latency(u->source, latency);
 
-    pa_log_debug("Set fixed latency %" PRIu64 " usec", pa_bytes_to_usec(u->buffer_size, &u->stream->input->sample_spec));
+    pa_log_debug("Set fixed latency %" PRIu64 " usec", latency);
 }
 
 /* Called from IO context. */
@@ -491,6 +610,43 @@ static pa_hook_result_t input_channel_map_changed_cb(pa_droid_hw_module *module,
     return PA_HOOK_OK;
 }
 
+/* Called from main thread. The stream counters are only written by the
+ * IO thread and can be read without asking it. */
+void pa_droid_source_get_stream_stats(pa_source *source, pa_droid_stream_stats *stats) {
+    struct userdata *u;
+
+    pa_source_assert_ref(source);
+    pa_assert_ctl_context();
+    pa_assert(pa_source_is_droid_source(source));
+    pa_assert(stats);
+
+    u = source->userdata;
+
+    pa_droid_stream_get_stats(u->stream, stats);
+}
+
+/* Publish the HAL read statistics whenever the source suspends, so they
+ * can be read with pactl list sources. */
+static pa_hook_result_t source_state_changed_cb(pa_core *c, pa_source *source, struct userdata *u) {
+    pa_droid_stream_stats stats;
+    pa_proplist *p;
+
+    pa_assert(source);
+    pa_assert(u);
+
+    if (u->source != source || pa_source_get_state(source) != PA_SOURCE_SUSPENDED)
+        return PA_HOOK_OK;
+
+    pa_droid_source_get_stream_stats(source, &stats);
+
+    p = pa_proplist_new();
+    pa_droid_stream_stats_to_proplist(&stats, p, PROP_DROID_STATS);
+    pa_source_update_proplist(source, PA_UPDATE_REPLACE, p);
+    pa_proplist_free(p);
+
+    return PA_HOOK_OK;
+}
+
 pa_source *pa_droid_source_new(pa_module *m,
                                  pa_modargs *ma,
                                  const char *driver,
@@ -512,6 +668,7 @@ pa_source *pa_droid_source_new(pa_module *m,
     bool namereg_fail = false;
     pa_droid_config_audio *config = NULL; /* Only used when source is created without card */
     uint32_t source_buffer = 0;
+    bool wakeup_clock = false;
 
     pa_assert(m);
     pa_assert(ma);
@@ -570,6 +727,11 @@ pa_source *pa_droid_source_new(pa_module *m,
         goto fail;
     }
 
+    if (pa_modargs_get_value_boolean(ma, "wakeup_clock", &wakeup_clock) < 0) {
+        pa_log("Failed to parse wakeup_clock, expects boolean argument.");
+        goto fail;
+    }
+
     u = pa_xnew0(struct userdata, 1);
     u->core = m->core;
     u->module = m;
@@ -687,8 +849,12 @@ pa_source *pa_droid_source_new(pa_module *m,
     pa_xfree(thread_name);
     thread_name = NULL;
 
+    u->wakeup_clock = wakeup_clock;
     update_latency(u);
 
+    if (u->wakeup_clock)
+        pa_droid_hw_wakeup_clock_join(u->hw_module, pa_bytes_to_usec(u->buffer_size, &u->stream->input->sample_spec));
+
     if (u->source->active_port)
         source_set_port_cb(u->source, u->source->active_port);
 
@@ -700,6 +866,10 @@ pa_source *pa_droid_source_new(pa_module *m,
                                                         PA_HOOK_NORMAL,
                                                         (pa_hook_cb_t) input_channel_map_changed_cb, u);
 
+    u->source_state_changed_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SOURCE_STATE_CHANGED],
+                                                   PA_HOOK_NORMAL,
+                                                   (pa_hook_cb_t) source_state_changed_cb, u);
+
     pa_droid_stream_set_data(u->stream, u->source);
     pa_source_put(u->source);
 
@@ -735,6 +905,9 @@ static void userdata_free(struct userdata *u) {
     if (u->input_buffer_size_changed_slot)
         pa_hook_slot_free(u->input_buffer_size_changed_slot);
 
+    if (u->source_state_changed_slot)
+        pa_hook_slot_free(u->source_state_changed_slot);
+
     if (u->source)
         pa_source_unlink(u->source);
 
@@ -748,12 +921,14 @@ static void userdata_free(struct userdata *u) {
     if (u->source)
         pa_source_unref(u->source);
 
-    if (u->memchunk.memblock)
-        pa_memblock_unref(u->memchunk.memblock);
+    ring_clear(u);
 
     if (u->stream)
         pa_droid_stream_unref(u->stream);
 
+    if (u->wakeup_clock)
+        pa_droid_hw_wakeup_clock_leave(u->hw_module);
+
     // Stand alone source
     if (u->hw_module)
         pa_droid_hw_module_unref(u->hw_module);
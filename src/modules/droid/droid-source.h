@@ -53,4 +53,9 @@ pa_source *pa_droid_source_new(pa_module *m,
                                  pa_card *card);
 void pa_droid_source_free(pa_source *s);
 
+/* Statistics of the HAL read() calls of the source since it was created.
+ * They are also set as droid.stats.read.* properties whenever the source
+ * suspends. */
+void pa_droid_source_get_stream_stats(pa_source *source, pa_droid_stream_stats *stats);
+
 #endif
@@ -0,0 +1,771 @@
+/*
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-rtclock.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/modargs.h>
+#include <pulsecore/mutex.h>
+#include <pulsecore/sample-util.h>
+
+#include "droid-stub-hal.h"
+
+#define DEFAULT_RATE            (48000)
+#define DEFAULT_BUFFER_SIZE     (3840)
+#define DEFAULT_LATENCY_MSEC    (20)
+#define DEFAULT_OFFLOAD_BITRATE (128000)
+/* Compressed data a stub offload stream takes before write() blocks. */
+#define OFFLOAD_BUFFER_USEC     (PA_USEC_PER_SEC)
+
+static const char* const valid_modargs[] = {
+    "rate",
+    "buffer_size",
+    "block_usec",
+    "jitter_usec",
+    "fail_every",
+    "latency_msec",
+    "offload_bitrate",
+    NULL,
+};
+
+typedef struct stub_config {
+    uint32_t rate;
+    uint32_t buffer_size;
+    uint32_t block_usec;
+    uint32_t jitter_usec;
+    uint32_t fail_every;
+    uint32_t latency_msec;
+    uint32_t offload_bitrate;
+} stub_config;
+
+typedef struct stub_device {
+    audio_hw_device_t device;
+    stub_config config;
+    audio_mode_t mode;
+    bool mic_mute;
+} stub_device;
+
+typedef struct stub_stream {
+    stub_device *dev;
+    bool output;
+    pa_sample_spec sample_spec;
+    audio_channel_mask_t channel_mask;
+    audio_format_t format;
+    audio_devices_t devices;
+    size_t frame_size;
+    /* Compressed offload stream, sample_spec.rate is the rate of the
+     * encoded audio. */
+    bool compressed;
+    bool paused;
+    pa_usec_t paused_at;
+
+    bool standby;
+    pa_usec_t next;
+    pa_usec_t last_return;
+    uint64_t frames;
+    uint64_t calls;
+    unsigned seed;
+
+    /* Both stream types start with struct audio_stream, so the common
+     * callbacks can find the stub stream from either. */
+    union {
+        struct audio_stream common;
+        struct audio_stream_out out;
+        struct audio_stream_in in;
+    } hal;
+} stub_stream;
+
+#define STUB_STREAM(stream) ((stub_stream *) ((uint8_t *) (stream) - offsetof(stub_stream, hal)))
+
+static pa_static_mutex stats_mutex = PA_STATIC_MUTEX_INIT;
+static pa_droid_stub_hal_stats stats;
+
+static pa_mutex *stats_lock(void) {
+    pa_mutex *m;
+
+    m = pa_static_mutex_get(&stats_mutex, false, false);
+    pa_mutex_lock(m);
+
+    return m;
+}
+
+void pa_droid_stub_hal_get_stats(pa_droid_stub_hal_stats *s) {
+    pa_mutex *m;
+
+    pa_assert(s);
+
+    m = stats_lock();
+    *s = stats;
+    pa_mutex_unlock(m);
+}
+
+void pa_droid_stub_hal_reset_stats(void) {
+    pa_mutex *m;
+    pid_t output_tid, input_tid;
+
+    m = stats_lock();
+    output_tid = stats.output_tid;
+    input_tid = stats.input_tid;
+    pa_zero(stats);
+    stats.output_tid = output_tid;
+    stats.input_tid = input_tid;
+    pa_mutex_unlock(m);
+}
+
+static void stub_config_load(stub_config *config) {
+    const char *args;
+    pa_modargs *ma;
+
+    config->rate = DEFAULT_RATE;
+    config->buffer_size = DEFAULT_BUFFER_SIZE;
+    config->block_usec = 0;
+    config->jitter_usec = 0;
+    config->fail_every = 0;
+    config->latency_msec = DEFAULT_LATENCY_MSEC;
+    config->offload_bitrate = DEFAULT_OFFLOAD_BITRATE;
+
+    if (!(args = getenv(DROID_STUB_HAL_ENV)))
+        return;
+
+    if (!(ma = pa_modargs_new(args, valid_modargs))) {
+        pa_log("Failed to parse %s, using defaults.", DROID_STUB_HAL_ENV);
+        return;
+    }
+
+    if (pa_modargs_get_value_u32(ma, "rate", &config->rate) < 0 ||
+        !pa_sample_rate_valid(config->rate)) {
+        pa_log("Invalid rate, using %u.", DEFAULT_RATE);
+        config->rate = DEFAULT_RATE;
+    }
+
+    if (pa_modargs_get_value_u32(ma, "buffer_size", &config->buffer_size) < 0 || config->buffer_size == 0) {
+        pa_log("Invalid buffer_size, using %u.", DEFAULT_BUFFER_SIZE);
+        config->buffer_size = DEFAULT_BUFFER_SIZE;
+    }
+
+    if (pa_modargs_get_value_u32(ma, "block_usec", &config->block_usec) < 0)
+        pa_log("Invalid block_usec, ignoring.");
+
+    if (pa_modargs_get_value_u32(ma, "jitter_usec", &config->jitter_usec) < 0)
+        pa_log("Invalid jitter_usec, ignoring.");
+
+    if (pa_modargs_get_value_u32(ma, "fail_every", &config->fail_every) < 0)
+        pa_log("Invalid fail_every, ignoring.");
+
+    if (pa_modargs_get_value_u32(ma, "latency_msec", &config->latency_msec) < 0)
+        pa_log("Invalid latency_msec, ignoring.");
+
+    if (pa_modargs_get_value_u32(ma, "offload_bitrate", &config->offload_bitrate) < 0 || config->offload_bitrate == 0) {
+        pa_log("Invalid offload_bitrate, using %u.", DEFAULT_OFFLOAD_BITRATE);
+        config->offload_bitrate = DEFAULT_OFFLOAD_BITRATE;
+    }
+
+    pa_modargs_free(ma);
+}
+
+static void sleep_until(pa_usec_t t) {
+    struct timespec ts;
+
+    pa_timespec_store(&ts, t);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+}
+
+static bool stub_stream_init(stub_stream *s, stub_device *dev, bool output,
+                             audio_devices_t devices, struct audio_config *config) {
+    uint32_t format;
+    unsigned channels;
+
+    if (!pa_convert_format(config->format, CONV_FROM_HAL, &format)) {
+        pa_log("Stub HAL doesn't support format %#x.", config->format);
+        return false;
+    }
+
+    channels = __builtin_popcount(config->channel_mask);
+    if (channels == 0 || channels > PA_CHANNELS_MAX) {
+        pa_log("Stub HAL doesn't support channel mask %#x.", config->channel_mask);
+        return false;
+    }
+
+    s->dev = dev;
+    s->output = output;
+    s->devices = devices;
+    s->format = config->format;
+    s->channel_mask = config->channel_mask;
+    s->sample_spec.format = format;
+    s->sample_spec.rate = dev->config.rate;
+    s->sample_spec.channels = channels;
+    s->frame_size = pa_frame_size(&s->sample_spec);
+    s->standby = true;
+    s->seed = (uint32_t) pa_rtclock_now();
+
+    /* Like most HALs, report what we actually use. */
+    config->sample_rate = dev->config.rate;
+
+    return true;
+}
+
+#ifdef DROID_HAVE_COMPRESS_OFFLOAD
+/* Offload streams take any compressed format. The data isn't decoded, it
+ * just plays at offload_bitrate. */
+static void stub_stream_init_compressed(stub_stream *s, stub_device *dev,
+                                        audio_devices_t devices, struct audio_config *config) {
+    s->dev = dev;
+    s->output = true;
+    s->compressed = true;
+    s->devices = devices;
+    s->format = config->format;
+    s->channel_mask = config->channel_mask;
+    s->sample_spec.format = PA_SAMPLE_U8;
+    s->sample_spec.rate = config->sample_rate;
+    s->sample_spec.channels = 1;
+    s->frame_size = 1;
+    s->standby = true;
+    s->seed = (uint32_t) pa_rtclock_now();
+}
+#endif
+
+/* Blocks the calling thread like a HAL waiting for its DMA buffer would.
+ * Returns false if this call should fail. */
+static bool stub_stream_block(stub_stream *s, size_t bytes) {
+    pa_usec_t now, gap, duration;
+    bool xrun = false;
+    bool fail;
+    pa_mutex *m;
+    pid_t tid;
+
+    now = pa_rtclock_now();
+    gap = s->standby ? 0 : now - s->last_return;
+
+    if (s->compressed)
+        duration = (pa_usec_t) bytes * 8 * PA_USEC_PER_SEC / s->dev->config.offload_bitrate;
+    else if (s->dev->config.block_usec)
+        duration = s->dev->config.block_usec;
+    else
+        duration = pa_bytes_to_usec(bytes, &s->sample_spec);
+
+    if (s->standby) {
+        s->standby = false;
+        s->next = now;
+    } else if (s->paused) {
+        /* Nothing plays while paused, the data is just queued. */
+        s->next = PA_MAX(s->next, now);
+    } else if (s->next < now) {
+        /* The hardware ran out of data or the buffer overflowed. */
+        xrun = true;
+        s->next = now;
+    }
+
+    s->next += duration;
+    s->frames += bytes / s->frame_size;
+    s->calls++;
+
+    fail = s->dev->config.fail_every && (s->calls % s->dev->config.fail_every) == 0;
+
+    tid = (pid_t) syscall(SYS_gettid);
+
+    m = stats_lock();
+    if (s->compressed) {
+        stats.offload_writes++;
+        stats.offload_bytes += bytes;
+        stats.write_failures += fail;
+        stats.underruns += xrun;
+    } else if (s->output) {
+        stats.writes++;
+        stats.write_bytes += bytes;
+        stats.write_failures += fail;
+        stats.underruns += xrun;
+        stats.write_gap_sum += gap;
+        stats.write_gap_max = PA_MAX(stats.write_gap_max, gap);
+        stats.output_tid = tid;
+    } else {
+        stats.reads++;
+        stats.read_bytes += bytes;
+        stats.read_failures += fail;
+        stats.overruns += xrun;
+        stats.read_gap_sum += gap;
+        stats.read_gap_max = PA_MAX(stats.read_gap_max, gap);
+        stats.input_tid = tid;
+    }
+    pa_mutex_unlock(m);
+
+    if (s->compressed) {
+        /* Offload DSPs buffer a lot of compressed data, only block once
+         * the buffer is full. */
+        if (!s->paused && s->next > now + OFFLOAD_BUFFER_USEC)
+            sleep_until(s->next - OFFLOAD_BUFFER_USEC);
+    } else if (s->dev->config.jitter_usec)
+        sleep_until(s->next + rand_r(&s->seed) % s->dev->config.jitter_usec);
+    else
+        sleep_until(s->next);
+
+    s->last_return = pa_rtclock_now();
+
+    return !fail;
+}
+
+
+/* Common stream callbacks */
+
+static uint32_t stream_get_sample_rate(const struct audio_stream *stream) {
+    return STUB_STREAM(stream)->sample_spec.rate;
+}
+
+static int stream_set_sample_rate(struct audio_stream *stream, uint32_t rate) {
+    return -ENOSYS;
+}
+
+static size_t stream_get_buffer_size(const struct audio_stream *stream) {
+    stub_stream *s = STUB_STREAM(stream);
+
+    return pa_frame_align(s->dev->config.buffer_size, &s->sample_spec);
+}
+
+static audio_channel_mask_t stream_get_channels(const struct audio_stream *stream) {
+    return STUB_STREAM(stream)->channel_mask;
+}
+
+static audio_format_t stream_get_format(const struct audio_stream *stream) {
+    return STUB_STREAM(stream)->format;
+}
+
+static int stream_set_format(struct audio_stream *stream, audio_format_t format) {
+    return -ENOSYS;
+}
+
+static int stream_standby(struct audio_stream *stream) {
+    STUB_STREAM(stream)->standby = true;
+
+    return 0;
+}
+
+static int stream_dump(const struct audio_stream *stream, int fd) {
+    return 0;
+}
+
+static audio_devices_t stream_get_device(const struct audio_stream *stream) {
+    return STUB_STREAM(stream)->devices;
+}
+
+static int stream_set_device(struct audio_stream *stream, audio_devices_t device) {
+    STUB_STREAM(stream)->devices = device;
+
+    return 0;
+}
+
+static int stream_set_parameters(struct audio_stream *stream, const char *kv_pairs) {
+    return 0;
+}
+
+static char *stream_get_parameters(const struct audio_stream *stream, const char *keys) {
+    /* The caller frees the result with free(). */
+    return strdup("");
+}
+
+static int stream_add_audio_effect(const struct audio_stream *stream, effect_handle_t effect) {
+    return 0;
+}
+
+static int stream_remove_audio_effect(const struct audio_stream *stream, effect_handle_t effect) {
+    return 0;
+}
+
+static void stream_common_init(struct audio_stream *common) {
+    common->get_sample_rate = stream_get_sample_rate;
+    common->set_sample_rate = stream_set_sample_rate;
+    common->get_buffer_size = stream_get_buffer_size;
+    common->get_channels = stream_get_channels;
+    common->get_format = stream_get_format;
+    common->set_format = stream_set_format;
+    common->standby = stream_standby;
+    common->dump = stream_dump;
+    common->get_device = stream_get_device;
+    common->set_device = stream_set_device;
+    common->set_parameters = stream_set_parameters;
+    common->get_parameters = stream_get_parameters;
+    common->add_audio_effect = stream_add_audio_effect;
+    common->remove_audio_effect = stream_remove_audio_effect;
+}
+
+/* Output stream */
+
+static uint32_t out_get_latency(const struct audio_stream_out *stream) {
+    return STUB_STREAM(stream)->dev->config.latency_msec;
+}
+
+static int out_set_volume(struct audio_stream_out *stream, float left, float right) {
+    return 0;
+}
+
+static ssize_t out_write(struct audio_stream_out *stream, const void *buffer, size_t bytes) {
+    stub_stream *s = STUB_STREAM(stream);
+
+    if (!stub_stream_block(s, bytes))
+        return -EIO;
+
+    return bytes;
+}
+
+static int out_get_render_position(const struct audio_stream_out *stream, uint32_t *dsp_frames) {
+    *dsp_frames = (uint32_t) STUB_STREAM(stream)->frames;
+
+    return 0;
+}
+
+#if ANDROID_VERSION_MAJOR > 4 || (ANDROID_VERSION_MAJOR == 4 && ANDROID_VERSION_MINOR >= 4)
+static int out_get_presentation_position(const struct audio_stream_out *stream,
+                                         uint64_t *frames, struct timespec *timestamp) {
+    stub_stream *s = STUB_STREAM(stream);
+    pa_usec_t now;
+    uint64_t pending = 0;
+
+    now = pa_rtclock_now();
+
+    /* Whatever is due after now is still in our imaginary DMA buffer. */
+    if (!s->standby && s->next > now)
+        pending = pa_usec_to_bytes(s->next - now, &s->sample_spec) / s->frame_size;
+
+    *frames = s->frames > pending ? s->frames - pending : 0;
+    pa_timespec_store(timestamp, now);
+
+    return 0;
+}
+#endif
+
+static int out_get_next_write_timestamp(const struct audio_stream_out *stream, int64_t *timestamp) {
+    return -ENOSYS;
+}
+
+#ifdef DROID_HAVE_COMPRESS_OFFLOAD
+static int out_pause(struct audio_stream_out *stream) {
+    stub_stream *s = STUB_STREAM(stream);
+    pa_mutex *m;
+
+    if (s->paused)
+        return -ENOSYS;
+
+    s->paused = true;
+    s->paused_at = pa_rtclock_now();
+
+    m = stats_lock();
+    stats.pauses++;
+    pa_mutex_unlock(m);
+
+    return 0;
+}
+
+static int out_resume(struct audio_stream_out *stream) {
+    stub_stream *s = STUB_STREAM(stream);
+
+    if (!s->paused)
+        return -ENOSYS;
+
+    s->paused = false;
+
+    /* Whatever was queued starts playing now. */
+    if (!s->standby && s->next > s->paused_at)
+        s->next += pa_rtclock_now() - s->paused_at;
+
+    return 0;
+}
+
+static int out_drain(struct audio_stream_out *stream, audio_drain_type_t type) {
+    stub_stream *s = STUB_STREAM(stream);
+    pa_mutex *m;
+
+    if (s->paused)
+        return -ENOSYS;
+
+    if (!s->standby)
+        sleep_until(s->next);
+
+    m = stats_lock();
+    stats.drains++;
+    pa_mutex_unlock(m);
+
+    return 0;
+}
+
+static int out_flush(struct audio_stream_out *stream) {
+    stub_stream *s = STUB_STREAM(stream);
+
+    if (!s->paused)
+        return -ENOSYS;
+
+    s->standby = true;
+
+    return 0;
+}
+#endif
+
+/* Input stream */
+
+static int in_set_gain(struct audio_stream_in *stream, float gain) {
+    return 0;
+}
+
+static ssize_t in_read(struct audio_stream_in *stream, void *buffer, size_t bytes) {
+    stub_stream *s = STUB_STREAM(stream);
+
+    if (!stub_stream_block(s, bytes))
+        return -EIO;
+
+    memset(buffer, 0, bytes);
+
+    return bytes;
+}
+
+static uint32_t in_get_input_frames_lost(struct audio_stream_in *stream) {
+    return 0;
+}
+
+/* Device */
+
+static int device_close(hw_device_t *device) {
+    pa_log_info("Closing stub audio HAL.");
+    pa_xfree(device);
+
+    return 0;
+}
+
+static int device_init_check(const struct audio_hw_device *device) {
+    return 0;
+}
+
+static int device_set_voice_volume(struct audio_hw_device *device, float volume) {
+    return 0;
+}
+
+static int device_set_master_volume(struct audio_hw_device *device, float volume) {
+    return -ENOSYS;
+}
+
+static int device_set_mode(struct audio_hw_device *device, audio_mode_t mode) {
+    ((stub_device *) device)->mode = mode;
+
+    return 0;
+}
+
+static int device_set_mic_mute(struct audio_hw_device *device, bool state) {
+    ((stub_device *) device)->mic_mute = state;
+
+    return 0;
+}
+
+static int device_get_mic_mute(const struct audio_hw_device *device, bool *state) {
+    *state = ((const stub_device *) device)->mic_mute;
+
+    return 0;
+}
+
+static int device_set_parameters(struct audio_hw_device *device, const char *kv_pairs) {
+    return 0;
+}
+
+static char *device_get_parameters(const struct audio_hw_device *device, const char *keys) {
+    return strdup("");
+}
+
+static size_t device_get_input_buffer_size(const struct audio_hw_device *device,
+                                           const struct audio_config *config) {
+    return ((const stub_device *) device)->config.buffer_size;
+}
+
+static int device_open_output_stream(struct audio_hw_device *device,
+                                     audio_io_handle_t handle,
+                                     audio_devices_t devices,
+                                     audio_output_flags_t flags,
+                                     struct audio_config *config,
+                                     struct audio_stream_out **stream_out
+#if AUDIO_API_VERSION_MAJ >= 3
+                                     , const char *address
+#endif
+                                     ) {
+    stub_stream *s;
+    pa_mutex *m;
+
+    s = pa_xnew0(stub_stream, 1);
+
+#ifdef DROID_HAVE_COMPRESS_OFFLOAD
+    /* The PCM stream of a sink on the offload output is opened with the
+     * same flags, only the format tells them apart. */
+    if ((flags & AUDIO_OUTPUT_FLAG_COMPRESS_OFFLOAD) && (config->format & AUDIO_FORMAT_MAIN_MASK) != AUDIO_FORMAT_PCM) {
+        stub_stream_init_compressed(s, (stub_device *) device, devices, config);
+
+        s->hal.out.pause = out_pause;
+        s->hal.out.resume = out_resume;
+        s->hal.out.drain = out_drain;
+        s->hal.out.flush = out_flush;
+    } else
+#endif
+    if (!stub_stream_init(s, (stub_device *) device, true, devices, config)) {
+        pa_xfree(s);
+        return -EINVAL;
+    }
+
+    stream_common_init(&s->hal.out.common);
+    s->hal.out.get_latency = out_get_latency;
+    s->hal.out.set_volume = out_set_volume;
+    s->hal.out.write = out_write;
+    s->hal.out.get_render_position = out_get_render_position;
+    s->hal.out.get_next_write_timestamp = out_get_next_write_timestamp;
+#if ANDROID_VERSION_MAJOR > 4 || (ANDROID_VERSION_MAJOR == 4 && ANDROID_VERSION_MINOR >= 4)
+    s->hal.out.get_presentation_position = out_get_presentation_position;
+#endif
+
+    if (!s->compressed) {
+        m = stats_lock();
+        stats.output_spec = s->sample_spec;
+        pa_mutex_unlock(m);
+    }
+
+    pa_log_debug("Stub HAL opened %soutput stream %p", s->compressed ? "offload " : "", (void *) s);
+    *stream_out = &s->hal.out;
+
+    return 0;
+}
+
+static void device_close_output_stream(struct audio_hw_device *device, struct audio_stream_out *stream) {
+    pa_log_debug("Stub HAL closed output stream %p", (void *) STUB_STREAM(stream));
+    pa_xfree(STUB_STREAM(stream));
+}
+
+static int device_open_input_stream(struct audio_hw_device *device,
+                                    audio_io_handle_t handle,
+                                    audio_devices_t devices,
+                                    struct audio_config *config,
+                                    struct audio_stream_in **stream_in
+#if AUDIO_API_VERSION_MAJ >= 3
+                                    , audio_input_flags_t flags
+                                    , const char *address
+                                    , audio_source_t source
+#endif
+                                    ) {
+    stub_stream *s;
+    pa_mutex *m;
+
+    s = pa_xnew0(stub_stream, 1);
+
+    if (!stub_stream_init(s, (stub_device *) device, false, devices, config)) {
+        pa_xfree(s);
+        return -EINVAL;
+    }
+
+    stream_common_init(&s->hal.in.common);
+    s->hal.in.set_gain = in_set_gain;
+    s->hal.in.read = in_read;
+    s->hal.in.get_input_frames_lost = in_get_input_frames_lost;
+
+    m = stats_lock();
+    stats.input_spec = s->sample_spec;
+    pa_mutex_unlock(m);
+
+    pa_log_debug("Stub HAL opened input stream %p", (void *) s);
+    *stream_in = &s->hal.in;
+
+    return 0;
+}
+
+static void device_close_input_stream(struct audio_hw_device *device, struct audio_stream_in *stream) {
+    pa_log_debug("Stub HAL closed input stream %p", (void *) STUB_STREAM(stream));
+    pa_xfree(STUB_STREAM(stream));
+}
+
+static int device_dump(const struct audio_hw_device *device, int fd) {
+    return 0;
+}
+
+static int module_open(const hw_module_t *module, const char *name, hw_device_t **device) {
+    stub_device *dev;
+
+    if (!pa_streq(name, AUDIO_HARDWARE_INTERFACE))
+        return -EINVAL;
+
+    dev = pa_xnew0(stub_device, 1);
+    stub_config_load(&dev->config);
+
+    dev->device.common.tag = HARDWARE_DEVICE_TAG;
+    dev->device.common.version = AUDIO_DEVICE_API_VERSION_CURRENT;
+    dev->device.common.module = (hw_module_t *) module;
+    dev->device.common.close = device_close;
+
+    dev->device.init_check = device_init_check;
+    dev->device.set_voice_volume = device_set_voice_volume;
+    dev->device.set_master_volume = device_set_master_volume;
+    dev->device.set_mode = device_set_mode;
+    dev->device.set_mic_mute = device_set_mic_mute;
+    dev->device.get_mic_mute = device_get_mic_mute;
+    dev->device.set_parameters = device_set_parameters;
+    dev->device.get_parameters = device_get_parameters;
+    dev->device.get_input_buffer_size = device_get_input_buffer_size;
+    dev->device.open_output_stream = device_open_output_stream;
+    dev->device.close_output_stream = device_close_output_stream;
+    dev->device.open_input_stream = device_open_input_stream;
+    dev->device.close_input_stream = device_close_input_stream;
+    dev->device.dump = device_dump;
+
+    pa_log_info("Opened stub audio HAL: rate %u buffer size %u block %u usec jitter %u usec fail every %u latency %u ms",
+                dev->config.rate, dev->config.buffer_size, dev->config.block_usec,
+                dev->config.jitter_usec, dev->config.fail_every, dev->config.latency_msec);
+
+    *device = &dev->device.common;
+
+    return 0;
+}
+
+static struct hw_module_methods_t stub_module_methods = {
+    .open = module_open,
+};
+
+static struct audio_module stub_module = {
+    .common = {
+        .tag = HARDWARE_MODULE_TAG,
+        .module_api_version = AUDIO_MODULE_API_VERSION_0_1,
+        .hal_api_version = HARDWARE_HAL_API_VERSION,
+        .id = AUDIO_HARDWARE_MODULE_ID,
+        .name = "PulseAudio droid stub audio HAL",
+        .author = "PulseAudio",
+        .methods = &stub_module_methods,
+    },
+};
+
+int pa_droid_stub_hal_get_module(const char *name, const struct hw_module_t **module) {
+    pa_assert(name);
+    pa_assert(module);
+
+    pa_log_info("Using stub audio HAL in place of %s.%s", AUDIO_HARDWARE_MODULE_ID, name);
+    *module = &stub_module.common;
+
+    return 0;
+}
@@ -0,0 +1,93 @@
+#ifndef foodroidstubhalfoo
+#define foodroidstubhalfoo
+
+/*
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#include <sys/types.h>
+
+#include <pulse/sample.h>
+
+#include "droid-util.h"
+
+/* In-process audio HAL used instead of the hybris one when configured
+ * with --enable-droid-stub-hal. Output streams consume and input
+ * streams produce silence at the pace of the stream sample rate, so
+ * droid sinks and sources can be run and profiled on a plain Linux
+ * host.
+ *
+ * The stub is configured through the PULSE_DROID_STUB_HAL environment
+ * variable, which is read when the hw module is opened and contains
+ * space separated key=value pairs:
+ *
+ *   rate=<Hz>           sample rate reported for all streams (48000)
+ *   buffer_size=<bytes> stream buffer size (3840, 20 ms of S16 stereo)
+ *   block_usec=<usec>   time every write()/read() blocks, instead of
+ *                       the duration of the data transferred
+ *   jitter_usec=<usec>  random extra time added to every block
+ *   fail_every=<n>      fail every n:th write()/read() with -EIO
+ *   latency_msec=<ms>   value returned by get_latency()
+ *   offload_bitrate=<bits/s>
+ *                       rate at which compressed offload streams play
+ *                       (128000)
+ */
+
+#define DROID_STUB_HAL_ENV "PULSE_DROID_STUB_HAL"
+
+typedef struct pa_droid_stub_hal_stats {
+    uint64_t writes;
+    uint64_t write_bytes;
+    uint64_t write_failures;
+    uint64_t underruns;
+    /* Time spent outside write() between two calls. For droid sink this
+     * is the time from rendering to the data being handed to the HAL. */
+    pa_usec_t write_gap_sum;
+    pa_usec_t write_gap_max;
+
+    uint64_t reads;
+    uint64_t read_bytes;
+    uint64_t read_failures;
+    uint64_t overruns;
+    /* Time spent outside read() between two calls. */
+    pa_usec_t read_gap_sum;
+    pa_usec_t read_gap_max;
+
+    /* Compressed offload streams. Their failures and underruns are
+     * counted with the PCM output ones. */
+    uint64_t offload_writes;
+    uint64_t offload_bytes;
+    uint64_t drains;
+    uint64_t pauses;
+
+    /* Sample spec of the last opened streams, for converting bytes to time. */
+    pa_sample_spec output_spec;
+    pa_sample_spec input_spec;
+
+    /* Kernel thread ids of the threads that last called write() and
+     * read(), 0 if none did yet. Kept over pa_droid_stub_hal_reset_stats(). */
+    pid_t output_tid;
+    pid_t input_tid;
+} pa_droid_stub_hal_stats;
+
+/* Drop-in replacement for hw_get_module_by_class(AUDIO_HARDWARE_MODULE_ID, name, module). */
+int pa_droid_stub_hal_get_module(const char *name, const struct hw_module_t **module);
+
+/* Statistics are accumulated over all streams, also after they are closed. */
+void pa_droid_stub_hal_get_stats(pa_droid_stub_hal_stats *stats);
+void pa_droid_stub_hal_reset_stats(void);
+
+#endif
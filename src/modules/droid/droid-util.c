@@ -26,11 +26,14 @@
 #include <signal.h>
 #include <stdio.h>
 #include <string.h>
+#include <inttypes.h>
+#include <limits.h>
 
 #ifdef HAVE_VALGRIND_MEMCHECK_H
 #include <valgrind/memcheck.h>
 #endif
 
+#include <pulse/mainloop-api.h>
 #include <pulse/rtclock.h>
 #include <pulse/timeval.h>
 #include <pulse/volume.h>
@@ -56,9 +59,15 @@
 #include <pulsecore/shared.h>
 #include <pulsecore/mutex.h>
 #include <pulsecore/strlist.h>
+#include <pulsecore/strbuf.h>
 #include <pulsecore/atomic.h>
 
 #include "droid-util.h"
+#include "droid-config-cache.h"
+
+#ifdef DROID_STUB_HAL
+#include "droid-stub-hal.h"
+#endif
 
 struct droid_quirk {
     const char *name;
@@ -143,11 +152,13 @@ CONVERT_FUNC(input_channel);
 static const char * const droid_combined_auto_outputs[3]    = { "primary", "low_latency", NULL };
 static const char * const droid_combined_auto_inputs[2]     = { "primary", NULL };
 
-static void droid_config_free(pa_droid_config_audio *config);
 static void droid_port_free(pa_droid_port *p);
 
 static pa_droid_stream *get_primary_output(pa_droid_hw_module *hw);
 static int input_stream_set_route(pa_droid_stream *s, audio_devices_t device);
+static void droid_hw_module_close(pa_droid_hw_module *hw);
+static bool routing_worker_start(pa_droid_hw_module *hw);
+static void routing_worker_stop(pa_droid_hw_module *hw);
 
 static bool string_convert_num_to_str(const struct string_conversion *list, const uint32_t value, const char **to_str) {
     pa_assert(list);
@@ -1717,6 +1728,10 @@ static void update_sink_types(pa_droid_hw_module *hw, pa_sink *ignore_sink) {
     if (!pa_streq(hw->module_id, PA_DROID_PRIMARY_DEVICE))
         return;
 
+    /* The routing worker walks the outputs as well, see
+     * droid_output_stream_set_route(). */
+    pa_mutex_lock(hw->output_mutex);
+
     PA_IDXSET_FOREACH(s, hw->outputs, idx) {
         if (!(sink = pa_droid_stream_get_data(s)))
             continue;
@@ -1739,6 +1754,8 @@ static void update_sink_types(pa_droid_hw_module *hw, pa_sink *ignore_sink) {
 #endif
     }
 
+    pa_mutex_unlock(hw->output_mutex);
+
     if (primary_sink == low_latency_sink)
         low_latency_sink = NULL;
 
@@ -1875,7 +1892,11 @@ static pa_droid_hw_module *droid_hw_module_open(pa_core *core, pa_droid_config_a
         goto fail;
     }
 
+#ifdef DROID_STUB_HAL
+    ret = pa_droid_stub_hal_get_module(module->name, (const hw_module_t**) &hwmod);
+#else
     ret = hw_get_module_by_class(AUDIO_HARDWARE_MODULE_ID, module->name, (const hw_module_t**) &hwmod);
+#endif
     if (ret) {
         pa_log("Failed to load audio hw module %s.%s : %s (%d)", AUDIO_HARDWARE_MODULE_ID, module->name,
                                                                  strerror(-ret), -ret);
@@ -1928,6 +1949,13 @@ static pa_droid_hw_module *droid_hw_module_open(pa_core *core, pa_droid_config_a
     for (h = 0; h < PA_DROID_HOOK_MAX; h++)
         pa_hook_init(&hw->hooks[h], hw);
 
+    if (!routing_worker_start(hw)) {
+        /* Config stays owned by the caller on failure. */
+        hw->config = NULL;
+        droid_hw_module_close(hw);
+        return NULL;
+    }
+
     pa_assert_se(pa_shared_set(core, hw->shared_name, hw) >= 0);
 
     return hw;
@@ -1936,9 +1964,6 @@ fail:
     if (device)
         audio_hw_device_close(device);
 
-    if (hw)
-        pa_xfree(hw);
-
     return NULL;
 }
 
@@ -1974,6 +1999,8 @@ static void droid_hw_module_close(pa_droid_hw_module *hw) {
 
     pa_log_info("Closing hw module %s.%s (%s)", AUDIO_HARDWARE_MODULE_ID, hw->enabled_module->name, DROID_DEVICE_STRING);
 
+    routing_worker_stop(hw);
+
     if (hw->sink_put_hook_slot)
         pa_hook_slot_free(hw->sink_put_hook_slot);
     if (hw->sink_unlink_hook_slot)
@@ -1988,7 +2015,7 @@ static void droid_hw_module_close(pa_droid_hw_module *hw) {
         pa_hook_done(&hw->hooks[h]);
 
     if (hw->config)
-        droid_config_free(hw->config);
+        pa_droid_config_free(hw->config);
 
     if (hw->device && !pa_droid_quirk(hw, QUIRK_UNLOAD_NO_CLOSE))
         audio_hw_device_close(hw->device);
@@ -2032,7 +2059,7 @@ void pa_droid_hw_module_unref(pa_droid_hw_module *hw) {
     droid_hw_module_close(hw);
 }
 
-static void droid_config_free(pa_droid_config_audio *config) {
+void pa_droid_config_free(pa_droid_config_audio *config) {
     pa_droid_config_hw_module *module;
     pa_droid_config_output *output;
     pa_droid_config_input *input;
@@ -2063,39 +2090,60 @@ static void droid_config_free(pa_droid_config_audio *config) {
     pa_xfree(config);
 }
 
+/* Use the cached configuration if the file hasn't changed since it was
+ * last parsed. */
+static pa_droid_config_audio *config_load(const char *filename) {
+    pa_droid_config_audio *config;
+    pa_usec_t start;
+
+    start = pa_rtclock_now();
+
+    if ((config = pa_droid_config_cache_load(filename))) {
+        pa_log_info("Loaded configuration %s from cache in %" PRIu64 " usec.", filename, pa_rtclock_now() - start);
+        return config;
+    }
+
+    config = pa_xnew0(pa_droid_config_audio, 1);
+
+    if (!pa_parse_droid_audio_config(filename, config)) {
+        pa_droid_config_free(config);
+        return NULL;
+    }
+
+    pa_log_info("Parsed configuration %s in %" PRIu64 " usec.", filename, pa_rtclock_now() - start);
+
+    pa_droid_config_cache_save(filename, config);
+
+    return config;
+}
+
 pa_droid_config_audio *pa_droid_config_load(pa_modargs *ma) {
     pa_droid_config_audio *config;
     const char *config_location;
 
     pa_assert(ma);
 
-    config = pa_xnew0(pa_droid_config_audio, 1);
-
     if ((config_location = pa_modargs_get_value(ma, "config", NULL))) {
-        if (!pa_parse_droid_audio_config(config_location, config)) {
+        if (!(config = config_load(config_location))) {
             pa_log("Failed to parse configuration from %s", config_location);
-            goto fail;
+            return NULL;
         }
     } else {
         config_location = AUDIO_POLICY_VENDOR_CONFIG_FILE;
 
-        if (!pa_parse_droid_audio_config(config_location, config)) {
+        if (!(config = config_load(config_location))) {
             pa_log_debug("Failed to parse configuration from vendor %s", config_location);
 
             config_location = AUDIO_POLICY_CONFIG_FILE;
 
-            if (!pa_parse_droid_audio_config(config_location, config)) {
+            if (!(config = config_load(config_location))) {
                 pa_log("Failed to parse configuration from %s", config_location);
-                goto fail;
+                return NULL;
             }
         }
     }
 
     return config;
-
-fail:
-    droid_config_free(config);
-    return NULL;
 }
 
 void pa_droid_hw_module_lock(pa_droid_hw_module *hw) {
@@ -2212,30 +2260,20 @@ fail:
     return false;
 }
 
-pa_droid_stream *pa_droid_open_output_stream(pa_droid_hw_module *module,
-                                             const pa_sample_spec *spec,
-                                             const pa_channel_map *map,
-                                             audio_output_flags_t flags,
-                                             audio_devices_t devices) {
+static pa_droid_stream *output_stream_open(pa_droid_hw_module *module,
+                                           const pa_sample_spec *spec,
+                                           const pa_channel_map *map,
+                                           audio_output_flags_t flags,
+                                           audio_devices_t devices,
+                                           struct audio_config *config_out) {
     pa_droid_stream *s = NULL;
     pa_droid_output_stream *output = NULL;
     pa_droid_stream *primary_stream = NULL;
     int ret;
     struct audio_stream_out *stream;
-    pa_channel_map channel_map;
-    pa_sample_spec sample_spec;
-    struct audio_config config_out;
-
-    pa_assert(module);
-    pa_assert(spec);
-    pa_assert(map);
-
-    sample_spec = *spec;
-    channel_map = *map;
-
-    if (!stream_config_fill(devices, &sample_spec, &channel_map, &config_out))
-        goto fail;
 
+    /* Output devices are updated by the routing worker under output_mutex. */
+    pa_mutex_lock(module->output_mutex);
     if (pa_idxset_size(module->outputs) == 0)
         pa_log_debug("Set initial output device to %#010x", devices);
     else if ((primary_stream = get_primary_output(module))) {
@@ -2243,13 +2281,14 @@ pa_droid_stream *pa_droid_open_output_stream(pa_droid_hw_module *module,
                      primary_stream->output->device);
         devices = primary_stream->output->device;
     }
+    pa_mutex_unlock(module->output_mutex);
 
     pa_droid_hw_module_lock(module);
     ret = module->device->open_output_stream(module->device,
                                              module->stream_out_id++,
                                              devices,
                                              flags,
-                                             &config_out,
+                                             config_out,
                                              &stream
 #if AUDIO_API_VERSION_MAJ >= 3
                                              /* Go with empty address, should work
@@ -2269,13 +2308,16 @@ pa_droid_stream *pa_droid_open_output_stream(pa_droid_hw_module *module,
     output->stream = stream;
     output->sample_spec = *spec;
     output->channel_map = *map;
+    output->encoding = PA_ENCODING_PCM;
     output->flags = flags;
     output->device = devices;
 
     if ((output->sample_spec.rate = output->stream->common.get_sample_rate(&output->stream->common)) != spec->rate)
         pa_log_warn("Requested sample rate %u but got %u instead.", spec->rate, output->sample_spec.rate);
 
+    pa_mutex_lock(module->output_mutex);
     pa_idxset_put(module->outputs, s, NULL);
+    pa_mutex_unlock(module->output_mutex);
 
     s->buffer_size = output->stream->common.get_buffer_size(&output->stream->common);
 
@@ -2284,8 +2326,8 @@ pa_droid_stream *pa_droid_open_output_stream(pa_droid_hw_module *module,
             devices,
             output->flags,
             output->sample_spec.rate,
-            output->sample_spec.channels, config_out.channel_mask,
-            output->sample_spec.format, config_out.format,
+            output->sample_spec.channels, config_out->channel_mask,
+            output->sample_spec.format, config_out->format,
             s->buffer_size,
             pa_bytes_to_usec(s->buffer_size, &output->sample_spec));
 
@@ -2298,6 +2340,123 @@ fail:
     return NULL;
 }
 
+pa_droid_stream *pa_droid_open_output_stream(pa_droid_hw_module *module,
+                                             const pa_sample_spec *spec,
+                                             const pa_channel_map *map,
+                                             audio_output_flags_t flags,
+                                             audio_devices_t devices) {
+    pa_channel_map channel_map;
+    pa_sample_spec sample_spec;
+    struct audio_config config_out;
+
+    pa_assert(module);
+    pa_assert(spec);
+    pa_assert(map);
+
+    sample_spec = *spec;
+    channel_map = *map;
+
+    if (!stream_config_fill(devices, &sample_spec, &channel_map, &config_out))
+        return NULL;
+
+    return output_stream_open(module, spec, map, flags, devices, &config_out);
+}
+
+#ifdef DROID_HAVE_COMPRESS_OFFLOAD
+pa_droid_stream *pa_droid_open_offload_stream(pa_droid_hw_module *module,
+                                              pa_encoding_t encoding,
+                                              uint32_t rate,
+                                              audio_output_flags_t flags,
+                                              audio_devices_t devices) {
+    pa_droid_stream *s;
+    pa_sample_spec sample_spec;
+    pa_channel_map channel_map;
+    struct audio_config config_out;
+
+    pa_assert(module);
+    pa_assert(flags & AUDIO_OUTPUT_FLAG_COMPRESS_OFFLOAD);
+
+    memset(&config_out, 0, sizeof(config_out));
+
+    switch (encoding) {
+        case PA_ENCODING_MPEG_IEC61937:
+            config_out.format = AUDIO_FORMAT_MP3;
+            break;
+        case PA_ENCODING_MPEG2_AAC_IEC61937:
+            config_out.format = AUDIO_FORMAT_AAC;
+            break;
+        default:
+            pa_log_info("Encoding %s can't be offloaded.", pa_encoding_to_string(encoding));
+            return NULL;
+    }
+
+    config_out.sample_rate = rate;
+    config_out.channel_mask = AUDIO_CHANNEL_OUT_STEREO;
+
+    config_out.offload_info = AUDIO_INFO_INITIALIZER;
+    config_out.offload_info.sample_rate = config_out.sample_rate;
+    config_out.offload_info.channel_mask = config_out.channel_mask;
+    config_out.offload_info.format = config_out.format;
+    config_out.offload_info.stream_type = AUDIO_STREAM_MUSIC;
+    config_out.offload_info.duration_us = -1;
+    config_out.offload_info.is_streaming = true;
+
+    /* The sink side sees the encoded data as IEC61937 frames, which are
+     * two channels of 16 bit samples. */
+    sample_spec.format = PA_SAMPLE_S16LE;
+    sample_spec.rate = rate;
+    sample_spec.channels = 2;
+    pa_channel_map_init_stereo(&channel_map);
+
+    if (!(s = output_stream_open(module, &sample_spec, &channel_map, flags, devices, &config_out)))
+        return NULL;
+
+    s->output->encoding = encoding;
+
+    return s;
+}
+
+int pa_droid_stream_drain(pa_droid_stream *s) {
+    struct audio_stream_out *stream;
+
+    pa_assert(s);
+    pa_assert(s->output);
+
+    stream = s->output->stream;
+
+    if (!stream->drain)
+        return -1;
+
+    /* Without set_callback() the HAL blocks until everything is played. */
+    return stream->drain(stream, AUDIO_DRAIN_ALL);
+}
+
+int pa_droid_stream_pause(pa_droid_stream *s, bool pause) {
+    struct audio_stream_out *stream;
+
+    pa_assert(s);
+    pa_assert(s->output);
+
+    stream = s->output->stream;
+
+    if (pause)
+        return stream->pause ? stream->pause(stream) : -1;
+    else
+        return stream->resume ? stream->resume(stream) : -1;
+}
+
+int pa_droid_stream_flush(pa_droid_stream *s) {
+    struct audio_stream_out *stream;
+
+    pa_assert(s);
+    pa_assert(s->output);
+
+    stream = s->output->stream;
+
+    return stream->flush ? stream->flush(stream) : -1;
+}
+#endif
+
 static int input_stream_open(pa_droid_stream *s) {
     pa_droid_input_stream *input;
     audio_stream_in_t *stream;
@@ -2702,6 +2861,299 @@ int pa_droid_set_parameters(pa_droid_hw_module *hw, const char *parameters) {
     return ret;
 }
 
+/* Routing worker */
+
+typedef struct droid_routing_msg {
+    pa_msgobject parent;
+    pa_droid_hw_module *hw;
+} droid_routing_msg;
+
+PA_DEFINE_PRIVATE_CLASS(droid_routing_msg, pa_msgobject);
+
+enum {
+    ROUTING_MESSAGE_RUN,
+    ROUTING_MESSAGE_DONE,
+    ROUTING_MESSAGE_FLUSH,
+};
+
+typedef struct routing_op {
+    pa_droid_hw_module *hw;
+    pa_droid_stream *stream;
+    char *parameters;
+    audio_devices_t devices;
+    int ret;
+    pa_usec_t queued;
+    pa_usec_t started;
+    pa_usec_t finished;
+} routing_op;
+
+/* Operations taking longer than this are logged as slow. */
+#define SLOW_ROUTING_USEC   (20 * PA_USEC_PER_MSEC)
+
+static void routing_op_free_cb(pa_mainloop_api *m, void *userdata) {
+    routing_op *op = userdata;
+
+    if (op->stream)
+        pa_droid_stream_unref(op->stream);
+    else
+        pa_droid_hw_module_unref(op->hw);
+
+    pa_xfree(op->parameters);
+    pa_xfree(op);
+}
+
+/* Called from main thread. Dropping the last reference may close the hw
+ * module and with it the message queue that is being dispatched, so the
+ * references are released from a fresh main loop iteration. */
+static void routing_op_free(routing_op *op) {
+    pa_mainloop_api_once(op->hw->core->mainloop, routing_op_free_cb, op);
+}
+
+/* Called from routing worker */
+static void routing_op_run(routing_op *op) {
+    op->started = pa_rtclock_now();
+
+    if (!op->stream)
+        op->ret = pa_droid_set_parameters(op->hw, op->parameters);
+    else if (op->parameters)
+        op->ret = pa_droid_stream_set_parameters(op->stream, op->parameters);
+    else
+        op->ret = pa_droid_stream_set_route(op->stream, op->devices);
+
+    op->finished = pa_rtclock_now();
+}
+
+/* Called from main thread */
+static void routing_op_done(routing_op *op) {
+    pa_droid_routing_stats *stats = &op->hw->routing_stats;
+    pa_droid_routing_result result;
+
+    result.stream = op->stream;
+    result.parameters = op->parameters;
+    result.devices = op->devices;
+    result.ret = op->ret;
+    result.wait_usec = op->started - op->queued;
+    result.call_usec = op->finished - op->started;
+
+    stats->operations++;
+    if (op->ret < 0)
+        stats->failures++;
+    stats->wait_sum += result.wait_usec;
+    stats->wait_max = PA_MAX(stats->wait_max, result.wait_usec);
+    stats->call_sum += result.call_usec;
+    stats->call_max = PA_MAX(stats->call_max, result.call_usec);
+
+    if (result.call_usec < SLOW_ROUTING_USEC)
+        pa_log_debug("Routing operation took %" PRIu64 " usec (queued %" PRIu64 " usec).",
+                     result.call_usec, result.wait_usec);
+    else if (op->parameters)
+        pa_log_info("Slow set_parameters(%s) took %" PRIu64 " usec (queued %" PRIu64 " usec).",
+                    op->parameters, result.call_usec, result.wait_usec);
+    else
+        pa_log_info("Slow routing to %#010x took %" PRIu64 " usec (queued %" PRIu64 " usec).",
+                    op->devices, result.call_usec, result.wait_usec);
+
+    pa_hook_fire(&op->hw->hooks[PA_DROID_HOOK_ROUTING_DONE], &result);
+}
+
+static int routing_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
+    droid_routing_msg *msg = (droid_routing_msg *) o;
+
+    switch (code) {
+        case ROUTING_MESSAGE_RUN:
+            /* Called from routing worker */
+            routing_op_run(data);
+            pa_asyncmsgq_post(msg->hw->routing_mq.outq, PA_MSGOBJECT(msg), ROUTING_MESSAGE_DONE, data, 0, NULL,
+                              (pa_free_cb_t) routing_op_free);
+            break;
+
+        case ROUTING_MESSAGE_DONE:
+            /* Called from main thread */
+            routing_op_done(data);
+            break;
+
+        case ROUTING_MESSAGE_FLUSH:
+            /* Called from routing worker. Everything queued before this
+             * message has run already. */
+            break;
+    }
+
+    return 0;
+}
+
+static void routing_thread_func(void *userdata) {
+    pa_droid_hw_module *hw = userdata;
+    int ret;
+
+    pa_thread_mq_install(&hw->routing_mq);
+
+    for (;;) {
+        if ((ret = pa_rtpoll_run(hw->routing_rtpoll)) < 0) {
+            pa_log("Routing worker failed.");
+            pa_asyncmsgq_wait_for(hw->routing_mq.inq, PA_MESSAGE_SHUTDOWN);
+            break;
+        }
+
+        if (ret == 0)
+            break;
+    }
+}
+
+static bool routing_worker_start(pa_droid_hw_module *hw) {
+    char *name;
+
+    hw->routing_msg = PA_MSGOBJECT(pa_msgobject_new(droid_routing_msg));
+    hw->routing_msg->process_msg = routing_process_msg;
+    ((droid_routing_msg *) hw->routing_msg)->hw = hw;
+
+    hw->routing_rtpoll = pa_rtpoll_new();
+    if (pa_thread_mq_init(&hw->routing_mq, hw->core->mainloop, hw->routing_rtpoll) < 0) {
+        pa_log("Failed to init routing worker message queue.");
+        pa_rtpoll_free(hw->routing_rtpoll);
+        hw->routing_rtpoll = NULL;
+        return false;
+    }
+
+    name = pa_sprintf_malloc("droid-route-%s", hw->module_id);
+    hw->routing_thread = pa_thread_new(name, routing_thread_func, hw);
+    pa_xfree(name);
+
+    if (!hw->routing_thread) {
+        pa_log("Failed to create routing worker thread.");
+        return false;
+    }
+
+    return true;
+}
+
+static void routing_worker_stop(pa_droid_hw_module *hw) {
+    if (hw->routing_thread) {
+        pa_asyncmsgq_send(hw->routing_mq.inq, NULL, PA_MESSAGE_SHUTDOWN, NULL, 0, NULL);
+        pa_thread_free(hw->routing_thread);
+        hw->routing_thread = NULL;
+    }
+
+    if (hw->routing_rtpoll) {
+        pa_thread_mq_done(&hw->routing_mq);
+        pa_rtpoll_free(hw->routing_rtpoll);
+        hw->routing_rtpoll = NULL;
+    }
+
+    if (hw->routing_msg) {
+        pa_msgobject_unref(hw->routing_msg);
+        hw->routing_msg = NULL;
+    }
+}
+
+static void routing_op_queue(pa_droid_hw_module *hw, pa_droid_stream *s, const char *parameters,
+                             audio_devices_t devices) {
+    routing_op *op;
+
+    op = pa_xnew0(routing_op, 1);
+    op->hw = hw;
+    /* Keep the stream, or the hw module when there is no stream, alive
+     * until the main thread has seen the result. */
+    if (s)
+        op->stream = pa_droid_stream_ref(s);
+    else
+        pa_droid_hw_module_ref(hw);
+    op->parameters = pa_xstrdup(parameters);
+    op->devices = devices;
+    op->queued = pa_rtclock_now();
+
+    pa_asyncmsgq_post(hw->routing_mq.inq, hw->routing_msg, ROUTING_MESSAGE_RUN, op, 0, NULL, NULL);
+}
+
+void pa_droid_set_parameters_async(pa_droid_hw_module *hw, const char *parameters) {
+    pa_assert(hw);
+    pa_assert(parameters);
+
+    routing_op_queue(hw, NULL, parameters, 0);
+}
+
+void pa_droid_stream_set_parameters_async(pa_droid_stream *s, const char *parameters) {
+    pa_assert(s);
+    pa_assert(parameters);
+
+    routing_op_queue(s->module, s, parameters, 0);
+}
+
+void pa_droid_stream_set_route_async(pa_droid_stream *s, audio_devices_t device) {
+    pa_assert(s);
+
+    routing_op_queue(s->module, s, NULL, device);
+}
+
+void pa_droid_hw_module_routing_flush(pa_droid_hw_module *hw) {
+    pa_assert(hw);
+    pa_assert_ctl_context();
+
+    if (!hw->routing_thread)
+        return;
+
+    pa_asyncmsgq_send(hw->routing_mq.inq, hw->routing_msg, ROUTING_MESSAGE_FLUSH, NULL, 0, NULL);
+}
+
+void pa_droid_hw_module_get_routing_stats(pa_droid_hw_module *hw, pa_droid_routing_stats *stats) {
+    pa_assert(hw);
+    pa_assert(stats);
+    pa_assert_ctl_context();
+
+    *stats = hw->routing_stats;
+}
+
+void pa_droid_hw_wakeup_clock_join(pa_droid_hw_module *hw, pa_usec_t period) {
+    int current;
+
+    pa_assert(hw);
+    pa_assert(period > 0);
+    pa_assert(period <= INT_MAX);
+    pa_assert_ctl_context();
+
+    current = pa_atomic_load(&hw->wakeup_period);
+
+    if (current == 0 || (pa_usec_t) current > period)
+        pa_atomic_store(&hw->wakeup_period, (int) period);
+
+    hw->wakeup_clock_users++;
+
+    pa_log_debug("Joined wakeup clock of %s with period %llu usec, clock period %d usec, %u users.",
+                 hw->module_id, (unsigned long long) period, pa_atomic_load(&hw->wakeup_period), hw->wakeup_clock_users);
+}
+
+void pa_droid_hw_wakeup_clock_leave(pa_droid_hw_module *hw) {
+    pa_assert(hw);
+    pa_assert(hw->wakeup_clock_users > 0);
+    pa_assert_ctl_context();
+
+    /* The period isn't made longer again when a user with the shortest
+     * one leaves, the grid only needs to be common. */
+    if (--hw->wakeup_clock_users == 0)
+        pa_atomic_store(&hw->wakeup_period, 0);
+}
+
+pa_usec_t pa_droid_hw_wakeup_clock_align(pa_droid_hw_module *hw, pa_usec_t wakeup, pa_usec_t now, bool early) {
+    pa_usec_t period, grid;
+
+    pa_assert(hw);
+
+    if ((period = (pa_usec_t) pa_atomic_load(&hw->wakeup_period)) == 0)
+        return wakeup;
+
+    grid = wakeup - wakeup % period;
+
+    if (grid == wakeup)
+        return wakeup;
+
+    /* A grid point that is due right now still counts, otherwise an IO
+     * thread that woke up on the grid would move off it again and every
+     * other wakeup would be unaligned. */
+    if (early)
+        return grid >= now ? grid : wakeup;
+
+    return grid + period;
+}
+
 bool pa_droid_stream_is_primary(pa_droid_stream *s) {
     pa_assert(s);
     pa_assert(s->output || s->input);
@@ -2720,6 +3172,10 @@ int pa_droid_stream_suspend(pa_droid_stream *s, bool suspend) {
     pa_assert(s);
     pa_assert(s->output || s->input);
 
+    /* Don't count the time in standby as an interval between calls. */
+    if (suspend)
+        s->counters.last_start = 0;
+
     if (s->output) {
         if (suspend) {
             pa_atomic_dec(&s->module->active_outputs);
@@ -2758,6 +3214,185 @@ pa_usec_t pa_droid_stream_get_latency(pa_droid_stream *s) {
     return 0;
 }
 
+static unsigned histogram_bucket(pa_usec_t usec) {
+    unsigned b;
+
+    if (usec < PA_DROID_STREAM_HISTOGRAM_FIRST_USEC)
+        return 0;
+
+    b = pa_ulog2((unsigned) PA_MIN(usec, (pa_usec_t) UINT_MAX)) - pa_ulog2(PA_DROID_STREAM_HISTOGRAM_FIRST_USEC) + 1;
+
+    return PA_MIN(b, PA_DROID_STREAM_HISTOGRAM_BUCKETS - 1);
+}
+
+/* Only one thread at a time does IO on a stream, so there is no need for
+ * compare-and-swap. */
+static void histogram_add(pa_atomic_t *histogram, pa_atomic_t *max, pa_usec_t usec) {
+    pa_atomic_inc(&histogram[histogram_bucket(usec)]);
+
+    if (usec > (pa_usec_t) pa_atomic_load(max))
+        pa_atomic_store(max, (int) PA_MIN(usec, (pa_usec_t) INT_MAX));
+}
+
+static void stream_account(pa_droid_stream *s, const pa_sample_spec *ss, pa_usec_t start, size_t bytes, ssize_t ret) {
+    pa_droid_stream_counters *c = &s->counters;
+    pa_usec_t duration;
+
+    duration = pa_rtclock_now() - start;
+
+    pa_atomic_inc(&c->calls);
+    histogram_add(c->duration, &c->duration_max, duration);
+
+    if (c->last_start > 0)
+        histogram_add(c->interval, &c->interval_max, start - c->last_start);
+    c->last_start = start;
+
+    if (ret < 0)
+        pa_atomic_inc(&c->errors);
+    else if ((size_t) ret < bytes)
+        pa_atomic_inc(&c->short_calls);
+
+    /* Compressed data has no fixed duration. */
+    if (ss && duration > pa_bytes_to_usec(s->buffer_size, ss))
+        pa_atomic_inc(&c->slow_calls);
+}
+
+ssize_t pa_droid_stream_write(pa_droid_stream *s, const void *buffer, size_t bytes) {
+    pa_usec_t start;
+    ssize_t ret;
+
+    start = pa_rtclock_now();
+    ret = s->output->stream->write(s->output->stream, buffer, bytes);
+    stream_account(s, s->output->encoding == PA_ENCODING_PCM ? &s->output->sample_spec : NULL, start, bytes, ret);
+
+    return ret;
+}
+
+ssize_t pa_droid_stream_read(pa_droid_stream *s, void *buffer, size_t bytes) {
+    pa_usec_t start;
+    ssize_t ret;
+
+    start = pa_rtclock_now();
+    ret = s->input->stream->read(s->input->stream, buffer, bytes);
+    stream_account(s, &s->input->sample_spec, start, bytes, ret);
+
+    return ret;
+}
+
+void pa_droid_stream_get_stats(pa_droid_stream *s, pa_droid_stream_stats *stats) {
+    pa_droid_stream_counters *c;
+    unsigned i;
+
+    pa_assert(s);
+    pa_assert(stats);
+
+    c = &s->counters;
+
+    for (i = 0; i < PA_DROID_STREAM_HISTOGRAM_BUCKETS; i++) {
+        stats->duration[i] = (unsigned) pa_atomic_load(&c->duration[i]);
+        stats->interval[i] = (unsigned) pa_atomic_load(&c->interval[i]);
+    }
+
+    stats->duration_max = (pa_usec_t) pa_atomic_load(&c->duration_max);
+    stats->interval_max = (pa_usec_t) pa_atomic_load(&c->interval_max);
+    stats->calls = (unsigned) pa_atomic_load(&c->calls);
+    stats->short_calls = (unsigned) pa_atomic_load(&c->short_calls);
+    stats->errors = (unsigned) pa_atomic_load(&c->errors);
+    stats->slow_calls = (unsigned) pa_atomic_load(&c->slow_calls);
+    stats->silence_writes = 0;
+}
+
+static void histogram_to_proplist(const unsigned *histogram, pa_proplist *p, const char *prefix, const char *name) {
+    pa_strbuf *buf;
+    char *key, *value;
+    unsigned i;
+
+    buf = pa_strbuf_new();
+
+    for (i = 0; i < PA_DROID_STREAM_HISTOGRAM_BUCKETS; i++)
+        pa_strbuf_printf(buf, i > 0 ? " %u" : "%u", histogram[i]);
+
+    key = pa_sprintf_malloc("%s.%s", prefix, name);
+    value = pa_strbuf_to_string_free(buf);
+    pa_proplist_sets(p, key, value);
+    pa_xfree(value);
+    pa_xfree(key);
+}
+
+static void counter_to_proplist(uint64_t counter, pa_proplist *p, const char *prefix, const char *name) {
+    char *key;
+
+    key = pa_sprintf_malloc("%s.%s", prefix, name);
+    pa_proplist_setf(p, key, "%" PRIu64, counter);
+    pa_xfree(key);
+}
+
+void pa_droid_stream_stats_to_proplist(const pa_droid_stream_stats *stats, pa_proplist *p, const char *prefix) {
+    pa_assert(stats);
+    pa_assert(p);
+    pa_assert(prefix);
+
+    histogram_to_proplist(stats->duration, p, prefix, "duration");
+    histogram_to_proplist(stats->interval, p, prefix, "interval");
+    counter_to_proplist(stats->duration_max, p, prefix, "duration_max");
+    counter_to_proplist(stats->interval_max, p, prefix, "interval_max");
+    counter_to_proplist(stats->calls, p, prefix, "calls");
+    counter_to_proplist(stats->short_calls, p, prefix, "short_calls");
+    counter_to_proplist(stats->errors, p, prefix, "errors");
+    counter_to_proplist(stats->slow_calls, p, prefix, "slow_calls");
+    counter_to_proplist(stats->silence_writes, p, prefix, "silence_writes");
+}
+
+int pa_droid_stream_get_position(pa_droid_stream *s, uint64_t *frames, pa_usec_t *timestamp) {
+    struct audio_stream_out *stream;
+    uint32_t dsp_frames;
+
+    pa_assert(s);
+    pa_assert(frames);
+    pa_assert(timestamp);
+
+    if (!s->output || !(stream = s->output->stream))
+        return -1;
+
+#if ANDROID_VERSION_MAJOR > 4 || (ANDROID_VERSION_MAJOR == 4 && ANDROID_VERSION_MINOR >= 4)
+    if (stream->get_presentation_position) {
+        struct timespec ts;
+
+        if (stream->get_presentation_position(stream, frames, &ts) == 0) {
+            *timestamp = pa_timespec_load(&ts);
+            return 0;
+        }
+    }
+#endif
+
+    if (stream->get_render_position && stream->get_render_position(stream, &dsp_frames) == 0) {
+        *frames = dsp_frames;
+        *timestamp = pa_rtclock_now();
+        return 0;
+    }
+
+    return -1;
+}
+
+audio_devices_t pa_droid_stream_get_device(pa_droid_stream *s) {
+    audio_devices_t device;
+
+    pa_assert(s);
+    pa_assert(s->output || s->input);
+
+    if (s->output) {
+        pa_mutex_lock(s->module->output_mutex);
+        device = s->output->device;
+        pa_mutex_unlock(s->module->output_mutex);
+    } else {
+        pa_mutex_lock(s->module->input_mutex);
+        device = s->input->device;
+        pa_mutex_unlock(s->module->input_mutex);
+    }
+
+    return device;
+}
+
 void pa_droid_stream_set_data(pa_droid_stream *s, void *data) {
     pa_assert(s);
 
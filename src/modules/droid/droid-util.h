@@ -25,11 +25,18 @@
 #ifdef HAVE_CONFIG_H
 #include <config.h>
 #endif
+#include <pulse/format.h>
+#include <pulse/proplist.h>
+
 #include <pulsecore/core-util.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/mutex.h>
 #include <pulsecore/strlist.h>
 #include <pulsecore/atomic.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/thread-mq.h>
+#include <pulsecore/rtpoll.h>
+#include <pulsecore/msgobject.h>
 
 #include <android-config.h>
 
@@ -61,6 +68,13 @@
 #define DROID_AUDIO_HAL_USE_VSID
 #endif
 
+/* Compressed offload needs offload_info and the drain, pause and resume
+ * stream callbacks, which appeared in Android 4.4. */
+#if defined(HAVE_ENUM_AUDIO_OUTPUT_FLAG_COMPRESS_OFFLOAD) && \
+    (ANDROID_VERSION_MAJOR > 4 || (ANDROID_VERSION_MAJOR == 4 && ANDROID_VERSION_MINOR >= 4))
+#define DROID_HAVE_COMPRESS_OFFLOAD
+#endif
+
 #define PROP_DROID_DEVICES    "droid.devices"
 #define PROP_DROID_FLAGS      "droid.flags"
 #define PROP_DROID_HW_MODULE  "droid.hw_module"
@@ -90,10 +104,34 @@ typedef struct pa_droid_quirks pa_droid_quirks;
 typedef enum pa_droid_hook {
     PA_DROID_HOOK_INPUT_CHANNEL_MAP_CHANGED,    /* Call data: pa_droid_stream */
     PA_DROID_HOOK_INPUT_BUFFER_SIZE_CHANGED,    /* Call data: pa_droid_stream */
+    PA_DROID_HOOK_ROUTING_DONE,                 /* Call data: pa_droid_routing_result */
     PA_DROID_HOOK_MAX
 } pa_droid_hook_t;
 
 
+/* Result of an operation run by the routing worker, see
+ * pa_droid_stream_set_route_async(). */
+typedef struct pa_droid_routing_result {
+    /* NULL for hw module parameters. */
+    pa_droid_stream *stream;
+    /* Parameters for set_parameters operations, NULL for routing. */
+    const char *parameters;
+    audio_devices_t devices;
+    int ret;
+    /* Time spent in the queue and in the HAL call. */
+    pa_usec_t wait_usec;
+    pa_usec_t call_usec;
+} pa_droid_routing_result;
+
+typedef struct pa_droid_routing_stats {
+    uint64_t operations;
+    uint64_t failures;
+    pa_usec_t wait_sum;
+    pa_usec_t wait_max;
+    pa_usec_t call_sum;
+    pa_usec_t call_max;
+} pa_droid_routing_stats;
+
 struct pa_droid_hw_module {
     PA_REFCNT_DECLARE;
 
@@ -125,12 +163,28 @@ struct pa_droid_hw_module {
 
     pa_droid_quirks *quirks;
     pa_hook hooks[PA_DROID_HOOK_MAX];
+
+    /* Routing worker. Runs set_parameters() calls queued from any thread
+     * one at a time and reports back to the main thread. */
+    pa_thread *routing_thread;
+    pa_thread_mq routing_mq;
+    pa_rtpoll *routing_rtpoll;
+    pa_msgobject *routing_msg;
+    pa_droid_routing_stats routing_stats; /* Main thread */
+
+    /* Shared wakeup clock, see pa_droid_hw_wakeup_clock_align(). The
+     * period is read from IO threads, the user count only in main thread. */
+    pa_atomic_t wakeup_period;
+    unsigned wakeup_clock_users;
 };
 
 struct pa_droid_output_stream {
     struct audio_stream_out *stream;
     pa_sample_spec sample_spec;
     pa_channel_map channel_map;
+    /* For offload streams the encoding of the data written, with
+     * sample_spec describing its IEC61937 framing. */
+    pa_encoding_t encoding;
     uint32_t flags;
     uint32_t device;
 };
@@ -147,6 +201,46 @@ struct pa_droid_input_stream {
     bool merged;
 };
 
+/* Histogram buckets of HAL call times. The first bucket counts calls
+ * shorter than 256 usec, each following one calls up to twice as long
+ * as the previous and the last one everything longer. */
+#define PA_DROID_STREAM_HISTOGRAM_BUCKETS (12)
+#define PA_DROID_STREAM_HISTOGRAM_FIRST_USEC (256)
+
+/* Counters of the HAL write() or read() calls of a stream, updated
+ * without locking by the thread doing the IO. Droid sink in writer thread
+ * mode writes from its IO thread as well, but only after flushing the
+ * writer thread, so there still is a single writer at a time. */
+typedef struct pa_droid_stream_counters {
+    /* Time spent in the call. */
+    pa_atomic_t duration[PA_DROID_STREAM_HISTOGRAM_BUCKETS];
+    /* Time from the start of the previous call to the start of this one. */
+    pa_atomic_t interval[PA_DROID_STREAM_HISTOGRAM_BUCKETS];
+    pa_atomic_t duration_max;
+    pa_atomic_t interval_max;
+    pa_atomic_t calls;
+    pa_atomic_t short_calls;
+    pa_atomic_t errors;
+    pa_atomic_t slow_calls;
+    pa_usec_t last_start; /* 0 after standby */
+} pa_droid_stream_counters;
+
+/* Snapshot of pa_droid_stream_counters, see pa_droid_stream_get_stats(). */
+typedef struct pa_droid_stream_stats {
+    unsigned duration[PA_DROID_STREAM_HISTOGRAM_BUCKETS];
+    unsigned interval[PA_DROID_STREAM_HISTOGRAM_BUCKETS];
+    pa_usec_t duration_max;
+    pa_usec_t interval_max;
+    unsigned calls;
+    /* Calls that transferred less than asked for. */
+    unsigned short_calls;
+    unsigned errors;
+    /* Calls that blocked for longer than the stream buffer lasts. */
+    unsigned slow_calls;
+    /* Buffers of silence written instead of audio, filled in by droid sink. */
+    unsigned silence_writes;
+} pa_droid_stream_stats;
+
 struct pa_droid_stream {
     PA_REFCNT_DECLARE;
 
@@ -156,6 +250,8 @@ struct pa_droid_stream {
 
     pa_droid_output_stream *output;
     pa_droid_input_stream *input;
+
+    pa_droid_stream_counters counters;
 };
 
 struct pa_droid_card_data {
@@ -340,7 +436,9 @@ bool pa_input_device_default_audio_source(audio_devices_t input_device, audio_so
 
 /* Config parser */
 bool pa_parse_droid_audio_config(const char *filename, pa_droid_config_audio *config);
+/* Parsed configurations are cached, see droid-config-cache.h. */
 pa_droid_config_audio *pa_droid_config_load(pa_modargs *ma);
+void pa_droid_config_free(pa_droid_config_audio *config);
 
 const pa_droid_config_output *pa_droid_config_find_output(const pa_droid_config_hw_module *module, const char *name);
 const pa_droid_config_input *pa_droid_config_find_input(const pa_droid_config_hw_module *module, const char *name);
@@ -386,6 +484,40 @@ pa_hook *pa_droid_hooks(pa_droid_hw_module *hw);
 /* Module operations */
 int pa_droid_set_parameters(pa_droid_hw_module *hw, const char *parameters);
 
+/* Asynchronous routing and parameter changes. The operation is queued to
+ * the routing worker of the hw module and the caller returns right away,
+ * so IO threads can keep writing while slow HALs process the change.
+ * Operations run in the order they were queued. When an operation is done
+ * PA_DROID_HOOK_ROUTING_DONE is fired in the main thread. May be called
+ * from any thread. */
+void pa_droid_set_parameters_async(pa_droid_hw_module *hw, const char *parameters);
+void pa_droid_stream_set_parameters_async(pa_droid_stream *s, const char *parameters);
+void pa_droid_stream_set_route_async(pa_droid_stream *s, audio_devices_t device);
+
+/* Waits until the routing worker has run the operations queued so far.
+ * Synchronous HAL calls that must not overtake queued routing, like the
+ * voice call mode and call state, call this first. Called from main
+ * thread. */
+void pa_droid_hw_module_routing_flush(pa_droid_hw_module *hw);
+
+/* Statistics of the operations completed by the routing worker. Called
+ * from main thread. */
+void pa_droid_hw_module_get_routing_stats(pa_droid_hw_module *hw, pa_droid_routing_stats *stats);
+
+/* Shared wakeup clock. IO threads of sinks and sources that joined the
+ * clock of their hw module move their timers to a common grid of
+ * multiples of the shortest joined period, so that during a call the
+ * sink and the source are served in the same wakeup instead of waking
+ * up the CPU once each. Join and leave are called from main thread. */
+void pa_droid_hw_wakeup_clock_join(pa_droid_hw_module *hw, pa_usec_t period);
+void pa_droid_hw_wakeup_clock_leave(pa_droid_hw_module *hw);
+/* Called from IO context. Returns wakeup moved to the grid, to the
+ * previous grid point when early is true (for output, which must not be
+ * late) and to the next one otherwise (for input, which may read late).
+ * The wakeup is returned unchanged when nobody joined the clock or when
+ * the previous grid point is already in the past. */
+pa_usec_t pa_droid_hw_wakeup_clock_align(pa_droid_hw_module *hw, pa_usec_t wakeup, pa_usec_t now, bool early);
+
 /* Stream operations */
 pa_droid_stream *pa_droid_stream_ref(pa_droid_stream *s);
 void pa_droid_stream_unref(pa_droid_stream *s);
@@ -399,6 +531,24 @@ pa_droid_stream *pa_droid_open_output_stream(pa_droid_hw_module *module,
                                              audio_output_flags_t flags,
                                              audio_devices_t devices);
 
+#ifdef DROID_HAVE_COMPRESS_OFFLOAD
+/* Open a compressed offload output stream that takes encoded frames with
+ * the IEC61937 framing removed. Returns NULL if the encoding can't be
+ * offloaded or the HAL refuses the stream, for example because another
+ * offload stream is already open. */
+pa_droid_stream *pa_droid_open_offload_stream(pa_droid_hw_module *module,
+                                              pa_encoding_t encoding,
+                                              uint32_t rate,
+                                              audio_output_flags_t flags,
+                                              audio_devices_t devices);
+
+/* Blocks until everything written to the offload stream has been played. */
+int pa_droid_stream_drain(pa_droid_stream *s);
+int pa_droid_stream_pause(pa_droid_stream *s, bool pause);
+/* Drop everything written to a paused offload stream. */
+int pa_droid_stream_flush(pa_droid_stream *s);
+#endif
+
 /* Set routing to the input or output stream, with following side-effects:
  * Output:
  * - if routing is set to primary output stream, set routing to all other
@@ -423,18 +573,32 @@ int pa_droid_stream_suspend(pa_droid_stream *s, bool suspend);
 
 size_t pa_droid_stream_buffer_size(pa_droid_stream *s);
 pa_usec_t pa_droid_stream_get_latency(pa_droid_stream *s);
+/* Get the number of frames the HAL has played from an output stream and
+ * the monotonic time stamp of that position. Uses get_presentation_position()
+ * when the HAL implements it and get_render_position() otherwise. The
+ * counter may be reset by the HAL when entering standby. Returns 0 on
+ * success, negative if the HAL reports no position. */
+int pa_droid_stream_get_position(pa_droid_stream *s, uint64_t *frames, pa_usec_t *timestamp);
 
 static inline int pa_droid_output_stream_any_active(pa_droid_stream *s) {
     return pa_atomic_load(&s->module->active_outputs);
 }
 
-static inline ssize_t pa_droid_stream_write(pa_droid_stream *stream, const void *buffer, size_t bytes) {
-    return stream->output->stream->write(stream->output->stream, buffer, bytes);
-}
-
-static inline ssize_t pa_droid_stream_read(pa_droid_stream *stream, void *buffer, size_t bytes) {
-    return stream->input->stream->read(stream->input->stream, buffer, bytes);
-}
+/* Called from the thread doing the IO of the stream. The calls are
+ * accounted in the stream counters. */
+ssize_t pa_droid_stream_write(pa_droid_stream *stream, const void *buffer, size_t bytes);
+ssize_t pa_droid_stream_read(pa_droid_stream *stream, void *buffer, size_t bytes);
+
+/* Called from any thread. Counters are kept for the lifetime of the
+ * stream. silence_writes is left zero. */
+void pa_droid_stream_get_stats(pa_droid_stream *s, pa_droid_stream_stats *stats);
+/* Sets the stats as <prefix>.<name> properties, histograms as space
+ * separated bucket counts. */
+void pa_droid_stream_stats_to_proplist(const pa_droid_stream_stats *stats, pa_proplist *p, const char *prefix);
+
+/* Device the stream is currently routed to. Routing is done by the routing
+ * worker, so this takes the stream mutex. */
+audio_devices_t pa_droid_stream_get_device(pa_droid_stream *s);
 
 void pa_droid_stream_set_data(pa_droid_stream *s, void *data);
 void *pa_droid_stream_get_data(pa_droid_stream *s);
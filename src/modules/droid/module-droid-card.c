@@ -113,7 +113,10 @@ static const char* const valid_modargs[] = {
     "module_id",
     "voice_source_routing",
     "sink_buffer",
+    "sink_writer_thread",
+    "sink_writer_buffers",
     "source_buffer",
+    "wakeup_clock",
     "deferred_volume",
     "mute_routing_before",
     "mute_routing_after",
@@ -299,6 +302,7 @@ static int set_parameters_cb(pa_droid_card_data *card_data, const char *str) {
     pa_assert_se((u = card_data->userdata));
     pa_assert(str);
 
+    pa_droid_hw_module_routing_flush(u->hw_module);
     return pa_droid_set_parameters(u->hw_module, str);
 }
 
@@ -432,6 +436,10 @@ static int set_mode(struct userdata *u, audio_mode_t mode) {
 
     pa_log_debug("Set mode to %s.", mode_str);
 
+    /* The voice call path stays synchronous, but it must see the routing
+     * sinks have queued before it. */
+    pa_droid_hw_module_routing_flush(u->hw_module);
+
     pa_droid_hw_module_lock(u->hw_module);
     if ((ret = u->hw_module->device->set_mode(u->hw_module->device, mode)) < 0)
         pa_log("Failed to set mode.");
@@ -444,6 +452,7 @@ static void set_mic_switch(struct userdata *u, pa_droid_profile *p, bool mic_swi
     char *setparam;
 
     setparam = pa_sprintf_malloc("MicSwitch=%u",mic_switch);
+    pa_droid_hw_module_routing_flush(u->hw_module);
     pa_droid_set_parameters(u->hw_module, setparam);
 
     pa_xfree(setparam);
@@ -684,6 +693,7 @@ static bool voicecall_vsid(struct userdata *u, pa_droid_profile *p, uint32_t vsi
                                                 AUDIO_PARAMETER_KEY_CALL_STATE,
                                                 enabling ? CALL_ACTIVE : CALL_INACTIVE);
 
+    pa_droid_hw_module_routing_flush(u->hw_module);
     pa_droid_set_parameters(u->hw_module, setparam);
     pa_xfree(setparam);
 
@@ -65,9 +65,13 @@ static const char* const valid_modargs[] = {
     "mute_routing_after",
     "prewrite_on_resume",
     "sink_buffer",
+    "sink_writer_thread",
+    "sink_writer_buffers",
+    "wakeup_clock",
     "deferred_volume",
     "voice_property_key",
     "voice_property_value",
+    "config",
     NULL,
 };
 
@@ -61,7 +61,9 @@ static const char* const valid_modargs[] = {
     "source_name",
     "module_id",
     "source_buffer",
+    "wakeup_clock",
     "deferred_volume",
+    "config",
     NULL,
 };
 
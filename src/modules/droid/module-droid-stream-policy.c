@@ -0,0 +1,443 @@
+/*
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core.h>
+#include <pulsecore/module.h>
+#include <pulsecore/sink.h>
+#include <pulsecore/sink-input.h>
+#include <pulsecore/modargs.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/idxset.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "droid-util.h"
+#include "droid-sink.h"
+
+#include "module-droid-stream-policy-symdef.h"
+
+PA_MODULE_AUTHOR("PulseAudio");
+PA_MODULE_DESCRIPTION("Droid stream policy. Play streams that are not latency critical from the deep buffer output.");
+PA_MODULE_VERSION(PACKAGE_VERSION);
+PA_MODULE_LOAD_ONCE(true);
+PA_MODULE_USAGE(
+        "fast_roles=<space separated media.role values that need low latency> "
+        "deep_buffer_roles=<space separated media.role values that never need low latency> "
+        "fast_latency_msec=<streams requesting less latency than this use the low latency output> "
+        "merge_roles=<while a stream with one of these roles exists, all streams use the low latency output>"
+);
+
+static const char* const valid_modargs[] = {
+    "fast_roles",
+    "deep_buffer_roles",
+    "fast_latency_msec",
+    "merge_roles",
+    NULL,
+};
+
+#define DEFAULT_FAST_ROLES          "phone event game a11y animation"
+#define DEFAULT_DEEP_BUFFER_ROLES   "music video"
+#define DEFAULT_FAST_LATENCY_MSEC   (50)
+#define DEFAULT_MERGE_ROLES         "phone"
+
+/* Updated on droid sinks whenever they stop running, so that the power
+ * effect of the policy can be seen with pactl list sinks. */
+#define PROP_DROID_OUTPUT_WAKEUPS           "droid.output.wakeups"
+#define PROP_DROID_OUTPUT_WAKEUPS_PER_SEC   "droid.output.wakeups_per_sec"
+
+/* Values in userdata.streams, never zero so that the hashmap iterators
+ * don't stop at them. */
+enum {
+    STREAM_DEEP_BUFFER = 1,
+    STREAM_FAST,
+};
+
+struct sink_stats {
+    pa_usec_t running_since;
+    uint64_t wakeups;
+};
+
+struct userdata {
+    pa_core *core;
+    pa_module *module;
+
+    char *fast_roles;
+    char *deep_buffer_roles;
+    char *merge_roles;
+    pa_usec_t fast_latency;
+
+    /* Sink inputs the policy may move, and whether they need low latency. */
+    pa_hashmap *streams;
+    /* Per sink wakeup accounting, for droid sinks that are running. */
+    pa_hashmap *sink_stats;
+
+    /* Sink inputs that had one of merge_roles when they were put. Kept
+     * here because clients may change media.role later. */
+    pa_idxset *merging;
+    bool moving;
+
+    pa_hook_slot *sink_input_new_slot;
+    pa_hook_slot *sink_input_put_slot;
+    pa_hook_slot *sink_input_unlink_slot;
+    pa_hook_slot *sink_input_move_finish_slot;
+    pa_hook_slot *sink_put_slot;
+    pa_hook_slot *sink_state_changed_slot;
+};
+
+static pa_sink *find_sink(struct userdata *u, const char *type) {
+    pa_sink *s;
+    uint32_t idx;
+
+    PA_IDXSET_FOREACH(s, u->core->sinks, idx) {
+        if (!PA_SINK_IS_LINKED(pa_sink_get_state(s)) || !pa_sink_is_droid_sink(s))
+            continue;
+
+        if (pa_streq(pa_strnull(pa_proplist_gets(s->proplist, type)), "true"))
+            return s;
+    }
+
+    return NULL;
+}
+
+/* Returns false when there is no separate deep buffer output. */
+static bool find_sinks(struct userdata *u, pa_sink **fast, pa_sink **deep) {
+    *fast = find_sink(u, PROP_DROID_OUTPUT_LOW_LATENCY);
+    *deep = find_sink(u, PROP_DROID_OUTPUT_MEDIA_LATENCY);
+
+    return *fast && *deep && *fast != *deep;
+}
+
+static bool role_in(const char *list, const char *role) {
+    return role && pa_str_in_list_spaces(list, role);
+}
+
+static bool is_managed_sink(struct userdata *u, pa_sink *s) {
+    pa_sink *fast, *deep;
+
+    if (!find_sinks(u, &fast, &deep))
+        return false;
+
+    return s == fast || s == deep;
+}
+
+static pa_sink *target_sink(struct userdata *u, bool fast_stream) {
+    pa_sink *fast, *deep;
+
+    if (!find_sinks(u, &fast, &deep))
+        return NULL;
+
+    return fast_stream || !pa_idxset_isempty(u->merging) ? fast : deep;
+}
+
+static void move_stream(struct userdata *u, pa_sink_input *i, bool fast_stream) {
+    pa_sink *s;
+
+    if (!(s = target_sink(u, fast_stream)) || i->sink == s)
+        return;
+
+    if (!pa_sink_input_may_move_to(i, s))
+        return;
+
+    pa_log_debug("Moving %s stream %s from %s to %s.",
+                 fast_stream ? "low latency" : "deep buffer",
+                 pa_strnull(pa_proplist_gets(i->proplist, PA_PROP_MEDIA_NAME)),
+                 i->sink->name, s->name);
+
+    u->moving = true;
+    if (pa_sink_input_move_to(i, s, false) < 0)
+        pa_log_info("Failed to move stream %u to %s.", i->index, s->name);
+    u->moving = false;
+}
+
+static void apply_all(struct userdata *u) {
+    pa_sink_input *i;
+    void *type;
+    void *state;
+
+    PA_HASHMAP_FOREACH_KV(i, type, u->streams, state)
+        move_stream(u, i, PA_PTR_TO_UINT(type) == STREAM_FAST);
+}
+
+static pa_hook_result_t sink_input_new_cb(pa_core *c, pa_sink_input_new_data *new_data, struct userdata *u) {
+    const char *role;
+    pa_sink *s;
+
+    pa_assert(c);
+    pa_assert(new_data);
+    pa_assert(u);
+
+    if (new_data->sink || !new_data->proplist)
+        return PA_HOOK_OK;
+
+    /* Only streams with a known role are placed here, the rest is moved
+     * once the requested latency is known. */
+    role = pa_proplist_gets(new_data->proplist, PA_PROP_MEDIA_ROLE);
+
+    if (role_in(u->fast_roles, role) || role_in(u->merge_roles, role))
+        s = target_sink(u, true);
+    else if (role_in(u->deep_buffer_roles, role))
+        s = target_sink(u, false);
+    else
+        return PA_HOOK_OK;
+
+    if (s)
+        pa_sink_input_new_data_set_sink(new_data, s, false);
+
+    return PA_HOOK_OK;
+}
+
+static pa_hook_result_t sink_input_put_cb(pa_core *c, pa_sink_input *i, struct userdata *u) {
+    const char *role;
+    pa_usec_t latency;
+    bool fast_stream;
+
+    pa_assert(c);
+    pa_sink_input_assert_ref(i);
+    pa_assert(u);
+
+    role = pa_proplist_gets(i->proplist, PA_PROP_MEDIA_ROLE);
+
+    if (role_in(u->merge_roles, role)) {
+        pa_idxset_put(u->merging, i, NULL);
+
+        if (pa_idxset_size(u->merging) == 1) {
+            pa_log_info("Stream with role %s appeared, merging streams to the low latency output.", role);
+            apply_all(u);
+        }
+    }
+
+    /* Streams that were routed explicitly are left alone. */
+    if (i->save_sink || (i->flags & PA_SINK_INPUT_DONT_MOVE) || !is_managed_sink(u, i->sink))
+        return PA_HOOK_OK;
+
+    if (role_in(u->fast_roles, role) || role_in(u->merge_roles, role))
+        fast_stream = true;
+    else if (role_in(u->deep_buffer_roles, role))
+        fast_stream = false;
+    else {
+        /* For native clients the requested latency follows from the
+         * buffer attributes. */
+        latency = pa_sink_input_get_requested_latency(i);
+        fast_stream = latency > 0 && latency < u->fast_latency;
+    }
+
+    pa_hashmap_put(u->streams, i, PA_UINT_TO_PTR(fast_stream ? STREAM_FAST : STREAM_DEEP_BUFFER));
+    move_stream(u, i, fast_stream);
+
+    return PA_HOOK_OK;
+}
+
+static pa_hook_result_t sink_input_unlink_cb(pa_core *c, pa_sink_input *i, struct userdata *u) {
+    pa_assert(c);
+    pa_sink_input_assert_ref(i);
+    pa_assert(u);
+
+    pa_hashmap_remove(u->streams, i);
+
+    if (pa_idxset_remove_by_data(u->merging, i, NULL)) {
+        if (pa_idxset_isempty(u->merging)) {
+            pa_log_info("Moving deep buffer streams back to the deep buffer output.");
+            apply_all(u);
+        }
+    }
+
+    return PA_HOOK_OK;
+}
+
+static pa_hook_result_t sink_input_move_finish_cb(pa_core *c, pa_sink_input *i, struct userdata *u) {
+    pa_assert(c);
+    pa_sink_input_assert_ref(i);
+    pa_assert(u);
+
+    /* Moved by someone else, stop managing it. */
+    if (!u->moving && !is_managed_sink(u, i->sink))
+        pa_hashmap_remove(u->streams, i);
+
+    return PA_HOOK_OK;
+}
+
+static pa_hook_result_t sink_put_cb(pa_core *c, pa_sink *s, struct userdata *u) {
+    pa_assert(c);
+    pa_sink_assert_ref(s);
+    pa_assert(u);
+
+    /* A new droid output may be the deep buffer one. */
+    if (pa_sink_is_droid_sink(s))
+        apply_all(u);
+
+    return PA_HOOK_OK;
+}
+
+static void update_wakeups(struct userdata *u, pa_sink *s, struct sink_stats *st) {
+    pa_proplist *pl;
+    uint64_t total, wakeups;
+    pa_usec_t running;
+
+    total = pa_droid_sink_get_wakeups(s);
+    wakeups = total - st->wakeups;
+    running = pa_rtclock_now() - st->running_since;
+
+    pl = pa_proplist_new();
+    pa_proplist_setf(pl, PROP_DROID_OUTPUT_WAKEUPS, "%" PRIu64, total);
+    if (running > 0)
+        pa_proplist_setf(pl, PROP_DROID_OUTPUT_WAKEUPS_PER_SEC, "%0.1f",
+                         (double) wakeups * PA_USEC_PER_SEC / running);
+    pa_sink_update_proplist(s, PA_UPDATE_REPLACE, pl);
+    pa_proplist_free(pl);
+
+    pa_log_info("%s woke up %" PRIu64 " times in %0.1f s.", s->name, wakeups, (double) running / PA_USEC_PER_SEC);
+}
+
+static pa_hook_result_t sink_state_changed_cb(pa_core *c, pa_sink *s, struct userdata *u) {
+    struct sink_stats *st;
+
+    pa_assert(c);
+    pa_sink_assert_ref(s);
+    pa_assert(u);
+
+    if (!pa_sink_is_droid_sink(s))
+        return PA_HOOK_OK;
+
+    st = pa_hashmap_get(u->sink_stats, s);
+
+    if (pa_sink_get_state(s) == PA_SINK_RUNNING) {
+        if (!st) {
+            st = pa_xnew(struct sink_stats, 1);
+            st->running_since = pa_rtclock_now();
+            st->wakeups = pa_droid_sink_get_wakeups(s);
+            pa_hashmap_put(u->sink_stats, s, st);
+        }
+    } else if (st) {
+        if (PA_SINK_IS_LINKED(pa_sink_get_state(s)))
+            update_wakeups(u, s, st);
+
+        pa_hashmap_remove_and_free(u->sink_stats, s);
+    }
+
+    return PA_HOOK_OK;
+}
+
+int pa__init(pa_module *m) {
+    pa_modargs *ma = NULL;
+    struct userdata *u;
+    pa_sink_input *i;
+    uint32_t idx;
+    uint32_t fast_latency_msec = DEFAULT_FAST_LATENCY_MSEC;
+
+    pa_assert(m);
+
+    if (!(ma = pa_modargs_new(m->argument, valid_modargs))) {
+        pa_log("Failed to parse module arguments.");
+        goto fail;
+    }
+
+    if (pa_modargs_get_value_u32(ma, "fast_latency_msec", &fast_latency_msec) < 0) {
+        pa_log("Failed to parse fast_latency_msec.");
+        goto fail;
+    }
+
+    u = pa_xnew0(struct userdata, 1);
+    u->core = m->core;
+    u->module = m;
+    m->userdata = u;
+
+    u->fast_roles = pa_xstrdup(pa_modargs_get_value(ma, "fast_roles", DEFAULT_FAST_ROLES));
+    u->deep_buffer_roles = pa_xstrdup(pa_modargs_get_value(ma, "deep_buffer_roles", DEFAULT_DEEP_BUFFER_ROLES));
+    u->merge_roles = pa_xstrdup(pa_modargs_get_value(ma, "merge_roles", DEFAULT_MERGE_ROLES));
+    u->fast_latency = fast_latency_msec * PA_USEC_PER_MSEC;
+
+    u->streams = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
+    u->sink_stats = pa_hashmap_new_full(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func, NULL, pa_xfree);
+
+    u->merging = pa_idxset_new(NULL, NULL);
+
+    PA_IDXSET_FOREACH(i, m->core->sink_inputs, idx) {
+        if (role_in(u->merge_roles, pa_proplist_gets(i->proplist, PA_PROP_MEDIA_ROLE)))
+            pa_idxset_put(u->merging, i, NULL);
+    }
+
+    /* Before module-intended-roles, after module-stream-restore. */
+    u->sink_input_new_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_INPUT_NEW], PA_HOOK_EARLY+5,
+                                             (pa_hook_cb_t) sink_input_new_cb, u);
+    u->sink_input_put_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_INPUT_PUT], PA_HOOK_LATE,
+                                             (pa_hook_cb_t) sink_input_put_cb, u);
+    u->sink_input_unlink_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_INPUT_UNLINK], PA_HOOK_LATE,
+                                                (pa_hook_cb_t) sink_input_unlink_cb, u);
+    u->sink_input_move_finish_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_INPUT_MOVE_FINISH], PA_HOOK_LATE,
+                                                     (pa_hook_cb_t) sink_input_move_finish_cb, u);
+    /* After droid-util has tagged the output types. */
+    u->sink_put_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_PUT], PA_HOOK_LATE+10,
+                                       (pa_hook_cb_t) sink_put_cb, u);
+    u->sink_state_changed_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_STATE_CHANGED], PA_HOOK_NORMAL,
+                                                 (pa_hook_cb_t) sink_state_changed_cb, u);
+
+    pa_modargs_free(ma);
+
+    return 0;
+
+fail:
+    if (ma)
+        pa_modargs_free(ma);
+
+    pa__done(m);
+
+    return -1;
+}
+
+void pa__done(pa_module *m) {
+    struct userdata *u;
+
+    pa_assert(m);
+
+    if ((u = m->userdata)) {
+
+        if (u->sink_input_new_slot)
+            pa_hook_slot_free(u->sink_input_new_slot);
+        if (u->sink_input_put_slot)
+            pa_hook_slot_free(u->sink_input_put_slot);
+        if (u->sink_input_unlink_slot)
+            pa_hook_slot_free(u->sink_input_unlink_slot);
+        if (u->sink_input_move_finish_slot)
+            pa_hook_slot_free(u->sink_input_move_finish_slot);
+        if (u->sink_put_slot)
+            pa_hook_slot_free(u->sink_put_slot);
+        if (u->sink_state_changed_slot)
+            pa_hook_slot_free(u->sink_state_changed_slot);
+
+        if (u->streams)
+            pa_hashmap_free(u->streams);
+        if (u->sink_stats)
+            pa_hashmap_free(u->sink_stats);
+        if (u->merging)
+            pa_idxset_free(u->merging, NULL);
+
+        pa_xfree(u->fast_roles);
+        pa_xfree(u->deep_buffer_roles);
+        pa_xfree(u->merge_roles);
+
+        pa_xfree(u);
+    }
+}
@@ -39,6 +39,10 @@
 
 #include <pulsecore/i18n.h>
 #include <pulsecore/atomic.h>
+#include <pulsecore/asyncq.h>
+#include <pulsecore/flist.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/seqlock.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/namereg.h>
 #include <pulsecore/sink.h>
@@ -76,6 +80,8 @@ PA_MODULE_USAGE(
           "autoloaded=<set if this module is being loaded automatically> "
           "use_volume_sharing=<yes or no> "
           "use_master_format=<yes or no> "
+          "use_worker_thread=<yes or no> "
+          "low_latency=<yes or no> "
         ));
 
 /* NOTE: Make sure the enum and ec_table are maintained in the correct order */
@@ -142,9 +148,20 @@ static const pa_echo_canceller ec_table[] = {
 #define DEFAULT_SAVE_AEC false
 #define DEFAULT_AUTOLOADED false
 #define DEFAULT_USE_MASTER_FORMAT false
+#define DEFAULT_USE_WORKER_THREAD false
+#define DEFAULT_LOW_LATENCY false
 
 #define MEMBLOCKQ_MAXLENGTH (16*1024*1024)
 
+/* Blocks handed to the worker thread that haven't been posted yet. When
+ * the worker falls this far behind, the source I/O thread waits for it. */
+#define WORKER_MAX_PENDING 4
+#define WORKER_QUEUE_LENGTH 8
+
+/* With low_latency the masters are asked for this many pushes or pops per
+ * canceller block. */
+#define LOW_LATENCY_SUBBLOCKS 4
+
 /* Can only be used in main context */
 #define IS_ACTIVE(u) ((pa_source_get_state((u)->source) == PA_SOURCE_RUNNING) && \
                       (pa_sink_get_state((u)->sink) == PA_SINK_RUNNING))
@@ -176,6 +193,37 @@ static const pa_echo_canceller ec_table[] = {
  *    be before capture and the difference should not be bigger than one frame
  *    size. We would ideally like to resample the sink_input but most driver
  *    don't give enough accuracy to be able to do that right now.
+ *
+ * With use_worker_thread the canceller runs on a thread of its own instead of
+ * the source I/O thread, so that a slow canceller doesn't hold up the other
+ * source outputs of the master source. The source I/O thread hands each pair
+ * of record and playback blocks to the worker and posts the canceled block
+ * when it next gets data from the master source, which adds one block of
+ * latency. This is only done when the canceller doesn't do its own drift
+ * compensation.
+ *
+ * With low_latency the latency added on top of the masters is cut down to
+ * what the canceller block size needs:
+ *
+ *  - Masters with dynamic latency are asked for a fraction of a canceller
+ *    block, whatever our own source outputs and sink inputs ask for. Capture
+ *    then reaches the source memblockq in sub-block pieces and a block is
+ *    canceled and posted within a sub-block of its last sample being
+ *    captured, rather than within a fragment of the master source, which may
+ *    be much longer than the block. The playback reference is forwarded in
+ *    sub-block pieces the same way.
+ *
+ *  - A master with fixed latency pushes whole fragments, which can't be
+ *    made any earlier. The worker thread then wakes up the source I/O thread
+ *    as soon as it finishes a block, so the block is posted right away
+ *    instead of with the next fragment of the master source.
+ *
+ *  - The source latency counts the capture samples actually waiting for a
+ *    full block and the blocks actually with the worker, rather than a
+ *    block each.
+ *
+ * The canceller keeps its block size. This costs more wakeups of the I/O
+ * threads.
  */
 
 struct userdata;
@@ -188,20 +236,49 @@ struct pa_echo_canceller_msg {
 PA_DEFINE_PRIVATE_CLASS(pa_echo_canceller_msg, pa_msgobject);
 #define PA_ECHO_CANCELLER_MSG(o) (pa_echo_canceller_msg_cast(o))
 
-struct snapshot {
-    pa_usec_t sink_now;
-    pa_usec_t sink_latency;
-    size_t sink_delay;
+/* A record and playback block pair on its way through the worker thread. */
+struct worker_job {
+    pa_memchunk rchunk;
+    pa_memchunk pchunk;
+    pa_memchunk cchunk;
+    /* The canceller may read and change the capture volume while running. */
+    pa_volume_t capture_volume;
+    pa_volume_t new_capture_volume;
+    pa_usec_t process_usec;
+};
+
+PA_STATIC_FLIST_DECLARE(echo_cancel_jobs, 0, pa_xfree);
+
+static struct worker_job worker_quit;
+
+/* The timing of each side is published by its I/O thread after every cycle
+ * and read from there by calc_diff() without any messaging. A zero now means
+ * nothing was published yet. A snapshot taken before the last suspend or
+ * resume has an older generation and counts as not published either, its
+ * counters and latencies don't match what the I/O threads do now. */
+struct sink_snapshot {
+    int generation;
+    pa_usec_t now;
+    pa_usec_t latency;
+    size_t delay;
     int64_t send_counter;
+};
 
-    pa_usec_t source_now;
-    pa_usec_t source_latency;
-    size_t source_delay;
+struct source_snapshot {
+    int generation;
+    pa_usec_t now;
+    pa_usec_t latency;
+    size_t delay;
     int64_t recv_counter;
     size_t rlen;
     size_t plen;
 };
 
+struct snapshot {
+    struct sink_snapshot sink;
+    struct source_snapshot source;
+};
+
 struct userdata {
     pa_core *core;
     pa_module *module;
@@ -214,6 +291,10 @@ struct userdata {
     uint32_t source_blocksize;
     uint32_t sink_blocksize;
 
+    /* The latency requested from the masters with low_latency, 0
+     * otherwise */
+    pa_usec_t low_latency_usec;
+
     bool need_realign;
 
     /* to wakeup the source I/O thread */
@@ -240,6 +321,14 @@ struct userdata {
 
     pa_atomic_t request_resync;
 
+    /* Bumped from main context whenever the published snapshots become
+     * stale */
+    pa_atomic_t snapshot_generation;
+    pa_seqlock sink_snapshot_lock;
+    struct sink_snapshot sink_snapshot;
+    pa_seqlock source_snapshot_lock;
+    struct source_snapshot source_snapshot;
+
     pa_time_event *time_event;
     pa_usec_t adjust_time;
     int adjust_threshold;
@@ -251,12 +340,26 @@ struct userdata {
 
     bool use_volume_sharing;
 
+    pa_thread *worker_thread;
+    pa_asyncq *worker_in;
+    pa_asyncq *worker_out;
+    struct worker_job *worker_job; /* Only accessed in the worker thread */
+
     struct {
         pa_cvolume current_volume;
+
+        unsigned worker_pending;
+        uint64_t worker_jobs;
+        uint64_t worker_stalls;
+        uint64_t worker_depth_sum;
+        unsigned worker_depth_max;
+        pa_usec_t worker_process_sum;
+        pa_usec_t worker_process_max;
     } thread_info;
 };
 
-static void source_output_snapshot_within_thread(struct userdata *u, struct snapshot *snapshot);
+static void source_output_snapshot_within_thread(struct userdata *u, struct source_snapshot *snapshot);
+static void source_output_publish_snapshot(struct userdata *u);
 
 static const char* const valid_modargs[] = {
     "source_name",
@@ -277,18 +380,16 @@ static const char* const valid_modargs[] = {
     "autoloaded",
     "use_volume_sharing",
     "use_master_format",
+    "use_worker_thread",
+    "low_latency",
     NULL
 };
 
 enum {
     SOURCE_OUTPUT_MESSAGE_POST = PA_SOURCE_OUTPUT_MESSAGE_MAX,
     SOURCE_OUTPUT_MESSAGE_REWIND,
-    SOURCE_OUTPUT_MESSAGE_LATENCY_SNAPSHOT,
-    SOURCE_OUTPUT_MESSAGE_APPLY_DIFF_TIME
-};
-
-enum {
-    SINK_INPUT_MESSAGE_LATENCY_SNAPSHOT
+    SOURCE_OUTPUT_MESSAGE_APPLY_DIFF_TIME,
+    SOURCE_OUTPUT_MESSAGE_WORKER_DONE
 };
 
 enum {
@@ -300,39 +401,51 @@ static int64_t calc_diff(struct userdata *u, struct snapshot *snapshot) {
     pa_usec_t plen, rlen, source_delay, sink_delay, recv_counter, send_counter;
 
     /* get latency difference between playback and record */
-    plen = pa_bytes_to_usec(snapshot->plen, &u->sink_input->sample_spec);
-    rlen = pa_bytes_to_usec(snapshot->rlen, &u->source_output->sample_spec);
+    plen = pa_bytes_to_usec(snapshot->source.plen, &u->sink_input->sample_spec);
+    rlen = pa_bytes_to_usec(snapshot->source.rlen, &u->source_output->sample_spec);
     if (plen > rlen)
         buffer_latency = plen - rlen;
     else
         buffer_latency = 0;
 
-    source_delay = pa_bytes_to_usec(snapshot->source_delay, &u->source_output->sample_spec);
-    sink_delay = pa_bytes_to_usec(snapshot->sink_delay, &u->sink_input->sample_spec);
+    source_delay = pa_bytes_to_usec(snapshot->source.delay, &u->source_output->sample_spec);
+    sink_delay = pa_bytes_to_usec(snapshot->sink.delay, &u->sink_input->sample_spec);
     buffer_latency += source_delay + sink_delay;
 
     /* add the latency difference due to samples not yet transferred */
-    send_counter = pa_bytes_to_usec(snapshot->send_counter, &u->sink->sample_spec);
-    recv_counter = pa_bytes_to_usec(snapshot->recv_counter, &u->sink->sample_spec);
+    send_counter = pa_bytes_to_usec(snapshot->sink.send_counter, &u->sink->sample_spec);
+    recv_counter = pa_bytes_to_usec(snapshot->source.recv_counter, &u->sink->sample_spec);
     if (recv_counter <= send_counter)
         buffer_latency += (int64_t) (send_counter - recv_counter);
     else
         buffer_latency = PA_CLIP_SUB(buffer_latency, (int64_t) (recv_counter - send_counter));
 
     /* capture and playback are perfectly aligned when diff_time is 0 */
-    diff_time = (snapshot->sink_now + snapshot->sink_latency - buffer_latency) -
-          (snapshot->source_now - snapshot->source_latency);
+    diff_time = (snapshot->sink.now + snapshot->sink.latency - buffer_latency) -
+          (snapshot->source.now - snapshot->source.latency);
 
     pa_log_debug("Diff %lld (%lld - %lld + %lld) %lld %lld %lld %lld", (long long) diff_time,
-        (long long) snapshot->sink_latency,
-        (long long) buffer_latency, (long long) snapshot->source_latency,
+        (long long) snapshot->sink.latency,
+        (long long) buffer_latency, (long long) snapshot->source.latency,
         (long long) source_delay, (long long) sink_delay,
         (long long) (send_counter - recv_counter),
-        (long long) (snapshot->sink_now - snapshot->source_now));
+        (long long) (snapshot->sink.now - snapshot->source.now));
 
     return diff_time;
 }
 
+/* Called from main context, when sink or source get suspended or resumed.
+ * The I/O threads publish new snapshots once they run again. */
+static void invalidate_snapshots(struct userdata *u) {
+    pa_atomic_inc(&u->snapshot_generation);
+}
+
+/* Returns true if the I/O thread published s since the snapshots were last
+ * invalidated. */
+static bool snapshot_is_current(struct userdata *u, pa_usec_t now, int generation) {
+    return now != 0 && generation == pa_atomic_load(&u->snapshot_generation);
+}
+
 /* Called from main context */
 static void time_callback(pa_mainloop_api *a, pa_time_event *e, const struct timeval *t, void *userdata) {
     struct userdata *u = userdata;
@@ -349,9 +462,15 @@ static void time_callback(pa_mainloop_api *a, pa_time_event *e, const struct tim
     if (!IS_ACTIVE(u))
         return;
 
-    /* update our snapshots */
-    pa_asyncmsgq_send(u->source_output->source->asyncmsgq, PA_MSGOBJECT(u->source_output), SOURCE_OUTPUT_MESSAGE_LATENCY_SNAPSHOT, &latency_snapshot, 0, NULL);
-    pa_asyncmsgq_send(u->sink_input->sink->asyncmsgq, PA_MSGOBJECT(u->sink_input), SINK_INPUT_MESSAGE_LATENCY_SNAPSHOT, &latency_snapshot, 0, NULL);
+    /* get the latest snapshots of both I/O threads */
+    pa_seqlock_read(&u->source_snapshot_lock, &u->source_snapshot, &latency_snapshot.source, sizeof(latency_snapshot.source));
+    pa_seqlock_read(&u->sink_snapshot_lock, &u->sink_snapshot, &latency_snapshot.sink, sizeof(latency_snapshot.sink));
+
+    if (!snapshot_is_current(u, latency_snapshot.source.now, latency_snapshot.source.generation) ||
+        !snapshot_is_current(u, latency_snapshot.sink.now, latency_snapshot.sink.generation)) {
+        pa_core_rttime_restart(u->core, u->time_event, pa_rtclock_now() + u->adjust_time);
+        return;
+    }
 
     /* calculate drift between capture and playback */
     diff_time = calc_diff(u, &latency_snapshot);
@@ -419,7 +538,12 @@ static int source_process_msg_cb(pa_msgobject *o, int code, void *data, int64_t
                 /* Add the latency internal to our source output on top */
                 pa_bytes_to_usec(pa_memblockq_get_length(u->source_output->thread_info.delay_memblockq), &u->source_output->source->sample_spec) +
                 /* and the buffering we do on the source */
-                pa_bytes_to_usec(u->source_output_blocksize, &u->source_output->source->sample_spec);
+                pa_bytes_to_usec(u->low_latency_usec > 0 ? pa_memblockq_get_length(u->source_memblockq) : u->source_output_blocksize,
+                                 &u->source_output->source->sample_spec) +
+                /* and the blocks still with the worker thread, which are
+                 * only posted with the next push without low_latency */
+                pa_bytes_to_usec((u->worker_thread ? (u->low_latency_usec > 0 ? u->thread_info.worker_pending : PA_MAX(u->thread_info.worker_pending, 1U)) : 0) *
+                                 u->source_output_blocksize, &u->source_output->source->sample_spec);
 
             return 0;
 
@@ -473,6 +597,9 @@ static int source_set_state_cb(pa_source *s, pa_source_state_t state) {
         !PA_SOURCE_OUTPUT_IS_LINKED(pa_source_output_get_state(u->source_output)))
         return 0;
 
+    if (state == PA_SOURCE_RUNNING || state == PA_SOURCE_SUSPENDED)
+        invalidate_snapshots(u);
+
     if (state == PA_SOURCE_RUNNING) {
         /* restart timer when both sink and source are active */
         if ((pa_sink_get_state(u->sink) == PA_SINK_RUNNING) && u->adjust_time)
@@ -498,6 +625,9 @@ static int sink_set_state_cb(pa_sink *s, pa_sink_state_t state) {
         !PA_SINK_INPUT_IS_LINKED(pa_sink_input_get_state(u->sink_input)))
         return 0;
 
+    if (state == PA_SINK_RUNNING || state == PA_SINK_SUSPENDED)
+        invalidate_snapshots(u);
+
     if (state == PA_SINK_RUNNING) {
         /* restart timer when both sink and source are active */
         if ((pa_source_get_state(u->source) == PA_SOURCE_RUNNING) && u->adjust_time)
@@ -512,6 +642,15 @@ static int sink_set_state_cb(pa_sink *s, pa_sink_state_t state) {
     return 0;
 }
 
+/* Returns the latency to request from a master when our source or sink is
+ * asked for latency, which is (pa_usec_t) -1 if nobody cares. */
+static pa_usec_t master_requested_latency(struct userdata *u, pa_usec_t latency) {
+    if (u->low_latency_usec > 0 && (latency == (pa_usec_t) -1 || latency > u->low_latency_usec))
+        return u->low_latency_usec;
+
+    return latency;
+}
+
 /* Called from source I/O thread context */
 static void source_update_requested_latency_cb(pa_source *s) {
     struct userdata *u;
@@ -528,7 +667,7 @@ static void source_update_requested_latency_cb(pa_source *s) {
     /* Just hand this one over to the master source */
     pa_source_output_set_requested_latency_within_thread(
             u->source_output,
-            pa_source_get_requested_latency_within_thread(s));
+            master_requested_latency(u, pa_source_get_requested_latency_within_thread(s)));
 }
 
 /* Called from sink I/O thread context */
@@ -547,7 +686,7 @@ static void sink_update_requested_latency_cb(pa_sink *s) {
     /* Just hand this one over to the master sink */
     pa_sink_input_set_requested_latency_within_thread(
             u->sink_input,
-            pa_sink_get_requested_latency_within_thread(s));
+            master_requested_latency(u, pa_sink_get_requested_latency_within_thread(s)));
 }
 
 /* Called from sink I/O thread context */
@@ -680,11 +819,17 @@ static void do_resync(struct userdata *u) {
     int64_t diff_time;
     struct snapshot latency_snapshot;
 
-    pa_log("Doing resync");
+    /* take our own snapshot, and the latest one of the sink I/O thread */
+    source_output_snapshot_within_thread(u, &latency_snapshot.source);
+    pa_seqlock_read(&u->sink_snapshot_lock, &u->sink_snapshot, &latency_snapshot.sink, sizeof(latency_snapshot.sink));
+
+    if (!snapshot_is_current(u, latency_snapshot.sink.now, latency_snapshot.sink.generation)) {
+        /* Nothing played since the last resume yet, try again next time */
+        pa_atomic_store(&u->request_resync, 1);
+        return;
+    }
 
-    /* update our snapshot */
-    source_output_snapshot_within_thread(u, &latency_snapshot);
-    pa_asyncmsgq_send(u->sink_input->sink->asyncmsgq, PA_MSGOBJECT(u->sink_input), SINK_INPUT_MESSAGE_LATENCY_SNAPSHOT, &latency_snapshot, 0, NULL);
+    pa_log("Doing resync");
 
     /* calculate drift between capture and playback */
     diff_time = calc_diff(u, &latency_snapshot);
@@ -864,6 +1009,230 @@ static void do_push(struct userdata *u) {
     }
 }
 
+/* Called from the worker thread. */
+static void worker_thread_func(void *userdata) {
+    struct userdata *u = userdata;
+    struct worker_job *job;
+    uint8_t *rdata, *pdata, *cdata;
+    pa_usec_t start;
+
+    pa_assert(u);
+
+    pa_log_debug("Worker thread starting up.");
+
+    if (u->core->realtime_scheduling)
+        pa_make_realtime(u->core->realtime_priority);
+
+    while ((job = pa_asyncq_pop(u->worker_in, true)) != &worker_quit) {
+        pa_assert(job);
+
+        start = pa_rtclock_now();
+
+        rdata = pa_memblock_acquire_chunk(&job->rchunk);
+        pdata = pa_memblock_acquire_chunk(&job->pchunk);
+        cdata = pa_memblock_acquire(job->cchunk.memblock);
+
+        /* perform echo cancellation */
+        u->worker_job = job;
+        u->ec->run(u->ec, rdata, pdata, cdata);
+        u->worker_job = NULL;
+
+        pa_memblock_release(job->cchunk.memblock);
+        pa_memblock_release(job->pchunk.memblock);
+        pa_memblock_release(job->rchunk.memblock);
+
+        job->process_usec = pa_rtclock_now() - start;
+
+        /* Never blocks, there are at most WORKER_MAX_PENDING jobs around. */
+        pa_assert_se(pa_asyncq_push(u->worker_out, job, true) == 0);
+
+        /* Have the source I/O thread post the block now rather than with the
+         * next push of the master source. */
+        if (u->low_latency_usec > 0)
+            pa_asyncmsgq_post(u->asyncmsgq, PA_MSGOBJECT(u->source_output), SOURCE_OUTPUT_MESSAGE_WORKER_DONE,
+                              NULL, 0, NULL, NULL);
+    }
+
+    pa_log_debug("Worker thread shutting down.");
+}
+
+/* Called from source I/O thread context, or from main context once the
+ * source output is gone. */
+static void worker_finish_job(struct userdata *u, struct worker_job *job, bool post) {
+    int unused PA_GCC_UNUSED;
+
+    u->thread_info.worker_pending--;
+    u->thread_info.worker_jobs++;
+    u->thread_info.worker_process_sum += job->process_usec;
+    u->thread_info.worker_process_max = PA_MAX(u->thread_info.worker_process_max, job->process_usec);
+
+    if (post) {
+        if (job->new_capture_volume != PA_VOLUME_INVALID)
+            pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(u->ec->msg), ECHO_CANCELLER_MESSAGE_SET_VOLUME,
+                              PA_UINT_TO_PTR(job->new_capture_volume), 0, NULL, NULL);
+
+        if (u->save_aec && u->canceled_file) {
+            unused = fwrite((uint8_t *) pa_memblock_acquire(job->cchunk.memblock), 1, job->cchunk.length, u->canceled_file);
+            pa_memblock_release(job->cchunk.memblock);
+        }
+
+        /* forward the (echo-canceled) data to the virtual source */
+        pa_source_post(u->source, &job->cchunk);
+    }
+
+    pa_memblock_unref(job->rchunk.memblock);
+    pa_memblock_unref(job->pchunk.memblock);
+    pa_memblock_unref(job->cchunk.memblock);
+
+    if (pa_flist_push(PA_STATIC_FLIST_GET(echo_cancel_jobs), job) < 0)
+        pa_xfree(job);
+}
+
+/* Posts the blocks the worker thread has finished, or waits for all of them
+ * if flush is set. Called from source I/O thread context. */
+static void worker_collect(struct userdata *u, bool flush, bool post) {
+    struct worker_job *job;
+
+    while (u->thread_info.worker_pending > 0 && (job = pa_asyncq_pop(u->worker_out, flush)))
+        worker_finish_job(u, job, post);
+}
+
+static void worker_log_stats(struct userdata *u) {
+    if (u->thread_info.worker_jobs == 0)
+        return;
+
+    pa_log_info("Worker thread: %llu blocks, %llu stalls, queue depth avg %0.2f max %u, "
+                "processing time avg %llu usec max %llu usec",
+                (unsigned long long) u->thread_info.worker_jobs,
+                (unsigned long long) u->thread_info.worker_stalls,
+                (double) u->thread_info.worker_depth_sum / u->thread_info.worker_jobs,
+                u->thread_info.worker_depth_max,
+                (unsigned long long) (u->thread_info.worker_process_sum / u->thread_info.worker_jobs),
+                (unsigned long long) u->thread_info.worker_process_max);
+}
+
+/* Like do_push(), but leaves running the canceller to the worker thread and
+ * posts what it has finished so far.
+ *
+ * Called from source I/O thread context. */
+static void do_push_worker(struct userdata *u) {
+    size_t rlen, plen;
+    struct worker_job *job;
+    int unused PA_GCC_UNUSED;
+
+    worker_collect(u, false, true);
+
+    rlen = pa_memblockq_get_length(u->source_memblockq);
+    plen = pa_memblockq_get_length(u->sink_memblockq);
+
+    while (rlen >= u->source_output_blocksize) {
+
+        if (!(job = pa_flist_pop(PA_STATIC_FLIST_GET(echo_cancel_jobs))))
+            job = pa_xnew(struct worker_job, 1);
+
+        /* take fixed blocks from recorded and played samples, the job
+         * keeps the references */
+        pa_memblockq_peek_fixed_size(u->source_memblockq, u->source_output_blocksize, &job->rchunk);
+        pa_memblockq_peek_fixed_size(u->sink_memblockq, u->sink_blocksize, &job->pchunk);
+
+        /* we ran out of played data and pchunk has been filled with silence bytes */
+        if (plen < u->sink_blocksize)
+            pa_memblockq_seek(u->sink_memblockq, u->sink_blocksize - plen, PA_SEEK_RELATIVE, true);
+
+        if (u->save_aec) {
+            if (u->captured_file) {
+                unused = fwrite(pa_memblock_acquire_chunk(&job->rchunk), 1, u->source_output_blocksize, u->captured_file);
+                pa_memblock_release(job->rchunk.memblock);
+            }
+            if (u->played_file) {
+                unused = fwrite(pa_memblock_acquire_chunk(&job->pchunk), 1, u->sink_blocksize, u->played_file);
+                pa_memblock_release(job->pchunk.memblock);
+            }
+        }
+
+        job->cchunk.index = 0;
+        job->cchunk.length = u->source_blocksize;
+        job->cchunk.memblock = pa_memblock_new(u->source->core->mempool, job->cchunk.length);
+        job->capture_volume = pa_cvolume_avg(&u->thread_info.current_volume);
+        job->new_capture_volume = PA_VOLUME_INVALID;
+        job->process_usec = 0;
+
+        if (u->thread_info.worker_pending >= WORKER_MAX_PENDING) {
+            struct worker_job *done;
+
+            /* The worker can't keep up, wait for the oldest block so that
+             * the latency stays bounded. */
+            u->thread_info.worker_stalls++;
+            pa_assert_se(done = pa_asyncq_pop(u->worker_out, true));
+            worker_finish_job(u, done, true);
+        }
+
+        pa_assert_se(pa_asyncq_push(u->worker_in, job, false) == 0);
+        u->thread_info.worker_pending++;
+        u->thread_info.worker_depth_sum += u->thread_info.worker_pending;
+        u->thread_info.worker_depth_max = PA_MAX(u->thread_info.worker_depth_max, u->thread_info.worker_pending);
+
+        /* drop consumed source samples */
+        pa_memblockq_drop(u->source_memblockq, u->source_output_blocksize);
+        rlen -= u->source_output_blocksize;
+
+        /* drop consumed sink samples */
+        pa_memblockq_drop(u->sink_memblockq, u->sink_blocksize);
+
+        if (plen >= u->sink_blocksize)
+            plen -= u->sink_blocksize;
+        else
+            plen = 0;
+    }
+}
+
+/* Called from main context. */
+static int worker_start(struct userdata *u) {
+    u->worker_in = pa_asyncq_new(WORKER_QUEUE_LENGTH);
+    u->worker_out = pa_asyncq_new(WORKER_QUEUE_LENGTH);
+
+    if (!u->worker_in || !u->worker_out) {
+        pa_log("pa_asyncq_new() failed.");
+        return -1;
+    }
+
+    if (!(u->worker_thread = pa_thread_new("echo-cancel", worker_thread_func, u))) {
+        pa_log("Failed to create worker thread.");
+        return -1;
+    }
+
+    pa_log_info("Running the canceller in a worker thread.");
+
+    return 0;
+}
+
+/* Called from main context, after the source output has been unlinked. */
+static void worker_stop(struct userdata *u) {
+    struct worker_job *job;
+
+    if (u->worker_thread) {
+        pa_assert_se(pa_asyncq_push(u->worker_in, &worker_quit, true) == 0);
+        pa_thread_free(u->worker_thread);
+        u->worker_thread = NULL;
+    }
+
+    /* Nothing is left in worker_in after the worker saw worker_quit. */
+    if (u->worker_out) {
+        while ((job = pa_asyncq_pop(u->worker_out, false)))
+            worker_finish_job(u, job, false);
+
+        pa_asyncq_free(u->worker_out, NULL);
+        u->worker_out = NULL;
+    }
+
+    if (u->worker_in) {
+        pa_asyncq_free(u->worker_in, NULL);
+        u->worker_in = NULL;
+    }
+
+    worker_log_stats(u);
+}
+
 /* Called from source I/O thread context. */
 static void source_output_push_cb(pa_source_output *o, const pa_memchunk *chunk) {
     struct userdata *u;
@@ -889,8 +1258,10 @@ static void source_output_push_cb(pa_source_output *o, const pa_memchunk *chunk)
     plen = pa_memblockq_get_length(u->sink_memblockq);
 
     /* Let's not do anything else till we have enough data to process */
-    if (rlen < u->source_output_blocksize)
+    if (rlen < u->source_output_blocksize) {
+        source_output_publish_snapshot(u);
         return;
+    }
 
     /* See if we need to drop samples in order to sync */
     if (pa_atomic_cmpxchg (&u->request_resync, 1, 0)) {
@@ -908,6 +1279,10 @@ static void source_output_push_cb(pa_source_output *o, const pa_memchunk *chunk)
         to_skip -= to_skip % u->source_output_blocksize;
 
         if (to_skip) {
+            /* Keep the order of what we post to the source. */
+            if (u->worker_thread)
+                worker_collect(u, true, true);
+
             pa_memblockq_peek_fixed_size(u->source_memblockq, to_skip, &rchunk);
             pa_source_post(u->source, &rchunk);
 
@@ -938,8 +1313,31 @@ static void source_output_push_cb(pa_source_output *o, const pa_memchunk *chunk)
     /* process and push out samples, do drift compensation only if the sink is actually running */
     if (u->ec->params.drift_compensation && u->sink->thread_info.state == PA_SINK_RUNNING)
         do_push_drift_comp(u);
+    else if (u->worker_thread)
+        do_push_worker(u);
     else
         do_push(u);
+
+    source_output_publish_snapshot(u);
+}
+
+/* Called from sink I/O thread context. */
+static void sink_input_publish_snapshot(struct userdata *u) {
+    struct sink_snapshot snapshot;
+    size_t delay;
+
+    /* Taken first, so that a snapshot racing an invalidation is stale
+     * rather than current. */
+    snapshot.generation = pa_atomic_load(&u->snapshot_generation);
+
+    delay = pa_memblockq_get_length(u->sink_input->thread_info.render_memblockq);
+
+    snapshot.now = pa_rtclock_now();
+    snapshot.latency = pa_sink_get_latency_within_thread(u->sink_input->sink);
+    snapshot.delay = (u->sink_input->thread_info.resampler ? pa_resampler_request(u->sink_input->thread_info.resampler, delay) : delay);
+    snapshot.send_counter = u->send_counter;
+
+    pa_seqlock_write(&u->sink_snapshot_lock, &u->sink_snapshot, &snapshot, sizeof(snapshot));
 }
 
 /* Called from sink I/O thread context. */
@@ -950,6 +1348,10 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
     pa_assert(chunk);
     pa_assert_se(u = i->userdata);
 
+    /* Before rendering, what has been sent so far is all accounted for by
+     * the master sink latency and our render queue. */
+    sink_input_publish_snapshot(u);
+
     if (u->sink->thread_info.rewind_requested)
         pa_sink_process_rewind(u->sink, 0);
 
@@ -1005,10 +1407,13 @@ static void sink_input_process_rewind_cb(pa_sink_input *i, size_t nbytes) {
 }
 
 /* Called from source I/O thread context. */
-static void source_output_snapshot_within_thread(struct userdata *u, struct snapshot *snapshot) {
+static void source_output_snapshot_within_thread(struct userdata *u, struct source_snapshot *snapshot) {
     size_t delay, rlen, plen;
     pa_usec_t now, latency;
 
+    /* See sink_input_publish_snapshot() */
+    snapshot->generation = pa_atomic_load(&u->snapshot_generation);
+
     now = pa_rtclock_now();
     latency = pa_source_get_latency_within_thread(u->source_output->source);
     delay = pa_memblockq_get_length(u->source_output->thread_info.delay_memblockq);
@@ -1017,14 +1422,22 @@ static void source_output_snapshot_within_thread(struct userdata *u, struct snap
     rlen = pa_memblockq_get_length(u->source_memblockq);
     plen = pa_memblockq_get_length(u->sink_memblockq);
 
-    snapshot->source_now = now;
-    snapshot->source_latency = latency;
-    snapshot->source_delay = delay;
+    snapshot->now = now;
+    snapshot->latency = latency;
+    snapshot->delay = delay;
     snapshot->recv_counter = u->recv_counter;
     snapshot->rlen = rlen + u->sink_skip;
     snapshot->plen = plen + u->source_skip;
 }
 
+/* Called from source I/O thread context. */
+static void source_output_publish_snapshot(struct userdata *u) {
+    struct source_snapshot snapshot;
+
+    source_output_snapshot_within_thread(u, &snapshot);
+    pa_seqlock_write(&u->source_snapshot_lock, &u->source_snapshot, &snapshot, sizeof(snapshot));
+}
+
 /* Called from source I/O thread context. */
 static int source_output_process_msg_cb(pa_msgobject *obj, int code, void *data, int64_t offset, pa_memchunk *chunk) {
     struct userdata *u = PA_SOURCE_OUTPUT(obj)->userdata;
@@ -1059,50 +1472,24 @@ static int source_output_process_msg_cb(pa_msgobject *obj, int code, void *data,
 
             return 0;
 
-        case SOURCE_OUTPUT_MESSAGE_LATENCY_SNAPSHOT: {
-            struct snapshot *snapshot = (struct snapshot *) data;
-
-            source_output_snapshot_within_thread(u, snapshot);
-            return 0;
-        }
-
         case SOURCE_OUTPUT_MESSAGE_APPLY_DIFF_TIME:
             apply_diff_time(u, offset);
             return 0;
 
-    }
-
-    return pa_source_output_process_msg(obj, code, data, offset, chunk);
-}
-
-/* Called from sink I/O thread context. */
-static int sink_input_process_msg_cb(pa_msgobject *obj, int code, void *data, int64_t offset, pa_memchunk *chunk) {
-    struct userdata *u = PA_SINK_INPUT(obj)->userdata;
-
-    switch (code) {
-
-        case SINK_INPUT_MESSAGE_LATENCY_SNAPSHOT: {
-            size_t delay;
-            pa_usec_t now, latency;
-            struct snapshot *snapshot = (struct snapshot *) data;
-
-            pa_sink_input_assert_io_context(u->sink_input);
-
-            now = pa_rtclock_now();
-            latency = pa_sink_get_latency_within_thread(u->sink_input->sink);
-            delay = pa_memblockq_get_length(u->sink_input->thread_info.render_memblockq);
+        case SOURCE_OUTPUT_MESSAGE_WORKER_DONE:
+            pa_source_output_assert_io_context(u->source_output);
 
-            delay = (u->sink_input->thread_info.resampler ? pa_resampler_request(u->sink_input->thread_info.resampler, delay) : delay);
+            /* What was pending when the source output went away is dropped
+             * by worker_stop(). */
+            if (PA_SOURCE_IS_LINKED(u->source->thread_info.state) &&
+                PA_SOURCE_OUTPUT_IS_LINKED(u->source_output->thread_info.state))
+                worker_collect(u, false, true);
 
-            snapshot->sink_now = now;
-            snapshot->sink_latency = latency;
-            snapshot->sink_delay = delay;
-            snapshot->send_counter = u->send_counter;
             return 0;
-        }
+
     }
 
-    return pa_sink_input_process_msg(obj, code, data, offset, chunk);
+    return pa_source_output_process_msg(obj, code, data, offset, chunk);
 }
 
 /* Called from sink I/O thread context. */
@@ -1293,6 +1680,12 @@ static void source_output_detach_cb(pa_source_output *o) {
 
     pa_log_debug("Source output %d detach", o->index);
 
+    /* Blocks for the old master source are of no use anymore. */
+    if (u->worker_thread) {
+        worker_collect(u, true, false);
+        worker_log_stats(u);
+    }
+
     if (u->rtpoll_item_read) {
         pa_rtpoll_item_free(u->rtpoll_item_read);
         u->rtpoll_item_read = NULL;
@@ -1544,18 +1937,32 @@ static int canceller_process_msg_cb(pa_msgobject *o, int code, void *userdata, i
     return 0;
 }
 
-/* Called by the canceller, so source I/O thread context. */
+/* Called by the canceller, so source I/O thread or worker thread context. */
 pa_volume_t pa_echo_canceller_get_capture_volume(pa_echo_canceller *ec) {
 #ifndef ECHO_CANCEL_TEST
+    struct worker_job *job = ec->msg->userdata->worker_job;
+
+    if (job)
+        return job->new_capture_volume != PA_VOLUME_INVALID ? job->new_capture_volume : job->capture_volume;
+
     return pa_cvolume_avg(&ec->msg->userdata->thread_info.current_volume);
 #else
     return PA_VOLUME_NORM;
 #endif
 }
 
-/* Called by the canceller, so source I/O thread context. */
+/* Called by the canceller, so source I/O thread or worker thread context. The
+ * worker thread has no message queue, so the source I/O thread posts the
+ * change once it gets the block back. */
 void pa_echo_canceller_set_capture_volume(pa_echo_canceller *ec, pa_volume_t v) {
 #ifndef ECHO_CANCEL_TEST
+    struct worker_job *job = ec->msg->userdata->worker_job;
+
+    if (job) {
+        job->new_capture_volume = v != job->capture_volume ? v : PA_VOLUME_INVALID;
+        return;
+    }
+
     if (pa_cvolume_avg(&ec->msg->userdata->thread_info.current_volume) != v) {
         pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(ec->msg), ECHO_CANCELLER_MESSAGE_SET_VOLUME, PA_UINT_TO_PTR(v),
                 0, NULL, NULL);
@@ -1653,6 +2060,8 @@ int pa__init(pa_module*m) {
     uint32_t temp;
     uint32_t nframes = 0;
     bool use_master_format;
+    bool use_worker_thread;
+    bool low_latency;
 
     pa_assert(m);
 
@@ -1753,6 +2162,18 @@ int pa__init(pa_module*m) {
         goto fail;
     }
 
+    use_worker_thread = DEFAULT_USE_WORKER_THREAD;
+    if (pa_modargs_get_value_boolean(ma, "use_worker_thread", &use_worker_thread) < 0) {
+        pa_log("use_worker_thread= expects a boolean argument");
+        goto fail;
+    }
+
+    low_latency = DEFAULT_LOW_LATENCY;
+    if (pa_modargs_get_value_boolean(ma, "low_latency", &low_latency) < 0) {
+        pa_log("low_latency= expects a boolean argument");
+        goto fail;
+    }
+
     if (init_common(ma, u, &source_ss, &source_map) < 0)
         goto fail;
 
@@ -1764,6 +2185,9 @@ int pa__init(pa_module*m) {
 
     u->need_realign = true;
 
+    pa_seqlock_init(&u->sink_snapshot_lock);
+    pa_seqlock_init(&u->source_snapshot_lock);
+
     source_output_ss = source_ss;
     source_output_map = source_map;
 
@@ -1785,6 +2209,15 @@ int pa__init(pa_module*m) {
     u->source_blocksize = nframes * pa_frame_size(&source_ss);
     u->sink_blocksize = nframes * pa_frame_size(&sink_ss);
 
+    if (low_latency) {
+        u->low_latency_usec = PA_MAX(pa_bytes_to_usec(u->source_output_blocksize, &source_output_ss) / LOW_LATENCY_SUBBLOCKS, 1U);
+
+        if (!(source_master->flags & PA_SOURCE_DYNAMIC_LATENCY))
+            pa_log_info("Master source has a fixed latency, capture still comes in its fragments");
+        if (!(sink_master->flags & PA_SINK_DYNAMIC_LATENCY))
+            pa_log_info("Master sink has a fixed latency, playback still goes out in its fragments");
+    }
+
     if (u->ec->params.drift_compensation)
         pa_assert(u->ec->set_drift);
 
@@ -1926,6 +2359,9 @@ int pa__init(pa_module*m) {
 
     u->source->output_from_master = u->source_output;
 
+    if (u->low_latency_usec > 0)
+        pa_source_output_set_requested_latency(u->source_output, u->low_latency_usec);
+
     /* Create sink input */
     pa_sink_input_new_data_init(&sink_input_data);
     sink_input_data.driver = __FILE__;
@@ -1947,7 +2383,6 @@ int pa__init(pa_module*m) {
     if (!u->sink_input)
         goto fail;
 
-    u->sink_input->parent.process_msg = sink_input_process_msg_cb;
     u->sink_input->pop = sink_input_pop_cb;
     u->sink_input->process_rewind = sink_input_process_rewind_cb;
     u->sink_input->update_max_rewind = sink_input_update_max_rewind_cb;
@@ -1968,6 +2403,9 @@ int pa__init(pa_module*m) {
 
     u->sink->input_to_master = u->sink_input;
 
+    if (u->low_latency_usec > 0)
+        pa_sink_input_set_requested_latency(u->sink_input, u->low_latency_usec);
+
     pa_sink_input_get_silence(u->sink_input, &silence);
 
     u->source_memblockq = pa_memblockq_new("module-echo-cancel source_memblockq", 0, MEMBLOCKQ_MAXLENGTH, 0,
@@ -1991,6 +2429,11 @@ int pa__init(pa_module*m) {
         pa_atomic_store(&u->request_resync, 1);
     }
 
+    if (use_worker_thread && u->ec->params.drift_compensation) {
+        pa_log_info("Canceller does drift compensation, not using a worker thread");
+        use_worker_thread = false;
+    }
+
     if (u->save_aec) {
         pa_log("Creating AEC files in /tmp");
         u->captured_file = fopen("/tmp/aec_rec.sw", "wb");
@@ -2018,6 +2461,9 @@ int pa__init(pa_module*m) {
     pa_sink_put(u->sink);
     pa_source_put(u->source);
 
+    if (use_worker_thread && worker_start(u) < 0)
+        goto fail;
+
     pa_sink_input_put(u->sink_input);
     pa_source_output_put(u->source_output);
     pa_modargs_free(ma);
@@ -2070,6 +2516,10 @@ void pa__done(pa_module*m) {
     if (u->sink)
         pa_sink_unlink(u->sink);
 
+    /* The source output is unlinked, so nobody hands blocks to the worker
+     * thread anymore. */
+    worker_stop(u);
+
     if (u->source_output)
         pa_source_output_unref(u->source_output);
     if (u->sink_input)
@@ -0,0 +1,262 @@
+/***
+  This file is part of PulseAudio.
+
+  Copyright 2004-2008 Lennart Poettering
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/ltdl-helper.h>
+#include <pulsecore/macro.h>
+
+#include "ladspa-util.h"
+
+int pa_ladspa_plugin_load(const char *plugin, const char *label, lt_dlhandle *dl, const LADSPA_Descriptor **descriptor) {
+    LADSPA_Descriptor_Function descriptor_func;
+    const LADSPA_Descriptor *d;
+    unsigned long j;
+    const char *e;
+    char *t;
+
+    pa_assert(plugin);
+    pa_assert(label);
+    pa_assert(dl);
+    pa_assert(descriptor);
+
+    if (!(e = getenv("LADSPA_PATH")))
+        e = LADSPA_PATH;
+
+    /* FIXME: This is not exactly thread safe */
+    t = pa_xstrdup(lt_dlgetsearchpath());
+    lt_dlsetsearchpath(e);
+    *dl = lt_dlopenext(plugin);
+    lt_dlsetsearchpath(t);
+    pa_xfree(t);
+
+    if (!*dl) {
+        pa_log("Failed to load LADSPA plugin: %s", lt_dlerror());
+        return -1;
+    }
+
+    if (!(descriptor_func = (LADSPA_Descriptor_Function) pa_load_sym(*dl, NULL, "ladspa_descriptor"))) {
+        pa_log("LADSPA module lacks ladspa_descriptor() symbol.");
+        return -1;
+    }
+
+    for (j = 0;; j++) {
+
+        if (!(d = descriptor_func(j))) {
+            pa_log("Failed to find plugin label '%s' in plugin '%s'.", label, plugin);
+            return -1;
+        }
+
+        if (pa_streq(d->Label, label))
+            break;
+    }
+
+    *descriptor = d;
+
+    pa_log_debug("Module: %s", plugin);
+    pa_log_debug("Label: %s", d->Label);
+    pa_log_debug("Unique ID: %lu", d->UniqueID);
+    pa_log_debug("Name: %s", d->Name);
+    pa_log_debug("Maker: %s", d->Maker);
+    pa_log_debug("Copyright: %s", d->Copyright);
+
+    return 0;
+}
+
+int pa_ladspa_parse_controls(const char *cdata, unsigned long n_control, double *values, bool *use_default) {
+    unsigned long p = 0;
+    const char *state = NULL;
+    char *k;
+
+    pa_assert(values);
+    pa_assert(use_default);
+
+    pa_log_debug("Trying to read %lu control values", n_control);
+
+    if (!cdata && n_control > 0)
+        return -1;
+
+    pa_log_debug("cdata: '%s'", cdata);
+
+    while ((k = pa_split(cdata, ",", &state)) && p < n_control) {
+        double f;
+
+        if (*k == 0) {
+            pa_log_debug("Read empty config value (p=%lu)", p);
+            use_default[p++] = true;
+            pa_xfree(k);
+            continue;
+        }
+
+        if (pa_atod(k, &f) < 0) {
+            pa_log_debug("Failed to parse control value '%s' (p=%lu)", k, p);
+            pa_xfree(k);
+            goto fail;
+        }
+
+        pa_xfree(k);
+
+        pa_log_debug("Read config value %f (p=%lu)", f, p);
+
+        use_default[p] = false;
+        values[p++] = f;
+    }
+
+    /* The previous loop doesn't take the last control value into account
+       if it is left empty, so we do it here. */
+    if (*cdata == 0 || cdata[strlen(cdata) - 1] == ',') {
+        if (p < n_control)
+            use_default[p] = true;
+        p++;
+    }
+
+    if (p > n_control || k) {
+        pa_log("Too many control values passed, %lu expected.", n_control);
+        pa_xfree(k);
+        goto fail;
+    }
+
+    if (p < n_control) {
+        pa_log("Not enough control values passed, %lu expected, %lu passed.", n_control, p);
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+    return -1;
+}
+
+int pa_ladspa_control_check(const LADSPA_Descriptor *d, unsigned long p, uint32_t rate, double value) {
+    LADSPA_PortRangeHintDescriptor hint;
+    LADSPA_Data lower, upper;
+
+    pa_assert(d);
+    pa_assert(p < d->PortCount);
+
+    hint = d->PortRangeHints[p].HintDescriptor;
+    lower = d->PortRangeHints[p].LowerBound;
+    upper = d->PortRangeHints[p].UpperBound;
+
+    if (LADSPA_IS_HINT_SAMPLE_RATE(hint)) {
+        upper *= (LADSPA_Data) rate;
+        lower *= (LADSPA_Data) rate;
+    }
+
+    if (LADSPA_IS_HINT_BOUNDED_ABOVE(hint)) {
+        if (value > upper) {
+            pa_log_warn("Control value of port %s over upper bound: %f (upper bound: %f)", d->PortNames[p], value, upper);
+            return -1;
+        }
+    }
+    if (LADSPA_IS_HINT_BOUNDED_BELOW(hint)) {
+        if (value < lower) {
+            pa_log_warn("Control value of port %s below lower bound: %f (lower bound: %f)", d->PortNames[p], value, lower);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int pa_ladspa_control_default(const LADSPA_Descriptor *d, unsigned long p, uint32_t rate, LADSPA_Data *value) {
+    LADSPA_PortRangeHintDescriptor hint;
+    LADSPA_Data lower, upper;
+
+    pa_assert(d);
+    pa_assert(p < d->PortCount);
+    pa_assert(value);
+
+    hint = d->PortRangeHints[p].HintDescriptor;
+
+    if (!LADSPA_IS_HINT_HAS_DEFAULT(hint)) {
+        pa_log_warn("Control port value left empty but plugin defines no default.");
+        return -1;
+    }
+
+    lower = d->PortRangeHints[p].LowerBound;
+    upper = d->PortRangeHints[p].UpperBound;
+
+    if (LADSPA_IS_HINT_SAMPLE_RATE(hint)) {
+        lower *= (LADSPA_Data) rate;
+        upper *= (LADSPA_Data) rate;
+    }
+
+    switch (hint & LADSPA_HINT_DEFAULT_MASK) {
+
+    case LADSPA_HINT_DEFAULT_MINIMUM:
+        *value = lower;
+        break;
+
+    case LADSPA_HINT_DEFAULT_MAXIMUM:
+        *value = upper;
+        break;
+
+    case LADSPA_HINT_DEFAULT_LOW:
+        if (LADSPA_IS_HINT_LOGARITHMIC(hint))
+            *value = (LADSPA_Data) exp(log(lower) * 0.75 + log(upper) * 0.25);
+        else
+            *value = (LADSPA_Data) (lower * 0.75 + upper * 0.25);
+        break;
+
+    case LADSPA_HINT_DEFAULT_MIDDLE:
+        if (LADSPA_IS_HINT_LOGARITHMIC(hint))
+            *value = (LADSPA_Data) exp(log(lower) * 0.5 + log(upper) * 0.5);
+        else
+            *value = (LADSPA_Data) (lower * 0.5 + upper * 0.5);
+        break;
+
+    case LADSPA_HINT_DEFAULT_HIGH:
+        if (LADSPA_IS_HINT_LOGARITHMIC(hint))
+            *value = (LADSPA_Data) exp(log(lower) * 0.25 + log(upper) * 0.75);
+        else
+            *value = (LADSPA_Data) (lower * 0.25 + upper * 0.75);
+        break;
+
+    case LADSPA_HINT_DEFAULT_0:
+        *value = 0;
+        break;
+
+    case LADSPA_HINT_DEFAULT_1:
+        *value = 1;
+        break;
+
+    case LADSPA_HINT_DEFAULT_100:
+        *value = 100;
+        break;
+
+    case LADSPA_HINT_DEFAULT_440:
+        *value = 440;
+        break;
+
+    default:
+        pa_assert_not_reached();
+    }
+
+    return 0;
+}
@@ -0,0 +1,50 @@
+#ifndef fooladspautilhfoo
+#define fooladspautilhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  Copyright 2004-2008 Lennart Poettering
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include <ltdl.h>
+
+#include "ladspa.h"
+
+/* Plugin loading and control port handling shared by module-ladspa-sink and
+ * the ladspa stage of module-filter-graph-sink. The search path is taken
+ * from $LADSPA_PATH, falling back to LADSPA_PATH of the build. */
+
+/* Opens the LADSPA library plugin and looks up the plugin with the given
+ * label in it. On failure *dl may still need to be closed. */
+int pa_ladspa_plugin_load(const char *plugin, const char *label, lt_dlhandle *dl, const LADSPA_Descriptor **descriptor);
+
+/* Parses a comma separated list of n_control values. An empty value means
+ * the default of the port is used. */
+int pa_ladspa_parse_controls(const char *cdata, unsigned long n_control, double *values, bool *use_default);
+
+/* Checks value against the bounds input control port p has at the given
+ * sample rate. */
+int pa_ladspa_control_check(const LADSPA_Descriptor *d, unsigned long p, uint32_t rate, double value);
+
+/* Returns the default of input control port p at the given sample rate in
+ * *value, or fails if the plugin defines none. */
+int pa_ladspa_control_default(const LADSPA_Descriptor *d, unsigned long p, uint32_t rate, LADSPA_Data *value);
+
+#endif
@@ -48,6 +48,7 @@
 
 #include <pulsecore/core-rtclock.h>
 #include <pulsecore/i18n.h>
+#include <pulsecore/filter/planar.h>
 #include <pulsecore/aupdate.h>
 #include <pulsecore/namereg.h>
 #include <pulsecore/sink.h>
@@ -107,8 +108,13 @@ struct userdata {
     size_t input_buffer_max;
     //message
     float *W;//windowing function (time domain)
-    float *work_buffer, **input, **overlap_accum;
+    float *work_buffer, *input_buffer, **overlap_accum;
     fftwf_complex *output_window;
+    /* work_buffer and output_window hold all channels, this far apart */
+    size_t work_stride, output_stride;
+    /* The channels of input_buffer and work_buffer. Audio is deinterleaved
+     * once into input and interleaved once out of work. */
+    pa_planar input, work;
     fftwf_plan forward_plan, inverse_plan;
     //size_t samplings;
 
@@ -221,19 +227,23 @@ static void * alloc(size_t x, size_t s) {
 }
 
 static void alloc_input_buffers(struct userdata *u, size_t min_buffer_length) {
+    size_t stride;
+    float *tmp;
+
     if (min_buffer_length <= u->input_buffer_max)
         return;
 
     pa_assert(min_buffer_length >= u->window_size);
-    for (size_t c = 0; c < u->channels; ++c) {
-        float *tmp = alloc(min_buffer_length, sizeof(float));
-        if (u->input[c]) {
-            if (!u->first_iteration)
-                memcpy(tmp, u->input[c], u->overlap_size * sizeof(float));
-            fftwf_free(u->input[c]);
-        }
-        u->input[c] = tmp;
-    }
+    stride = PA_ROUND_UP(min_buffer_length, v_size);
+    tmp = alloc(stride * u->channels, sizeof(float));
+    if (u->input_buffer) {
+        if (!u->first_iteration)
+            for (size_t c = 0; c < u->channels; ++c)
+                memcpy(tmp + c * stride, u->input.plane[c], u->overlap_size * sizeof(float));
+        fftwf_free(u->input_buffer);
+    }
+    u->input_buffer = tmp;
+    pa_planar_init(&u->input, u->channels, min_buffer_length, tmp, stride);
     u->input_buffer_max = min_buffer_length;
 }
 
@@ -347,158 +357,87 @@ static void sink_set_mute_cb(pa_sink *s) {
     pa_sink_input_set_mute(u->sink_input, s->muted, s->save_muted);
 }
 
-#if 1
-//reference implementation
-static void dsp_logic(
-    float * restrict dst,//used as a temp array too, needs to be fft_length!
-    float * restrict src,/*input data w/ overlap at start,
-                               *automatically cycled in routine
-                               */
-    float * restrict overlap,
-    const float X,//multiplier
-    const float * restrict H,//The freq. magnitude scalers filter
-    const float * restrict W,//The windowing function
-    fftwf_complex * restrict output_window,//The transformed windowed src
-    struct userdata *u) {
-
-    //use a linear-phase sliding STFT and overlap-add method (for each channel)
-    //window the data
-    for(size_t j = 0; j < u->window_size; ++j) {
+/* The loops below assume 16 byte aligned buffers with lengths rounded up to
+ * v_size, see alloc(). */
+
+static void window_input(float * restrict dst, const float * restrict src, const float * restrict W, float X, size_t n) {
+#ifdef __SSE2__
+    const __m128 x = _mm_set1_ps(X);
+
+    for (size_t j = 0; j < n; j += v_size)
+        _mm_store_ps(dst + j, _mm_mul_ps(x, _mm_mul_ps(_mm_load_ps(W + j), _mm_load_ps(src + j))));
+#else
+    for (size_t j = 0; j < n; ++j)
         dst[j] = X * W[j] * src[j];
+#endif
+}
+
+/* The filter is purely magnitude based, so both the real and the imaginary
+ * part of each bin are scaled by the same factor. */
+static void apply_filter(fftwf_complex * restrict d, const float * restrict H, size_t n) {
+#ifdef __SSE2__
+    for (size_t j = 0; j < n; j += v_size / 2) {
+        float *p = (float *) (d + j);
+        __m128 h = _mm_set_ps(H[j + 1], H[j + 1], H[j], H[j]);
+
+        _mm_store_ps(p, _mm_mul_ps(_mm_load_ps(p), h));
+    }
+#else
+    for (size_t j = 0; j < n; ++j) {
+        d[j][0] *= H[j];
+        d[j][1] *= H[j];
     }
-    //zero pad the remaining fft window
-    memset(dst + u->window_size, 0, (u->fft_size - u->window_size) * sizeof(float));
-    //Processing is done here!
-    //do fft
-    fftwf_execute_dft_r2c(u->forward_plan, dst, output_window);
-    //perform filtering
-    for(size_t j = 0; j < FILTER_SIZE(u); ++j) {
-        u->output_window[j][0] *= H[j];
-        u->output_window[j][1] *= H[j];
-    }
-    //inverse fft
-    fftwf_execute_dft_c2r(u->inverse_plan, output_window, dst);
-    ////debug: tests overlapping add
-    ////and negates ALL PREVIOUS processing
-    ////yields a perfect reconstruction if COLA is held
-    //for(size_t j = 0; j < u->window_size; ++j) {
-    //    u->work_buffer[j] = u->W[j] * u->input[c][j];
-    //}
-
-    //overlap add and preserve overlap component from this window (linear phase)
-    for(size_t j = 0; j < u->overlap_size; ++j) {
-        u->work_buffer[j] += overlap[j];
-        overlap[j] = dst[u->R + j];
-    }
-    ////debug: tests if basic buffering works
-    ////shouldn't modify the signal AT ALL (beyond roundoff)
-    //for(size_t j = 0; j < u->window_size;++j) {
-    //    u->work_buffer[j] = u->input[c][j];
-    //}
-
-    //preserve the needed input for the next window's overlap
-    memmove(src, src + u->R,
-        (u->samples_gathered - u->R) * sizeof(float)
-    );
+#endif
 }
+
+/* Adds the overlap of the previous window and keeps the one of this window
+ * for the next. */
+static void overlap_add(float * restrict dst, float * restrict overlap, size_t R, size_t n) {
+#ifdef __SSE2__
+    for (size_t j = 0; j < n; j += v_size) {
+        _mm_store_ps(dst + j, _mm_add_ps(_mm_load_ps(dst + j), _mm_load_ps(overlap + j)));
+        _mm_store_ps(overlap + j, _mm_loadu_ps(dst + R + j));
+    }
 #else
-typedef float v4sf __attribute__ ((__aligned__(v_size * sizeof(float))));
-typedef union float_vector {
-    float f[v_size];
-    v4sf v;
-    __m128 m;
-} float_vector_t;
-
-//regardless of sse enabled, the loops in here assume
-//16 byte aligned addresses and memory allocations divisible by v_size
-static void dsp_logic(
-    float * restrict dst,//used as a temp array too, needs to be fft_length!
-    float * restrict src,/*input data w/ overlap at start,
-                               *automatically cycled in routine
-                               */
-    float * restrict overlap,//The size of the overlap
-    const float X,//multiplier
-    const float * restrict H,//The freq. magnitude scalers filter
-    const float * restrict W,//The windowing function
-    fftwf_complex * restrict output_window,//The transformed windowed src
-    struct userdata *u) {//Collection of constants
+    for (size_t j = 0; j < n; ++j) {
+        dst[j] += overlap[j];
+        overlap[j] = dst[R + j];
+    }
+#endif
+}
+
+/* One hop of a linear-phase sliding STFT and overlap-add. All channels are
+ * transformed by a single FFTW call in each direction, channel c being at
+ * work_buffer + c * work_stride and output_window + c * output_stride. */
+static void dsp_logic(struct userdata *u, const float *Xs, float * const *Hs) {
+    const size_t window_size = PA_ROUND_UP(u->window_size, v_size);
     const size_t overlap_size = PA_ROUND_UP(u->overlap_size, v_size);
-    float_vector_t x;
-    x.f[0] = x.f[1] = x.f[2] = x.f[3] = X;
-
-    //assert(u->samples_gathered >= u->R);
-    //use a linear-phase sliding STFT and overlap-add method
-    for(size_t j = 0; j < u->window_size; j += v_size) {
-        //dst[j] = W[j] * src[j];
-        float_vector_t *d = (float_vector_t*) (dst + j);
-        float_vector_t *w = (float_vector_t*) (W + j);
-        float_vector_t *s = (float_vector_t*) (src + j);
-//#if __SSE2__
-        d->m = _mm_mul_ps(x.m, _mm_mul_ps(w->m, s->m));
-//        d->v = x->v * w->v * s->v;
-//#endif
-    }
-    //zero pad the remaining fft window
-    memset(dst + u->window_size, 0, (u->fft_size - u->window_size) * sizeof(float));
-
-    //Processing is done here!
-    //do fft
-    fftwf_execute_dft_r2c(u->forward_plan, dst, output_window);
-    //perform filtering - purely magnitude based
-    for(size_t j = 0; j < FILTER_SIZE; j += v_size / 2) {
-        //output_window[j][0]*=H[j];
-        //output_window[j][1]*=H[j];
-        float_vector_t *d = (float_vector_t*)( ((float *) output_window) + 2 * j);
-        float_vector_t h;
-        h.f[0] = h.f[1] = H[j];
-        h.f[2] = h.f[3] = H[j + 1];
-//#if __SSE2__
-        d->m = _mm_mul_ps(d->m, h.m);
-//#else
-//        d->v = d->v * h.v;
-//#endif
-    }
-
-    //inverse fft
-    fftwf_execute_dft_c2r(u->inverse_plan, output_window, dst);
-
-    ////debug: tests overlapping add
-    ////and negates ALL PREVIOUS processing
-    ////yields a perfect reconstruction if COLA is held
-    //for(size_t j = 0; j < u->window_size; ++j) {
-    //    dst[j] = W[j] * src[j];
-    //}
-
-    //overlap add and preserve overlap component from this window (linear phase)
-    for(size_t j = 0; j < overlap_size; j += v_size) {
-        //dst[j]+=overlap[j];
-        //overlap[j]+=dst[j+R];
-        float_vector_t *d = (float_vector_t*)(dst + j);
-        float_vector_t *o = (float_vector_t*)(overlap + j);
-//#if __SSE2__
-        d->m = _mm_add_ps(d->m, o->m);
-        o->m = ((float_vector_t*)(dst + u->R + j))->m;
-//#else
-//        d->v = d->v + o->v;
-//        o->v = ((float_vector_t*)(dst + u->R + j))->v;
-//#endif
-    }
-    //memcpy(overlap, dst+u->R, u->overlap_size * sizeof(float)); //overlap preserve (debug)
-    //zero out the bit beyond the real overlap so we don't add garbage next iteration
-    memset(overlap + u->overlap_size, 0, overlap_size - u->overlap_size);
-
-    ////debug: tests if basic buffering works
-    ////shouldn't modify the signal AT ALL (beyond roundoff)
-    //for(size_t j = 0; j < u->window_size; ++j) {
-    //    dst[j] = src[j];
-    //}
-
-    //preserve the needed input for the next window's overlap
-    memmove(src, src + u->R,
-        (u->samples_gathered - u->R) * sizeof(float)
-    );
+    size_t c;
+
+    //window the data and zero pad the remaining fft window
+    for (c = 0; c < u->channels; ++c) {
+        float *dst = u->work_buffer + c * u->work_stride;
+
+        window_input(dst, u->input.plane[c], u->W, Xs[c], window_size);
+        memset(dst + window_size, 0, (u->fft_size - window_size) * sizeof(float));
+    }
+
+    fftwf_execute(u->forward_plan);
+
+    for (c = 0; c < u->channels; ++c)
+        apply_filter(u->output_window + c * u->output_stride, Hs[c], FILTER_SIZE(u));
+
+    fftwf_execute(u->inverse_plan);
+
+    for (c = 0; c < u->channels; ++c) {
+        overlap_add(u->work_buffer + c * u->work_stride, u->overlap_accum[c], u->R, overlap_size);
+        //zero out the bit beyond the real overlap so we don't add garbage next iteration
+        memset(u->overlap_accum[c] + u->overlap_size, 0, (overlap_size - u->overlap_size) * sizeof(float));
+
+        //preserve the needed input for the next window's overlap
+        memmove(u->input.plane[c], u->input.plane[c] + u->R, (u->samples_gathered - u->R) * sizeof(float));
+    }
 }
-#endif
 
 static void flatten_to_memblockq(struct userdata *u) {
     size_t mbs = pa_mempool_block_size_max(u->sink->core->mempool);
@@ -521,8 +460,8 @@ static void flatten_to_memblockq(struct userdata *u) {
 
 static void process_samples(struct userdata *u) {
     size_t fs = pa_frame_size(&(u->sink->sample_spec));
-    unsigned a_i;
-    float *H, X;
+    unsigned a_i[PA_CHANNELS_MAX];
+    float *H[PA_CHANNELS_MAX], X[PA_CHANNELS_MAX];
     size_t iterations, offset;
     pa_assert(u->samples_gathered >= u->window_size);
     iterations = (u->samples_gathered - u->overlap_size) / u->R;
@@ -537,33 +476,28 @@ static void process_samples(struct userdata *u) {
     for(size_t iter = 0; iter < iterations; ++iter) {
         offset = iter * u->R * fs;
         for(size_t c = 0;c < u->channels; c++) {
-            a_i = pa_aupdate_read_begin(u->a_H[c]);
-            X = u->Xs[c][a_i];
-            H = u->Hs[c][a_i];
-            dsp_logic(
-                u->work_buffer,
-                u->input[c],
-                u->overlap_accum[c],
-                X,
-                H,
-                u->W,
-                u->output_window,
-                u
-            );
+            a_i[c] = pa_aupdate_read_begin(u->a_H[c]);
+            X[c] = u->Xs[c][a_i[c]];
+            H[c] = u->Hs[c][a_i[c]];
+        }
+        dsp_logic(u, X, H);
+        for(size_t c = 0;c < u->channels; c++)
             pa_aupdate_read_end(u->a_H[c]);
-            if (u->first_iteration) {
+
+        if (u->first_iteration) {
+            for(size_t c = 0;c < u->channels; c++) {
+                float *work = u->work.plane[c];
+
                 /* The windowing function will make the audio ramped in, as a cheap fix we can
                  * undo the windowing (for non-zero window values)
                  */
                 for(size_t i = 0; i < u->overlap_size; ++i) {
-                    u->work_buffer[i] = u->W[i] <= FLT_EPSILON ? u->work_buffer[i] : u->work_buffer[i] / u->W[i];
+                    work[i] = u->W[i] <= FLT_EPSILON ? work[i] : work[i] / u->W[i];
                 }
             }
-            pa_sample_clamp(PA_SAMPLE_FLOAT32NE, (uint8_t *) (((float *)u->output_buffer) + c) + offset, fs, u->work_buffer, sizeof(float), u->R);
-        }
-        if (u->first_iteration) {
             u->first_iteration = false;
         }
+        pa_planar_export(&u->work, 0, (float *) (u->output_buffer + offset), u->R);
         u->samples_gathered -= u->R;
     }
     flatten_to_memblockq(u);
@@ -574,14 +508,9 @@ static void input_buffer(struct userdata *u, pa_memchunk *in) {
     size_t samples = in->length/fs;
     float *src = pa_memblock_acquire_chunk(in);
     pa_assert(u->samples_gathered + samples <= u->input_buffer_max);
-    for(size_t c = 0; c < u->channels; c++) {
-        //buffer with an offset after the overlap from previous
-        //iterations
-        pa_assert_se(
-            u->input[c] + u->samples_gathered + samples <= u->input[c] + u->input_buffer_max
-        );
-        pa_sample_clamp(PA_SAMPLE_FLOAT32NE, u->input[c] + u->samples_gathered, sizeof(float), src + c, fs, samples);
-    }
+    //buffer with an offset after the overlap from previous
+    //iterations
+    pa_planar_import(&u->input, u->samples_gathered, src, samples);
     u->samples_gathered += samples;
     pa_memblock_release(in->memblock);
 }
@@ -1089,6 +1018,7 @@ int pa__init(pa_module*m) {
     pa_sink_new_data sink_data;
     size_t i;
     unsigned c;
+    int fft_size;
     float *H;
     unsigned a_i;
     bool use_volume_sharing = true;
@@ -1151,17 +1081,26 @@ int pa__init(pa_module*m) {
     }
 
     u->W = alloc(u->window_size, sizeof(float));
-    u->work_buffer = alloc(u->fft_size, sizeof(float));
-    u->input = pa_xnew0(float *, u->channels);
+    u->work_stride = PA_ROUND_UP(u->fft_size, v_size);
+    u->work_buffer = alloc(u->work_stride * u->channels, sizeof(float));
+    pa_planar_init(&u->work, u->channels, u->work_stride, u->work_buffer, u->work_stride);
+    u->input_buffer = NULL;
     u->overlap_accum = pa_xnew0(float *, u->channels);
     for (c = 0; c < u->channels; ++c) {
         u->a_H[c] = pa_aupdate_new();
-        u->input[c] = NULL;
         u->overlap_accum[c] = alloc(u->overlap_size, sizeof(float));
     }
-    u->output_window = alloc(FILTER_SIZE(u), sizeof(fftwf_complex));
-    u->forward_plan = fftwf_plan_dft_r2c_1d(u->fft_size, u->work_buffer, u->output_window, FFTW_ESTIMATE);
-    u->inverse_plan = fftwf_plan_dft_c2r_1d(u->fft_size, u->output_window, u->work_buffer, FFTW_ESTIMATE);
+    u->output_stride = PA_ROUND_UP(FILTER_SIZE(u), v_size / 2);
+    u->output_window = alloc(u->output_stride * u->channels, sizeof(fftwf_complex));
+    fft_size = (int) u->fft_size;
+    u->forward_plan = fftwf_plan_many_dft_r2c(1, &fft_size, (int) u->channels,
+                                              u->work_buffer, NULL, 1, (int) u->work_stride,
+                                              u->output_window, NULL, 1, (int) u->output_stride,
+                                              FFTW_ESTIMATE);
+    u->inverse_plan = fftwf_plan_many_dft_c2r(1, &fft_size, (int) u->channels,
+                                              u->output_window, NULL, 1, (int) u->output_stride,
+                                              u->work_buffer, NULL, 1, (int) u->work_stride,
+                                              FFTW_ESTIMATE);
 
     hanning_window(u->W, u->window_size);
     u->first_iteration = true;
@@ -1347,11 +1286,10 @@ void pa__done(pa_module*m) {
     for (c = 0; c < u->channels; ++c) {
         pa_aupdate_free(u->a_H[c]);
         fftwf_free(u->overlap_accum[c]);
-        fftwf_free(u->input[c]);
     }
     pa_xfree(u->a_H);
     pa_xfree(u->overlap_accum);
-    pa_xfree(u->input);
+    fftwf_free(u->input_buffer);
     fftwf_free(u->work_buffer);
     fftwf_free(u->W);
     for (c = 0; c < u->channels; ++c) {
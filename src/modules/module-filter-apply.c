@@ -34,10 +34,13 @@
 #include <pulsecore/sink-input.h>
 #include <pulsecore/modargs.h>
 #include <pulsecore/proplist-util.h>
+#include <pulsecore/strbuf.h>
 
 #include "module-filter-apply-symdef.h"
 
 #define PA_PROP_FILTER_APPLY_MOVING "filter.apply.moving"
+#define PA_PROP_FILTER_APPLY_PARAMETERS "filter.apply.%s.parameters"
+#define PA_PROP_FILTER_GRAPH_FILTERS "device.filter_graph.filters"
 #define PA_PROP_MDM_AUTO_FILTERED   "module-device-manager.auto_filtered"
 
 PA_MODULE_AUTHOR("Colin Guthrie");
@@ -54,6 +57,15 @@ static const char* const valid_modargs[] = {
 #define DEFAULT_AUTOCLEAN true
 #define HOUSEKEEPING_INTERVAL (10 * PA_USEC_PER_SEC)
 
+/* A comma separated list of filters in filter.apply is run by one filter
+ * graph sink rather than by a chain of filter sinks. This works for the
+ * filters the filter graph has a stage for, otherwise loading the sink
+ * fails. The stage of a filter is set up from the
+ * filter.apply.<filter>.parameters property of the stream. */
+#define FILTER_CHAIN_DELIMITER ","
+#define FILTER_GRAPH_DELIMITER "|"
+#define FILTER_GRAPH_MODULE "module-filter-graph-sink"
+
 struct filter {
     char *name;
     uint32_t module_index;
@@ -144,6 +156,39 @@ static bool should_group_filter(struct filter *filter) {
     return pa_streq(filter->name, "echo-cancel");
 }
 
+static bool is_filter_chain(const char *want) {
+    return strpbrk(want, FILTER_CHAIN_DELIMITER) != NULL;
+}
+
+/* Returns the filters= argument of the filter graph sink running the chain
+ * of filters the sink input wants. */
+static char *get_filter_graph(pa_sink_input *i, const char *want) {
+    pa_strbuf *graph;
+    const char *state = NULL;
+    char *name;
+
+    graph = pa_strbuf_new();
+
+    while ((name = pa_split(want, FILTER_CHAIN_DELIMITER, &state))) {
+        const char *parameters;
+        char *prop;
+
+        prop = pa_sprintf_malloc(PA_PROP_FILTER_APPLY_PARAMETERS, name);
+        parameters = pa_proplist_gets(i->proplist, prop);
+
+        pa_strbuf_printf(graph, "%s%s%s%s",
+                         pa_strbuf_isempty(graph) ? "" : FILTER_GRAPH_DELIMITER,
+                         name,
+                         parameters ? ":" : "",
+                         parameters ? parameters : "");
+
+        pa_xfree(prop);
+        pa_xfree(name);
+    }
+
+    return pa_strbuf_to_string_free(graph);
+}
+
 static char* get_group(pa_object *o, bool is_sink_input) {
     pa_proplist *pl;
 
@@ -416,7 +461,7 @@ static pa_hook_result_t process(struct userdata *u, pa_object *o, bool is_sink_i
     pa_sink *sink = NULL;
     pa_source *source = NULL;
     pa_module *module = NULL;
-    char *module_name = NULL;
+    char *module_name = NULL, *graph = NULL;
     struct filter *fltr = NULL, *filter = NULL;
 
     if (is_sink_input) {
@@ -443,8 +488,21 @@ static pa_hook_result_t process(struct userdata *u, pa_object *o, bool is_sink_i
         if (!module)
             goto done;
 
-        module_name = pa_sprintf_malloc("module-%s", want);
-        if (pa_streq(module->name, module_name)) {
+        if (is_filter_chain(want)) {
+            if (!is_sink_input) {
+                pa_log_debug("Filter chains are only supported for sink inputs. Ignoring.");
+                goto done;
+            }
+
+            /* The filter graph sink is told apart from others running
+             * different filters or parameters by its filters= argument. */
+            graph = get_filter_graph(PA_SINK_INPUT(o), want);
+            want = graph;
+        }
+
+        module_name = graph ? pa_xstrdup(FILTER_GRAPH_MODULE) : pa_sprintf_malloc("module-%s", want);
+        if (pa_streq(module->name, module_name) &&
+            (!graph || pa_safe_streq(pa_proplist_gets(sink->proplist, PA_PROP_FILTER_GRAPH_FILTERS), graph))) {
             pa_log_debug("Stream appears to be playing on an appropriate sink already. Ignoring.");
             goto done;
         }
@@ -457,14 +515,21 @@ static pa_hook_result_t process(struct userdata *u, pa_object *o, bool is_sink_i
         }
 
         if (!(filter = pa_hashmap_get(u->filters, fltr))) {
-            char *args;
+            char *args, *filters = NULL;
             pa_module *m;
 
-            args = pa_sprintf_malloc("autoloaded=1 %s%s %s%s",
+            if (graph)
+                filters = pa_escape(graph, "\"");
+
+            args = pa_sprintf_malloc("autoloaded=1 %s%s %s%s %s%s%s",
                     fltr->sink_master ? "sink_master=" : "",
                     fltr->sink_master ? fltr->sink_master->name : "",
                     fltr->source_master ? "source_master=" : "",
-                    fltr->source_master ? fltr->source_master->name : "");
+                    fltr->source_master ? fltr->source_master->name : "",
+                    filters ? "filters=\"" : "",
+                    filters ? filters : "",
+                    filters ? "\"" : "");
+            pa_xfree(filters);
 
             pa_log_debug("Loading %s with arguments '%s'", module_name, args);
 
@@ -506,6 +571,7 @@ static pa_hook_result_t process(struct userdata *u, pa_object *o, bool is_sink_i
 
 done:
     pa_xfree(module_name);
+    pa_xfree(graph);
     pa_xfree(fltr);
 
     return PA_HOOK_OK;
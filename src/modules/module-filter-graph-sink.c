@@ -0,0 +1,1465 @@
+/***
+    This file is part of PulseAudio.
+
+    PulseAudio is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 2.1 of the License,
+    or (at your option) any later version.
+
+    PulseAudio is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+
+#include <pulse/gccmacro.h>
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/i18n.h>
+#include <pulsecore/namereg.h>
+#include <pulsecore/sink.h>
+#include <pulsecore/module.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/modargs.h>
+#include <pulsecore/log.h>
+#include <pulsecore/rtpoll.h>
+#include <pulsecore/strbuf.h>
+#include <pulsecore/filter/biquad-cascade.h>
+#include <pulsecore/filter/planar.h>
+
+#include "module-filter-graph-sink-symdef.h"
+#include "ladspa-util.h"
+
+PA_MODULE_DESCRIPTION(_("Sink running several filter stages"));
+PA_MODULE_VERSION(PACKAGE_VERSION);
+PA_MODULE_LOAD_ONCE(false);
+PA_MODULE_USAGE(
+        _("sink_name=<name for the sink> "
+          "sink_properties=<properties for the sink> "
+          "sink_master=<name of sink to filter> "
+          "rate=<sample rate> "
+          "channels=<number of channels> "
+          "channel_map=<channel map> "
+          "stages=<'|' separated list of type[:arguments]> "
+          "filters=<'|' separated list of filter[:arguments]> "
+          "autoloaded=<set if this module is being loaded automatically> "
+          "use_volume_sharing=<yes or no> "
+          "force_flat_volume=<yes or no> "
+        ));
+
+/* Stacking filter sinks costs a sink, a sink input, a memblockq and a
+ * rewind per filter. This sink instead runs all stages of a filter graph
+ * one after the other, in place on one float buffer per channel. The
+ * stages are
+ *
+ *   peq:<bands>    biquad bands as taken by module-parametric-eq-sink
+ *   ladspa:<plugin>:<label>[:<control>]
+ *                  a LADSPA plugin with the same number of audio inputs
+ *                  and outputs. control is a comma separated list of values
+ *                  as taken by module-ladspa-sink, all defaults if omitted
+ *   gain:<dB>      a fixed gain
+ *   delay:<msec>   delays all channels
+ *
+ * e.g. stages="peq:lowshelf:100::3,peaking:1000:1.4:-6|gain:-3".
+ *
+ * Alternatively filters= takes the names module-filter-apply uses for the
+ * filters that have a stage doing the same, each with the arguments of that
+ * stage, e.g.
+ *
+ *   filters="ladspa-sink:amp:amp_stereo:2|parametric-eq-sink:highpass:40"
+ *
+ * This is how module-filter-apply collapses a chain of filters into one
+ * sink.
+ *
+ * The state of all stages is saved at intervals spread over max_rewind. A
+ * rewind restores the nearest earlier state and runs the graph from there
+ * up to the rewind target, using the history kept in the memblockq, like
+ * module-parametric-eq-sink does for its filters. LADSPA plugins can't save
+ * their state, so they are reset there instead, as module-ladspa-sink does
+ * on every rewind. */
+
+#define MEMBLOCKQ_MAXLENGTH (16*1024*1024)
+
+#define DEFAULT_AUTOLOADED false
+
+#define FILTER_GRAPH_MAX_STAGES 16
+#define FILTER_GRAPH_MAX_DELAY_MSEC 1000
+#define STAGE_DELIMITER "|"
+
+/* Frames a LADSPA plugin that can't run in place is run for at a time */
+#define LADSPA_SCRATCH_FRAMES 1024
+
+/* Stage states saved for rewinding. They are spread over max_rewind, at
+ * least GRAPH_MIN_SAVE_INTERVAL frames apart. */
+#define GRAPH_SAVED_STATES 64
+#define GRAPH_MIN_SAVE_INTERVAL 256
+
+struct stage_type {
+    const char *name;
+
+    /* What module-filter-apply calls the filter this stage replaces, or
+     * NULL */
+    const char *filter;
+
+    /* args is NULL when the stage was given without arguments. Returns NULL
+     * on invalid arguments. */
+    void *(*init)(const char *args, unsigned channels, uint32_t rate);
+    void (*done)(void *data);
+
+    /* Filters one buffer per channel in place. */
+    void (*process)(void *data, float * const *planes, unsigned n);
+
+    /* The history of the stage can be saved and restored later for
+     * rewinding. The size doesn't change after init. All three are NULL
+     * for stages without history. */
+    size_t (*state_size)(void *data);
+    void (*save)(void *data, void *state);
+    void (*restore)(void *data, const void *state);
+
+    /* Drops the history of a stage that can't save it. Called when the
+     * other stages are restored for a rewind. May be NULL. */
+    void (*reset)(void *data);
+
+    /* Called from I/O thread context with how many frames past a saved
+     * state the stage may be rewound by. Saved states are dropped
+     * afterwards. May be NULL. */
+    void (*set_max_rewind)(void *data, unsigned frames);
+
+    /* Frames the stage delays the audio by. May be NULL. */
+    unsigned (*get_delay)(void *data);
+};
+
+struct stage {
+    const struct stage_type *type;
+    void *data;
+};
+
+struct saved_state {
+    int64_t index;
+    /* The states of all stages, one after the other */
+    void *state;
+};
+
+struct userdata {
+    pa_module *module;
+
+    pa_sink *sink;
+    pa_sink_input *sink_input;
+
+    pa_memblockq *memblockq;
+
+    bool auto_desc;
+    bool autoloaded;
+    unsigned channels;
+
+    struct stage stages[FILTER_GRAPH_MAX_STAGES];
+    unsigned n_stages;
+
+    /* Sum of the delays of all stages */
+    unsigned delay;
+
+    size_t block_size;
+    pa_planar planes;
+
+    size_t state_size;
+
+    /* Everything below is only accessed from the I/O thread once the sink
+     * is put. */
+
+    /* Frames run through the stages so far, rewinds included */
+    int64_t index;
+    int64_t next_save;
+    unsigned save_interval;
+    struct saved_state saved[GRAPH_SAVED_STATES];
+    unsigned saved_first;
+    unsigned n_saved;
+};
+
+static const char* const valid_modargs[] = {
+    "sink_name",
+    "sink_properties",
+    "sink_master",
+    "rate",
+    "channels",
+    "channel_map",
+    "stages",
+    "filters",
+    "autoloaded",
+    "use_volume_sharing",
+    "force_flat_volume",
+    NULL
+};
+
+static void *peq_init(const char *args, unsigned channels, uint32_t rate) {
+    return pa_biquad_cascade_new_from_bands(args ? args : "", channels, rate);
+}
+
+static void peq_done(void *data) {
+    pa_biquad_cascade_free(data);
+}
+
+static void peq_process(void *data, float * const *planes, unsigned n) {
+    pa_biquad_cascade_process_planar(data, planes, n);
+}
+
+static size_t peq_state_size(void *data) {
+    return pa_biquad_cascade_state_size(data);
+}
+
+static void peq_save(void *data, void *state) {
+    pa_biquad_cascade_save(data, state);
+}
+
+static void peq_restore(void *data, const void *state) {
+    pa_biquad_cascade_restore(data, state);
+}
+
+struct gain {
+    unsigned channels;
+    float factor;
+};
+
+static void *gain_init(const char *args, unsigned channels, uint32_t rate) {
+    struct gain *g;
+    double db;
+
+    if (!args || pa_atod(args, &db) < 0) {
+        pa_log("Invalid gain '%s'", pa_strnull(args));
+        return NULL;
+    }
+
+    g = pa_xnew(struct gain, 1);
+    g->channels = channels;
+    g->factor = (float) pow(10.0, db / 20.0);
+
+    return g;
+}
+
+static void gain_done(void *data) {
+    pa_xfree(data);
+}
+
+static void gain_process(void *data, float * const *planes, unsigned n) {
+    struct gain *g = data;
+    unsigned c, i;
+
+    for (c = 0; c < g->channels; c++)
+        for (i = 0; i < n; i++)
+            planes[c][i] *= g->factor;
+}
+
+struct delay {
+    unsigned channels;
+    unsigned frames;
+    /* The last size samples of each channel, as a ring the next sample is
+     * written to at index. The ring is longer than the delay by as much as
+     * the stage may be rewound by, so a rewind only moves index back. */
+    unsigned size;
+    unsigned index;
+    float *history[PA_CHANNELS_MAX];
+};
+
+static void *delay_init(const char *args, unsigned channels, uint32_t rate) {
+    struct delay *d;
+    uint32_t msec;
+    unsigned c;
+
+    if (!args || pa_atou(args, &msec) < 0 || msec == 0 || msec > FILTER_GRAPH_MAX_DELAY_MSEC) {
+        pa_log("Invalid delay '%s', expected 1 to %u msec", pa_strnull(args), FILTER_GRAPH_MAX_DELAY_MSEC);
+        return NULL;
+    }
+
+    d = pa_xnew0(struct delay, 1);
+    d->channels = channels;
+    d->frames = PA_MAX((unsigned) (((uint64_t) rate * msec) / 1000), 1U);
+    d->size = d->frames + 1;
+
+    for (c = 0; c < channels; c++)
+        d->history[c] = pa_xnew0(float, d->size);
+
+    return d;
+}
+
+static void delay_done(void *data) {
+    struct delay *d = data;
+    unsigned c;
+
+    for (c = 0; c < d->channels; c++)
+        pa_xfree(d->history[c]);
+
+    pa_xfree(d);
+}
+
+static void delay_process(void *data, float * const *planes, unsigned n) {
+    struct delay *d = data;
+    unsigned c, i, index, read;
+
+    for (c = 0; c < d->channels; c++) {
+        float *h = d->history[c];
+
+        index = d->index;
+        read = index >= d->frames ? index - d->frames : index + d->size - d->frames;
+
+        for (i = 0; i < n; i++) {
+            h[index] = planes[c][i];
+            planes[c][i] = h[read];
+
+            if (++index == d->size)
+                index = 0;
+            if (++read == d->size)
+                read = 0;
+        }
+    }
+
+    d->index = (unsigned) (((uint64_t) d->index + n) % d->size);
+}
+
+static size_t delay_state_size(void *data) {
+    return sizeof(unsigned);
+}
+
+static void delay_save(void *data, void *state) {
+    memcpy(state, &((struct delay *) data)->index, sizeof(unsigned));
+}
+
+static void delay_restore(void *data, const void *state) {
+    memcpy(&((struct delay *) data)->index, state, sizeof(unsigned));
+}
+
+static void delay_set_max_rewind(void *data, unsigned frames) {
+    struct delay *d = data;
+    unsigned size, keep, c, i;
+
+    size = d->frames + frames + 1;
+    if (size == d->size)
+        return;
+
+    /* Keep the newest samples, oldest first. */
+    keep = PA_MIN(size, d->size);
+
+    for (c = 0; c < d->channels; c++) {
+        float *h = pa_xnew0(float, size);
+
+        for (i = 0; i < keep; i++)
+            h[i] = d->history[c][(d->index + d->size - keep + i) % d->size];
+
+        pa_xfree(d->history[c]);
+        d->history[c] = h;
+    }
+
+    d->index = keep % size;
+    d->size = size;
+}
+
+static unsigned delay_get_delay(void *data) {
+    return ((struct delay *) data)->frames;
+}
+
+struct ladspa {
+    lt_dlhandle dl;
+    const LADSPA_Descriptor *descriptor;
+    bool active;
+
+    /* Instance h handles the n_ports channels starting at h * n_ports. */
+    LADSPA_Handle handle[PA_CHANNELS_MAX];
+    unsigned n_instances;
+    unsigned long input[PA_CHANNELS_MAX], output[PA_CHANNELS_MAX];
+    unsigned long n_ports;
+
+    LADSPA_Data *control;
+    /* Every port must be connected, the control outputs all go here. */
+    LADSPA_Data control_out;
+
+    /* What plugins that can't run in place write to, unallocated for the
+     * others */
+    pa_planar scratch;
+};
+
+static void ladspa_done(void *data) {
+    struct ladspa *l = data;
+    unsigned h;
+
+    for (h = 0; h < l->n_instances; h++) {
+        if (l->active && l->descriptor->deactivate)
+            l->descriptor->deactivate(l->handle[h]);
+        l->descriptor->cleanup(l->handle[h]);
+    }
+
+    if (l->dl)
+        lt_dlclose(l->dl);
+
+    pa_planar_free(&l->scratch);
+    pa_xfree(l->control);
+    pa_xfree(l);
+}
+
+/* Sets the n_control input control ports from a comma separated list of
+ * values, all defaults if controls is NULL. */
+static int ladspa_set_controls(struct ladspa *l, const char *controls, unsigned long n_control, uint32_t rate) {
+    const LADSPA_Descriptor *d = l->descriptor;
+    double *values;
+    bool *use_default;
+    unsigned long p, k = 0;
+    unsigned h;
+    int r = -1;
+
+    values = pa_xnew0(double, PA_MAX(n_control, 1UL));
+    use_default = pa_xnew0(bool, PA_MAX(n_control, 1UL));
+    l->control = pa_xnew0(LADSPA_Data, PA_MAX(n_control, 1UL));
+
+    if (controls) {
+        if (pa_ladspa_parse_controls(controls, n_control, values, use_default) < 0)
+            goto finish;
+    } else
+        for (k = 0; k < n_control; k++)
+            use_default[k] = true;
+
+    /* p iterates over all ports, k over the input control ports */
+    for (p = 0, k = 0; p < d->PortCount; p++) {
+        LADSPA_Data *port;
+
+        if (!LADSPA_IS_PORT_CONTROL(d->PortDescriptors[p]))
+            continue;
+
+        if (LADSPA_IS_PORT_OUTPUT(d->PortDescriptors[p]))
+            port = &l->control_out;
+        else {
+            port = &l->control[k];
+
+            if (use_default[k]) {
+                if (pa_ladspa_control_default(d, p, rate, port) < 0)
+                    goto finish;
+            } else {
+                if (pa_ladspa_control_check(d, p, rate, values[k]) < 0)
+                    goto finish;
+
+                if (LADSPA_IS_HINT_INTEGER(d->PortRangeHints[p].HintDescriptor))
+                    *port = roundf(values[k]);
+                else
+                    *port = (LADSPA_Data) values[k];
+            }
+
+            k++;
+        }
+
+        for (h = 0; h < l->n_instances; h++)
+            d->connect_port(l->handle[h], p, port);
+    }
+
+    r = 0;
+
+finish:
+    pa_xfree(values);
+    pa_xfree(use_default);
+
+    return r;
+}
+
+static void *ladspa_init(const char *args, unsigned channels, uint32_t rate) {
+    struct ladspa *l;
+    const LADSPA_Descriptor *d;
+    unsigned long p, n_inputs = 0, n_outputs = 0, n_control = 0;
+    char *plugin, *label, *controls;
+    unsigned h;
+
+    if (!args || !strchr(args, ':')) {
+        pa_log("Invalid LADSPA stage '%s', expected <plugin>:<label>[:<control>]", pa_strnull(args));
+        return NULL;
+    }
+
+    plugin = pa_xstrdup(args);
+    label = strchr(plugin, ':');
+    *(label++) = 0;
+    if ((controls = strchr(label, ':')))
+        *(controls++) = 0;
+
+    l = pa_xnew0(struct ladspa, 1);
+
+    if (pa_ladspa_plugin_load(plugin, label, &l->dl, &l->descriptor) < 0)
+        goto fail;
+
+    d = l->descriptor;
+
+    for (p = 0; p < d->PortCount; p++) {
+        if (LADSPA_IS_PORT_AUDIO(d->PortDescriptors[p])) {
+            if (LADSPA_IS_PORT_INPUT(d->PortDescriptors[p])) {
+                if (n_inputs == PA_CHANNELS_MAX) {
+                    pa_log("Too many audio input ports");
+                    goto fail;
+                }
+
+                l->input[n_inputs++] = p;
+            } else if (LADSPA_IS_PORT_OUTPUT(d->PortDescriptors[p])) {
+                if (n_outputs == PA_CHANNELS_MAX) {
+                    pa_log("Too many audio output ports");
+                    goto fail;
+                }
+
+                l->output[n_outputs++] = p;
+            }
+        } else if (LADSPA_IS_PORT_CONTROL(d->PortDescriptors[p]) && LADSPA_IS_PORT_INPUT(d->PortDescriptors[p]))
+            n_control++;
+    }
+
+    /* The stage works in place on the channel buffers, so it can't mix
+     * channels up or down. */
+    if (n_inputs == 0 || n_inputs != n_outputs) {
+        pa_log("Plugin %s has %lu audio inputs and %lu outputs, expected the same number", d->Label, n_inputs, n_outputs);
+        goto fail;
+    }
+
+    if (channels % n_inputs) {
+        pa_log("Cannot handle non-integral number of plugins required for given number of channels");
+        goto fail;
+    }
+
+    l->n_ports = n_inputs;
+
+    for (h = 0; h < channels / l->n_ports; h++) {
+        if (!(l->handle[h] = d->instantiate(d, rate))) {
+            pa_log("Failed to instantiate plugin %s with label %s", plugin, d->Label);
+            goto fail;
+        }
+
+        l->n_instances++;
+    }
+
+    if (ladspa_set_controls(l, controls, n_control, rate) < 0)
+        goto fail;
+
+    if (LADSPA_IS_INPLACE_BROKEN(d->Properties)) {
+        pa_log_debug("Plugin %s can't run in place", d->Label);
+        pa_planar_alloc(&l->scratch, channels, LADSPA_SCRATCH_FRAMES);
+    }
+
+    if (d->activate)
+        for (h = 0; h < l->n_instances; h++)
+            d->activate(l->handle[h]);
+    l->active = true;
+
+    pa_xfree(plugin);
+
+    return l;
+
+fail:
+    pa_xfree(plugin);
+    ladspa_done(l);
+
+    return NULL;
+}
+
+static void ladspa_connect(struct ladspa *l, float * const *in, float * const *out) {
+    unsigned h;
+    unsigned long c;
+
+    for (h = 0; h < l->n_instances; h++)
+        for (c = 0; c < l->n_ports; c++) {
+            l->descriptor->connect_port(l->handle[h], l->input[c], in[h * l->n_ports + c]);
+            l->descriptor->connect_port(l->handle[h], l->output[c], out[h * l->n_ports + c]);
+        }
+}
+
+static void ladspa_process(void *data, float * const *planes, unsigned n) {
+    struct ladspa *l = data;
+    float *in[PA_CHANNELS_MAX];
+    unsigned h, c, k, done;
+
+    /* The graph hands over different parts of its buffers from call to
+     * call, so the audio ports are connected every time. */
+    if (!l->scratch.data) {
+        ladspa_connect(l, planes, planes);
+
+        for (h = 0; h < l->n_instances; h++)
+            l->descriptor->run(l->handle[h], n);
+
+        return;
+    }
+
+    for (done = 0; done < n; done += k) {
+        k = PA_MIN(n - done, (unsigned) LADSPA_SCRATCH_FRAMES);
+
+        for (c = 0; c < l->scratch.channels; c++)
+            in[c] = planes[c] + done;
+
+        ladspa_connect(l, in, l->scratch.plane);
+
+        for (h = 0; h < l->n_instances; h++)
+            l->descriptor->run(l->handle[h], k);
+
+        for (c = 0; c < l->scratch.channels; c++)
+            memcpy(in[c], l->scratch.plane[c], k * sizeof(float));
+    }
+}
+
+static void ladspa_reset(void *data) {
+    struct ladspa *l = data;
+    unsigned h;
+
+    if (l->descriptor->deactivate)
+        for (h = 0; h < l->n_instances; h++)
+            l->descriptor->deactivate(l->handle[h]);
+    if (l->descriptor->activate)
+        for (h = 0; h < l->n_instances; h++)
+            l->descriptor->activate(l->handle[h]);
+}
+
+static const struct stage_type stage_types[] = {
+    {
+        .name = "peq",
+        .filter = "parametric-eq-sink",
+        .init = peq_init,
+        .done = peq_done,
+        .process = peq_process,
+        .state_size = peq_state_size,
+        .save = peq_save,
+        .restore = peq_restore,
+    },
+    {
+        .name = "ladspa",
+        .filter = "ladspa-sink",
+        .init = ladspa_init,
+        .done = ladspa_done,
+        .process = ladspa_process,
+        .reset = ladspa_reset,
+    },
+    {
+        .name = "gain",
+        .init = gain_init,
+        .done = gain_done,
+        .process = gain_process,
+    },
+    {
+        .name = "delay",
+        .init = delay_init,
+        .done = delay_done,
+        .process = delay_process,
+        .state_size = delay_state_size,
+        .save = delay_save,
+        .restore = delay_restore,
+        .set_max_rewind = delay_set_max_rewind,
+        .get_delay = delay_get_delay,
+    },
+};
+
+static const struct stage_type *find_stage_type(const char *name, bool by_filter) {
+    unsigned i;
+
+    for (i = 0; i < PA_ELEMENTSOF(stage_types); i++) {
+        const char *n = by_filter ? stage_types[i].filter : stage_types[i].name;
+
+        if (n && pa_streq(n, name))
+            return &stage_types[i];
+    }
+
+    return NULL;
+}
+
+static int add_stage(struct userdata *u, const struct stage_type *type, const char *args, uint32_t rate) {
+    struct stage *s;
+
+    if (u->n_stages >= FILTER_GRAPH_MAX_STAGES) {
+        pa_log("At most %u stages are supported", FILTER_GRAPH_MAX_STAGES);
+        return -1;
+    }
+
+    s = &u->stages[u->n_stages];
+
+    if (!(s->data = type->init(args, u->channels, rate))) {
+        pa_log("Failed to set up %s stage", type->name);
+        return -1;
+    }
+
+    s->type = type;
+    u->n_stages++;
+
+    if (type->get_delay)
+        u->delay += type->get_delay(s->data);
+
+    if (type->state_size)
+        u->state_size += type->state_size(s->data);
+
+    return 0;
+}
+
+/* Parses a list of type[:arguments] stages, or of filter[:arguments] ones if
+ * by_filter is set. */
+static int parse_stages(struct userdata *u, const char *stages, bool by_filter, uint32_t rate) {
+    const char *state = NULL;
+    char *stage;
+
+    while ((stage = pa_split(stages, STAGE_DELIMITER, &state))) {
+        const struct stage_type *type;
+        char *args;
+
+        if ((args = strchr(stage, ':')))
+            *(args++) = 0;
+
+        if (!(type = find_stage_type(stage, by_filter))) {
+            pa_log(by_filter ? "No stage for filter '%s'" : "Unknown stage type '%s'", stage);
+            pa_xfree(stage);
+            return -1;
+        }
+
+        if (add_stage(u, type, args, rate) < 0) {
+            pa_xfree(stage);
+            return -1;
+        }
+
+        pa_xfree(stage);
+    }
+
+    return 0;
+}
+
+/* Called from I/O thread context */
+static void save_state(struct userdata *u) {
+    struct saved_state *s = NULL;
+    uint8_t *p;
+    unsigned i;
+
+    if (u->n_saved > 0) {
+        s = &u->saved[(u->saved_first + u->n_saved - 1) % GRAPH_SAVED_STATES];
+        if (s->index != u->index)
+            s = NULL;
+    }
+
+    if (!s) {
+        if (u->n_saved == GRAPH_SAVED_STATES) {
+            u->saved_first = (u->saved_first + 1) % GRAPH_SAVED_STATES;
+            u->n_saved--;
+        }
+
+        s = &u->saved[(u->saved_first + u->n_saved) % GRAPH_SAVED_STATES];
+        s->index = u->index;
+        u->n_saved++;
+    }
+
+    p = s->state;
+    for (i = 0; i < u->n_stages; i++)
+        if (u->stages[i].type->save) {
+            u->stages[i].type->save(u->stages[i].data, p);
+            p += u->stages[i].type->state_size(u->stages[i].data);
+        }
+}
+
+/* Called from I/O thread context */
+static void restore_state(struct userdata *u, const struct saved_state *s) {
+    const uint8_t *p = s->state;
+    unsigned i;
+
+    for (i = 0; i < u->n_stages; i++)
+        if (u->stages[i].type->restore) {
+            u->stages[i].type->restore(u->stages[i].data, p);
+            p += u->stages[i].type->state_size(u->stages[i].data);
+        }
+
+    u->index = s->index;
+}
+
+/* Called from I/O thread context. Runs all stages over the first n frames
+ * of the planes, saving their state on the way. */
+static void process(struct userdata *u, unsigned n) {
+    float *planes[PA_CHANNELS_MAX];
+    unsigned done = 0, k, c, i;
+
+    while (done < n) {
+        if (u->index >= u->next_save) {
+            save_state(u);
+            u->next_save = u->index + u->save_interval;
+        }
+
+        k = (unsigned) PA_MIN((int64_t) (n - done), u->next_save - u->index);
+
+        for (c = 0; c < u->channels; c++)
+            planes[c] = u->planes.plane[c] + done;
+
+        for (i = 0; i < u->n_stages; i++)
+            u->stages[i].type->process(u->stages[i].data, planes, k);
+
+        u->index += k;
+        done += k;
+    }
+}
+
+/* Called from I/O thread context. Rewinds the memblockq by nbytes and puts
+ * the stages into the state they had there. */
+static void rewind_stages(struct userdata *u, size_t nbytes) {
+    size_t fs = pa_frame_size(&u->sink->sample_spec);
+    int64_t target = u->index - (int64_t) (nbytes / fs);
+    struct saved_state *s = NULL;
+    size_t ff;
+    unsigned i;
+
+    while (u->n_saved > 0) {
+        s = &u->saved[(u->saved_first + u->n_saved - 1) % GRAPH_SAVED_STATES];
+        if (s->index <= target)
+            break;
+        u->n_saved--;
+        s = NULL;
+    }
+
+    if (!s) {
+        /* Keeping the current history clicks less than starting over from
+         * silence. */
+        pa_log_debug("No saved stage state for rewinding %lu bytes", (unsigned long) nbytes);
+        pa_memblockq_rewind(u->memblockq, nbytes);
+        u->index = target;
+        u->next_save = u->index;
+        return;
+    }
+
+    restore_state(u, s);
+    u->next_save = u->index + u->save_interval;
+
+    for (i = 0; i < u->n_stages; i++)
+        if (u->stages[i].type->reset)
+            u->stages[i].type->reset(u->stages[i].data);
+
+    /* Run the graph from the saved state up to the rewind target. */
+    ff = (size_t) (target - s->index) * fs;
+    pa_memblockq_rewind(u->memblockq, nbytes + ff);
+
+    while (ff > 0) {
+        pa_memchunk tchunk;
+        const float *src;
+        unsigned n;
+
+        if (pa_memblockq_peek(u->memblockq, &tchunk) < 0) {
+            pa_log_debug("Hole in the stream, cannot fast forward the stages");
+            pa_memblockq_drop(u->memblockq, ff);
+            u->index = target;
+            u->next_save = u->index;
+            break;
+        }
+
+        n = (unsigned) (PA_MIN(PA_MIN(tchunk.length, ff), u->block_size) / fs);
+
+        src = pa_memblock_acquire_chunk(&tchunk);
+        pa_planar_import(&u->planes, 0, src, n);
+        pa_memblock_release(tchunk.memblock);
+        pa_memblock_unref(tchunk.memblock);
+
+        process(u, n);
+
+        pa_memblockq_drop(u->memblockq, n * fs);
+        ff -= n * fs;
+    }
+}
+
+/* Called from I/O thread context */
+static int sink_process_msg_cb(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
+    struct userdata *u = PA_SINK(o)->userdata;
+
+    switch (code) {
+
+        case PA_SINK_MESSAGE_GET_LATENCY:
+
+            /* The sink is _put() before the sink input is, so let's
+             * make sure we don't access it in that time. Also, the
+             * sink input is first shut down, the sink second. */
+            if (!PA_SINK_IS_LINKED(u->sink->thread_info.state) ||
+                !PA_SINK_INPUT_IS_LINKED(u->sink_input->thread_info.state)) {
+                *((pa_usec_t*) data) = 0;
+                return 0;
+            }
+
+            *((pa_usec_t*) data) =
+
+                /* Get the latency of the master sink */
+                pa_sink_get_latency_within_thread(u->sink_input->sink) +
+
+                /* Add the latency internal to our sink input on top */
+                pa_bytes_to_usec(pa_memblockq_get_length(u->sink_input->thread_info.render_memblockq), &u->sink_input->sink->sample_spec) +
+
+                /* And the delay of the stages */
+                pa_bytes_to_usec(u->delay * pa_frame_size(&u->sink->sample_spec), &u->sink->sample_spec);
+
+            return 0;
+    }
+
+    return pa_sink_process_msg(o, code, data, offset, chunk);
+}
+
+/* Called from main context */
+static int sink_set_state_cb(pa_sink *s, pa_sink_state_t state) {
+    struct userdata *u;
+
+    pa_sink_assert_ref(s);
+    pa_assert_se(u = s->userdata);
+
+    if (!PA_SINK_IS_LINKED(state) ||
+        !PA_SINK_INPUT_IS_LINKED(pa_sink_input_get_state(u->sink_input)))
+        return 0;
+
+    pa_sink_input_cork(u->sink_input, state == PA_SINK_SUSPENDED);
+    return 0;
+}
+
+/* Called from I/O thread context */
+static void sink_request_rewind_cb(pa_sink *s) {
+    struct userdata *u;
+
+    pa_sink_assert_ref(s);
+    pa_assert_se(u = s->userdata);
+
+    if (!PA_SINK_IS_LINKED(u->sink->thread_info.state) ||
+        !PA_SINK_INPUT_IS_LINKED(u->sink_input->thread_info.state))
+        return;
+
+    /* Just hand this one over to the master sink */
+    pa_sink_input_request_rewind(u->sink_input,
+                                 s->thread_info.rewind_nbytes +
+                                 pa_memblockq_get_length(u->memblockq), true, false, false);
+}
+
+/* Called from I/O thread context */
+static void sink_update_requested_latency_cb(pa_sink *s) {
+    struct userdata *u;
+
+    pa_sink_assert_ref(s);
+    pa_assert_se(u = s->userdata);
+
+    if (!PA_SINK_IS_LINKED(u->sink->thread_info.state) ||
+        !PA_SINK_INPUT_IS_LINKED(u->sink_input->thread_info.state))
+        return;
+
+    /* Just hand this one over to the master sink */
+    pa_sink_input_set_requested_latency_within_thread(
+            u->sink_input,
+            pa_sink_get_requested_latency_within_thread(s));
+}
+
+/* Called from main context */
+static void sink_set_volume_cb(pa_sink *s) {
+    struct userdata *u;
+
+    pa_sink_assert_ref(s);
+    pa_assert_se(u = s->userdata);
+
+    if (!PA_SINK_IS_LINKED(pa_sink_get_state(s)) ||
+        !PA_SINK_INPUT_IS_LINKED(pa_sink_input_get_state(u->sink_input)))
+        return;
+
+    pa_sink_input_set_volume(u->sink_input, &s->real_volume, s->save_volume, true);
+}
+
+/* Called from main context */
+static void sink_set_mute_cb(pa_sink *s) {
+    struct userdata *u;
+
+    pa_sink_assert_ref(s);
+    pa_assert_se(u = s->userdata);
+
+    if (!PA_SINK_IS_LINKED(pa_sink_get_state(s)) ||
+        !PA_SINK_INPUT_IS_LINKED(pa_sink_input_get_state(u->sink_input)))
+        return;
+
+    pa_sink_input_set_mute(u->sink_input, s->muted, s->save_muted);
+}
+
+/* Called from I/O thread context */
+static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk) {
+    struct userdata *u;
+    float *src, *dst;
+    size_t fs;
+    unsigned n;
+    pa_memchunk tchunk;
+
+    pa_sink_input_assert_ref(i);
+    pa_assert(chunk);
+    pa_assert_se(u = i->userdata);
+
+    /* Hmm, process any rewind request that might be queued up */
+    pa_sink_process_rewind(u->sink, 0);
+
+    while (pa_memblockq_peek(u->memblockq, &tchunk) < 0) {
+        pa_memchunk nchunk;
+
+        pa_sink_render(u->sink, nbytes, &nchunk);
+        pa_memblockq_push(u->memblockq, &nchunk);
+        pa_memblock_unref(nchunk.memblock);
+    }
+
+    tchunk.length = PA_MIN(nbytes, tchunk.length);
+    pa_assert(tchunk.length > 0);
+
+    fs = pa_frame_size(&i->sample_spec);
+    n = (unsigned) (PA_MIN(tchunk.length, u->block_size) / fs);
+
+    pa_assert(n > 0);
+
+    chunk->index = 0;
+    chunk->length = n*fs;
+    chunk->memblock = pa_memblock_new(i->sink->core->mempool, chunk->length);
+
+    pa_memblockq_drop(u->memblockq, chunk->length);
+
+    src = pa_memblock_acquire_chunk(&tchunk);
+    pa_planar_import(&u->planes, 0, src, n);
+    pa_memblock_release(tchunk.memblock);
+    pa_memblock_unref(tchunk.memblock);
+
+    process(u, n);
+
+    dst = pa_memblock_acquire(chunk->memblock);
+    pa_planar_export(&u->planes, 0, dst, n);
+    pa_memblock_release(chunk->memblock);
+
+    return 0;
+}
+
+/* Called from I/O thread context */
+static void sink_input_process_rewind_cb(pa_sink_input *i, size_t nbytes) {
+    struct userdata *u;
+    size_t amount = 0;
+
+    pa_sink_input_assert_ref(i);
+    pa_assert_se(u = i->userdata);
+
+    if (u->sink->thread_info.rewind_nbytes > 0) {
+        size_t max_rewrite;
+
+        max_rewrite = nbytes + pa_memblockq_get_length(u->memblockq);
+        amount = PA_MIN(u->sink->thread_info.rewind_nbytes, max_rewrite);
+        u->sink->thread_info.rewind_nbytes = 0;
+
+        if (amount > 0)
+            pa_memblockq_seek(u->memblockq, - (int64_t) amount, PA_SEEK_RELATIVE, true);
+    }
+
+    pa_sink_process_rewind(u->sink, amount);
+    rewind_stages(u, nbytes);
+}
+
+/* Called from I/O thread context */
+static void sink_input_update_max_rewind_cb(pa_sink_input *i, size_t nbytes) {
+    struct userdata *u;
+    size_t fs;
+    unsigned k;
+
+    pa_sink_input_assert_ref(i);
+    pa_assert_se(u = i->userdata);
+
+    fs = pa_frame_size(&u->sink->sample_spec);
+    u->save_interval = PA_MAX((unsigned) (nbytes / fs / (GRAPH_SAVED_STATES - 1)), (unsigned) GRAPH_MIN_SAVE_INTERVAL);
+
+    /* Keep enough history to fast forward from the saved states. */
+    pa_memblockq_set_maxrewind(u->memblockq, nbytes + u->save_interval * fs);
+    pa_sink_set_max_rewind_within_thread(u->sink, nbytes);
+
+    for (k = 0; k < u->n_stages; k++)
+        if (u->stages[k].type->set_max_rewind)
+            u->stages[k].type->set_max_rewind(u->stages[k].data, (unsigned) (nbytes / fs) + u->save_interval);
+
+    /* The stages may have changed the layout of their state. */
+    u->n_saved = 0;
+    u->next_save = u->index;
+}
+
+/* Called from I/O thread context */
+static void sink_input_update_max_request_cb(pa_sink_input *i, size_t nbytes) {
+    struct userdata *u;
+
+    pa_sink_input_assert_ref(i);
+    pa_assert_se(u = i->userdata);
+
+    pa_sink_set_max_request_within_thread(u->sink, nbytes);
+}
+
+/* Called from I/O thread context */
+static void sink_input_update_sink_latency_range_cb(pa_sink_input *i) {
+    struct userdata *u;
+
+    pa_sink_input_assert_ref(i);
+    pa_assert_se(u = i->userdata);
+
+    pa_sink_set_latency_range_within_thread(u->sink, i->sink->thread_info.min_latency, i->sink->thread_info.max_latency);
+}
+
+/* Called from I/O thread context */
+static void sink_input_update_sink_fixed_latency_cb(pa_sink_input *i) {
+    struct userdata *u;
+
+    pa_sink_input_assert_ref(i);
+    pa_assert_se(u = i->userdata);
+
+    pa_sink_set_fixed_latency_within_thread(u->sink, i->sink->thread_info.fixed_latency);
+}
+
+/* Called from I/O thread context */
+static void sink_input_detach_cb(pa_sink_input *i) {
+    struct userdata *u;
+
+    pa_sink_input_assert_ref(i);
+    pa_assert_se(u = i->userdata);
+
+    pa_sink_detach_within_thread(u->sink);
+
+    pa_sink_set_rtpoll(u->sink, NULL);
+}
+
+/* Called from I/O thread context */
+static void sink_input_attach_cb(pa_sink_input *i) {
+    struct userdata *u;
+
+    pa_sink_input_assert_ref(i);
+    pa_assert_se(u = i->userdata);
+
+    pa_sink_set_rtpoll(u->sink, i->sink->thread_info.rtpoll);
+    pa_sink_set_latency_range_within_thread(u->sink, i->sink->thread_info.min_latency, i->sink->thread_info.max_latency);
+    pa_sink_set_fixed_latency_within_thread(u->sink, i->sink->thread_info.fixed_latency);
+    pa_sink_set_max_request_within_thread(u->sink, pa_sink_input_get_max_request(i));
+
+    /* FIXME: Too small max_rewind:
+     * https://bugs.freedesktop.org/show_bug.cgi?id=53709 */
+    pa_sink_set_max_rewind_within_thread(u->sink, pa_sink_input_get_max_rewind(i));
+
+    pa_sink_attach_within_thread(u->sink);
+}
+
+/* Called from main context */
+static void sink_input_kill_cb(pa_sink_input *i) {
+    struct userdata *u;
+
+    pa_sink_input_assert_ref(i);
+    pa_assert_se(u = i->userdata);
+
+    /* The order here matters! We first kill the sink input, followed
+     * by the sink. That means the sink callbacks must be protected
+     * against an unconnected sink input! */
+    pa_sink_input_unlink(u->sink_input);
+    pa_sink_unlink(u->sink);
+
+    pa_sink_input_unref(u->sink_input);
+    u->sink_input = NULL;
+
+    pa_sink_unref(u->sink);
+    u->sink = NULL;
+
+    pa_module_unload_request(u->module, true);
+}
+
+/* Called from IO thread context */
+static void sink_input_state_change_cb(pa_sink_input *i, pa_sink_input_state_t state) {
+    struct userdata *u;
+
+    pa_sink_input_assert_ref(i);
+    pa_assert_se(u = i->userdata);
+
+    /* If we are added for the first time, ask for a rewinding so that
+     * we are heard right-away. */
+    if (PA_SINK_INPUT_IS_LINKED(state) &&
+        i->thread_info.state == PA_SINK_INPUT_INIT) {
+        pa_log_debug("Requesting rewind due to state change.");
+        pa_sink_input_request_rewind(i, 0, false, true, true);
+    }
+}
+
+/* Called from main context */
+static void sink_input_moving_cb(pa_sink_input *i, pa_sink *dest) {
+    struct userdata *u;
+
+    pa_sink_input_assert_ref(i);
+    pa_assert_se(u = i->userdata);
+
+    if (u->autoloaded) {
+        /* We were autoloaded, and don't support moving. Let's unload ourselves. */
+        pa_log_debug("Can't move autoloaded stream, unloading");
+        pa_module_unload_request(u->module, true);
+    }
+
+    if (dest) {
+        pa_sink_set_asyncmsgq(u->sink, dest->asyncmsgq);
+        pa_sink_update_flags(u->sink, PA_SINK_LATENCY|PA_SINK_DYNAMIC_LATENCY, dest->flags);
+    } else
+        pa_sink_set_asyncmsgq(u->sink, NULL);
+
+    if (u->auto_desc && dest) {
+        const char *z;
+        pa_proplist *pl;
+
+        pl = pa_proplist_new();
+        z = pa_proplist_gets(dest->proplist, PA_PROP_DEVICE_DESCRIPTION);
+        pa_proplist_setf(pl, PA_PROP_DEVICE_DESCRIPTION, "Filter Graph %s on %s",
+                         pa_proplist_gets(u->sink->proplist, "device.filter_graph.stages"), z ? z : dest->name);
+
+        pa_sink_update_proplist(u->sink, PA_UPDATE_REPLACE, pl);
+        pa_proplist_free(pl);
+    }
+}
+
+/* Called from main context */
+static void sink_input_volume_changed_cb(pa_sink_input *i) {
+    struct userdata *u;
+
+    pa_sink_input_assert_ref(i);
+    pa_assert_se(u = i->userdata);
+
+    pa_sink_volume_changed(u->sink, &i->volume);
+}
+
+/* Called from main context */
+static void sink_input_mute_changed_cb(pa_sink_input *i) {
+    struct userdata *u;
+
+    pa_sink_input_assert_ref(i);
+    pa_assert_se(u = i->userdata);
+
+    pa_sink_mute_changed(u->sink, i->muted);
+}
+
+int pa__init(pa_module*m) {
+    struct userdata *u;
+    pa_sample_spec ss;
+    pa_channel_map map;
+    pa_modargs *ma;
+    pa_sink *master=NULL;
+    pa_sink_input_new_data sink_input_data;
+    pa_sink_new_data sink_data;
+    bool use_volume_sharing = true;
+    bool force_flat_volume = false;
+    const char *stages, *filters;
+    pa_strbuf *names;
+    char *t;
+    pa_memchunk silence;
+    unsigned c;
+
+    pa_assert(m);
+
+    if (!(ma = pa_modargs_new(m->argument, valid_modargs))) {
+        pa_log("Failed to parse module arguments.");
+        goto fail;
+    }
+
+    if (!(master = pa_namereg_get(m->core, pa_modargs_get_value(ma, "sink_master", NULL), PA_NAMEREG_SINK))) {
+        pa_log("Master sink not found");
+        goto fail;
+    }
+
+    pa_assert(master);
+
+    ss = master->sample_spec;
+    ss.format = PA_SAMPLE_FLOAT32;
+    map = master->channel_map;
+    if (pa_modargs_get_sample_spec_and_channel_map(ma, &ss, &map, PA_CHANNEL_MAP_DEFAULT) < 0) {
+        pa_log("Invalid sample format specification or channel map");
+        goto fail;
+    }
+
+    if (pa_modargs_get_value_boolean(ma, "use_volume_sharing", &use_volume_sharing) < 0) {
+        pa_log("use_volume_sharing= expects a boolean argument");
+        goto fail;
+    }
+
+    if (pa_modargs_get_value_boolean(ma, "force_flat_volume", &force_flat_volume) < 0) {
+        pa_log("force_flat_volume= expects a boolean argument");
+        goto fail;
+    }
+
+    if (use_volume_sharing && force_flat_volume) {
+        pa_log("Flat volume can't be forced when using volume sharing.");
+        goto fail;
+    }
+
+    stages = pa_modargs_get_value(ma, "stages", NULL);
+    filters = pa_modargs_get_value(ma, "filters", NULL);
+
+    if (!stages == !filters) {
+        pa_log("Exactly one of stages= and filters= is needed");
+        goto fail;
+    }
+
+    u = pa_xnew0(struct userdata, 1);
+    u->module = m;
+    m->userdata = u;
+    u->channels = ss.channels;
+
+    u->autoloaded = DEFAULT_AUTOLOADED;
+    if (pa_modargs_get_value_boolean(ma, "autoloaded", &u->autoloaded) < 0) {
+        pa_log("Failed to parse autoloaded value");
+        goto fail;
+    }
+
+    if (parse_stages(u, stages ? stages : filters, !stages, ss.rate) < 0)
+        goto fail;
+
+    if (u->n_stages == 0) {
+        pa_log("No filter stages given");
+        goto fail;
+    }
+
+    u->block_size = pa_frame_align(pa_mempool_block_size_max(m->core->mempool), &ss);
+    pa_planar_alloc(&u->planes, u->channels, u->block_size / pa_frame_size(&ss));
+
+    for (c = 0; c < GRAPH_SAVED_STATES; c++)
+        u->saved[c].state = pa_xmalloc(PA_MAX(u->state_size, (size_t) 1));
+    u->save_interval = GRAPH_MIN_SAVE_INTERVAL;
+
+    /* Create sink */
+    pa_sink_new_data_init(&sink_data);
+    sink_data.driver = __FILE__;
+    sink_data.module = m;
+    if (!(sink_data.name = pa_xstrdup(pa_modargs_get_value(ma, "sink_name", NULL))))
+        sink_data.name = pa_sprintf_malloc("%s.filter_graph", master->name);
+    pa_sink_new_data_set_sample_spec(&sink_data, &ss);
+    pa_sink_new_data_set_channel_map(&sink_data, &map);
+    pa_proplist_sets(sink_data.proplist, PA_PROP_DEVICE_MASTER_DEVICE, master->name);
+    pa_proplist_sets(sink_data.proplist, PA_PROP_DEVICE_CLASS, "filter");
+
+    names = pa_strbuf_new();
+    for (c = 0; c < u->n_stages; c++)
+        pa_strbuf_printf(names, "%s%s", c > 0 ? STAGE_DELIMITER : "", u->stages[c].type->name);
+    pa_proplist_sets(sink_data.proplist, "device.filter_graph.stages", (t = pa_strbuf_to_string_free(names)));
+    pa_xfree(t);
+    if (filters)
+        pa_proplist_sets(sink_data.proplist, "device.filter_graph.filters", filters);
+
+    if (pa_modargs_get_proplist(ma, "sink_properties", sink_data.proplist, PA_UPDATE_REPLACE) < 0) {
+        pa_log("Invalid properties");
+        pa_sink_new_data_done(&sink_data);
+        goto fail;
+    }
+
+    if ((u->auto_desc = !pa_proplist_contains(sink_data.proplist, PA_PROP_DEVICE_DESCRIPTION))) {
+        const char *z;
+
+        z = pa_proplist_gets(master->proplist, PA_PROP_DEVICE_DESCRIPTION);
+        pa_proplist_setf(sink_data.proplist, PA_PROP_DEVICE_DESCRIPTION, "Filter Graph %s on %s",
+                         pa_proplist_gets(sink_data.proplist, "device.filter_graph.stages"), z ? z : master->name);
+    }
+
+    u->sink = pa_sink_new(m->core, &sink_data, (master->flags & (PA_SINK_LATENCY|PA_SINK_DYNAMIC_LATENCY))
+                                               | (use_volume_sharing ? PA_SINK_SHARE_VOLUME_WITH_MASTER : 0));
+    pa_sink_new_data_done(&sink_data);
+
+    if (!u->sink) {
+        pa_log("Failed to create sink.");
+        goto fail;
+    }
+
+    u->sink->parent.process_msg = sink_process_msg_cb;
+    u->sink->set_state = sink_set_state_cb;
+    u->sink->update_requested_latency = sink_update_requested_latency_cb;
+    u->sink->request_rewind = sink_request_rewind_cb;
+    pa_sink_set_set_mute_callback(u->sink, sink_set_mute_cb);
+    if (!use_volume_sharing) {
+        pa_sink_set_set_volume_callback(u->sink, sink_set_volume_cb);
+        pa_sink_enable_decibel_volume(u->sink, true);
+    }
+    /* Normally this flag would be enabled automatically be we can force it. */
+    if (force_flat_volume)
+        u->sink->flags |= PA_SINK_FLAT_VOLUME;
+    u->sink->userdata = u;
+
+    pa_sink_set_asyncmsgq(u->sink, master->asyncmsgq);
+
+    /* Create sink input */
+    pa_sink_input_new_data_init(&sink_input_data);
+    sink_input_data.driver = __FILE__;
+    sink_input_data.module = m;
+    pa_sink_input_new_data_set_sink(&sink_input_data, master, false);
+    sink_input_data.origin_sink = u->sink;
+    pa_proplist_setf(sink_input_data.proplist, PA_PROP_MEDIA_NAME, "Filter Graph Stream from %s", pa_proplist_gets(u->sink->proplist, PA_PROP_DEVICE_DESCRIPTION));
+    pa_proplist_sets(sink_input_data.proplist, PA_PROP_MEDIA_ROLE, "filter");
+    pa_sink_input_new_data_set_sample_spec(&sink_input_data, &ss);
+    pa_sink_input_new_data_set_channel_map(&sink_input_data, &map);
+
+    pa_sink_input_new(&u->sink_input, m->core, &sink_input_data);
+    pa_sink_input_new_data_done(&sink_input_data);
+
+    if (!u->sink_input)
+        goto fail;
+
+    u->sink_input->pop = sink_input_pop_cb;
+    u->sink_input->process_rewind = sink_input_process_rewind_cb;
+    u->sink_input->update_max_rewind = sink_input_update_max_rewind_cb;
+    u->sink_input->update_max_request = sink_input_update_max_request_cb;
+    u->sink_input->update_sink_latency_range = sink_input_update_sink_latency_range_cb;
+    u->sink_input->update_sink_fixed_latency = sink_input_update_sink_fixed_latency_cb;
+    u->sink_input->kill = sink_input_kill_cb;
+    u->sink_input->attach = sink_input_attach_cb;
+    u->sink_input->detach = sink_input_detach_cb;
+    u->sink_input->state_change = sink_input_state_change_cb;
+    u->sink_input->moving = sink_input_moving_cb;
+    u->sink_input->volume_changed = use_volume_sharing ? NULL : sink_input_volume_changed_cb;
+    u->sink_input->mute_changed = sink_input_mute_changed_cb;
+    u->sink_input->userdata = u;
+
+    u->sink->input_to_master = u->sink_input;
+
+    pa_sink_input_get_silence(u->sink_input, &silence);
+    u->memblockq = pa_memblockq_new("module-filter-graph-sink memblockq", 0, MEMBLOCKQ_MAXLENGTH, 0, &ss, 1, 1, 0, &silence);
+    pa_memblock_unref(silence.memblock);
+
+    pa_sink_put(u->sink);
+    pa_sink_input_put(u->sink_input);
+
+    pa_modargs_free(ma);
+
+    return 0;
+
+fail:
+    if (ma)
+        pa_modargs_free(ma);
+
+    pa__done(m);
+
+    return -1;
+}
+
+int pa__get_n_used(pa_module *m) {
+    struct userdata *u;
+
+    pa_assert(m);
+    pa_assert_se(u = m->userdata);
+
+    return pa_sink_linked_by(u->sink);
+}
+
+void pa__done(pa_module*m) {
+    struct userdata *u;
+    unsigned i;
+
+    pa_assert(m);
+
+    if (!(u = m->userdata))
+        return;
+
+    /* See comments in sink_input_kill_cb() above regarding
+     * destruction order! */
+
+    if (u->sink_input)
+        pa_sink_input_unlink(u->sink_input);
+
+    if (u->sink)
+        pa_sink_unlink(u->sink);
+
+    if (u->sink_input)
+        pa_sink_input_unref(u->sink_input);
+
+    if (u->sink)
+        pa_sink_unref(u->sink);
+
+    if (u->memblockq)
+        pa_memblockq_free(u->memblockq);
+
+    for (i = 0; i < u->n_stages; i++)
+        u->stages[i].type->done(u->stages[i].data);
+
+    pa_planar_free(&u->planes);
+
+    for (i = 0; i < GRAPH_SAVED_STATES; i++)
+        pa_xfree(u->saved[i].state);
+
+    pa_xfree(u);
+}
@@ -29,6 +29,7 @@
 #include <pulse/xmalloc.h>
 
 #include <pulsecore/i18n.h>
+#include <pulsecore/filter/planar.h>
 #include <pulsecore/namereg.h>
 #include <pulsecore/sink.h>
 #include <pulsecore/module.h>
@@ -37,7 +38,7 @@
 #include <pulsecore/log.h>
 #include <pulsecore/rtpoll.h>
 #include <pulsecore/sample-util.h>
-#include <pulsecore/ltdl-helper.h>
+#include <pulsecore/strbuf.h>
 
 #ifdef HAVE_DBUS
 #include <pulsecore/protocol-dbus.h>
@@ -46,6 +47,7 @@
 
 #include "module-ladspa-sink-symdef.h"
 #include "ladspa.h"
+#include "ladspa-util.h"
 
 PA_MODULE_AUTHOR("Lennart Poettering");
 PA_MODULE_DESCRIPTION(_("Virtual LADSPA sink"));
@@ -65,22 +67,53 @@ PA_MODULE_USAGE(
       "input_ladspaport_map=<comma separated list of input LADSPA port names> "
       "output_ladspaport_map=<comma separated list of output LADSPA port names> "));
 
+/* To run a chain of plugins in one sink, plugin, label, control and the port
+ * maps take one entry per plugin, separated by '|'. For example
+ * plugin="a|b" label="x|y" control="1,2|" runs b on the output of a. */
+
 #define MEMBLOCKQ_MAXLENGTH (16*1024*1024)
 
+#define MAX_PLUGINS 8
+#define CHAIN_DELIMITER "|"
+
+/* Number of output memblocks we keep around for reuse. The master sink
+ * usually still holds the one we returned last. */
+#define OUTPUT_RING_SIZE 4
+
 /* PLEASE NOTICE: The PortAudio ports and the LADSPA ports are two different concepts.
 They are not related and where possible the names of the LADSPA port variables contains "ladspa" to avoid confusion */
 
+struct plugin {
+    lt_dlhandle dl;
+    const LADSPA_Descriptor *descriptor;
+    LADSPA_Handle handle[PA_CHANNELS_MAX];
+    unsigned long max_ladspaport_count, input_count, output_count, n_instances;
+
+    /* The part of the control array in struct userdata used by this plugin */
+    LADSPA_Data *control;
+    long unsigned n_control;
+};
+
 struct userdata {
     pa_module *module;
 
     pa_sink *sink;
     pa_sink_input *sink_input;
 
-    const LADSPA_Descriptor *descriptor;
-    LADSPA_Handle handle[PA_CHANNELS_MAX];
-    unsigned long max_ladspaport_count, input_count, output_count, channels;
-    LADSPA_Data **input, **output;
+    struct plugin plugin[MAX_PLUGINS];
+    unsigned n_plugins;
+    unsigned long channels;
+
+    /* Persistent planar port buffers. Plugins that can run in place read
+     * and write the same set, the others write to the other set, so a chain
+     * only copies samples when entering and leaving the sink. */
+    pa_planar buffer[2];
+    unsigned output_set;
     size_t block_size;
+
+    pa_memblock *output_ring[OUTPUT_RING_SIZE];
+    unsigned output_ring_index;
+
     LADSPA_Data *control;
     long unsigned n_control;
 
@@ -435,12 +468,31 @@ static void sink_set_mute_cb(pa_sink *s) {
     pa_sink_input_set_mute(u->sink_input, s->muted, s->save_muted);
 }
 
+/* Called from I/O thread context. Returns a reference to a block of
+ * block_size bytes that nobody else holds a reference to. */
+static pa_memblock *output_block_get(struct userdata *u) {
+    pa_memblock **b;
+
+    b = &u->output_ring[u->output_ring_index];
+    u->output_ring_index = (u->output_ring_index + 1) % OUTPUT_RING_SIZE;
+
+    if (*b && !pa_memblock_ref_is_one(*b)) {
+        pa_memblock_unref(*b);
+        *b = NULL;
+    }
+
+    if (!*b)
+        *b = pa_memblock_new(u->module->core->mempool, u->block_size);
+
+    return pa_memblock_ref(*b);
+}
+
 /* Called from I/O thread context */
 static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk) {
     struct userdata *u;
     float *src, *dst;
     size_t fs;
-    unsigned n, h, c;
+    unsigned n, h, k;
     pa_memchunk tchunk;
 
     pa_sink_input_assert_ref(i);
@@ -468,26 +520,25 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
 
     chunk->index = 0;
     chunk->length = n*fs;
-    chunk->memblock = pa_memblock_new(i->sink->core->mempool, chunk->length);
+    chunk->memblock = output_block_get(u);
 
     pa_memblockq_drop(u->memblockq, chunk->length);
 
     src = pa_memblock_acquire_chunk(&tchunk);
-    dst = pa_memblock_acquire(chunk->memblock);
+    pa_planar_import(&u->buffer[0], 0, src, n);
+    pa_memblock_release(tchunk.memblock);
+    pa_memblock_unref(tchunk.memblock);
 
-    for (h = 0; h < (u->channels / u->max_ladspaport_count); h++) {
-        for (c = 0; c < u->input_count; c++)
-            pa_sample_clamp(PA_SAMPLE_FLOAT32NE, u->input[c], sizeof(float), src+ h*u->max_ladspaport_count + c, u->channels*sizeof(float), n);
-        u->descriptor->run(u->handle[h], n);
-        for (c = 0; c < u->output_count; c++)
-            pa_sample_clamp(PA_SAMPLE_FLOAT32NE, dst + h*u->max_ladspaport_count + c, u->channels*sizeof(float), u->output[c], sizeof(float), n);
-    }
+    /* The ports are connected to the channel buffers once at load time, so
+     * the whole chain runs without touching the memblocks. */
+    for (k = 0; k < u->n_plugins; k++)
+        for (h = 0; h < u->plugin[k].n_instances; h++)
+            u->plugin[k].descriptor->run(u->plugin[k].handle[h], n);
 
-    pa_memblock_release(tchunk.memblock);
+    dst = pa_memblock_acquire(chunk->memblock);
+    pa_planar_export(&u->buffer[u->output_set], 0, dst, n);
     pa_memblock_release(chunk->memblock);
 
-    pa_memblock_unref(tchunk.memblock);
-
     return 0;
 }
 
@@ -507,19 +558,23 @@ static void sink_input_process_rewind_cb(pa_sink_input *i, size_t nbytes) {
         u->sink->thread_info.rewind_nbytes = 0;
 
         if (amount > 0) {
-            unsigned c;
+            unsigned c, k;
 
             pa_memblockq_seek(u->memblockq, - (int64_t) amount, PA_SEEK_RELATIVE, true);
 
-            pa_log_debug("Resetting plugin");
+            pa_log_debug("Resetting plugins");
 
-            /* Reset the plugin */
-            if (u->descriptor->deactivate)
-                for (c = 0; c < (u->channels / u->max_ladspaport_count); c++)
-                    u->descriptor->deactivate(u->handle[c]);
-            if (u->descriptor->activate)
-                for (c = 0; c < (u->channels / u->max_ladspaport_count); c++)
-                    u->descriptor->activate(u->handle[c]);
+            /* Reset the plugins */
+            for (k = 0; k < u->n_plugins; k++) {
+                struct plugin *p = &u->plugin[k];
+
+                if (p->descriptor->deactivate)
+                    for (c = 0; c < p->n_instances; c++)
+                        p->descriptor->deactivate(p->handle[c]);
+                if (p->descriptor->activate)
+                    for (c = 0; c < p->n_instances; c++)
+                        p->descriptor->activate(p->handle[c]);
+            }
         }
     }
 
@@ -676,118 +731,56 @@ static void sink_input_mute_changed_cb(pa_sink_input *i) {
     pa_sink_mute_changed(u->sink, i->muted);
 }
 
-static int parse_control_parameters(struct userdata *u, const char *cdata, double *read_values, bool *use_default) {
-    unsigned long p = 0;
-    const char *state = NULL;
-    char *k;
-
-    pa_assert(read_values);
-    pa_assert(use_default);
-    pa_assert(u);
-
-    pa_log_debug("Trying to read %lu control values", u->n_control);
-
-    if (!cdata && u->n_control > 0)
-        return -1;
-
-    pa_log_debug("cdata: '%s'", cdata);
-
-    while ((k = pa_split(cdata, ",", &state)) && p < u->n_control) {
-        double f;
-
-        if (*k == 0) {
-            pa_log_debug("Read empty config value (p=%lu)", p);
-            use_default[p++] = true;
-            pa_xfree(k);
-            continue;
-        }
-
-        if (pa_atod(k, &f) < 0) {
-            pa_log_debug("Failed to parse control value '%s' (p=%lu)", k, p);
-            pa_xfree(k);
-            goto fail;
-        }
-
-        pa_xfree(k);
-
-        pa_log_debug("Read config value %f (p=%lu)", f, p);
-
-        use_default[p] = false;
-        read_values[p++] = f;
-    }
-
-    /* The previous loop doesn't take the last control value into account
-       if it is left empty, so we do it here. */
-    if (*cdata == 0 || cdata[strlen(cdata) - 1] == ',') {
-        if (p < u->n_control)
-            use_default[p] = true;
-        p++;
-    }
-
-    if (p > u->n_control || k) {
-        pa_log("Too many control values passed, %lu expected.", u->n_control);
-        pa_xfree(k);
-        goto fail;
-    }
-
-    if (p < u->n_control) {
-        pa_log("Not enough control values passed, %lu expected, %lu passed.", u->n_control, p);
-        goto fail;
-    }
-
-    return 0;
-
-fail:
-    return -1;
-}
-
 static void connect_control_ports(struct userdata *u) {
     unsigned long p = 0, h = 0, c;
     const LADSPA_Descriptor *d;
+    unsigned k;
 
     pa_assert(u);
-    pa_assert_se(d = u->descriptor);
 
-    for (p = 0; p < d->PortCount; p++) {
-        if (!LADSPA_IS_PORT_CONTROL(d->PortDescriptors[p]))
-            continue;
+    for (k = 0; k < u->n_plugins; k++) {
+        struct plugin *pl = &u->plugin[k];
 
-        if (LADSPA_IS_PORT_OUTPUT(d->PortDescriptors[p])) {
-            for (c = 0; c < (u->channels / u->max_ladspaport_count); c++)
-                d->connect_port(u->handle[c], p, &u->control_out);
-            continue;
-        }
+        pa_assert_se(d = pl->descriptor);
 
-        /* input control port */
+        for (p = 0; p < d->PortCount; p++) {
+            if (!LADSPA_IS_PORT_CONTROL(d->PortDescriptors[p]))
+                continue;
 
-        pa_log_debug("Binding %f to port %s", u->control[h], d->PortNames[p]);
+            if (LADSPA_IS_PORT_OUTPUT(d->PortDescriptors[p])) {
+                for (c = 0; c < pl->n_instances; c++)
+                    d->connect_port(pl->handle[c], p, &u->control_out);
+                continue;
+            }
 
-        for (c = 0; c < (u->channels / u->max_ladspaport_count); c++)
-            d->connect_port(u->handle[c], p, &u->control[h]);
+            /* input control port */
 
-        h++;
+            pa_log_debug("Binding %f to port %s", u->control[h], d->PortNames[p]);
+
+            for (c = 0; c < pl->n_instances; c++)
+                d->connect_port(pl->handle[c], p, &u->control[h]);
+
+            h++;
+        }
     }
 }
 
-static int validate_control_parameters(struct userdata *u, double *control_values, bool *use_default) {
+static int validate_plugin_control_parameters(struct userdata *u, struct plugin *pl, double *control_values, bool *use_default) {
     unsigned long p = 0, h = 0;
     const LADSPA_Descriptor *d;
-    pa_sample_spec ss;
+    LADSPA_Data value;
 
     pa_assert(control_values);
     pa_assert(use_default);
     pa_assert(u);
-    pa_assert_se(d = u->descriptor);
-
-    ss = u->ss;
+    pa_assert(pl);
+    pa_assert_se(d = pl->descriptor);
 
     /* Iterate over all ports. Check for every control port that 1) it
      * supports default values if a default value is provided and 2) the
      * provided value is within the limits specified in the plugin. */
 
     for (p = 0; p < d->PortCount; p++) {
-        LADSPA_PortRangeHintDescriptor hint = d->PortRangeHints[p].HintDescriptor;
-
         if (!LADSPA_IS_PORT_CONTROL(d->PortDescriptors[p]))
             continue;
 
@@ -797,34 +790,10 @@ static int validate_control_parameters(struct userdata *u, double *control_value
         if (use_default[h]) {
             /* User wants to use default value. Check if the plugin
              * provides it. */
-            if (!LADSPA_IS_HINT_HAS_DEFAULT(hint)) {
-                pa_log_warn("Control port value left empty but plugin defines no default.");
+            if (pa_ladspa_control_default(d, p, u->ss.rate, &value) < 0)
                 return -1;
-            }
-        }
-        else {
-            /* Check if the user-provided value is within the bounds. */
-            LADSPA_Data lower = d->PortRangeHints[p].LowerBound;
-            LADSPA_Data upper = d->PortRangeHints[p].UpperBound;
-
-            if (LADSPA_IS_HINT_SAMPLE_RATE(hint)) {
-                upper *= (LADSPA_Data) ss.rate;
-                lower *= (LADSPA_Data) ss.rate;
-            }
-
-            if (LADSPA_IS_HINT_BOUNDED_ABOVE(hint)) {
-                if (control_values[h] > upper) {
-                    pa_log_warn("Control value %lu over upper bound: %f (upper bound: %f)", h, control_values[h], upper);
-                    return -1;
-                }
-            }
-            if (LADSPA_IS_HINT_BOUNDED_BELOW(hint)) {
-                if (control_values[h] < lower) {
-                    pa_log_warn("Control value %lu below lower bound: %f (lower bound: %f)", h, control_values[h], lower);
-                    return -1;
-                }
-            }
-        }
+        } else if (pa_ladspa_control_check(d, p, u->ss.rate, control_values[h]) < 0)
+            return -1;
 
         h++;
     }
@@ -832,20 +801,15 @@ static int validate_control_parameters(struct userdata *u, double *control_value
     return 0;
 }
 
-static int write_control_parameters(struct userdata *u, double *control_values, bool *use_default) {
+static void write_plugin_control_parameters(struct userdata *u, struct plugin *pl, double *control_values, bool *use_default) {
     unsigned long p = 0, h = 0, c;
     const LADSPA_Descriptor *d;
-    pa_sample_spec ss;
 
     pa_assert(control_values);
     pa_assert(use_default);
     pa_assert(u);
-    pa_assert_se(d = u->descriptor);
-
-    ss = u->ss;
-
-    if (validate_control_parameters(u, control_values, use_default) < 0)
-        return -1;
+    pa_assert(pl);
+    pa_assert_se(d = pl->descriptor);
 
     /* p iterates over all ports, h is the control port iterator */
 
@@ -856,205 +820,105 @@ static int write_control_parameters(struct userdata *u, double *control_values,
             continue;
 
         if (LADSPA_IS_PORT_OUTPUT(d->PortDescriptors[p])) {
-            for (c = 0; c < (u->channels / u->max_ladspaport_count); c++)
-                d->connect_port(u->handle[c], p, &u->control_out);
+            for (c = 0; c < pl->n_instances; c++)
+                d->connect_port(pl->handle[c], p, &u->control_out);
             continue;
         }
 
-        if (use_default[h]) {
-
-            LADSPA_Data lower, upper;
-
-            lower = d->PortRangeHints[p].LowerBound;
-            upper = d->PortRangeHints[p].UpperBound;
-
-            if (LADSPA_IS_HINT_SAMPLE_RATE(hint)) {
-                lower *= (LADSPA_Data) ss.rate;
-                upper *= (LADSPA_Data) ss.rate;
-            }
-
-            switch (hint & LADSPA_HINT_DEFAULT_MASK) {
-
-            case LADSPA_HINT_DEFAULT_MINIMUM:
-                u->control[h] = lower;
-                break;
-
-            case LADSPA_HINT_DEFAULT_MAXIMUM:
-                u->control[h] = upper;
-                break;
-
-            case LADSPA_HINT_DEFAULT_LOW:
-                if (LADSPA_IS_HINT_LOGARITHMIC(hint))
-                    u->control[h] = (LADSPA_Data) exp(log(lower) * 0.75 + log(upper) * 0.25);
-                else
-                    u->control[h] = (LADSPA_Data) (lower * 0.75 + upper * 0.25);
-                break;
-
-            case LADSPA_HINT_DEFAULT_MIDDLE:
-                if (LADSPA_IS_HINT_LOGARITHMIC(hint))
-                    u->control[h] = (LADSPA_Data) exp(log(lower) * 0.5 + log(upper) * 0.5);
-                else
-                    u->control[h] = (LADSPA_Data) (lower * 0.5 + upper * 0.5);
-                break;
-
-            case LADSPA_HINT_DEFAULT_HIGH:
-                if (LADSPA_IS_HINT_LOGARITHMIC(hint))
-                    u->control[h] = (LADSPA_Data) exp(log(lower) * 0.25 + log(upper) * 0.75);
-                else
-                    u->control[h] = (LADSPA_Data) (lower * 0.25 + upper * 0.75);
-                break;
-
-            case LADSPA_HINT_DEFAULT_0:
-                u->control[h] = 0;
-                break;
-
-            case LADSPA_HINT_DEFAULT_1:
-                u->control[h] = 1;
-                break;
-
-            case LADSPA_HINT_DEFAULT_100:
-                u->control[h] = 100;
-                break;
-
-            case LADSPA_HINT_DEFAULT_440:
-                u->control[h] = 440;
-                break;
-
-            default:
-                pa_assert_not_reached();
-            }
-        }
+        if (use_default[h])
+            pa_assert_se(pa_ladspa_control_default(d, p, u->ss.rate, &pl->control[h]) >= 0);
         else {
             if (LADSPA_IS_HINT_INTEGER(hint)) {
-                u->control[h] = roundf(control_values[h]);
+                pl->control[h] = roundf(control_values[h]);
             }
             else {
-                u->control[h] = control_values[h];
+                pl->control[h] = control_values[h];
             }
         }
 
         h++;
     }
-
-    /* set the use_default array to the user data */
-    memcpy(u->use_default, use_default, u->n_control * sizeof(u->use_default[0]));
-
-    return 0;
 }
 
-int pa__init(pa_module*m) {
-    struct userdata *u;
-    pa_sample_spec ss;
-    pa_channel_map map;
-    pa_modargs *ma;
-    char *t;
-    pa_sink *master;
-    pa_sink_input_new_data sink_input_data;
-    pa_sink_new_data sink_data;
-    const char *plugin, *label, *input_ladspaport_map, *output_ladspaport_map;
-    LADSPA_Descriptor_Function descriptor_func;
-    unsigned long input_ladspaport[PA_CHANNELS_MAX], output_ladspaport[PA_CHANNELS_MAX];
-    const char *e, *cdata;
-    const LADSPA_Descriptor *d;
-    unsigned long p, h, j, n_control, c;
-    pa_memchunk silence;
+/* control_values and use_default cover the control ports of all plugins of
+ * the chain, in order. */
+static int validate_control_parameters(struct userdata *u, double *control_values, bool *use_default) {
+    long unsigned h = 0;
+    unsigned k;
 
-    pa_assert(m);
+    pa_assert(u);
 
-    pa_assert_cc(sizeof(LADSPA_Data) == sizeof(float));
+    for (k = 0; k < u->n_plugins; k++) {
+        if (validate_plugin_control_parameters(u, &u->plugin[k], control_values + h, use_default + h) < 0)
+            return -1;
 
-    if (!(ma = pa_modargs_new(m->argument, valid_modargs))) {
-        pa_log("Failed to parse module arguments.");
-        goto fail;
+        h += u->plugin[k].n_control;
     }
 
-    if (!(master = pa_namereg_get(m->core, pa_modargs_get_value(ma, "master", NULL), PA_NAMEREG_SINK))) {
-        pa_log("Master sink not found");
-        goto fail;
-    }
+    return 0;
+}
 
-    ss = master->sample_spec;
-    ss.format = PA_SAMPLE_FLOAT32;
-    map = master->channel_map;
-    if (pa_modargs_get_sample_spec_and_channel_map(ma, &ss, &map, PA_CHANNEL_MAP_DEFAULT) < 0) {
-        pa_log("Invalid sample format specification or channel map");
-        goto fail;
-    }
+static int write_control_parameters(struct userdata *u, double *control_values, bool *use_default) {
+    long unsigned h = 0;
+    unsigned k;
 
-    if (ss.format != PA_SAMPLE_FLOAT32) {
-        pa_log("LADSPA accepts float format only");
-        goto fail;
-    }
+    pa_assert(u);
 
-    if (!(plugin = pa_modargs_get_value(ma, "plugin", NULL))) {
-        pa_log("Missing LADSPA plugin name");
-        goto fail;
-    }
+    if (validate_control_parameters(u, control_values, use_default) < 0)
+        return -1;
 
-    if (!(label = pa_modargs_get_value(ma, "label", NULL))) {
-        pa_log("Missing LADSPA plugin label");
-        goto fail;
+    for (k = 0; k < u->n_plugins; k++) {
+        write_plugin_control_parameters(u, &u->plugin[k], control_values + h, use_default + h);
+        h += u->plugin[k].n_control;
     }
 
-    if (!(input_ladspaport_map = pa_modargs_get_value(ma, "input_ladspaport_map", NULL)))
-        pa_log_debug("Using default input ladspa port mapping");
-
-    if (!(output_ladspaport_map = pa_modargs_get_value(ma, "output_ladspaport_map", NULL)))
-        pa_log_debug("Using default output ladspa port mapping");
-
-    cdata = pa_modargs_get_value(ma, "control", NULL);
+    /* set the use_default array to the user data */
+    memcpy(u->use_default, use_default, u->n_control * sizeof(u->use_default[0]));
 
-    u = pa_xnew0(struct userdata, 1);
-    u->module = m;
-    m->userdata = u;
-    u->max_ladspaport_count = 1; /*to avoid division by zero etc. in pa__done when failing before this value has been set*/
-    u->channels = 0;
-    u->input = NULL;
-    u->output = NULL;
-    u->ss = ss;
+    return 0;
+}
 
-    if (!(e = getenv("LADSPA_PATH")))
-        e = LADSPA_PATH;
+/* Returns the n-th entry of a list of per-plugin arguments. Missing entries
+ * of a given list are returned as empty strings. */
+static char *get_chain_entry(const char *list, unsigned n) {
+    const char *state = NULL;
+    char *e;
+    unsigned i = 0;
 
-    /* FIXME: This is not exactly thread safe */
-    t = pa_xstrdup(lt_dlgetsearchpath());
-    lt_dlsetsearchpath(e);
-    m->dl = lt_dlopenext(plugin);
-    lt_dlsetsearchpath(t);
-    pa_xfree(t);
+    if (!list)
+        return NULL;
 
-    if (!m->dl) {
-        pa_log("Failed to load LADSPA plugin: %s", lt_dlerror());
-        goto fail;
-    }
+    while ((e = pa_split(list, CHAIN_DELIMITER, &state))) {
+        if (i++ == n)
+            return e;
 
-    if (!(descriptor_func = (LADSPA_Descriptor_Function) pa_load_sym(m->dl, NULL, "ladspa_descriptor"))) {
-        pa_log("LADSPA module lacks ladspa_descriptor() symbol.");
-        goto fail;
+        pa_xfree(e);
     }
 
-    for (j = 0;; j++) {
+    return pa_xstrdup("");
+}
 
-        if (!(d = descriptor_func(j))) {
-            pa_log("Failed to find plugin label '%s' in plugin '%s'.", label, plugin);
-            goto fail;
-        }
+static void alloc_buffers(struct userdata *u, unsigned set) {
+    if (u->buffer[set].data)
+        return;
 
-        if (pa_streq(d->Label, label))
-            break;
-    }
+    pa_planar_alloc(&u->buffer[set], (unsigned) u->channels, u->block_size / pa_frame_size(&u->ss));
+}
 
-    u->descriptor = d;
+/* Loads a plugin of the chain and connects its audio ports to the channel
+ * buffers of *set. Plugins that can't run in place write to the other set,
+ * which is then returned in *set for the next plugin to read from. */
+static int plugin_load(struct userdata *u, struct plugin *pl, const char *plugin, const char *label,
+                       const char *input_ladspaport_map, const char *output_ladspaport_map, unsigned *set) {
+    unsigned long input_ladspaport[PA_CHANNELS_MAX], output_ladspaport[PA_CHANNELS_MAX];
+    const LADSPA_Descriptor *d;
+    unsigned long p, h, c;
+    unsigned output_set;
 
-    pa_log_debug("Module: %s", plugin);
-    pa_log_debug("Label: %s", d->Label);
-    pa_log_debug("Unique ID: %lu", d->UniqueID);
-    pa_log_debug("Name: %s", d->Name);
-    pa_log_debug("Maker: %s", d->Maker);
-    pa_log_debug("Copyright: %s", d->Copyright);
+    if (pa_ladspa_plugin_load(plugin, label, &pl->dl, &pl->descriptor) < 0)
+        return -1;
 
-    n_control = 0;
-    u->channels = ss.channels;
+    d = pl->descriptor;
 
     /*
     * Enumerate ladspa ports
@@ -1064,33 +928,48 @@ int pa__init(pa_module*m) {
         if (LADSPA_IS_PORT_AUDIO(d->PortDescriptors[p])) {
             if (LADSPA_IS_PORT_INPUT(d->PortDescriptors[p])) {
                 pa_log_debug("Port %lu is input: %s", p, d->PortNames[p]);
-                input_ladspaport[u->input_count] = p;
-                u->input_count++;
+
+                if (pl->input_count == PA_CHANNELS_MAX) {
+                    pa_log("Too many audio input ports");
+                    return -1;
+                }
+
+                input_ladspaport[pl->input_count] = p;
+                pl->input_count++;
             } else if (LADSPA_IS_PORT_OUTPUT(d->PortDescriptors[p])) {
                 pa_log_debug("Port %lu is output: %s", p, d->PortNames[p]);
-                output_ladspaport[u->output_count] = p;
-                u->output_count++;
+
+                if (pl->output_count == PA_CHANNELS_MAX) {
+                    pa_log("Too many audio output ports");
+                    return -1;
+                }
+
+                output_ladspaport[pl->output_count] = p;
+                pl->output_count++;
             }
         } else if (LADSPA_IS_PORT_CONTROL(d->PortDescriptors[p]) && LADSPA_IS_PORT_INPUT(d->PortDescriptors[p])) {
             pa_log_debug("Port %lu is control: %s", p, d->PortNames[p]);
-            n_control++;
+            pl->n_control++;
         } else
             pa_log_debug("Ignored port %s", d->PortNames[p]);
-        /* XXX: Has anyone ever seen an in-place plugin with non-equal number of input and output ports? */
-        /* Could be if the plugin is for up-mixing stereo to 5.1 channels */
-        /* Or if the plugin is down-mixing 5.1 to two channel stereo or binaural encoded signal */
-        if (u->input_count > u->max_ladspaport_count)
-            u->max_ladspaport_count = u->input_count;
-        else
-            u->max_ladspaport_count = u->output_count;
     }
 
-    if (u->channels % u->max_ladspaport_count) {
+    /* XXX: Has anyone ever seen an in-place plugin with non-equal number of input and output ports? */
+    /* Could be if the plugin is for up-mixing stereo to 5.1 channels */
+    /* Or if the plugin is down-mixing 5.1 to two channel stereo or binaural encoded signal */
+    pl->max_ladspaport_count = PA_MAX(pl->input_count, pl->output_count);
+
+    if (pl->max_ladspaport_count == 0) {
+        pa_log("Plugin %s has no audio ports", d->Label);
+        return -1;
+    }
+
+    if (u->channels % pl->max_ladspaport_count) {
         pa_log("Cannot handle non-integral number of plugins required for given number of channels");
-        goto fail;
+        return -1;
     }
 
-    pa_log_debug("Will run %lu plugin instances", u->channels / u->max_ladspaport_count);
+    pa_log_debug("Will run %lu plugin instances", u->channels / pl->max_ladspaport_count);
 
     /* Parse data for input ladspa port map */
     if (input_ladspaport_map) {
@@ -1098,10 +977,10 @@ int pa__init(pa_module*m) {
         char *pname;
         c = 0;
         while ((pname = pa_split(input_ladspaport_map, ",", &state))) {
-            if (c == u->input_count) {
+            if (c == pl->input_count) {
                 pa_log("Too many ports in input ladspa port map");
                 pa_xfree(pname);
-                goto fail;
+                return -1;
             }
 
             for (p = 0; p < d->PortCount; p++) {
@@ -1111,7 +990,7 @@ int pa__init(pa_module*m) {
                     } else {
                         pa_log("Port %s is not an audio input ladspa port", pname);
                         pa_xfree(pname);
-                        goto fail;
+                        return -1;
                     }
                 }
             }
@@ -1126,10 +1005,10 @@ int pa__init(pa_module*m) {
         char *pname;
         c = 0;
         while ((pname = pa_split(output_ladspaport_map, ",", &state))) {
-            if (c == u->output_count) {
+            if (c == pl->output_count) {
                 pa_log("Too many ports in output ladspa port map");
                 pa_xfree(pname);
-                goto fail;
+                return -1;
             }
             for (p = 0; p < d->PortCount; p++) {
                 if (pa_streq(d->PortNames[p], pname)) {
@@ -1138,7 +1017,7 @@ int pa__init(pa_module*m) {
                     } else {
                         pa_log("Port %s is not an output ladspa port", pname);
                         pa_xfree(pname);
-                        goto fail;
+                        return -1;
                     }
                 }
             }
@@ -1147,40 +1026,158 @@ int pa__init(pa_module*m) {
         }
     }
 
+    if (LADSPA_IS_INPLACE_BROKEN(d->Properties)) {
+        pa_log_debug("Plugin %s can't run in place", d->Label);
+        output_set = !*set;
+        alloc_buffers(u, output_set);
+    } else
+        output_set = *set;
+
+    /* Initialize plugin instances. Instance h handles the channels starting
+     * at h * max_ladspaport_count. */
+    pl->n_instances = u->channels / pl->max_ladspaport_count;
+
+    for (h = 0; h < pl->n_instances; h++) {
+        if (!(pl->handle[h] = d->instantiate(d, u->ss.rate))) {
+            pa_log("Failed to instantiate plugin %s with label %s", plugin, d->Label);
+            return -1;
+        }
+
+        for (c = 0; c < pl->input_count; c++)
+            d->connect_port(pl->handle[h], input_ladspaport[c], u->buffer[*set].plane[h * pl->max_ladspaport_count + c]);
+        for (c = 0; c < pl->output_count; c++)
+            d->connect_port(pl->handle[h], output_ladspaport[c], u->buffer[output_set].plane[h * pl->max_ladspaport_count + c]);
+    }
+
+    *set = output_set;
+
+    return 0;
+}
+
+int pa__init(pa_module*m) {
+    struct userdata *u;
+    pa_sample_spec ss;
+    pa_channel_map map;
+    pa_modargs *ma;
+    pa_sink *master;
+    pa_sink_input_new_data sink_input_data;
+    pa_sink_new_data sink_data;
+    const char *plugins, *labels, *input_ladspaport_maps, *output_ladspaport_maps, *controls;
+    pa_strbuf *names, *makers, *copyrights, *unique_ids;
+    char *name, *t;
+    unsigned long c;
+    unsigned k, set;
+    pa_memchunk silence;
+
+    pa_assert(m);
+
+    pa_assert_cc(sizeof(LADSPA_Data) == sizeof(float));
+
+    if (!(ma = pa_modargs_new(m->argument, valid_modargs))) {
+        pa_log("Failed to parse module arguments.");
+        goto fail;
+    }
+
+    if (!(master = pa_namereg_get(m->core, pa_modargs_get_value(ma, "master", NULL), PA_NAMEREG_SINK))) {
+        pa_log("Master sink not found");
+        goto fail;
+    }
+
+    ss = master->sample_spec;
+    ss.format = PA_SAMPLE_FLOAT32;
+    map = master->channel_map;
+    if (pa_modargs_get_sample_spec_and_channel_map(ma, &ss, &map, PA_CHANNEL_MAP_DEFAULT) < 0) {
+        pa_log("Invalid sample format specification or channel map");
+        goto fail;
+    }
+
+    if (ss.format != PA_SAMPLE_FLOAT32) {
+        pa_log("LADSPA accepts float format only");
+        goto fail;
+    }
+
+    if (!(plugins = pa_modargs_get_value(ma, "plugin", NULL))) {
+        pa_log("Missing LADSPA plugin name");
+        goto fail;
+    }
+
+    if (!(labels = pa_modargs_get_value(ma, "label", NULL))) {
+        pa_log("Missing LADSPA plugin label");
+        goto fail;
+    }
+
+    if (!(input_ladspaport_maps = pa_modargs_get_value(ma, "input_ladspaport_map", NULL)))
+        pa_log_debug("Using default input ladspa port mapping");
+
+    if (!(output_ladspaport_maps = pa_modargs_get_value(ma, "output_ladspaport_map", NULL)))
+        pa_log_debug("Using default output ladspa port mapping");
+
+    controls = pa_modargs_get_value(ma, "control", NULL);
+
+    u = pa_xnew0(struct userdata, 1);
+    u->module = m;
+    m->userdata = u;
+    u->channels = ss.channels;
+    u->ss = ss;
+
     u->block_size = pa_frame_align(pa_mempool_block_size_max(m->core->mempool), &ss);
 
     /* Create buffers */
-    if (LADSPA_IS_INPLACE_BROKEN(d->Properties)) {
-        u->input = (LADSPA_Data**) pa_xnew(LADSPA_Data*, (unsigned) u->input_count);
-        for (c = 0; c < u->input_count; c++)
-            u->input[c] = (LADSPA_Data*) pa_xnew(uint8_t, (unsigned) u->block_size);
-        u->output = (LADSPA_Data**) pa_xnew(LADSPA_Data*, (unsigned) u->output_count);
-        for (c = 0; c < u->output_count; c++)
-            u->output[c] = (LADSPA_Data*) pa_xnew(uint8_t, (unsigned) u->block_size);
-    } else {
-        u->input = (LADSPA_Data**) pa_xnew(LADSPA_Data*, (unsigned) u->max_ladspaport_count);
-        for (c = 0; c < u->max_ladspaport_count; c++)
-            u->input[c] = (LADSPA_Data*) pa_xnew(uint8_t, (unsigned) u->block_size);
-        u->output = u->input;
-    }
-    /* Initialize plugin instances */
-    for (h = 0; h < (u->channels / u->max_ladspaport_count); h++) {
-        if (!(u->handle[h] = d->instantiate(d, ss.rate))) {
-            pa_log("Failed to instantiate plugin %s with label %s", plugin, d->Label);
+    alloc_buffers(u, 0);
+    set = 0;
+
+    /* Load the plugins of the chain */
+    for (k = 0;; k++) {
+        char *plugin, *label, *input_ladspaport_map, *output_ladspaport_map;
+        int r;
+
+        if (!(plugin = get_chain_entry(plugins, k)) || !*plugin) {
+            pa_xfree(plugin);
+            break;
+        }
+
+        if (k == MAX_PLUGINS) {
+            pa_log("Too many plugins, at most %u can be chained", MAX_PLUGINS);
+            pa_xfree(plugin);
+            goto fail;
+        }
+
+        if (!*(label = get_chain_entry(labels, k))) {
+            pa_log("Missing LADSPA plugin label for plugin %s", plugin);
+            pa_xfree(plugin);
+            pa_xfree(label);
             goto fail;
         }
 
-        for (c = 0; c < u->input_count; c++)
-            d->connect_port(u->handle[h], input_ladspaport[c], u->input[c]);
-        for (c = 0; c < u->output_count; c++)
-            d->connect_port(u->handle[h], output_ladspaport[c], u->output[c]);
+        input_ladspaport_map = get_chain_entry(input_ladspaport_maps, k);
+        output_ladspaport_map = get_chain_entry(output_ladspaport_maps, k);
+
+        /* pa__done() cleans up after partially loaded plugins */
+        u->n_plugins++;
+        r = plugin_load(u, &u->plugin[k], plugin, label, input_ladspaport_map, output_ladspaport_map, &set);
+
+        pa_xfree(plugin);
+        pa_xfree(label);
+        pa_xfree(input_ladspaport_map);
+        pa_xfree(output_ladspaport_map);
+
+        if (r < 0)
+            goto fail;
+
+        u->n_control += u->plugin[k].n_control;
+    }
+
+    if (u->n_plugins == 0) {
+        pa_log("Missing LADSPA plugin name");
+        goto fail;
     }
 
-    u->n_control = n_control;
+    u->output_set = set;
 
     if (u->n_control > 0) {
         double *control_values;
         bool *use_default;
+        unsigned long h = 0;
 
         /* temporary storage for parser */
         control_values = pa_xnew(double, (unsigned) u->n_control);
@@ -1190,7 +1187,26 @@ int pa__init(pa_module*m) {
         u->control = pa_xnew(LADSPA_Data, (unsigned) u->n_control);
         u->use_default = pa_xnew(bool, (unsigned) u->n_control);
 
-        if ((parse_control_parameters(u, cdata, control_values, use_default) < 0) ||
+        for (k = 0; k < u->n_plugins; k++) {
+            struct plugin *pl = &u->plugin[k];
+            char *cdata;
+            int r;
+
+            pl->control = u->control + h;
+
+            if (pl->n_control > 0) {
+                cdata = get_chain_entry(controls, k);
+                r = pa_ladspa_parse_controls(cdata, pl->n_control, control_values + h, use_default + h);
+                pa_xfree(cdata);
+
+                if (r < 0)
+                    break;
+            }
+
+            h += pl->n_control;
+        }
+
+        if (k < u->n_plugins ||
             (write_control_parameters(u, control_values, use_default) < 0)) {
             pa_xfree(control_values);
             pa_xfree(use_default);
@@ -1204,9 +1220,24 @@ int pa__init(pa_module*m) {
         pa_xfree(use_default);
     }
 
-    if (d->activate)
-        for (c = 0; c < (u->channels / u->max_ladspaport_count); c++)
-            d->activate(u->handle[c]);
+    names = pa_strbuf_new();
+    makers = pa_strbuf_new();
+    copyrights = pa_strbuf_new();
+    unique_ids = pa_strbuf_new();
+
+    for (k = 0; k < u->n_plugins; k++) {
+        const LADSPA_Descriptor *d = u->plugin[k].descriptor;
+        const char *delimiter = k > 0 ? CHAIN_DELIMITER : "";
+
+        pa_strbuf_printf(names, "%s%s", delimiter, d->Name);
+        pa_strbuf_printf(makers, "%s%s", delimiter, d->Maker);
+        pa_strbuf_printf(copyrights, "%s%s", delimiter, d->Copyright);
+        pa_strbuf_printf(unique_ids, "%s%lu", delimiter, (unsigned long) d->UniqueID);
+
+        if (d->activate)
+            for (c = 0; c < u->plugin[k].n_instances; c++)
+                d->activate(u->plugin[k].handle[c]);
+    }
 
     /* Create sink */
     pa_sink_new_data_init(&sink_data);
@@ -1218,16 +1249,20 @@ int pa__init(pa_module*m) {
     pa_sink_new_data_set_channel_map(&sink_data, &map);
     pa_proplist_sets(sink_data.proplist, PA_PROP_DEVICE_MASTER_DEVICE, master->name);
     pa_proplist_sets(sink_data.proplist, PA_PROP_DEVICE_CLASS, "filter");
-    pa_proplist_sets(sink_data.proplist, "device.ladspa.module", plugin);
-    pa_proplist_sets(sink_data.proplist, "device.ladspa.label", d->Label);
-    pa_proplist_sets(sink_data.proplist, "device.ladspa.name", d->Name);
-    pa_proplist_sets(sink_data.proplist, "device.ladspa.maker", d->Maker);
-    pa_proplist_sets(sink_data.proplist, "device.ladspa.copyright", d->Copyright);
-    pa_proplist_setf(sink_data.proplist, "device.ladspa.unique_id", "%lu", (unsigned long) d->UniqueID);
+    pa_proplist_sets(sink_data.proplist, "device.ladspa.module", plugins);
+    pa_proplist_sets(sink_data.proplist, "device.ladspa.label", labels);
+    pa_proplist_sets(sink_data.proplist, "device.ladspa.name", (name = pa_strbuf_to_string_free(names)));
+    pa_proplist_sets(sink_data.proplist, "device.ladspa.maker", (t = pa_strbuf_to_string_free(makers)));
+    pa_xfree(t);
+    pa_proplist_sets(sink_data.proplist, "device.ladspa.copyright", (t = pa_strbuf_to_string_free(copyrights)));
+    pa_xfree(t);
+    pa_proplist_sets(sink_data.proplist, "device.ladspa.unique_id", (t = pa_strbuf_to_string_free(unique_ids)));
+    pa_xfree(t);
 
     if (pa_modargs_get_proplist(ma, "sink_properties", sink_data.proplist, PA_UPDATE_REPLACE) < 0) {
         pa_log("Invalid properties");
         pa_sink_new_data_done(&sink_data);
+        pa_xfree(name);
         goto fail;
     }
 
@@ -1235,9 +1270,11 @@ int pa__init(pa_module*m) {
         const char *z;
 
         z = pa_proplist_gets(master->proplist, PA_PROP_DEVICE_DESCRIPTION);
-        pa_proplist_setf(sink_data.proplist, PA_PROP_DEVICE_DESCRIPTION, "LADSPA Plugin %s on %s", d->Name, z ? z : master->name);
+        pa_proplist_setf(sink_data.proplist, PA_PROP_DEVICE_DESCRIPTION, "LADSPA Plugin %s on %s", name, z ? z : master->name);
     }
 
+    pa_xfree(name);
+
     u->sink = pa_sink_new(m->core, &sink_data,
                           (master->flags & (PA_SINK_LATENCY|PA_SINK_DYNAMIC_LATENCY)) | PA_SINK_SHARE_VOLUME_WITH_MASTER);
     pa_sink_new_data_done(&sink_data);
@@ -1324,7 +1361,7 @@ int pa__get_n_used(pa_module *m) {
 
 void pa__done(pa_module*m) {
     struct userdata *u;
-    unsigned c;
+    unsigned c, k;
 
     pa_assert(m);
 
@@ -1350,33 +1387,28 @@ void pa__done(pa_module*m) {
     if (u->sink)
         pa_sink_unref(u->sink);
 
-    for (c = 0; c < (u->channels / u->max_ladspaport_count); c++) {
-        if (u->handle[c]) {
-            if (u->descriptor->deactivate)
-                u->descriptor->deactivate(u->handle[c]);
-            u->descriptor->cleanup(u->handle[c]);
-        }
-    }
+    for (k = 0; k < u->n_plugins; k++) {
+        struct plugin *pl = &u->plugin[k];
 
-    if (u->output == u->input) {
-        if (u->input != NULL) {
-            for (c = 0; c < u->max_ladspaport_count; c++)
-                pa_xfree(u->input[c]);
-            pa_xfree(u->input);
-        }
-    } else {
-        if (u->input != NULL) {
-            for (c = 0; c < u->input_count; c++)
-                pa_xfree(u->input[c]);
-            pa_xfree(u->input);
-        }
-        if (u->output != NULL) {
-            for (c = 0; c < u->output_count; c++)
-                pa_xfree(u->output[c]);
-            pa_xfree(u->output);
+        for (c = 0; c < pl->n_instances; c++) {
+            if (pl->handle[c]) {
+                if (pl->descriptor->deactivate)
+                    pl->descriptor->deactivate(pl->handle[c]);
+                pl->descriptor->cleanup(pl->handle[c]);
+            }
         }
+
+        if (pl->dl)
+            lt_dlclose(pl->dl);
     }
 
+    pa_planar_free(&u->buffer[0]);
+    pa_planar_free(&u->buffer[1]);
+
+    for (c = 0; c < OUTPUT_RING_SIZE; c++)
+        if (u->output_ring[c])
+            pa_memblock_unref(u->output_ring[c]);
+
     if (u->memblockq)
         pa_memblockq_free(u->memblockq);
 
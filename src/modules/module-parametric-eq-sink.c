@@ -0,0 +1,928 @@
+/***
+    This file is part of PulseAudio.
+
+    PulseAudio is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 2.1 of the License,
+    or (at your option) any later version.
+
+    PulseAudio is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulse/gccmacro.h>
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/i18n.h>
+#include <pulsecore/namereg.h>
+#include <pulsecore/sink.h>
+#include <pulsecore/module.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/modargs.h>
+#include <pulsecore/log.h>
+#include <pulsecore/rtpoll.h>
+#include <pulsecore/sample-util.h>
+#include <pulsecore/ltdl-helper.h>
+#include <pulsecore/filter/biquad.h>
+#include <pulsecore/filter/biquad-cascade.h>
+
+#include "module-parametric-eq-sink-symdef.h"
+
+PA_MODULE_DESCRIPTION(_("Parametric equalizer sink"));
+PA_MODULE_VERSION(PACKAGE_VERSION);
+PA_MODULE_LOAD_ONCE(false);
+PA_MODULE_USAGE(
+        _("sink_name=<name for the sink> "
+          "sink_properties=<properties for the sink> "
+          "master=<name of sink to filter> "
+          "rate=<sample rate> "
+          "channels=<number of channels> "
+          "channel_map=<channel map> "
+          "bands=<comma separated list of type:frequency[:q[:gain]]> "
+          "use_volume_sharing=<yes or no> "
+          "force_flat_volume=<yes or no> "
+        ));
+
+/* The bands are a cascade of biquad filters run directly on the interleaved
+ * float data, so unlike module-equalizer-sink this adds no latency. Each band
+ * is given as type:frequency[:q[:gain]], with the frequency in Hz and the
+ * gain in dB. The types are peaking, lowshelf, highshelf, lowpass and
+ * highpass. Only peaking bands take a q, and lowpass and highpass take no
+ * gain, e.g.
+ *
+ *   bands="lowshelf:100::3,peaking:1000:1.4:-6,highshelf:8000::2"
+ *
+ * The bands can be changed at runtime by setting the device.peq.bands
+ * property of the sink, e.g. with pacmd update-sink-proplist. The output is
+ * crossfaded from the old to the new filters to avoid clicks. */
+
+#define MEMBLOCKQ_MAXLENGTH (16*1024*1024)
+
+#define PEQ_BANDS_PROPERTY "device.peq.bands"
+
+#define PEQ_FADE_USEC (20*PA_USEC_PER_MSEC)
+/* Frames filtered into the scratch buffer at a time while crossfading or
+ * fast forwarding after a rewind. */
+#define PEQ_SCRATCH_FRAMES 256
+
+/* Filter states saved for rewinding. They are spread over max_rewind, at
+ * least PEQ_MIN_SAVE_INTERVAL frames apart. */
+#define PEQ_SAVED_STATES 64
+#define PEQ_MIN_SAVE_INTERVAL 256
+
+enum {
+    SINK_MESSAGE_SET_CASCADE = PA_SINK_MESSAGE_MAX
+};
+
+struct saved_state {
+    int64_t index;
+    float *state;
+};
+
+struct cascade_update {
+    pa_biquad_cascade *bc;
+    /* Set by the I/O thread to a cascade the main thread must free */
+    pa_biquad_cascade *old;
+};
+
+struct userdata {
+    pa_module *module;
+
+    pa_sink *sink;
+    pa_sink_input *sink_input;
+
+    pa_memblockq *memblockq;
+
+    bool auto_desc;
+    unsigned channels;
+    uint32_t rate;
+    char *bands;
+
+    /* Everything below is only accessed from the I/O thread once the sink
+     * is put. */
+    pa_biquad_cascade *bc;
+
+    /* The cascade faded out after an update */
+    pa_biquad_cascade *bc_fade;
+    unsigned fade_frames;
+    unsigned fade_left;
+
+    float *scratch;
+
+    /* Frames filtered so far, rewinds included */
+    int64_t index;
+    int64_t next_save;
+    unsigned save_interval;
+    struct saved_state saved[PEQ_SAVED_STATES];
+    unsigned saved_first;
+    unsigned n_saved;
+};
+
+static const char* const valid_modargs[] = {
+    "sink_name",
+    "sink_properties",
+    "master",
+    "rate",
+    "channels",
+    "channel_map",
+    "bands",
+    "use_volume_sharing",
+    "force_flat_volume",
+    NULL
+};
+
+/* Called from I/O thread context, or from main context while the sink
+ * input isn't attached to a sink. Returns the cascade to free. */
+static pa_biquad_cascade *cascade_swap(struct userdata *u, pa_biquad_cascade *bc) {
+    pa_biquad_cascade *old = u->bc_fade;
+
+    u->bc_fade = u->bc;
+    u->bc = bc;
+    pa_biquad_cascade_copy_state(u->bc, u->bc_fade);
+    u->fade_left = u->fade_frames;
+
+    /* The saved states are of the old filters. */
+    u->n_saved = 0;
+    u->next_save = u->index;
+
+    return old;
+}
+
+/* Called from I/O thread context */
+static void save_state(struct userdata *u) {
+    struct saved_state *s;
+
+    if (u->n_saved > 0) {
+        s = &u->saved[(u->saved_first + u->n_saved - 1) % PEQ_SAVED_STATES];
+        if (s->index == u->index) {
+            pa_biquad_cascade_save(u->bc, s->state);
+            return;
+        }
+    }
+
+    if (u->n_saved == PEQ_SAVED_STATES) {
+        u->saved_first = (u->saved_first + 1) % PEQ_SAVED_STATES;
+        u->n_saved--;
+    }
+
+    s = &u->saved[(u->saved_first + u->n_saved) % PEQ_SAVED_STATES];
+    s->index = u->index;
+    pa_biquad_cascade_save(u->bc, s->state);
+    u->n_saved++;
+}
+
+/* Called from I/O thread context */
+static void filter(struct userdata *u, float *dst, const float *src, unsigned n) {
+    unsigned k, c;
+
+    if (u->fade_left == 0) {
+        pa_biquad_cascade_process_float32(u->bc, dst, src, n);
+        return;
+    }
+
+    while (n > 0 && u->fade_left > 0) {
+        k = PA_MIN(n, PA_MIN(u->fade_left, (unsigned) PEQ_SCRATCH_FRAMES));
+
+        pa_biquad_cascade_process_float32(u->bc_fade, u->scratch, src, k);
+        pa_biquad_cascade_process_float32(u->bc, dst, src, k);
+
+        for (c = 0; c < k * u->channels; c++) {
+            float g = (float) (u->fade_left - c / u->channels) / u->fade_frames;
+            dst[c] = dst[c] * (1.0f - g) + u->scratch[c] * g;
+        }
+
+        u->fade_left -= k;
+        dst += k * u->channels;
+        src += k * u->channels;
+        n -= k;
+    }
+
+    if (n > 0)
+        pa_biquad_cascade_process_float32(u->bc, dst, src, n);
+}
+
+/* Called from I/O thread context */
+static void process(struct userdata *u, float *dst, const float *src, unsigned n) {
+    unsigned k;
+
+    while (n > 0) {
+        if (u->index >= u->next_save) {
+            save_state(u);
+            u->next_save = u->index + u->save_interval;
+        }
+
+        k = (unsigned) PA_MIN((int64_t) n, u->next_save - u->index);
+        filter(u, dst, src, k);
+
+        u->index += k;
+        dst += k * u->channels;
+        src += k * u->channels;
+        n -= k;
+    }
+}
+
+/* Called from I/O thread context. Rewinds the memblockq by nbytes and puts
+ * the filters into the state they had there. */
+static void rewind_filter(struct userdata *u, size_t nbytes) {
+    size_t fs = pa_frame_size(&u->sink->sample_spec);
+    int64_t target = u->index - (int64_t) (nbytes / fs);
+    struct saved_state *s = NULL;
+    size_t ff;
+
+    /* A rewind in the middle of a crossfade just finishes it. */
+    u->fade_left = 0;
+
+    while (u->n_saved > 0) {
+        s = &u->saved[(u->saved_first + u->n_saved - 1) % PEQ_SAVED_STATES];
+        if (s->index <= target)
+            break;
+        u->n_saved--;
+        s = NULL;
+    }
+
+    if (!s) {
+        /* Keeping the current history clicks less than starting over from
+         * silence. */
+        pa_log_debug("No saved filter state for rewinding %lu bytes", (unsigned long) nbytes);
+        pa_memblockq_rewind(u->memblockq, nbytes);
+        u->index = target;
+        u->next_save = u->index;
+        return;
+    }
+
+    pa_biquad_cascade_restore(u->bc, s->state);
+
+    /* Fast forward from the saved state to the rewind target. */
+    ff = (size_t) (target - s->index) * fs;
+    pa_memblockq_rewind(u->memblockq, nbytes + ff);
+    u->index = s->index;
+
+    while (ff > 0) {
+        pa_memchunk tchunk;
+        float *src;
+        unsigned n;
+
+        if (pa_memblockq_peek(u->memblockq, &tchunk) < 0) {
+            pa_log_debug("Hole in the stream, cannot fast forward the filters");
+            pa_memblockq_drop(u->memblockq, ff);
+            u->index = target;
+            break;
+        }
+
+        n = (unsigned) (PA_MIN(PA_MIN(tchunk.length, ff), PEQ_SCRATCH_FRAMES * fs) / fs);
+
+        src = pa_memblock_acquire_chunk(&tchunk);
+        pa_biquad_cascade_process_float32(u->bc, u->scratch, src, n);
+        pa_memblock_release(tchunk.memblock);
+        pa_memblock_unref(tchunk.memblock);
+
+        pa_memblockq_drop(u->memblockq, n * fs);
+        u->index += n;
+        ff -= n * fs;
+    }
+
+    u->next_save = u->index + u->save_interval;
+}
+
+/* Called from I/O thread context */
+static int sink_process_msg_cb(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
+    struct userdata *u = PA_SINK(o)->userdata;
+
+    switch (code) {
+
+        case PA_SINK_MESSAGE_GET_LATENCY:
+
+            /* The sink is _put() before the sink input is, so let's
+             * make sure we don't access it in that time. Also, the
+             * sink input is first shut down, the sink second. */
+            if (!PA_SINK_IS_LINKED(u->sink->thread_info.state) ||
+                !PA_SINK_INPUT_IS_LINKED(u->sink_input->thread_info.state)) {
+                *((pa_usec_t*) data) = 0;
+                return 0;
+            }
+
+            *((pa_usec_t*) data) =
+
+                /* Get the latency of the master sink */
+                pa_sink_get_latency_within_thread(u->sink_input->sink) +
+
+                /* Add the latency internal to our sink input on top */
+                pa_bytes_to_usec(pa_memblockq_get_length(u->sink_input->thread_info.render_memblockq), &u->sink_input->sink->sample_spec);
+
+            return 0;
+
+        case SINK_MESSAGE_SET_CASCADE: {
+            struct cascade_update *update = data;
+
+            update->old = cascade_swap(u, update->bc);
+            return 0;
+        }
+    }
+
+    return pa_sink_process_msg(o, code, data, offset, chunk);
+}
+
+/* Called from main context */
+static int sink_set_state_cb(pa_sink *s, pa_sink_state_t state) {
+    struct userdata *u;
+
+    pa_sink_assert_ref(s);
+    pa_assert_se(u = s->userdata);
+
+    if (!PA_SINK_IS_LINKED(state) ||
+        !PA_SINK_INPUT_IS_LINKED(pa_sink_input_get_state(u->sink_input)))
+        return 0;
+
+    pa_sink_input_cork(u->sink_input, state == PA_SINK_SUSPENDED);
+    return 0;
+}
+
+/* Called from I/O thread context */
+static void sink_request_rewind_cb(pa_sink *s) {
+    struct userdata *u;
+
+    pa_sink_assert_ref(s);
+    pa_assert_se(u = s->userdata);
+
+    if (!PA_SINK_IS_LINKED(u->sink->thread_info.state) ||
+        !PA_SINK_INPUT_IS_LINKED(u->sink_input->thread_info.state))
+        return;
+
+    /* Just hand this one over to the master sink */
+    pa_sink_input_request_rewind(u->sink_input,
+                                 s->thread_info.rewind_nbytes +
+                                 pa_memblockq_get_length(u->memblockq), true, false, false);
+}
+
+/* Called from I/O thread context */
+static void sink_update_requested_latency_cb(pa_sink *s) {
+    struct userdata *u;
+
+    pa_sink_assert_ref(s);
+    pa_assert_se(u = s->userdata);
+
+    if (!PA_SINK_IS_LINKED(u->sink->thread_info.state) ||
+        !PA_SINK_INPUT_IS_LINKED(u->sink_input->thread_info.state))
+        return;
+
+    /* Just hand this one over to the master sink */
+    pa_sink_input_set_requested_latency_within_thread(
+            u->sink_input,
+            pa_sink_get_requested_latency_within_thread(s));
+}
+
+/* Called from main context */
+static void sink_set_volume_cb(pa_sink *s) {
+    struct userdata *u;
+
+    pa_sink_assert_ref(s);
+    pa_assert_se(u = s->userdata);
+
+    if (!PA_SINK_IS_LINKED(pa_sink_get_state(s)) ||
+        !PA_SINK_INPUT_IS_LINKED(pa_sink_input_get_state(u->sink_input)))
+        return;
+
+    pa_sink_input_set_volume(u->sink_input, &s->real_volume, s->save_volume, true);
+}
+
+/* Called from main context */
+static void sink_set_mute_cb(pa_sink *s) {
+    struct userdata *u;
+
+    pa_sink_assert_ref(s);
+    pa_assert_se(u = s->userdata);
+
+    if (!PA_SINK_IS_LINKED(pa_sink_get_state(s)) ||
+        !PA_SINK_INPUT_IS_LINKED(pa_sink_input_get_state(u->sink_input)))
+        return;
+
+    pa_sink_input_set_mute(u->sink_input, s->muted, s->save_muted);
+}
+
+/* Called from I/O thread context */
+static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk) {
+    struct userdata *u;
+    float *src, *dst;
+    size_t fs;
+    unsigned n;
+    pa_memchunk tchunk;
+
+    pa_sink_input_assert_ref(i);
+    pa_assert(chunk);
+    pa_assert_se(u = i->userdata);
+
+    /* Hmm, process any rewind request that might be queued up */
+    pa_sink_process_rewind(u->sink, 0);
+
+    while (pa_memblockq_peek(u->memblockq, &tchunk) < 0) {
+        pa_memchunk nchunk;
+
+        pa_sink_render(u->sink, nbytes, &nchunk);
+        pa_memblockq_push(u->memblockq, &nchunk);
+        pa_memblock_unref(nchunk.memblock);
+    }
+
+    tchunk.length = PA_MIN(nbytes, tchunk.length);
+    pa_assert(tchunk.length > 0);
+
+    fs = pa_frame_size(&i->sample_spec);
+    n = (unsigned) (tchunk.length / fs);
+
+    pa_assert(n > 0);
+
+    chunk->index = 0;
+    chunk->length = n*fs;
+    chunk->memblock = pa_memblock_new(i->sink->core->mempool, chunk->length);
+
+    pa_memblockq_drop(u->memblockq, chunk->length);
+
+    src = pa_memblock_acquire_chunk(&tchunk);
+    dst = pa_memblock_acquire(chunk->memblock);
+
+    process(u, dst, src, n);
+
+    pa_memblock_release(tchunk.memblock);
+    pa_memblock_release(chunk->memblock);
+
+    pa_memblock_unref(tchunk.memblock);
+
+    return 0;
+}
+
+/* Called from I/O thread context */
+static void sink_input_process_rewind_cb(pa_sink_input *i, size_t nbytes) {
+    struct userdata *u;
+    size_t amount = 0;
+
+    pa_sink_input_assert_ref(i);
+    pa_assert_se(u = i->userdata);
+
+    if (u->sink->thread_info.rewind_nbytes > 0) {
+        size_t max_rewrite;
+
+        max_rewrite = nbytes + pa_memblockq_get_length(u->memblockq);
+        amount = PA_MIN(u->sink->thread_info.rewind_nbytes, max_rewrite);
+        u->sink->thread_info.rewind_nbytes = 0;
+
+        if (amount > 0)
+            pa_memblockq_seek(u->memblockq, - (int64_t) amount, PA_SEEK_RELATIVE, true);
+    }
+
+    pa_sink_process_rewind(u->sink, amount);
+    rewind_filter(u, nbytes);
+}
+
+/* Called from I/O thread context */
+static void sink_input_update_max_rewind_cb(pa_sink_input *i, size_t nbytes) {
+    struct userdata *u;
+    size_t fs;
+
+    pa_sink_input_assert_ref(i);
+    pa_assert_se(u = i->userdata);
+
+    fs = pa_frame_size(&u->sink->sample_spec);
+    u->save_interval = PA_MAX((unsigned) (nbytes / fs / (PEQ_SAVED_STATES - 1)), (unsigned) PEQ_MIN_SAVE_INTERVAL);
+
+    /* Keep enough history to fast forward from the saved states. */
+    pa_memblockq_set_maxrewind(u->memblockq, nbytes + u->save_interval * fs);
+    pa_sink_set_max_rewind_within_thread(u->sink, nbytes);
+}
+
+/* Called from I/O thread context */
+static void sink_input_update_max_request_cb(pa_sink_input *i, size_t nbytes) {
+    struct userdata *u;
+
+    pa_sink_input_assert_ref(i);
+    pa_assert_se(u = i->userdata);
+
+    pa_sink_set_max_request_within_thread(u->sink, nbytes);
+}
+
+/* Called from I/O thread context */
+static void sink_input_update_sink_latency_range_cb(pa_sink_input *i) {
+    struct userdata *u;
+
+    pa_sink_input_assert_ref(i);
+    pa_assert_se(u = i->userdata);
+
+    pa_sink_set_latency_range_within_thread(u->sink, i->sink->thread_info.min_latency, i->sink->thread_info.max_latency);
+}
+
+/* Called from I/O thread context */
+static void sink_input_update_sink_fixed_latency_cb(pa_sink_input *i) {
+    struct userdata *u;
+
+    pa_sink_input_assert_ref(i);
+    pa_assert_se(u = i->userdata);
+
+    pa_sink_set_fixed_latency_within_thread(u->sink, i->sink->thread_info.fixed_latency);
+}
+
+/* Called from I/O thread context */
+static void sink_input_detach_cb(pa_sink_input *i) {
+    struct userdata *u;
+
+    pa_sink_input_assert_ref(i);
+    pa_assert_se(u = i->userdata);
+
+    pa_sink_detach_within_thread(u->sink);
+
+    pa_sink_set_rtpoll(u->sink, NULL);
+}
+
+/* Called from I/O thread context */
+static void sink_input_attach_cb(pa_sink_input *i) {
+    struct userdata *u;
+
+    pa_sink_input_assert_ref(i);
+    pa_assert_se(u = i->userdata);
+
+    pa_sink_set_rtpoll(u->sink, i->sink->thread_info.rtpoll);
+    pa_sink_set_latency_range_within_thread(u->sink, i->sink->thread_info.min_latency, i->sink->thread_info.max_latency);
+    pa_sink_set_fixed_latency_within_thread(u->sink, i->sink->thread_info.fixed_latency);
+    pa_sink_set_max_request_within_thread(u->sink, pa_sink_input_get_max_request(i));
+
+    /* FIXME: Too small max_rewind:
+     * https://bugs.freedesktop.org/show_bug.cgi?id=53709 */
+    pa_sink_set_max_rewind_within_thread(u->sink, pa_sink_input_get_max_rewind(i));
+
+    pa_sink_attach_within_thread(u->sink);
+}
+
+/* Called from main context */
+static void sink_input_kill_cb(pa_sink_input *i) {
+    struct userdata *u;
+
+    pa_sink_input_assert_ref(i);
+    pa_assert_se(u = i->userdata);
+
+    /* The order here matters! We first kill the sink input, followed
+     * by the sink. That means the sink callbacks must be protected
+     * against an unconnected sink input! */
+    pa_sink_input_unlink(u->sink_input);
+    pa_sink_unlink(u->sink);
+
+    pa_sink_input_unref(u->sink_input);
+    u->sink_input = NULL;
+
+    pa_sink_unref(u->sink);
+    u->sink = NULL;
+
+    pa_module_unload_request(u->module, true);
+}
+
+/* Called from IO thread context */
+static void sink_input_state_change_cb(pa_sink_input *i, pa_sink_input_state_t state) {
+    struct userdata *u;
+
+    pa_sink_input_assert_ref(i);
+    pa_assert_se(u = i->userdata);
+
+    /* If we are added for the first time, ask for a rewinding so that
+     * we are heard right-away. */
+    if (PA_SINK_INPUT_IS_LINKED(state) &&
+        i->thread_info.state == PA_SINK_INPUT_INIT) {
+        pa_log_debug("Requesting rewind due to state change.");
+        pa_sink_input_request_rewind(i, 0, false, true, true);
+    }
+}
+
+/* Called from main context */
+static void sink_input_moving_cb(pa_sink_input *i, pa_sink *dest) {
+    struct userdata *u;
+
+    pa_sink_input_assert_ref(i);
+    pa_assert_se(u = i->userdata);
+
+    if (dest) {
+        pa_sink_set_asyncmsgq(u->sink, dest->asyncmsgq);
+        pa_sink_update_flags(u->sink, PA_SINK_LATENCY|PA_SINK_DYNAMIC_LATENCY, dest->flags);
+    } else
+        pa_sink_set_asyncmsgq(u->sink, NULL);
+
+    if (u->auto_desc && dest) {
+        const char *z;
+        pa_proplist *pl;
+
+        pl = pa_proplist_new();
+        z = pa_proplist_gets(dest->proplist, PA_PROP_DEVICE_DESCRIPTION);
+        pa_proplist_setf(pl, PA_PROP_DEVICE_DESCRIPTION, "Parametric Equalizer %s on %s",
+                         pa_proplist_gets(u->sink->proplist, "device.peq.name"), z ? z : dest->name);
+
+        pa_sink_update_proplist(u->sink, PA_UPDATE_REPLACE, pl);
+        pa_proplist_free(pl);
+    }
+}
+
+/* Called from main context */
+static void sink_input_volume_changed_cb(pa_sink_input *i) {
+    struct userdata *u;
+
+    pa_sink_input_assert_ref(i);
+    pa_assert_se(u = i->userdata);
+
+    pa_sink_volume_changed(u->sink, &i->volume);
+}
+
+/* Called from main context */
+static void sink_input_mute_changed_cb(pa_sink_input *i) {
+    struct userdata *u;
+
+    pa_sink_input_assert_ref(i);
+    pa_assert_se(u = i->userdata);
+
+    pa_sink_mute_changed(u->sink, i->muted);
+}
+
+/* Called from main context */
+static pa_hook_result_t sink_proplist_changed_cb(pa_core *c, pa_sink *s, struct userdata *u) {
+    struct cascade_update update;
+    const char *bands;
+    pa_proplist *pl;
+
+    pa_assert(c);
+    pa_sink_assert_ref(s);
+    pa_assert(u);
+
+    if (s != u->sink)
+        return PA_HOOK_OK;
+
+    if (!(bands = pa_proplist_gets(s->proplist, PEQ_BANDS_PROPERTY)) || pa_streq(bands, u->bands))
+        return PA_HOOK_OK;
+
+    if ((update.bc = pa_biquad_cascade_new_from_bands(bands, u->channels, u->rate))) {
+        pa_log_info("Changing bands of %s to %s", s->name, bands);
+
+        pa_xfree(u->bands);
+        u->bands = pa_xstrdup(bands);
+
+        update.old = NULL;
+
+        /* While moving there is no I/O thread to hand the filters over to. */
+        if (u->sink->asyncmsgq)
+            pa_assert_se(pa_asyncmsgq_send(u->sink->asyncmsgq, PA_MSGOBJECT(u->sink), SINK_MESSAGE_SET_CASCADE, &update, 0, NULL) == 0);
+        else
+            update.old = cascade_swap(u, update.bc);
+
+        if (update.old)
+            pa_biquad_cascade_free(update.old);
+
+        return PA_HOOK_OK;
+    }
+
+    pa_log("Invalid bands '%s', keeping '%s'", bands, u->bands);
+
+    /* This calls us again, but then the bands match. */
+    pl = pa_proplist_new();
+    pa_proplist_sets(pl, PEQ_BANDS_PROPERTY, u->bands);
+    pa_sink_update_proplist(u->sink, PA_UPDATE_REPLACE, pl);
+    pa_proplist_free(pl);
+
+    return PA_HOOK_OK;
+}
+
+int pa__init(pa_module*m) {
+    struct userdata *u;
+    pa_sample_spec ss;
+    pa_channel_map map;
+    pa_modargs *ma;
+    pa_sink *master=NULL;
+    pa_sink_input_new_data sink_input_data;
+    pa_sink_new_data sink_data;
+    bool use_volume_sharing = true;
+    bool force_flat_volume = false;
+    pa_memchunk silence;
+    size_t state_size;
+    pa_biquad_cascade *max_bc;
+    unsigned i;
+
+    pa_assert(m);
+
+    if (!(ma = pa_modargs_new(m->argument, valid_modargs))) {
+        pa_log("Failed to parse module arguments.");
+        goto fail;
+    }
+
+    if (!(master = pa_namereg_get(m->core, pa_modargs_get_value(ma, "master", NULL), PA_NAMEREG_SINK))) {
+        pa_log("Master sink not found");
+        goto fail;
+    }
+
+    pa_assert(master);
+
+    ss = master->sample_spec;
+    ss.format = PA_SAMPLE_FLOAT32;
+    map = master->channel_map;
+    if (pa_modargs_get_sample_spec_and_channel_map(ma, &ss, &map, PA_CHANNEL_MAP_DEFAULT) < 0) {
+        pa_log("Invalid sample format specification or channel map");
+        goto fail;
+    }
+
+    if (pa_modargs_get_value_boolean(ma, "use_volume_sharing", &use_volume_sharing) < 0) {
+        pa_log("use_volume_sharing= expects a boolean argument");
+        goto fail;
+    }
+
+    if (pa_modargs_get_value_boolean(ma, "force_flat_volume", &force_flat_volume) < 0) {
+        pa_log("force_flat_volume= expects a boolean argument");
+        goto fail;
+    }
+
+    if (use_volume_sharing && force_flat_volume) {
+        pa_log("Flat volume can't be forced when using volume sharing.");
+        goto fail;
+    }
+
+    u = pa_xnew0(struct userdata, 1);
+    u->module = m;
+    m->userdata = u;
+    u->channels = ss.channels;
+    u->rate = ss.rate;
+    u->bands = pa_xstrdup(pa_modargs_get_value(ma, "bands", ""));
+
+    if (!(u->bc = pa_biquad_cascade_new_from_bands(u->bands, u->channels, u->rate))) {
+        pa_log("Invalid bands '%s'", u->bands);
+        goto fail;
+    }
+
+    /* Saved states must fit the largest cascade the bands can be changed
+     * to. */
+    max_bc = pa_biquad_cascade_new(u->channels, PA_BIQUAD_CASCADE_MAX_BANDS);
+    state_size = pa_biquad_cascade_state_size(max_bc);
+    pa_biquad_cascade_free(max_bc);
+
+    for (i = 0; i < PEQ_SAVED_STATES; i++)
+        u->saved[i].state = pa_xmalloc(state_size);
+    u->save_interval = PEQ_MIN_SAVE_INTERVAL;
+
+    u->fade_frames = (unsigned) PA_MAX(pa_usec_to_bytes(PEQ_FADE_USEC, &ss) / pa_frame_size(&ss), (size_t) 1);
+    u->scratch = pa_xnew(float, PEQ_SCRATCH_FRAMES * u->channels);
+
+    /* Create sink */
+    pa_sink_new_data_init(&sink_data);
+    sink_data.driver = __FILE__;
+    sink_data.module = m;
+    if (!(sink_data.name = pa_xstrdup(pa_modargs_get_value(ma, "sink_name", NULL))))
+        sink_data.name = pa_sprintf_malloc("%s.peq", master->name);
+    pa_sink_new_data_set_sample_spec(&sink_data, &ss);
+    pa_sink_new_data_set_channel_map(&sink_data, &map);
+    pa_proplist_sets(sink_data.proplist, PA_PROP_DEVICE_MASTER_DEVICE, master->name);
+    pa_proplist_sets(sink_data.proplist, PA_PROP_DEVICE_CLASS, "filter");
+    pa_proplist_sets(sink_data.proplist, "device.peq.name", sink_data.name);
+
+    if (pa_modargs_get_proplist(ma, "sink_properties", sink_data.proplist, PA_UPDATE_REPLACE) < 0) {
+        pa_log("Invalid properties");
+        pa_sink_new_data_done(&sink_data);
+        goto fail;
+    }
+
+    /* The bands modarg wins over sink_properties. */
+    pa_proplist_sets(sink_data.proplist, PEQ_BANDS_PROPERTY, u->bands);
+
+    if ((u->auto_desc = !pa_proplist_contains(sink_data.proplist, PA_PROP_DEVICE_DESCRIPTION))) {
+        const char *z;
+
+        z = pa_proplist_gets(master->proplist, PA_PROP_DEVICE_DESCRIPTION);
+        pa_proplist_setf(sink_data.proplist, PA_PROP_DEVICE_DESCRIPTION, "Parametric Equalizer %s on %s", sink_data.name, z ? z : master->name);
+    }
+
+    u->sink = pa_sink_new(m->core, &sink_data, (master->flags & (PA_SINK_LATENCY|PA_SINK_DYNAMIC_LATENCY))
+                                               | (use_volume_sharing ? PA_SINK_SHARE_VOLUME_WITH_MASTER : 0));
+    pa_sink_new_data_done(&sink_data);
+
+    if (!u->sink) {
+        pa_log("Failed to create sink.");
+        goto fail;
+    }
+
+    u->sink->parent.process_msg = sink_process_msg_cb;
+    u->sink->set_state = sink_set_state_cb;
+    u->sink->update_requested_latency = sink_update_requested_latency_cb;
+    u->sink->request_rewind = sink_request_rewind_cb;
+    pa_sink_set_set_mute_callback(u->sink, sink_set_mute_cb);
+    if (!use_volume_sharing) {
+        pa_sink_set_set_volume_callback(u->sink, sink_set_volume_cb);
+        pa_sink_enable_decibel_volume(u->sink, true);
+    }
+    /* Normally this flag would be enabled automatically be we can force it. */
+    if (force_flat_volume)
+        u->sink->flags |= PA_SINK_FLAT_VOLUME;
+    u->sink->userdata = u;
+
+    pa_sink_set_asyncmsgq(u->sink, master->asyncmsgq);
+
+    /* Create sink input */
+    pa_sink_input_new_data_init(&sink_input_data);
+    sink_input_data.driver = __FILE__;
+    sink_input_data.module = m;
+    pa_sink_input_new_data_set_sink(&sink_input_data, master, false);
+    sink_input_data.origin_sink = u->sink;
+    pa_proplist_setf(sink_input_data.proplist, PA_PROP_MEDIA_NAME, "Parametric Equalizer Stream from %s", pa_proplist_gets(u->sink->proplist, PA_PROP_DEVICE_DESCRIPTION));
+    pa_proplist_sets(sink_input_data.proplist, PA_PROP_MEDIA_ROLE, "filter");
+    pa_sink_input_new_data_set_sample_spec(&sink_input_data, &ss);
+    pa_sink_input_new_data_set_channel_map(&sink_input_data, &map);
+
+    pa_sink_input_new(&u->sink_input, m->core, &sink_input_data);
+    pa_sink_input_new_data_done(&sink_input_data);
+
+    if (!u->sink_input)
+        goto fail;
+
+    u->sink_input->pop = sink_input_pop_cb;
+    u->sink_input->process_rewind = sink_input_process_rewind_cb;
+    u->sink_input->update_max_rewind = sink_input_update_max_rewind_cb;
+    u->sink_input->update_max_request = sink_input_update_max_request_cb;
+    u->sink_input->update_sink_latency_range = sink_input_update_sink_latency_range_cb;
+    u->sink_input->update_sink_fixed_latency = sink_input_update_sink_fixed_latency_cb;
+    u->sink_input->kill = sink_input_kill_cb;
+    u->sink_input->attach = sink_input_attach_cb;
+    u->sink_input->detach = sink_input_detach_cb;
+    u->sink_input->state_change = sink_input_state_change_cb;
+    u->sink_input->moving = sink_input_moving_cb;
+    u->sink_input->volume_changed = use_volume_sharing ? NULL : sink_input_volume_changed_cb;
+    u->sink_input->mute_changed = sink_input_mute_changed_cb;
+    u->sink_input->userdata = u;
+
+    u->sink->input_to_master = u->sink_input;
+
+    pa_sink_input_get_silence(u->sink_input, &silence);
+    u->memblockq = pa_memblockq_new("module-parametric-eq-sink memblockq", 0, MEMBLOCKQ_MAXLENGTH, 0, &ss, 1, 1, 0, &silence);
+    pa_memblock_unref(silence.memblock);
+
+    pa_module_hook_connect(m, &m->core->hooks[PA_CORE_HOOK_SINK_PROPLIST_CHANGED], PA_HOOK_NORMAL, (pa_hook_cb_t) sink_proplist_changed_cb, u);
+
+    pa_sink_put(u->sink);
+    pa_sink_input_put(u->sink_input);
+
+    pa_modargs_free(ma);
+
+    return 0;
+
+fail:
+    if (ma)
+        pa_modargs_free(ma);
+
+    pa__done(m);
+
+    return -1;
+}
+
+int pa__get_n_used(pa_module *m) {
+    struct userdata *u;
+
+    pa_assert(m);
+    pa_assert_se(u = m->userdata);
+
+    return pa_sink_linked_by(u->sink);
+}
+
+void pa__done(pa_module*m) {
+    struct userdata *u;
+    unsigned i;
+
+    pa_assert(m);
+
+    if (!(u = m->userdata))
+        return;
+
+    /* See comments in sink_input_kill_cb() above regarding
+     * destruction order! */
+
+    if (u->sink_input)
+        pa_sink_input_unlink(u->sink_input);
+
+    if (u->sink)
+        pa_sink_unlink(u->sink);
+
+    if (u->sink_input)
+        pa_sink_input_unref(u->sink_input);
+
+    if (u->sink)
+        pa_sink_unref(u->sink);
+
+    if (u->memblockq)
+        pa_memblockq_free(u->memblockq);
+
+    if (u->bc)
+        pa_biquad_cascade_free(u->bc);
+
+    if (u->bc_fade)
+        pa_biquad_cascade_free(u->bc_fade);
+
+    for (i = 0; i < PEQ_SAVED_STATES; i++)
+        pa_xfree(u->saved[i].state);
+
+    pa_xfree(u->scratch);
+    pa_xfree(u->bands);
+    pa_xfree(u);
+}
@@ -1403,30 +1403,38 @@ static void command_subscribe_event(pa_pdispatch *pd,  uint32_t command,  uint32
     struct userdata *u = userdata;
     pa_subscription_event_type_t e;
     uint32_t idx;
+    bool changed = false;
 
     pa_assert(pd);
     pa_assert(t);
     pa_assert(u);
     pa_assert(command == PA_COMMAND_SUBSCRIBE_EVENT);
 
-    if (pa_tagstruct_getu32(t, &e) < 0 ||
-        pa_tagstruct_getu32(t, &idx) < 0) {
-        pa_log("Invalid protocol reply");
-        pa_module_unload_request(u->module, true);
-        return;
-    }
+    /* Starting with protocol version 33 the server may batch several
+     * events into a single packet */
+    do {
+        if (pa_tagstruct_getu32(t, &e) < 0 ||
+            pa_tagstruct_getu32(t, &idx) < 0) {
+            pa_log("Invalid protocol reply");
+            pa_module_unload_request(u->module, true);
+            return;
+        }
 
-    if (e != (PA_SUBSCRIPTION_EVENT_SERVER|PA_SUBSCRIPTION_EVENT_CHANGE) &&
+        if (e == (PA_SUBSCRIPTION_EVENT_SERVER|PA_SUBSCRIPTION_EVENT_CHANGE) ||
 #ifdef TUNNEL_SINK
-        e != (PA_SUBSCRIPTION_EVENT_SINK_INPUT|PA_SUBSCRIPTION_EVENT_CHANGE) &&
-        e != (PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_CHANGE)
+            e == (PA_SUBSCRIPTION_EVENT_SINK_INPUT|PA_SUBSCRIPTION_EVENT_CHANGE) ||
+            e == (PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_CHANGE)
 #else
-        e != (PA_SUBSCRIPTION_EVENT_SOURCE|PA_SUBSCRIPTION_EVENT_CHANGE)
+            e == (PA_SUBSCRIPTION_EVENT_SOURCE|PA_SUBSCRIPTION_EVENT_CHANGE)
 #endif
-        )
-        return;
+            )
+            changed = true;
 
-    request_info(u);
+    } while (!pa_tagstruct_eof(t));
+
+    /* One round of queries covers all events of the packet */
+    if (changed)
+        request_info(u);
 }
 
 /* Called from main context */
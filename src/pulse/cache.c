@@ -0,0 +1,824 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/macro.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/idxset.h>
+#include <pulsecore/llist.h>
+
+#include "internal.h"
+#include "cache.h"
+
+#define PA_CACHE_MASK_SUPPORTED \
+    (PA_SUBSCRIPTION_MASK_SINK|PA_SUBSCRIPTION_MASK_SOURCE|  \
+     PA_SUBSCRIPTION_MASK_SINK_INPUT|PA_SUBSCRIPTION_MASK_SOURCE_OUTPUT| \
+     PA_SUBSCRIPTION_MASK_MODULE|PA_SUBSCRIPTION_MASK_CLIENT| \
+     PA_SUBSCRIPTION_MASK_CARD)
+
+/* An outstanding introspection query, either for the full list of a
+ * facility (index == PA_INVALID_INDEX) or for a single object */
+struct pa_cache_request {
+    pa_cache *cache;
+    pa_subscription_event_type_t facility;
+    uint32_t index;
+
+    /* Another change event arrived while this query was in flight */
+    bool dirty;
+
+    pa_operation *operation;
+
+    PA_LLIST_FIELDS(pa_cache_request);
+};
+
+static void request_send(pa_cache_request *r);
+
+/*** Copying and freeing of info structures ***/
+
+static void sink_info_free(pa_sink_info *i) {
+    unsigned j;
+
+    pa_xfree((char*) i->name);
+    pa_xfree((char*) i->description);
+    pa_xfree((char*) i->monitor_source_name);
+    pa_xfree((char*) i->driver);
+
+    if (i->proplist)
+        pa_proplist_free(i->proplist);
+
+    for (j = 0; j < i->n_ports; j++) {
+        pa_xfree((char*) i->ports[j]->name);
+        pa_xfree((char*) i->ports[j]->description);
+        pa_xfree(i->ports[j]);
+    }
+    pa_xfree(i->ports);
+
+    for (j = 0; j < i->n_formats; j++)
+        pa_format_info_free(i->formats[j]);
+    pa_xfree(i->formats);
+
+    pa_xfree(i);
+}
+
+static pa_sink_info* sink_info_copy(const pa_sink_info *i) {
+    pa_sink_info *n;
+    unsigned j;
+
+    n = pa_xnewdup(pa_sink_info, i, 1);
+    n->name = pa_xstrdup(i->name);
+    n->description = pa_xstrdup(i->description);
+    n->monitor_source_name = pa_xstrdup(i->monitor_source_name);
+    n->driver = pa_xstrdup(i->driver);
+    n->proplist = i->proplist ? pa_proplist_copy(i->proplist) : NULL;
+
+    n->active_port = NULL;
+    n->ports = NULL;
+    if (i->n_ports > 0) {
+        n->ports = pa_xnew0(pa_sink_port_info*, i->n_ports + 1);
+
+        for (j = 0; j < i->n_ports; j++) {
+            n->ports[j] = pa_xnewdup(pa_sink_port_info, i->ports[j], 1);
+            n->ports[j]->name = pa_xstrdup(i->ports[j]->name);
+            n->ports[j]->description = pa_xstrdup(i->ports[j]->description);
+
+            if (i->ports[j] == i->active_port)
+                n->active_port = n->ports[j];
+        }
+    }
+
+    n->formats = NULL;
+    if (i->n_formats > 0) {
+        n->formats = pa_xnew0(pa_format_info*, i->n_formats);
+
+        for (j = 0; j < i->n_formats; j++)
+            n->formats[j] = pa_format_info_copy(i->formats[j]);
+    }
+
+    return n;
+}
+
+static void source_info_free(pa_source_info *i) {
+    unsigned j;
+
+    pa_xfree((char*) i->name);
+    pa_xfree((char*) i->description);
+    pa_xfree((char*) i->monitor_of_sink_name);
+    pa_xfree((char*) i->driver);
+
+    if (i->proplist)
+        pa_proplist_free(i->proplist);
+
+    for (j = 0; j < i->n_ports; j++) {
+        pa_xfree((char*) i->ports[j]->name);
+        pa_xfree((char*) i->ports[j]->description);
+        pa_xfree(i->ports[j]);
+    }
+    pa_xfree(i->ports);
+
+    for (j = 0; j < i->n_formats; j++)
+        pa_format_info_free(i->formats[j]);
+    pa_xfree(i->formats);
+
+    pa_xfree(i);
+}
+
+static pa_source_info* source_info_copy(const pa_source_info *i) {
+    pa_source_info *n;
+    unsigned j;
+
+    n = pa_xnewdup(pa_source_info, i, 1);
+    n->name = pa_xstrdup(i->name);
+    n->description = pa_xstrdup(i->description);
+    n->monitor_of_sink_name = pa_xstrdup(i->monitor_of_sink_name);
+    n->driver = pa_xstrdup(i->driver);
+    n->proplist = i->proplist ? pa_proplist_copy(i->proplist) : NULL;
+
+    n->active_port = NULL;
+    n->ports = NULL;
+    if (i->n_ports > 0) {
+        n->ports = pa_xnew0(pa_source_port_info*, i->n_ports + 1);
+
+        for (j = 0; j < i->n_ports; j++) {
+            n->ports[j] = pa_xnewdup(pa_source_port_info, i->ports[j], 1);
+            n->ports[j]->name = pa_xstrdup(i->ports[j]->name);
+            n->ports[j]->description = pa_xstrdup(i->ports[j]->description);
+
+            if (i->ports[j] == i->active_port)
+                n->active_port = n->ports[j];
+        }
+    }
+
+    n->formats = NULL;
+    if (i->n_formats > 0) {
+        n->formats = pa_xnew0(pa_format_info*, i->n_formats);
+
+        for (j = 0; j < i->n_formats; j++)
+            n->formats[j] = pa_format_info_copy(i->formats[j]);
+    }
+
+    return n;
+}
+
+static void sink_input_info_free(pa_sink_input_info *i) {
+    pa_xfree((char*) i->name);
+    pa_xfree((char*) i->resample_method);
+    pa_xfree((char*) i->driver);
+
+    if (i->proplist)
+        pa_proplist_free(i->proplist);
+    if (i->format)
+        pa_format_info_free(i->format);
+
+    pa_xfree(i);
+}
+
+static pa_sink_input_info* sink_input_info_copy(const pa_sink_input_info *i) {
+    pa_sink_input_info *n;
+
+    n = pa_xnewdup(pa_sink_input_info, i, 1);
+    n->name = pa_xstrdup(i->name);
+    n->resample_method = pa_xstrdup(i->resample_method);
+    n->driver = pa_xstrdup(i->driver);
+    n->proplist = i->proplist ? pa_proplist_copy(i->proplist) : NULL;
+    n->format = i->format ? pa_format_info_copy(i->format) : NULL;
+
+    return n;
+}
+
+static void source_output_info_free(pa_source_output_info *i) {
+    pa_xfree((char*) i->name);
+    pa_xfree((char*) i->resample_method);
+    pa_xfree((char*) i->driver);
+
+    if (i->proplist)
+        pa_proplist_free(i->proplist);
+    if (i->format)
+        pa_format_info_free(i->format);
+
+    pa_xfree(i);
+}
+
+static pa_source_output_info* source_output_info_copy(const pa_source_output_info *i) {
+    pa_source_output_info *n;
+
+    n = pa_xnewdup(pa_source_output_info, i, 1);
+    n->name = pa_xstrdup(i->name);
+    n->resample_method = pa_xstrdup(i->resample_method);
+    n->driver = pa_xstrdup(i->driver);
+    n->proplist = i->proplist ? pa_proplist_copy(i->proplist) : NULL;
+    n->format = i->format ? pa_format_info_copy(i->format) : NULL;
+
+    return n;
+}
+
+static void client_info_free(pa_client_info *i) {
+    pa_xfree((char*) i->name);
+    pa_xfree((char*) i->driver);
+
+    if (i->proplist)
+        pa_proplist_free(i->proplist);
+
+    pa_xfree(i);
+}
+
+static pa_client_info* client_info_copy(const pa_client_info *i) {
+    pa_client_info *n;
+
+    n = pa_xnewdup(pa_client_info, i, 1);
+    n->name = pa_xstrdup(i->name);
+    n->driver = pa_xstrdup(i->driver);
+    n->proplist = i->proplist ? pa_proplist_copy(i->proplist) : NULL;
+
+    return n;
+}
+
+static void module_info_free(pa_module_info *i) {
+    pa_xfree((char*) i->name);
+    pa_xfree((char*) i->argument);
+
+    if (i->proplist)
+        pa_proplist_free(i->proplist);
+
+    pa_xfree(i);
+}
+
+static pa_module_info* module_info_copy(const pa_module_info *i) {
+    pa_module_info *n;
+
+    n = pa_xnewdup(pa_module_info, i, 1);
+    n->name = pa_xstrdup(i->name);
+    n->argument = pa_xstrdup(i->argument);
+    n->proplist = i->proplist ? pa_proplist_copy(i->proplist) : NULL;
+
+    return n;
+}
+
+static void card_info_free(pa_card_info *i) {
+    unsigned j;
+
+    /* The names and descriptions in profiles2 are shared with the
+     * profiles array, like in introspect.c */
+    for (j = 0; j < i->n_profiles; j++) {
+        pa_xfree((char*) i->profiles[j].name);
+        pa_xfree((char*) i->profiles[j].description);
+        pa_xfree(i->profiles2[j]);
+    }
+    pa_xfree(i->profiles);
+    pa_xfree(i->profiles2);
+
+    for (j = 0; j < i->n_ports; j++) {
+        pa_xfree((char*) i->ports[j]->name);
+        pa_xfree((char*) i->ports[j]->description);
+        pa_xfree(i->ports[j]->profiles);
+        pa_xfree(i->ports[j]->profiles2);
+        if (i->ports[j]->proplist)
+            pa_proplist_free(i->ports[j]->proplist);
+        pa_xfree(i->ports[j]);
+    }
+    pa_xfree(i->ports);
+
+    pa_xfree((char*) i->name);
+    pa_xfree((char*) i->driver);
+
+    if (i->proplist)
+        pa_proplist_free(i->proplist);
+
+    pa_xfree(i);
+}
+
+/* Find the position of a profile of the original card info, so that
+ * the copied pointers can be pointed to the copied profiles */
+static unsigned card_profile_position(const pa_card_info *i, const pa_card_profile_info2 *p) {
+    unsigned j;
+
+    for (j = 0; j < i->n_profiles; j++)
+        if (i->profiles2[j] == p)
+            break;
+
+    return j;
+}
+
+static pa_card_info* card_info_copy(const pa_card_info *i) {
+    pa_card_info *n;
+    unsigned j, k;
+
+    n = pa_xnewdup(pa_card_info, i, 1);
+    n->name = pa_xstrdup(i->name);
+    n->driver = pa_xstrdup(i->driver);
+    n->proplist = i->proplist ? pa_proplist_copy(i->proplist) : NULL;
+
+    n->profiles = pa_xnew0(pa_card_profile_info, i->n_profiles + 1);
+    n->profiles2 = pa_xnew0(pa_card_profile_info2*, i->n_profiles + 1);
+    n->active_profile = NULL;
+    n->active_profile2 = NULL;
+
+    for (j = 0; j < i->n_profiles; j++) {
+        n->profiles[j] = i->profiles[j];
+        n->profiles[j].name = pa_xstrdup(i->profiles[j].name);
+        n->profiles[j].description = pa_xstrdup(i->profiles[j].description);
+
+        n->profiles2[j] = pa_xnewdup(pa_card_profile_info2, i->profiles2[j], 1);
+        n->profiles2[j]->name = n->profiles[j].name;
+        n->profiles2[j]->description = n->profiles[j].description;
+
+        if (i->profiles2[j] == i->active_profile2) {
+            n->active_profile = &n->profiles[j];
+            n->active_profile2 = n->profiles2[j];
+        }
+    }
+
+    n->ports = NULL;
+    if (i->n_ports > 0) {
+        n->ports = pa_xnew0(pa_card_port_info*, i->n_ports + 1);
+
+        for (j = 0; j < i->n_ports; j++) {
+            const pa_card_port_info *p = i->ports[j];
+            pa_card_port_info *np;
+
+            np = n->ports[j] = pa_xnewdup(pa_card_port_info, p, 1);
+            np->name = pa_xstrdup(p->name);
+            np->description = pa_xstrdup(p->description);
+            np->proplist = p->proplist ? pa_proplist_copy(p->proplist) : NULL;
+            np->profiles = NULL;
+            np->profiles2 = NULL;
+
+            if (p->n_profiles > 0) {
+                np->profiles = pa_xnew0(pa_card_profile_info*, i->n_profiles + 1);
+                np->profiles2 = pa_xnew0(pa_card_profile_info2*, i->n_profiles + 1);
+
+                for (k = 0; k < p->n_profiles; k++) {
+                    unsigned l = card_profile_position(i, p->profiles2[k]);
+
+                    pa_assert(l < i->n_profiles);
+                    np->profiles[k] = &n->profiles[l];
+                    np->profiles2[k] = n->profiles2[l];
+                }
+            }
+        }
+    }
+
+    return n;
+}
+
+/*** Requests ***/
+
+static pa_cache_request* request_new(pa_cache *cache, pa_subscription_event_type_t facility, uint32_t idx) {
+    pa_cache_request *r;
+
+    r = pa_xnew0(pa_cache_request, 1);
+    r->cache = cache;
+    r->facility = facility;
+    r->index = idx;
+
+    PA_LLIST_PREPEND(pa_cache_request, cache->requests, r);
+
+    if (idx == PA_INVALID_INDEX)
+        cache->n_list_requests++;
+
+    return r;
+}
+
+static void request_free(pa_cache_request *r) {
+    pa_assert(r);
+
+    if (r->operation) {
+        pa_operation_cancel(r->operation);
+        pa_operation_unref(r->operation);
+    }
+
+    if (r->index == PA_INVALID_INDEX)
+        r->cache->n_list_requests--;
+
+    PA_LLIST_REMOVE(pa_cache_request, r->cache->requests, r);
+    pa_xfree(r);
+}
+
+static pa_cache_request* request_find(pa_cache *cache, pa_subscription_event_type_t facility, uint32_t idx) {
+    pa_cache_request *r;
+
+    for (r = cache->requests; r; r = r->next)
+        if (r->facility == facility && r->index == idx)
+            return r;
+
+    return NULL;
+}
+
+static void check_ready(pa_cache *cache) {
+    pa_assert(cache);
+
+    if (cache->ready || cache->n_list_requests > 0)
+        return;
+
+    cache->ready = true;
+
+    if (cache->ready_callback)
+        cache->ready_callback(cache, cache->ready_userdata);
+}
+
+/* Called when a query has been completely answered (eol != 0) */
+static void request_done(pa_cache_request *r) {
+    pa_cache *cache = r->cache;
+
+    pa_operation_unref(r->operation);
+    r->operation = NULL;
+
+    if (r->dirty && r->index != PA_INVALID_INDEX) {
+        r->dirty = false;
+        request_send(r);
+        return;
+    }
+
+    request_free(r);
+    check_ready(cache);
+}
+
+static void object_update(pa_cache_request *r, uint32_t idx, void *info) {
+    pa_cache *cache = r->cache;
+    pa_subscription_event_type_t t;
+
+    t = r->facility;
+    if (pa_hashmap_remove_and_free(cache->objects[r->facility], PA_UINT32_TO_PTR(idx)) < 0)
+        t |= PA_SUBSCRIPTION_EVENT_NEW;
+    else
+        t |= PA_SUBSCRIPTION_EVENT_CHANGE;
+
+    pa_assert_se(pa_hashmap_put(cache->objects[r->facility], PA_UINT32_TO_PTR(idx), info) >= 0);
+
+    if (cache->ready && cache->change_callback)
+        cache->change_callback(cache, t, idx, cache->change_userdata);
+}
+
+static void sink_info_cb(pa_context *c, const pa_sink_info *i, int eol, void *userdata) {
+    if (eol)
+        request_done(userdata);
+    else
+        object_update(userdata, i->index, sink_info_copy(i));
+}
+
+static void source_info_cb(pa_context *c, const pa_source_info *i, int eol, void *userdata) {
+    if (eol)
+        request_done(userdata);
+    else
+        object_update(userdata, i->index, source_info_copy(i));
+}
+
+static void sink_input_info_cb(pa_context *c, const pa_sink_input_info *i, int eol, void *userdata) {
+    if (eol)
+        request_done(userdata);
+    else
+        object_update(userdata, i->index, sink_input_info_copy(i));
+}
+
+static void source_output_info_cb(pa_context *c, const pa_source_output_info *i, int eol, void *userdata) {
+    if (eol)
+        request_done(userdata);
+    else
+        object_update(userdata, i->index, source_output_info_copy(i));
+}
+
+static void client_info_cb(pa_context *c, const pa_client_info *i, int eol, void *userdata) {
+    if (eol)
+        request_done(userdata);
+    else
+        object_update(userdata, i->index, client_info_copy(i));
+}
+
+static void card_info_cb(pa_context *c, const pa_card_info *i, int eol, void *userdata) {
+    if (eol)
+        request_done(userdata);
+    else
+        object_update(userdata, i->index, card_info_copy(i));
+}
+
+static void module_info_cb(pa_context *c, const pa_module_info *i, int eol, void *userdata) {
+    if (eol)
+        request_done(userdata);
+    else
+        object_update(userdata, i->index, module_info_copy(i));
+}
+
+static void request_send(pa_cache_request *r) {
+    pa_context *c = r->cache->context;
+    bool list = r->index == PA_INVALID_INDEX;
+
+    pa_assert(!r->operation);
+
+    switch (r->facility) {
+        case PA_SUBSCRIPTION_EVENT_SINK:
+            r->operation = list ?
+                pa_context_get_sink_info_list(c, sink_info_cb, r) :
+                pa_context_get_sink_info_by_index(c, r->index, sink_info_cb, r);
+            break;
+
+        case PA_SUBSCRIPTION_EVENT_SOURCE:
+            r->operation = list ?
+                pa_context_get_source_info_list(c, source_info_cb, r) :
+                pa_context_get_source_info_by_index(c, r->index, source_info_cb, r);
+            break;
+
+        case PA_SUBSCRIPTION_EVENT_SINK_INPUT:
+            r->operation = list ?
+                pa_context_get_sink_input_info_list(c, sink_input_info_cb, r) :
+                pa_context_get_sink_input_info(c, r->index, sink_input_info_cb, r);
+            break;
+
+        case PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT:
+            r->operation = list ?
+                pa_context_get_source_output_info_list(c, source_output_info_cb, r) :
+                pa_context_get_source_output_info(c, r->index, source_output_info_cb, r);
+            break;
+
+        case PA_SUBSCRIPTION_EVENT_CLIENT:
+            r->operation = list ?
+                pa_context_get_client_info_list(c, client_info_cb, r) :
+                pa_context_get_client_info(c, r->index, client_info_cb, r);
+            break;
+
+        case PA_SUBSCRIPTION_EVENT_CARD:
+            r->operation = list ?
+                pa_context_get_card_info_list(c, card_info_cb, r) :
+                pa_context_get_card_info_by_index(c, r->index, card_info_cb, r);
+            break;
+
+        case PA_SUBSCRIPTION_EVENT_MODULE:
+            r->operation = list ?
+                pa_context_get_module_info_list(c, module_info_cb, r) :
+                pa_context_get_module_info(c, r->index, module_info_cb, r);
+            break;
+
+        default:
+            pa_assert_not_reached();
+    }
+
+    /* The context is going away, nothing we can do about it */
+    if (!r->operation)
+        request_free(r);
+}
+
+/*** Event handling ***/
+
+/* Called from pa_command_subscribe_event() for every cache of the context */
+void pa_cache_process_event(pa_cache *cache, pa_subscription_event_type_t t, uint32_t idx) {
+    pa_subscription_event_type_t facility;
+    pa_cache_request *r;
+
+    pa_assert(cache);
+
+    if (!pa_subscription_match_flags(cache->mask, t))
+        return;
+
+    facility = t & PA_SUBSCRIPTION_EVENT_FACILITY_MASK;
+    r = request_find(cache, facility, idx);
+
+    if ((t & PA_SUBSCRIPTION_EVENT_TYPE_MASK) == PA_SUBSCRIPTION_EVENT_REMOVE) {
+
+        if (r)
+            request_free(r);
+
+        if (pa_hashmap_remove_and_free(cache->objects[facility], PA_UINT32_TO_PTR(idx)) >= 0 &&
+            cache->ready && cache->change_callback)
+            cache->change_callback(cache, t, idx, cache->change_userdata);
+
+        return;
+    }
+
+    /* If a query for this object is already in flight, its answer may
+     * predate this event. Don't send a second one right away, but
+     * query again once the answer is in. */
+    if (r) {
+        r->dirty = true;
+        return;
+    }
+
+    request_send(request_new(cache, facility, idx));
+}
+
+/*** Public API ***/
+
+pa_cache* pa_cache_new(pa_context *c, pa_subscription_mask_t m) {
+    pa_cache *cache;
+    pa_operation *o;
+    unsigned f;
+
+    pa_assert(c);
+    pa_assert(PA_REFCNT_VALUE(c) >= 1);
+
+    PA_CHECK_VALIDITY_RETURN_NULL(c, c->state == PA_CONTEXT_READY, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, m != 0 && (m & ~PA_CACHE_MASK_SUPPORTED) == 0, PA_ERR_INVALID);
+
+    cache = pa_xnew0(pa_cache, 1);
+    cache->context = pa_context_ref(c);
+    cache->mask = m;
+
+    PA_LLIST_HEAD_INIT(pa_cache_request, cache->requests);
+
+    for (f = 0; f < PA_CACHE_N_FACILITIES; f++)
+        if (m & (1 << f))
+            cache->objects[f] = pa_hashmap_new_full(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func, NULL,
+                                                     f == PA_SUBSCRIPTION_EVENT_SINK ? (pa_free_cb_t) sink_info_free :
+                                                     f == PA_SUBSCRIPTION_EVENT_SOURCE ? (pa_free_cb_t) source_info_free :
+                                                     f == PA_SUBSCRIPTION_EVENT_SINK_INPUT ? (pa_free_cb_t) sink_input_info_free :
+                                                     f == PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT ? (pa_free_cb_t) source_output_info_free :
+                                                     f == PA_SUBSCRIPTION_EVENT_CLIENT ? (pa_free_cb_t) client_info_free :
+                                                     f == PA_SUBSCRIPTION_EVENT_CARD ? (pa_free_cb_t) card_info_free :
+                                                     (pa_free_cb_t) module_info_free);
+
+    PA_LLIST_PREPEND(pa_cache, c->caches, cache);
+
+    /* Subscribe before requesting the lists, so that nothing that
+     * happens in between goes unnoticed */
+    if ((o = pa_context_update_subscription(c)))
+        pa_operation_unref(o);
+
+    for (f = 0; f < PA_CACHE_N_FACILITIES; f++)
+        if (m & (1 << f))
+            request_send(request_new(cache, f, PA_INVALID_INDEX));
+
+    return cache;
+}
+
+void pa_cache_free(pa_cache *cache) {
+    pa_context *c;
+    pa_operation *o;
+    unsigned f;
+
+    pa_assert(cache);
+
+    c = cache->context;
+
+    while (cache->requests)
+        request_free(cache->requests);
+
+    for (f = 0; f < PA_CACHE_N_FACILITIES; f++)
+        if (cache->objects[f])
+            pa_hashmap_free(cache->objects[f]);
+
+    PA_LLIST_REMOVE(pa_cache, c->caches, cache);
+    pa_xfree(cache);
+
+    /* Drop the events only the cache was interested in */
+    if (c->state == PA_CONTEXT_READY && (o = pa_context_update_subscription(c)))
+        pa_operation_unref(o);
+
+    pa_context_unref(c);
+}
+
+pa_context* pa_cache_get_context(pa_cache *cache) {
+    pa_assert(cache);
+
+    return cache->context;
+}
+
+int pa_cache_is_ready(pa_cache *cache) {
+    pa_assert(cache);
+
+    return cache->ready;
+}
+
+void pa_cache_set_ready_callback(pa_cache *cache, pa_cache_notify_cb_t cb, void *userdata) {
+    pa_assert(cache);
+
+    cache->ready_callback = cb;
+    cache->ready_userdata = userdata;
+}
+
+void pa_cache_set_change_callback(pa_cache *cache, pa_cache_change_cb_t cb, void *userdata) {
+    pa_assert(cache);
+
+    cache->change_callback = cb;
+    cache->change_userdata = userdata;
+}
+
+static const void* get_by_index(pa_cache *cache, pa_subscription_event_type_t facility, uint32_t idx) {
+    pa_assert(cache);
+
+    if (!cache->objects[facility])
+        return NULL;
+
+    return pa_hashmap_get(cache->objects[facility], PA_UINT32_TO_PTR(idx));
+}
+
+static const void* iterate(pa_cache *cache, pa_subscription_event_type_t facility, void **state) {
+    pa_assert(cache);
+    pa_assert(state);
+
+    if (!cache->objects[facility])
+        return NULL;
+
+    return pa_hashmap_iterate(cache->objects[facility], state, NULL);
+}
+
+const pa_sink_info* pa_cache_get_sink_info_by_index(pa_cache *cache, uint32_t idx) {
+    return get_by_index(cache, PA_SUBSCRIPTION_EVENT_SINK, idx);
+}
+
+const pa_sink_info* pa_cache_get_sink_info_by_name(pa_cache *cache, const char *name) {
+    const pa_sink_info *i;
+    void *state = NULL;
+
+    pa_assert(name);
+
+    while ((i = pa_cache_iterate_sink_info(cache, &state)))
+        if (pa_streq(i->name, name))
+            return i;
+
+    return NULL;
+}
+
+const pa_sink_info* pa_cache_iterate_sink_info(pa_cache *cache, void **state) {
+    return iterate(cache, PA_SUBSCRIPTION_EVENT_SINK, state);
+}
+
+const pa_source_info* pa_cache_get_source_info_by_index(pa_cache *cache, uint32_t idx) {
+    return get_by_index(cache, PA_SUBSCRIPTION_EVENT_SOURCE, idx);
+}
+
+const pa_source_info* pa_cache_get_source_info_by_name(pa_cache *cache, const char *name) {
+    const pa_source_info *i;
+    void *state = NULL;
+
+    pa_assert(name);
+
+    while ((i = pa_cache_iterate_source_info(cache, &state)))
+        if (pa_streq(i->name, name))
+            return i;
+
+    return NULL;
+}
+
+const pa_source_info* pa_cache_iterate_source_info(pa_cache *cache, void **state) {
+    return iterate(cache, PA_SUBSCRIPTION_EVENT_SOURCE, state);
+}
+
+const pa_sink_input_info* pa_cache_get_sink_input_info(pa_cache *cache, uint32_t idx) {
+    return get_by_index(cache, PA_SUBSCRIPTION_EVENT_SINK_INPUT, idx);
+}
+
+const pa_sink_input_info* pa_cache_iterate_sink_input_info(pa_cache *cache, void **state) {
+    return iterate(cache, PA_SUBSCRIPTION_EVENT_SINK_INPUT, state);
+}
+
+const pa_source_output_info* pa_cache_get_source_output_info(pa_cache *cache, uint32_t idx) {
+    return get_by_index(cache, PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT, idx);
+}
+
+const pa_source_output_info* pa_cache_iterate_source_output_info(pa_cache *cache, void **state) {
+    return iterate(cache, PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT, state);
+}
+
+const pa_client_info* pa_cache_get_client_info(pa_cache *cache, uint32_t idx) {
+    return get_by_index(cache, PA_SUBSCRIPTION_EVENT_CLIENT, idx);
+}
+
+const pa_client_info* pa_cache_iterate_client_info(pa_cache *cache, void **state) {
+    return iterate(cache, PA_SUBSCRIPTION_EVENT_CLIENT, state);
+}
+
+const pa_card_info* pa_cache_get_card_info_by_index(pa_cache *cache, uint32_t idx) {
+    return get_by_index(cache, PA_SUBSCRIPTION_EVENT_CARD, idx);
+}
+
+const pa_card_info* pa_cache_get_card_info_by_name(pa_cache *cache, const char *name) {
+    const pa_card_info *i;
+    void *state = NULL;
+
+    pa_assert(name);
+
+    while ((i = pa_cache_iterate_card_info(cache, &state)))
+        if (pa_streq(i->name, name))
+            return i;
+
+    return NULL;
+}
+
+const pa_card_info* pa_cache_iterate_card_info(pa_cache *cache, void **state) {
+    return iterate(cache, PA_SUBSCRIPTION_EVENT_CARD, state);
+}
+
+const pa_module_info* pa_cache_get_module_info(pa_cache *cache, uint32_t idx) {
+    return get_by_index(cache, PA_SUBSCRIPTION_EVENT_MODULE, idx);
+}
+
+const pa_module_info* pa_cache_iterate_module_info(pa_cache *cache, void **state) {
+    return iterate(cache, PA_SUBSCRIPTION_EVENT_MODULE, state);
+}
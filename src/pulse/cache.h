@@ -0,0 +1,163 @@
+#ifndef foocachehfoo
+#define foocachehfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <inttypes.h>
+
+#include <pulse/def.h>
+#include <pulse/context.h>
+#include <pulse/introspect.h>
+#include <pulse/cdecl.h>
+#include <pulse/version.h>
+
+/** \page cache Object Cache
+ *
+ * \section overv_sec Overview
+ *
+ * Applications that display server objects (mixers, status applets)
+ * usually subscribe to events and then query the changed object with
+ * one of the pa_context_get_*_info() functions every time something
+ * happens. The object cache does this on behalf of the application: it
+ * keeps a local copy of the sinks, sources, sink inputs, source
+ * outputs, clients, cards and modules of the server, keeps it up to
+ * date from subscription events and lets the application look objects
+ * up synchronously.
+ *
+ * A cache is created with pa_cache_new() on a context that is in the
+ * PA_CONTEXT_READY state, for the object types given in a
+ * subscription mask. Once the initial contents have been fetched the
+ * callback set with pa_cache_set_ready_callback() is called and
+ * pa_cache_is_ready() returns non-zero. After that, the callback set
+ * with pa_cache_set_change_callback() is called whenever a cached
+ * object has been added, updated or removed.
+ *
+ * Several change events for the same object that arrive while it is
+ * being queried result in only one additional query. The cache
+ * coexists with pa_context_subscribe(): the subscription callback of
+ * the context is still only called for the events the application
+ * subscribed to itself.
+ *
+ * The info structures returned by the lookup functions are owned by
+ * the cache. They stay valid until the next time the main loop is
+ * run, or until the cache is freed.
+ */
+
+/** \file
+ * Local cache of server objects, maintained from subscription events.
+ *
+ * See also \subpage cache
+ */
+
+PA_C_DECL_BEGIN
+
+/** An opaque object cache. \since 11.0 */
+typedef struct pa_cache pa_cache;
+
+/** Callback prototype for pa_cache_set_ready_callback(). \since 11.0 */
+typedef void (*pa_cache_notify_cb_t)(pa_cache *cache, void *userdata);
+
+/** Callback prototype for pa_cache_set_change_callback(). t contains
+ * the facility and event type as in pa_context_subscribe_cb_t. The
+ * cache has already been updated when this is called. \since 11.0 */
+typedef void (*pa_cache_change_cb_t)(pa_cache *cache, pa_subscription_event_type_t t, uint32_t idx, void *userdata);
+
+/** Create a new object cache for the object types in m. Only
+ * PA_SUBSCRIPTION_MASK_SINK, PA_SUBSCRIPTION_MASK_SOURCE,
+ * PA_SUBSCRIPTION_MASK_SINK_INPUT, PA_SUBSCRIPTION_MASK_SOURCE_OUTPUT,
+ * PA_SUBSCRIPTION_MASK_MODULE, PA_SUBSCRIPTION_MASK_CLIENT and
+ * PA_SUBSCRIPTION_MASK_CARD are supported. The context needs to be in
+ * PA_CONTEXT_READY state. \since 11.0 */
+pa_cache* pa_cache_new(pa_context *c, pa_subscription_mask_t m);
+
+/** Free the cache and all objects in it. \since 11.0 */
+void pa_cache_free(pa_cache *cache);
+
+/** Return the context this cache belongs to. \since 11.0 */
+pa_context* pa_cache_get_context(pa_cache *cache);
+
+/** Return non-zero once the initial contents of the cache have been
+ * fetched. \since 11.0 */
+int pa_cache_is_ready(pa_cache *cache);
+
+/** Set the callback that is called once the cache is ready. \since 11.0 */
+void pa_cache_set_ready_callback(pa_cache *cache, pa_cache_notify_cb_t cb, void *userdata);
+
+/** Set the callback that is called whenever a cached object is added,
+ * changed or removed after the cache is ready. \since 11.0 */
+void pa_cache_set_change_callback(pa_cache *cache, pa_cache_change_cb_t cb, void *userdata);
+
+/** @{ \name Lookup */
+
+/** Look up a sink by its index, or return NULL. \since 11.0 */
+const pa_sink_info* pa_cache_get_sink_info_by_index(pa_cache *cache, uint32_t idx);
+
+/** Look up a sink by its name, or return NULL. \since 11.0 */
+const pa_sink_info* pa_cache_get_sink_info_by_name(pa_cache *cache, const char *name);
+
+/** Iterate through all cached sinks. state needs to point to a NULL
+ * pointer at the first call. Returns NULL after the last entry. \since 11.0 */
+const pa_sink_info* pa_cache_iterate_sink_info(pa_cache *cache, void **state);
+
+/** Look up a source by its index, or return NULL. \since 11.0 */
+const pa_source_info* pa_cache_get_source_info_by_index(pa_cache *cache, uint32_t idx);
+
+/** Look up a source by its name, or return NULL. \since 11.0 */
+const pa_source_info* pa_cache_get_source_info_by_name(pa_cache *cache, const char *name);
+
+/** Iterate through all cached sources, see pa_cache_iterate_sink_info(). \since 11.0 */
+const pa_source_info* pa_cache_iterate_source_info(pa_cache *cache, void **state);
+
+/** Look up a sink input by its index, or return NULL. \since 11.0 */
+const pa_sink_input_info* pa_cache_get_sink_input_info(pa_cache *cache, uint32_t idx);
+
+/** Iterate through all cached sink inputs, see pa_cache_iterate_sink_info(). \since 11.0 */
+const pa_sink_input_info* pa_cache_iterate_sink_input_info(pa_cache *cache, void **state);
+
+/** Look up a source output by its index, or return NULL. \since 11.0 */
+const pa_source_output_info* pa_cache_get_source_output_info(pa_cache *cache, uint32_t idx);
+
+/** Iterate through all cached source outputs, see pa_cache_iterate_sink_info(). \since 11.0 */
+const pa_source_output_info* pa_cache_iterate_source_output_info(pa_cache *cache, void **state);
+
+/** Look up a client by its index, or return NULL. \since 11.0 */
+const pa_client_info* pa_cache_get_client_info(pa_cache *cache, uint32_t idx);
+
+/** Iterate through all cached clients, see pa_cache_iterate_sink_info(). \since 11.0 */
+const pa_client_info* pa_cache_iterate_client_info(pa_cache *cache, void **state);
+
+/** Look up a card by its index, or return NULL. \since 11.0 */
+const pa_card_info* pa_cache_get_card_info_by_index(pa_cache *cache, uint32_t idx);
+
+/** Look up a card by its name, or return NULL. \since 11.0 */
+const pa_card_info* pa_cache_get_card_info_by_name(pa_cache *cache, const char *name);
+
+/** Iterate through all cached cards, see pa_cache_iterate_sink_info(). \since 11.0 */
+const pa_card_info* pa_cache_iterate_card_info(pa_cache *cache, void **state);
+
+/** Look up a module by its index, or return NULL. \since 11.0 */
+const pa_module_info* pa_cache_get_module_info(pa_cache *cache, uint32_t idx);
+
+/** Iterate through all cached modules, see pa_cache_iterate_sink_info(). \since 11.0 */
+const pa_module_info* pa_cache_iterate_module_info(pa_cache *cache, void **state);
+
+/** @} */
+
+PA_C_DECL_END
+
+#endif
@@ -155,6 +155,7 @@ pa_context *pa_context_new_with_proplist(pa_mainloop_api *mainloop, const char *
 
     PA_LLIST_HEAD_INIT(pa_stream, c->streams);
     PA_LLIST_HEAD_INIT(pa_operation, c->operations);
+    PA_LLIST_HEAD_INIT(pa_cache, c->caches);
 
     c->error = PA_OK;
     c->state = PA_CONTEXT_UNCONNECTED;
@@ -26,6 +26,7 @@
 #include <pulse/stream.h>
 #include <pulse/operation.h>
 #include <pulse/subscribe.h>
+#include <pulse/cache.h>
 #include <pulse/ext-device-manager.h>
 #include <pulse/ext-device-restore.h>
 #include <pulse/ext-stream-restore.h>
@@ -76,6 +77,7 @@ struct pa_context {
     pa_hashmap *record_streams, *playback_streams;
     PA_LLIST_HEAD(pa_stream, streams);
     PA_LLIST_HEAD(pa_operation, operations);
+    PA_LLIST_HEAD(pa_cache, caches);
 
     uint32_t version;
     uint32_t ctag;
@@ -87,6 +89,7 @@ struct pa_context {
     void *state_userdata;
     pa_context_subscribe_cb_t subscribe_callback;
     void *subscribe_userdata;
+    pa_subscription_mask_t subscribe_mask;
     pa_context_event_cb_t event_callback;
     void *event_userdata;
 
@@ -165,6 +168,7 @@ struct pa_stream {
     bool corked:1;
     bool timing_info_valid:1;
     bool auto_timing_update_requested:1;
+    bool timing_info_pushed:1;
 
     uint32_t channel;
     uint32_t syncid;
@@ -250,9 +254,41 @@ struct pa_operation {
     void *private; /* some operations might need this */
 };
 
+struct pa_write_buffer {
+    PA_REFCNT_DECLARE;
+
+    pa_mempool *mempool;
+    pa_memblock *memblock;
+    void *data;
+};
+
+#define PA_CACHE_N_FACILITIES (PA_SUBSCRIPTION_EVENT_CARD + 1)
+
+typedef struct pa_cache_request pa_cache_request;
+
+struct pa_cache {
+    pa_context *context;
+    pa_subscription_mask_t mask;
+
+    pa_hashmap *objects[PA_CACHE_N_FACILITIES];
+    PA_LLIST_HEAD(pa_cache_request, requests);
+    unsigned n_list_requests;
+    bool ready;
+
+    pa_cache_notify_cb_t ready_callback;
+    void *ready_userdata;
+    pa_cache_change_cb_t change_callback;
+    void *change_userdata;
+
+    PA_LLIST_FIELDS(pa_cache);
+};
+
 void pa_command_request(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
 void pa_command_stream_killed(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
 void pa_command_subscribe_event(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
+pa_operation* pa_context_update_subscription(pa_context *c);
+
+void pa_cache_process_event(pa_cache *cache, pa_subscription_event_type_t t, uint32_t idx);
 void pa_command_overflow_or_underflow(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
 void pa_command_stream_suspended(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
 void pa_command_stream_moved(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
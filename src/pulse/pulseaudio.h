@@ -30,6 +30,7 @@
 #include <pulse/stream.h>
 #include <pulse/introspect.h>
 #include <pulse/subscribe.h>
+#include <pulse/cache.h>
 #include <pulse/scache.h>
 #include <pulse/version.h>
 #include <pulse/error.h>
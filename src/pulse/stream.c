@@ -191,6 +191,7 @@ static pa_stream *pa_stream_new_with_proplist_internal(
 
     s->auto_timing_update_event = NULL;
     s->auto_timing_update_requested = false;
+    s->timing_info_pushed = false;
     s->auto_timing_interval_usec = AUTO_TIMING_INTERVAL_START_USEC;
 
     reset_callbacks(s);
@@ -386,13 +387,21 @@ static void request_auto_timing_update(pa_stream *s, bool force) {
         (force || !s->auto_timing_update_requested)) {
         pa_operation *o;
 
+        if (!force && s->timing_info_pushed) {
+            /* The server sent us fresh timing data along with a
+             * request since the last update, no need to ask for it */
+            s->timing_info_pushed = false;
+
+        } else {
+
 #ifdef STREAM_DEBUG
-        pa_log_debug("Automatically requesting new timing data");
+            pa_log_debug("Automatically requesting new timing data");
 #endif
 
-        if ((o = pa_stream_update_timing_info(s, NULL, NULL))) {
-            pa_operation_unref(o);
-            s->auto_timing_update_requested = true;
+            if ((o = pa_stream_update_timing_info(s, NULL, NULL))) {
+                pa_operation_unref(o);
+                s->auto_timing_update_requested = true;
+            }
         }
     }
 
@@ -491,6 +500,34 @@ static void check_smoother_status(pa_stream *s, bool aposteriori, bool force_sta
 
 static void auto_timing_update_callback(pa_mainloop_api *m, pa_time_event *e, const struct timeval *t, void *userdata);
 
+/* Timing data the server appends to PA_COMMAND_REQUEST,
+ * PA_COMMAND_STARTED and PA_COMMAND_UNDERFLOW since protocol version 33 */
+typedef struct pushed_timing_info {
+    pa_usec_t sink_usec;
+    bool playing;
+    struct timeval remote;
+    int64_t write_index, read_index;
+    uint64_t underrun_for, playing_for;
+} pushed_timing_info;
+
+static int get_pushed_timing_info(pa_tagstruct *t, pushed_timing_info *p) {
+    pa_assert(t);
+    pa_assert(p);
+
+    if (pa_tagstruct_get_usec(t, &p->sink_usec) < 0 ||
+        pa_tagstruct_get_boolean(t, &p->playing) < 0 ||
+        pa_tagstruct_get_timeval(t, &p->remote) < 0 ||
+        pa_tagstruct_gets64(t, &p->write_index) < 0 ||
+        pa_tagstruct_gets64(t, &p->read_index) < 0 ||
+        pa_tagstruct_getu64(t, &p->underrun_for) < 0 ||
+        pa_tagstruct_getu64(t, &p->playing_for) < 0)
+        return -1;
+
+    return 0;
+}
+
+static bool apply_pushed_timing_info(pa_stream *s, const pushed_timing_info *p);
+
 void pa_command_stream_moved(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
     pa_context *c = userdata;
     pa_stream *s;
@@ -722,6 +759,7 @@ void pa_command_stream_started(pa_pdispatch *pd, uint32_t command, uint32_t tag,
     pa_context *c = userdata;
     pa_stream *s;
     uint32_t channel;
+    pushed_timing_info timing;
 
     pa_assert(pd);
     pa_assert(command == PA_COMMAND_STARTED);
@@ -737,6 +775,7 @@ void pa_command_stream_started(pa_pdispatch *pd, uint32_t command, uint32_t tag,
     }
 
     if (pa_tagstruct_getu32(t, &channel) < 0 ||
+        (c->version >= 33 && get_pushed_timing_info(t, &timing) < 0) ||
         !pa_tagstruct_eof(t)) {
         pa_context_fail(c, PA_ERR_PROTOCOL);
         goto finish;
@@ -749,7 +788,9 @@ void pa_command_stream_started(pa_pdispatch *pd, uint32_t command, uint32_t tag,
         goto finish;
 
     check_smoother_status(s, true, true, false);
-    request_auto_timing_update(s, true);
+
+    if (c->version < 33 || !apply_pushed_timing_info(s, &timing))
+        request_auto_timing_update(s, true);
 
     if (s->started_callback)
         s->started_callback(s, s->started_userdata);
@@ -815,6 +856,8 @@ void pa_command_request(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tag
     pa_stream *s;
     pa_context *c = userdata;
     uint32_t bytes, channel;
+    pushed_timing_info timing;
+    bool pushed = false;
 
     pa_assert(pd);
     pa_assert(command == PA_COMMAND_REQUEST);
@@ -825,8 +868,22 @@ void pa_command_request(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tag
     pa_context_ref(c);
 
     if (pa_tagstruct_getu32(t, &channel) < 0 ||
-        pa_tagstruct_getu32(t, &bytes) < 0 ||
-        !pa_tagstruct_eof(t)) {
+        pa_tagstruct_getu32(t, &bytes) < 0) {
+        pa_context_fail(c, PA_ERR_PROTOCOL);
+        goto finish;
+    }
+
+    /* The server only attaches timing data to some requests */
+    if (c->version >= 33 && !pa_tagstruct_eof(t)) {
+        if (get_pushed_timing_info(t, &timing) < 0) {
+            pa_context_fail(c, PA_ERR_PROTOCOL);
+            goto finish;
+        }
+
+        pushed = true;
+    }
+
+    if (!pa_tagstruct_eof(t)) {
         pa_context_fail(c, PA_ERR_PROTOCOL);
         goto finish;
     }
@@ -843,6 +900,9 @@ void pa_command_request(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tag
     pa_log_debug("got request for %lli, now at %lli", (long long) bytes, (long long) s->requested_bytes);
 #endif
 
+    if (pushed)
+        apply_pushed_timing_info(s, &timing);
+
     if (s->requested_bytes > 0 && s->write_callback)
         s->write_callback(s, (size_t) s->requested_bytes, s->write_userdata);
 
@@ -860,6 +920,8 @@ void pa_command_overflow_or_underflow(pa_pdispatch *pd, uint32_t command, uint32
     pa_context *c = userdata;
     uint32_t channel;
     int64_t offset = -1;
+    pushed_timing_info timing;
+    bool pushed = false;
 
     pa_assert(pd);
     pa_assert(command == PA_COMMAND_OVERFLOW || command == PA_COMMAND_UNDERFLOW);
@@ -881,6 +943,15 @@ void pa_command_overflow_or_underflow(pa_pdispatch *pd, uint32_t command, uint32
         }
     }
 
+    if (c->version >= 33 && command == PA_COMMAND_UNDERFLOW) {
+        if (get_pushed_timing_info(t, &timing) < 0) {
+            pa_context_fail(c, PA_ERR_PROTOCOL);
+            goto finish;
+        }
+
+        pushed = true;
+    }
+
     if (!pa_tagstruct_eof(t)) {
         pa_context_fail(c, PA_ERR_PROTOCOL);
         goto finish;
@@ -898,7 +969,8 @@ void pa_command_overflow_or_underflow(pa_pdispatch *pd, uint32_t command, uint32
     if (s->buffer_attr.prebuf > 0)
         check_smoother_status(s, true, false, true);
 
-    request_auto_timing_update(s, true);
+    if (!pushed || !apply_pushed_timing_info(s, &timing))
+        request_auto_timing_update(s, true);
 
     if (command == PA_COMMAND_OVERFLOW) {
         if (s->overflow_callback)
@@ -1471,6 +1543,51 @@ int pa_stream_cancel_write(
     return 0;
 }
 
+static void update_write_index(pa_stream *s, size_t length, int64_t offset, pa_seek_mode_t seek) {
+    pa_assert(s);
+
+    /* This is obviously wrong since we ignore the seeking index . But
+     * that's OK, the server side applies the same error */
+    s->requested_bytes -= (seek == PA_SEEK_RELATIVE ? offset : 0) + (int64_t) length;
+
+#ifdef STREAM_DEBUG
+    pa_log_debug("wrote %lli, now at %lli", (long long) length, (long long) s->requested_bytes);
+#endif
+
+    if (s->direction == PA_STREAM_PLAYBACK) {
+
+        /* Update latency request correction */
+        if (s->write_index_corrections[s->current_write_index_correction].valid) {
+
+            if (seek == PA_SEEK_ABSOLUTE) {
+                s->write_index_corrections[s->current_write_index_correction].corrupt = false;
+                s->write_index_corrections[s->current_write_index_correction].absolute = true;
+                s->write_index_corrections[s->current_write_index_correction].value = offset + (int64_t) length;
+            } else if (seek == PA_SEEK_RELATIVE) {
+                if (!s->write_index_corrections[s->current_write_index_correction].corrupt)
+                    s->write_index_corrections[s->current_write_index_correction].value += offset + (int64_t) length;
+            } else
+                s->write_index_corrections[s->current_write_index_correction].corrupt = true;
+        }
+
+        /* Update the write index in the already available latency data */
+        if (s->timing_info_valid) {
+
+            if (seek == PA_SEEK_ABSOLUTE) {
+                s->timing_info.write_index_corrupt = false;
+                s->timing_info.write_index = offset + (int64_t) length;
+            } else if (seek == PA_SEEK_RELATIVE) {
+                if (!s->timing_info.write_index_corrupt)
+                    s->timing_info.write_index += offset + (int64_t) length;
+            } else
+                s->timing_info.write_index_corrupt = true;
+        }
+
+        if (!s->timing_info_valid || s->timing_info.write_index_corrupt)
+            request_auto_timing_update(s, true);
+    }
+}
+
 int pa_stream_write_ext_free(
         pa_stream *s,
         const void *data,
@@ -1561,59 +1678,119 @@ int pa_stream_write_ext_free(
             free_cb(free_cb_data);
     }
 
-    /* This is obviously wrong since we ignore the seeking index . But
-     * that's OK, the server side applies the same error */
-    s->requested_bytes -= (seek == PA_SEEK_RELATIVE ? offset : 0) + (int64_t) length;
+    update_write_index(s, length, offset, seek);
 
-#ifdef STREAM_DEBUG
-    pa_log_debug("wrote %lli, now at %lli", (long long) length, (long long) s->requested_bytes);
-#endif
+    return 0;
+}
 
-    if (s->direction == PA_STREAM_PLAYBACK) {
+int pa_stream_write(
+        pa_stream *s,
+        const void *data,
+        size_t length,
+        pa_free_cb_t free_cb,
+        int64_t offset,
+        pa_seek_mode_t seek) {
 
-        /* Update latency request correction */
-        if (s->write_index_corrections[s->current_write_index_correction].valid) {
+    return pa_stream_write_ext_free(s, data, length, free_cb, (void*) data, offset, seek);
+}
 
-            if (seek == PA_SEEK_ABSOLUTE) {
-                s->write_index_corrections[s->current_write_index_correction].corrupt = false;
-                s->write_index_corrections[s->current_write_index_correction].absolute = true;
-                s->write_index_corrections[s->current_write_index_correction].value = offset + (int64_t) length;
-            } else if (seek == PA_SEEK_RELATIVE) {
-                if (!s->write_index_corrections[s->current_write_index_correction].corrupt)
-                    s->write_index_corrections[s->current_write_index_correction].value += offset + (int64_t) length;
-            } else
-                s->write_index_corrections[s->current_write_index_correction].corrupt = true;
-        }
+pa_write_buffer* pa_context_new_write_buffer(pa_context *c, size_t nbytes) {
+    pa_write_buffer *b;
+    size_t m;
 
-        /* Update the write index in the already available latency data */
-        if (s->timing_info_valid) {
+    pa_assert(c);
+    pa_assert(PA_REFCNT_VALUE(c) >= 1);
 
-            if (seek == PA_SEEK_ABSOLUTE) {
-                s->timing_info.write_index_corrupt = false;
-                s->timing_info.write_index = offset + (int64_t) length;
-            } else if (seek == PA_SEEK_RELATIVE) {
-                if (!s->timing_info.write_index_corrupt)
-                    s->timing_info.write_index += offset + (int64_t) length;
-            } else
-                s->timing_info.write_index_corrupt = true;
-        }
+    PA_CHECK_VALIDITY_RETURN_NULL(c, !pa_detect_fork(), PA_ERR_FORKED);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, nbytes != 0, PA_ERR_INVALID);
 
-        if (!s->timing_info_valid || s->timing_info.write_index_corrupt)
-            request_auto_timing_update(s, true);
-    }
+    m = pa_mempool_block_size_max(c->mempool);
+    if (nbytes > m)
+        nbytes = m;
 
-    return 0;
+    b = pa_xnew(pa_write_buffer, 1);
+    PA_REFCNT_INIT(b);
+    b->mempool = c->mempool;
+    b->memblock = pa_memblock_new(c->mempool, nbytes);
+    b->data = pa_memblock_acquire(b->memblock);
+
+    return b;
 }
 
-int pa_stream_write(
+pa_write_buffer* pa_write_buffer_ref(pa_write_buffer *b) {
+    pa_assert(b);
+    pa_assert(PA_REFCNT_VALUE(b) >= 1);
+
+    PA_REFCNT_INC(b);
+    return b;
+}
+
+void pa_write_buffer_unref(pa_write_buffer *b) {
+    pa_assert(b);
+    pa_assert(PA_REFCNT_VALUE(b) >= 1);
+
+    if (PA_REFCNT_DEC(b) > 0)
+        return;
+
+    /* The pstream may still hold references to the block, it will be
+     * returned to the pool once the server has released it */
+    pa_memblock_release(b->memblock);
+    pa_memblock_unref(b->memblock);
+    pa_xfree(b);
+}
+
+void* pa_write_buffer_get_data(pa_write_buffer *b) {
+    pa_assert(b);
+    pa_assert(PA_REFCNT_VALUE(b) >= 1);
+
+    return b->data;
+}
+
+size_t pa_write_buffer_get_length(pa_write_buffer *b) {
+    pa_assert(b);
+    pa_assert(PA_REFCNT_VALUE(b) >= 1);
+
+    return pa_memblock_get_length(b->memblock);
+}
+
+int pa_stream_write_buffer(
         pa_stream *s,
-        const void *data,
+        pa_write_buffer *b,
+        size_t index,
         size_t length,
-        pa_free_cb_t free_cb,
         int64_t offset,
         pa_seek_mode_t seek) {
 
-    return pa_stream_write_ext_free(s, data, length, free_cb, (void*) data, offset, seek);
+    pa_memchunk chunk;
+
+    pa_assert(s);
+    pa_assert(PA_REFCNT_VALUE(s) >= 1);
+    pa_assert(b);
+    pa_assert(PA_REFCNT_VALUE(b) >= 1);
+
+    PA_CHECK_VALIDITY(s->context, !pa_detect_fork(), PA_ERR_FORKED);
+    PA_CHECK_VALIDITY(s->context, s->state == PA_STREAM_READY, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY(s->context, s->direction == PA_STREAM_PLAYBACK || s->direction == PA_STREAM_UPLOAD, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY(s->context, b->mempool == s->context->mempool, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(s->context, seek <= PA_SEEK_RELATIVE_END, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(s->context, s->direction == PA_STREAM_PLAYBACK || (seek == PA_SEEK_RELATIVE && offset == 0), PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(s->context, length > 0, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(s->context, index <= pa_memblock_get_length(b->memblock), PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(s->context, length <= pa_memblock_get_length(b->memblock) - index, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(s->context, offset % pa_frame_size(&s->sample_spec) == 0, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(s->context, length % pa_frame_size(&s->sample_spec) == 0, PA_ERR_INVALID);
+
+    chunk.memblock = b->memblock;
+    chunk.index = index;
+    chunk.length = length;
+
+    /* The pstream takes its own reference to the block and exports it
+     * as a SHM reference if possible, so nothing is copied here */
+    pa_pstream_send_memblock(s->context->pstream, s->channel, offset, seek, &chunk);
+
+    update_write_index(s, length, offset, seek);
+
+    return 0;
 }
 
 int pa_stream_peek(pa_stream *s, const void **data, size_t *length) {
@@ -1792,6 +1969,97 @@ static pa_usec_t calc_time(pa_stream *s, bool ignore_transport) {
     return usec;
 }
 
+/* Feed the current timing info into the smoother. age is how long ago
+ * the server took the snapshot. */
+static void update_smoother(pa_stream *s, pa_usec_t age) {
+    pa_timing_info *i = &s->timing_info;
+    pa_usec_t u, x;
+
+    /* Update smoother if we're not corked */
+    if (!s->smoother || s->corked)
+        return;
+
+    u = x = pa_rtclock_now() - age;
+
+    if (s->direction == PA_STREAM_PLAYBACK && s->context->version >= 13) {
+        pa_usec_t su;
+
+        /* If we weren't playing then it will take some time
+         * until the audio will actually come out through the
+         * speakers. Since we follow that timing here, we need
+         * to try to fix this up */
+
+        su = pa_bytes_to_usec((uint64_t) i->since_underrun, &s->sample_spec);
+
+        if (su < i->sink_usec)
+            x += i->sink_usec - su;
+    }
+
+    if (!i->playing)
+        pa_smoother_pause(s->smoother, x);
+
+    /* Update the smoother */
+    if ((s->direction == PA_STREAM_PLAYBACK && !i->read_index_corrupt) ||
+        (s->direction == PA_STREAM_RECORD && !i->write_index_corrupt))
+        pa_smoother_put(s->smoother, u, calc_time(s, true));
+
+    if (i->playing)
+        pa_smoother_resume(s->smoother, x, true);
+}
+
+/* Returns true if the timing info the server sent along with another
+ * command could be used in place of a PA_COMMAND_GET_PLAYBACK_LATENCY
+ * query */
+static bool apply_pushed_timing_info(pa_stream *s, const pushed_timing_info *p) {
+    pa_timing_info *i = &s->timing_info;
+    struct timeval now;
+    pa_usec_t age;
+
+    pa_assert(s);
+    pa_assert(p);
+    pa_assert(s->direction == PA_STREAM_PLAYBACK);
+
+    if (!(s->flags & PA_STREAM_AUTO_TIMING_UPDATE))
+        return false;
+
+    /* Unlike a query reply the pushed data carries no tag, so we cannot
+     * tell whether the server has seen a flush or seek we sent. Only use
+     * it when we have valid data from a query and nothing invalidated
+     * it since; the read index is then known to be current. */
+    if (!s->timing_info_valid || i->read_index_corrupt || s->auto_timing_update_requested)
+        return false;
+
+    i->sink_usec = p->sink_usec;
+    i->playing = (int) p->playing;
+    i->since_underrun = (int64_t) (p->playing ? p->playing_for : p->underrun_for);
+    i->read_index = p->read_index;
+
+    /* Data we sent that is still in flight is not included in the
+     * server's write index. Our locally maintained write index is
+     * more accurate, so keep it. */
+
+    pa_gettimeofday(&now);
+
+    if (i->synchronized_clocks && pa_timeval_cmp(&p->remote, &now) <= 0) {
+        age = pa_timeval_diff(&now, &p->remote);
+        i->timestamp = p->remote;
+    } else {
+        /* Assume the message took as long as the last query did */
+        age = i->transport_usec;
+        i->timestamp = now;
+        pa_timeval_sub(&i->timestamp, age);
+    }
+
+    update_smoother(s, age);
+
+    s->timing_info_pushed = true;
+
+    if (s->latency_update_callback)
+        s->latency_update_callback(s, s->latency_update_userdata);
+
+    return true;
+}
+
 static void stream_get_timing_info_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
     pa_operation *o = userdata;
     struct timeval local, remote, now;
@@ -1929,37 +2197,7 @@ static void stream_get_timing_info_callback(pa_pdispatch *pd, uint32_t command,
                 i->read_index -= (int64_t) pa_memblockq_get_length(o->stream->record_memblockq);
         }
 
-        /* Update smoother if we're not corked */
-        if (o->stream->smoother && !o->stream->corked) {
-            pa_usec_t u, x;
-
-            u = x = pa_rtclock_now() - i->transport_usec;
-
-            if (o->stream->direction == PA_STREAM_PLAYBACK && o->context->version >= 13) {
-                pa_usec_t su;
-
-                /* If we weren't playing then it will take some time
-                 * until the audio will actually come out through the
-                 * speakers. Since we follow that timing here, we need
-                 * to try to fix this up */
-
-                su = pa_bytes_to_usec((uint64_t) i->since_underrun, &o->stream->sample_spec);
-
-                if (su < i->sink_usec)
-                    x += i->sink_usec - su;
-            }
-
-            if (!i->playing)
-                pa_smoother_pause(o->stream->smoother, x);
-
-            /* Update the smoother */
-            if ((o->stream->direction == PA_STREAM_PLAYBACK && !i->read_index_corrupt) ||
-                (o->stream->direction == PA_STREAM_RECORD && !i->write_index_corrupt))
-                pa_smoother_put(o->stream->smoother, u, calc_time(o->stream, true));
-
-            if (i->playing)
-                pa_smoother_resume(o->stream->smoother, x, true);
-        }
+        update_smoother(o->stream, i->transport_usec);
     }
 
     o->stream->auto_timing_update_requested = false;
@@ -334,6 +334,10 @@ PA_C_DECL_BEGIN
 /** An opaque stream for playback or recording */
 typedef struct pa_stream pa_stream;
 
+/** An opaque, reference counted memory area allocated from the memory
+ * pool of a context, see pa_context_new_write_buffer(). \since 11.0 */
+typedef struct pa_write_buffer pa_write_buffer;
+
 /** A generic callback for operation completion */
 typedef void (*pa_stream_success_cb_t) (pa_stream*s, int success, void *userdata);
 
@@ -563,6 +567,52 @@ int pa_stream_write_ext_free(
         int64_t offset           /**< Offset for seeking, must be 0 for upload streams */,
         pa_seek_mode_t seek      /**< Seek mode, must be PA_SEEK_RELATIVE for upload streams */);
 
+/** Allocate a memory area of \a nbytes bytes from the memory pool of
+ * the context, for rendering audio data into it directly. If the
+ * connection to the server uses shared memory, data written from this
+ * area with pa_stream_write_buffer() is passed to the server as a
+ * reference to the shared memory segment and is never copied. If
+ * \a nbytes is (size_t) -1 or larger than the largest block the memory
+ * pool can hand out, the largest possible area is allocated; use
+ * pa_write_buffer_get_length() to find out the actual size.
+ *
+ * Unlike pa_stream_begin_write() the memory area is not tied to a
+ * stream, and any number of them may be allocated at a time. Fill in
+ * the data first: once any part of the area has been passed to
+ * pa_stream_write_buffer() its contents must not be modified anymore,
+ * as the server might still read from it. The same data may however be
+ * passed several times, in parts or as a whole, to one or more streams
+ * of the same context. To render new data allocate a new area. Returns
+ * NULL on failure. \since 11.0 */
+pa_write_buffer* pa_context_new_write_buffer(pa_context *c, size_t nbytes);
+
+/** Increase the reference count by one. \since 11.0 */
+pa_write_buffer* pa_write_buffer_ref(pa_write_buffer *b);
+
+/** Decrease the reference count by one. The memory area is returned to
+ * the memory pool once the last reference is gone and the server has
+ * released it. \since 11.0 */
+void pa_write_buffer_unref(pa_write_buffer *b);
+
+/** Return a pointer to the memory area. \since 11.0 */
+void* pa_write_buffer_get_data(pa_write_buffer *b);
+
+/** Return the size of the memory area in bytes. \since 11.0 */
+size_t pa_write_buffer_get_length(pa_write_buffer *b);
+
+/** Write \a nbytes bytes starting at byte \a index of the memory area
+ * \a b to the server (for playback streams). This works like
+ * pa_stream_write(), except that the data is never copied: the stream
+ * keeps its own reference to the memory area until the data has been
+ * sent, the caller's reference is not affected. \since 11.0 */
+int pa_stream_write_buffer(
+        pa_stream *p             /**< The stream to use */,
+        pa_write_buffer *b       /**< The memory area to write from, allocated from the context of the stream */,
+        size_t index             /**< Offset of the data within the memory area in bytes */,
+        size_t nbytes            /**< The length of the data to write in bytes, must be in multiples of the stream's sample spec frame size */,
+        int64_t offset           /**< Offset for seeking, must be 0 for upload streams, must be in multiples of the stream's sample spec frame size */,
+        pa_seek_mode_t seek      /**< Seek mode, must be PA_SEEK_RELATIVE for upload streams */);
+
 /** Read the next fragment from the buffer (for recording streams).
  * If there is data at the current read index, \a data will point to
  * the actual data and \a nbytes will contain the size of the data in
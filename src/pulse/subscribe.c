@@ -33,6 +33,7 @@ void pa_command_subscribe_event(pa_pdispatch *pd, uint32_t command, uint32_t tag
     pa_context *c = userdata;
     pa_subscription_event_type_t e;
     uint32_t idx;
+    pa_cache *cache, *next;
 
     pa_assert(pd);
     pa_assert(command == PA_COMMAND_SUBSCRIBE_EVENT);
@@ -42,29 +43,44 @@ void pa_command_subscribe_event(pa_pdispatch *pd, uint32_t command, uint32_t tag
 
     pa_context_ref(c);
 
-    if (pa_tagstruct_getu32(t, &e) < 0 ||
-        pa_tagstruct_getu32(t, &idx) < 0 ||
-        !pa_tagstruct_eof(t)) {
-        pa_context_fail(c, PA_ERR_PROTOCOL);
-        goto finish;
-    }
+    /* Starting with protocol version 33 the server may batch several
+     * events into a single packet */
+    do {
+        if (pa_tagstruct_getu32(t, &e) < 0 ||
+            pa_tagstruct_getu32(t, &idx) < 0 ||
+            (c->version < 33 && !pa_tagstruct_eof(t))) {
+            pa_context_fail(c, PA_ERR_PROTOCOL);
+            goto finish;
+        }
 
-    if (c->subscribe_callback)
-        c->subscribe_callback(c, e, idx, c->subscribe_userdata);
+        for (cache = c->caches; cache; cache = next) {
+            next = cache->next;
+            pa_cache_process_event(cache, e, idx);
+        }
+
+        /* If there are caches the server may send us more than the
+         * application asked for */
+        if (c->subscribe_callback && (!c->caches || pa_subscription_match_flags(c->subscribe_mask, e)))
+            c->subscribe_callback(c, e, idx, c->subscribe_userdata);
+
+    } while (!pa_tagstruct_eof(t) && c->state == PA_CONTEXT_READY);
 
 finish:
     pa_context_unref(c);
 }
 
-pa_operation* pa_context_subscribe(pa_context *c, pa_subscription_mask_t m, pa_context_success_cb_t cb, void *userdata) {
+static pa_operation* send_subscribe(pa_context *c, pa_context_success_cb_t cb, void *userdata) {
     pa_operation *o;
     pa_tagstruct *t;
     uint32_t tag;
+    pa_subscription_mask_t m;
+    pa_cache *cache;
 
-    pa_assert(c);
-    pa_assert(PA_REFCNT_VALUE(c) >= 1);
-
-    PA_CHECK_VALIDITY_RETURN_NULL(c, c->state == PA_CONTEXT_READY, PA_ERR_BADSTATE);
+    /* The server only knows a single mask per connection, so include
+     * everything our caches need */
+    m = c->subscribe_mask;
+    for (cache = c->caches; cache; cache = cache->next)
+        m |= cache->mask;
 
     o = pa_operation_new(c, NULL, (pa_operation_cb_t) cb, userdata);
 
@@ -76,6 +92,27 @@ pa_operation* pa_context_subscribe(pa_context *c, pa_subscription_mask_t m, pa_c
     return o;
 }
 
+pa_operation* pa_context_subscribe(pa_context *c, pa_subscription_mask_t m, pa_context_success_cb_t cb, void *userdata) {
+    pa_assert(c);
+    pa_assert(PA_REFCNT_VALUE(c) >= 1);
+
+    PA_CHECK_VALIDITY_RETURN_NULL(c, c->state == PA_CONTEXT_READY, PA_ERR_BADSTATE);
+
+    c->subscribe_mask = m;
+
+    return send_subscribe(c, cb, userdata);
+}
+
+/* Called by the object cache whenever the set of caches changes */
+pa_operation* pa_context_update_subscription(pa_context *c) {
+    pa_assert(c);
+    pa_assert(PA_REFCNT_VALUE(c) >= 1);
+
+    PA_CHECK_VALIDITY_RETURN_NULL(c, c->state == PA_CONTEXT_READY, PA_ERR_BADSTATE);
+
+    return send_subscribe(c, NULL, NULL);
+}
+
 void pa_context_set_subscribe_callback(pa_context *c, pa_context_subscribe_cb_t cb, void *userdata) {
     pa_assert(c);
     pa_assert(PA_REFCNT_VALUE(c) >= 1);
@@ -126,6 +126,8 @@ bool pa_cpu_init_x86(pa_cpu_x86_flag_t *flags) {
         pa_volume_func_init_sse(*flags);
         pa_remap_func_init_sse(*flags);
         pa_convert_func_init_sse(*flags);
+        pa_biquad_cascade_func_init_sse(*flags);
+        pa_sample_util_func_init_sse(*flags);
     }
 
     return true;
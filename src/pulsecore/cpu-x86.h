@@ -68,4 +68,8 @@ void pa_remap_func_init_sse(pa_cpu_x86_flag_t flags);
 
 void pa_convert_func_init_sse (pa_cpu_x86_flag_t flags);
 
+void pa_biquad_cascade_func_init_sse(pa_cpu_x86_flag_t flags);
+
+void pa_sample_util_func_init_sse(pa_cpu_x86_flag_t flags);
+
 #endif /* foocpux86hfoo */
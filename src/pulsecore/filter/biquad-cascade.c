@@ -0,0 +1,329 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <pulse/sample.h>
+#include <pulse/xmalloc.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "biquad-cascade.h"
+
+/* Frames converted at a time by pa_biquad_cascade_process_s16(). */
+#define S16_BLOCK_FRAMES 64
+
+/* Q of a band that doesn't give one, that of a Butterworth filter */
+#define DEFAULT_Q 0.7071
+
+/* Runs all stages over channel c, whose samples are stride floats apart. */
+static void process_channel_c(pa_biquad_cascade *bc, unsigned c, float *dst, const float *src, unsigned stride, unsigned n_frames) {
+    const unsigned lanes = bc->lanes;
+    float *last = bc->state + bc->stages * 2 * lanes + c;
+    unsigned s, i;
+
+    for (i = 0; i < n_frames; i++) {
+        float x = src[i * stride];
+
+        for (s = 0; s < bc->stages; s++) {
+            const float *k = bc->coeffs + s * 5 * lanes + c;
+            float *in = bc->state + s * 2 * lanes + c;
+            float *out = in + 2 * lanes;
+            float y;
+
+            y = k[0] * x + k[lanes] * in[0] + k[2 * lanes] * in[lanes] - k[3 * lanes] * out[0] - k[4 * lanes] * out[lanes];
+
+            in[lanes] = in[0];
+            in[0] = x;
+            x = y;
+        }
+
+        last[lanes] = last[0];
+        last[0] = x;
+
+        dst[i * stride] = x;
+    }
+}
+
+static void process_c(pa_biquad_cascade *bc, float *dst, const float *src, unsigned n_frames) {
+    unsigned c;
+
+    for (c = 0; c < bc->channels; c++)
+        process_channel_c(bc, c, dst + c, src + c, bc->channels, n_frames);
+}
+
+static pa_biquad_cascade_func_t process_func = process_c;
+
+pa_biquad_cascade_func_t pa_get_biquad_cascade_func(void) {
+    return process_func;
+}
+
+void pa_set_biquad_cascade_func(pa_biquad_cascade_func_t func) {
+    process_func = func;
+}
+
+pa_biquad_cascade *pa_biquad_cascade_new(unsigned channels, unsigned stages) {
+    pa_biquad_cascade *bc;
+
+    pa_assert(channels > 0);
+    pa_assert(stages > 0);
+
+    bc = pa_xnew0(pa_biquad_cascade, 1);
+    bc->channels = channels;
+    bc->stages = stages;
+    bc->lanes = PA_ROUND_UP(channels, PA_BIQUAD_CASCADE_LANES);
+
+    /* All-zero coefficients let the padding lanes output silence. */
+    bc->coeffs = pa_xnew0(float, stages * 5 * bc->lanes);
+    bc->state = pa_xnew0(float, (stages + 1) * 2 * bc->lanes);
+
+    return bc;
+}
+
+void pa_biquad_cascade_free(pa_biquad_cascade *bc) {
+    pa_assert(bc);
+
+    pa_xfree(bc->coeffs);
+    pa_xfree(bc->state);
+    pa_xfree(bc);
+}
+
+void pa_biquad_cascade_set(pa_biquad_cascade *bc, unsigned channel, unsigned stage, const struct biquad *bq) {
+    float *k;
+
+    pa_assert(bc);
+    pa_assert(bq);
+    pa_assert(channel < bc->channels);
+    pa_assert(stage < bc->stages);
+
+    k = bc->coeffs + stage * 5 * bc->lanes + channel;
+    k[0] = bq->b0;
+    k[bc->lanes] = bq->b1;
+    k[2 * bc->lanes] = bq->b2;
+    k[3 * bc->lanes] = bq->a1;
+    k[4 * bc->lanes] = bq->a2;
+}
+
+void pa_biquad_cascade_reset(pa_biquad_cascade *bc) {
+    pa_assert(bc);
+
+    memset(bc->state, 0, pa_biquad_cascade_state_size(bc));
+}
+
+size_t pa_biquad_cascade_state_size(const pa_biquad_cascade *bc) {
+    pa_assert(bc);
+
+    return (bc->stages + 1) * 2 * bc->lanes * sizeof(float);
+}
+
+void pa_biquad_cascade_save(const pa_biquad_cascade *bc, void *state) {
+    pa_assert(bc);
+    pa_assert(state);
+
+    memcpy(state, bc->state, pa_biquad_cascade_state_size(bc));
+}
+
+void pa_biquad_cascade_restore(pa_biquad_cascade *bc, const void *state) {
+    pa_assert(bc);
+    pa_assert(state);
+
+    memcpy(bc->state, state, pa_biquad_cascade_state_size(bc));
+}
+
+void pa_biquad_cascade_copy_state(pa_biquad_cascade *dst, const pa_biquad_cascade *src) {
+    unsigned nodes;
+
+    pa_assert(dst);
+    pa_assert(src);
+    pa_assert(dst->channels == src->channels);
+
+    nodes = PA_MIN(dst->stages, src->stages) + 1;
+
+    pa_biquad_cascade_reset(dst);
+    memcpy(dst->state, src->state, nodes * 2 * dst->lanes * sizeof(float));
+}
+
+void pa_biquad_cascade_process_float32(pa_biquad_cascade *bc, float *dst, const float *src, unsigned n_frames) {
+    pa_assert(bc);
+    pa_assert(dst);
+    pa_assert(src);
+
+    process_func(bc, dst, src, n_frames);
+}
+
+void pa_biquad_cascade_process_planar(pa_biquad_cascade *bc, float * const *planes, unsigned n_frames) {
+    unsigned c;
+
+    pa_assert(bc);
+    pa_assert(planes);
+
+    /* Each plane is contiguous, which the plain C loop handles about as well
+     * as the lane-parallel kernels handle interleaved data. */
+    for (c = 0; c < bc->channels; c++)
+        process_channel_c(bc, c, planes[c], planes[c], 1, n_frames);
+}
+
+void pa_biquad_cascade_process_s16(pa_biquad_cascade *bc, int16_t *dst, const int16_t *src, unsigned n_frames) {
+    float buf[S16_BLOCK_FRAMES * PA_CHANNELS_MAX];
+    unsigned frames, i;
+
+    pa_assert(bc);
+    pa_assert(dst);
+    pa_assert(src);
+    pa_assert(bc->channels <= PA_CHANNELS_MAX);
+
+    while (n_frames > 0) {
+        frames = PA_MIN(n_frames, (unsigned) S16_BLOCK_FRAMES);
+
+        for (i = 0; i < frames * bc->channels; i++)
+            buf[i] = src[i];
+
+        process_func(bc, buf, buf, frames);
+
+        for (i = 0; i < frames * bc->channels; i++)
+            dst[i] = PA_CLAMP_UNLIKELY((int) buf[i], -0x8000, 0x7fff);
+
+        src += frames * bc->channels;
+        dst += frames * bc->channels;
+        n_frames -= frames;
+    }
+}
+
+static const struct {
+    const char *name;
+    enum biquad_type type;
+} band_types[] = {
+    { "peaking", BQ_PEAKING },
+    { "lowshelf", BQ_LOWSHELF },
+    { "highshelf", BQ_HIGHSHELF },
+    { "lowpass", BQ_LOWPASS },
+    { "highpass", BQ_HIGHPASS },
+};
+
+/* Parses one type:frequency[:q[:gain]] band. Empty q and gain fields mean the
+ * defaults. biquad_set_eq() ignores q for all but peaking bands and the gain
+ * for lowpass and highpass, so giving them there is an error. */
+static int parse_band(const char *band, uint32_t rate, struct biquad *bq) {
+    const char *state = NULL;
+    char *type = NULL, *field;
+    double freq, q = DEFAULT_Q, gain = 0;
+    unsigned i;
+    int ret = -1;
+
+    if (!(type = pa_split(band, ":", &state)))
+        goto finish;
+
+    for (i = 0; i < PA_ELEMENTSOF(band_types); i++)
+        if (pa_streq(type, band_types[i].name))
+            break;
+
+    if (i >= PA_ELEMENTSOF(band_types)) {
+        pa_log("Unknown band type '%s'", type);
+        goto finish;
+    }
+
+    if (!(field = pa_split(band, ":", &state)) || pa_atod(field, &freq) < 0 || freq <= 0 || freq >= rate / 2) {
+        pa_log("Invalid frequency in band '%s'", band);
+        pa_xfree(field);
+        goto finish;
+    }
+    pa_xfree(field);
+
+    if ((field = pa_split(band, ":", &state))) {
+        if (*field && (pa_atod(field, &q) < 0 || q <= 0)) {
+            pa_log("Invalid q in band '%s'", band);
+            pa_xfree(field);
+            goto finish;
+        }
+        if (*field && band_types[i].type != BQ_PEAKING) {
+            pa_log("q is only supported by peaking bands, in band '%s'", band);
+            pa_xfree(field);
+            goto finish;
+        }
+        pa_xfree(field);
+    }
+
+    if ((field = pa_split(band, ":", &state))) {
+        if (*field && pa_atod(field, &gain) < 0) {
+            pa_log("Invalid gain in band '%s'", band);
+            pa_xfree(field);
+            goto finish;
+        }
+        if (*field && (band_types[i].type == BQ_LOWPASS || band_types[i].type == BQ_HIGHPASS)) {
+            pa_log("Gain is not supported by lowpass and highpass bands, in band '%s'", band);
+            pa_xfree(field);
+            goto finish;
+        }
+        pa_xfree(field);
+    }
+
+    if ((field = pa_split(band, ":", &state))) {
+        pa_log("Too many fields in band '%s'", band);
+        pa_xfree(field);
+        goto finish;
+    }
+
+    biquad_set_eq(bq, band_types[i].type, freq / (rate / 2), q, gain);
+    ret = 0;
+
+finish:
+    pa_xfree(type);
+    return ret;
+}
+
+pa_biquad_cascade *pa_biquad_cascade_new_from_bands(const char *bands, unsigned channels, uint32_t rate) {
+    struct biquad bq[PA_BIQUAD_CASCADE_MAX_BANDS];
+    pa_biquad_cascade *bc;
+    const char *state = NULL;
+    char *band;
+    unsigned n = 0, b, c;
+
+    pa_assert(bands);
+    pa_assert(channels > 0);
+
+    while ((band = pa_split(bands, ",", &state))) {
+        if (n >= PA_BIQUAD_CASCADE_MAX_BANDS) {
+            pa_log("At most %u bands are supported", PA_BIQUAD_CASCADE_MAX_BANDS);
+            pa_xfree(band);
+            return NULL;
+        }
+
+        if (parse_band(band, rate, &bq[n]) < 0) {
+            pa_xfree(band);
+            return NULL;
+        }
+
+        pa_xfree(band);
+        n++;
+    }
+
+    /* Without bands the audio passes through unchanged. */
+    if (n == 0)
+        biquad_set_eq(&bq[n++], BQ_PEAKING, 0, DEFAULT_Q, 0);
+
+    bc = pa_biquad_cascade_new(channels, n);
+    for (b = 0; b < n; b++)
+        for (c = 0; c < channels; c++)
+            pa_biquad_cascade_set(bc, c, b, &bq[b]);
+
+    return bc;
+}
@@ -0,0 +1,99 @@
+#ifndef foobiquadcascadehfoo
+#define foobiquadcascadehfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#include <pulsecore/filter/biquad.h>
+
+/* A cascade of biquad filters, run over all channels of interleaved frames.
+ *
+ * Every channel has its own coefficients for every stage, so e.g. the LFE
+ * channel can be lowpass filtered while all others are highpass filtered.
+ * Optimized implementations process PA_BIQUAD_CASCADE_LANES channels at a
+ * time in SIMD registers. Channels are padded up to a multiple of that
+ * with all-zero filters, so coefficients and state are laid out as
+ * [stage][coefficient][lane] and [node][tap][lane].
+ *
+ * The filters are in Direct Form I, with the output of one stage being the
+ * input of the next. Node 0 holds the last two input samples and node n the
+ * last two outputs of stage n - 1, like x, y and z of struct lr4. */
+
+#define PA_BIQUAD_CASCADE_LANES 4
+
+/* Most bands pa_biquad_cascade_new_from_bands() accepts */
+#define PA_BIQUAD_CASCADE_MAX_BANDS 16
+
+typedef struct pa_biquad_cascade pa_biquad_cascade;
+
+typedef void (*pa_biquad_cascade_func_t) (pa_biquad_cascade *bc, float *dst, const float *src, unsigned n_frames);
+
+struct pa_biquad_cascade {
+    unsigned channels;
+    unsigned stages;
+    /* channels rounded up to a multiple of PA_BIQUAD_CASCADE_LANES */
+    unsigned lanes;
+
+    /* b0, b1, b2, a1, a2 of every stage */
+    float *coeffs;
+    /* history of every node, see above */
+    float *state;
+};
+
+pa_biquad_cascade *pa_biquad_cascade_new(unsigned channels, unsigned stages);
+void pa_biquad_cascade_free(pa_biquad_cascade *bc);
+
+/* Creates a cascade with the same stages for all channels from a comma
+ * separated list of type:frequency[:q[:gain]] bands. type is one of peaking,
+ * lowshelf, highshelf, lowpass and highpass, the frequency is in Hz and the
+ * gain in dB. Empty q and gain fields mean a q of 0.7071 and no gain. Only
+ * peaking bands take a q and lowpass and highpass bands take no gain, the
+ * field must be left empty for the others.
+ * Returns NULL and logs why if the list is invalid. */
+pa_biquad_cascade *pa_biquad_cascade_new_from_bands(const char *bands, unsigned channels, uint32_t rate);
+
+/* Sets the coefficients of one stage for one channel. The history isn't
+ * touched. */
+void pa_biquad_cascade_set(pa_biquad_cascade *bc, unsigned channel, unsigned stage, const struct biquad *bq);
+
+/* Clears the history of all stages. */
+void pa_biquad_cascade_reset(pa_biquad_cascade *bc);
+
+/* The history can be saved and restored later, e.g. for rewinding. */
+size_t pa_biquad_cascade_state_size(const pa_biquad_cascade *bc);
+void pa_biquad_cascade_save(const pa_biquad_cascade *bc, void *state);
+void pa_biquad_cascade_restore(pa_biquad_cascade *bc, const void *state);
+
+/* Copies the history of the nodes both cascades have, for switching to new
+ * coefficients without starting from silence. The channel counts must match,
+ * the remaining nodes of dst are cleared. */
+void pa_biquad_cascade_copy_state(pa_biquad_cascade *dst, const pa_biquad_cascade *src);
+
+/* dst may be the same as src. */
+void pa_biquad_cascade_process_float32(pa_biquad_cascade *bc, float *dst, const float *src, unsigned n_frames);
+void pa_biquad_cascade_process_s16(pa_biquad_cascade *bc, int16_t *dst, const int16_t *src, unsigned n_frames);
+
+/* Filters one buffer per channel in place. */
+void pa_biquad_cascade_process_planar(pa_biquad_cascade *bc, float * const *planes, unsigned n_frames);
+
+pa_biquad_cascade_func_t pa_get_biquad_cascade_func(void);
+void pa_set_biquad_cascade_func(pa_biquad_cascade_func_t func);
+
+#endif
@@ -0,0 +1,90 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/cpu-arm.h>
+
+#include "biquad-cascade.h"
+
+#include <arm_neon.h>
+
+/* Runs all stages over four channels, starting at channel first. */
+static void process_group_neon(pa_biquad_cascade *bc, unsigned first, float *dst, const float *src, unsigned n_frames) {
+    const unsigned lanes = bc->lanes;
+    const unsigned n = PA_MIN(bc->channels - first, (unsigned) PA_BIQUAD_CASCADE_LANES);
+    float *last = bc->state + bc->stages * 2 * lanes + first;
+    float tmp[PA_BIQUAD_CASCADE_LANES] = { 0, 0, 0, 0 };
+    unsigned i, s, c;
+
+    for (i = 0; i < n_frames; i++) {
+        float32x4_t x, y;
+
+        if (n == PA_BIQUAD_CASCADE_LANES)
+            x = vld1q_f32(src + i * bc->channels + first);
+        else {
+            for (c = 0; c < n; c++)
+                tmp[c] = src[i * bc->channels + first + c];
+            x = vld1q_f32(tmp);
+        }
+
+        for (s = 0; s < bc->stages; s++) {
+            const float *k = bc->coeffs + s * 5 * lanes + first;
+            float *in = bc->state + s * 2 * lanes + first;
+            float *out = in + 2 * lanes;
+            float32x4_t x1 = vld1q_f32(in);
+            float32x4_t x2 = vld1q_f32(in + lanes);
+
+            y = vmulq_f32(vld1q_f32(k), x);
+            y = vmlaq_f32(y, vld1q_f32(k + lanes), x1);
+            y = vmlaq_f32(y, vld1q_f32(k + 2 * lanes), x2);
+            y = vmlsq_f32(y, vld1q_f32(k + 3 * lanes), vld1q_f32(out));
+            y = vmlsq_f32(y, vld1q_f32(k + 4 * lanes), vld1q_f32(out + lanes));
+
+            vst1q_f32(in + lanes, x1);
+            vst1q_f32(in, x);
+            x = y;
+        }
+
+        vst1q_f32(last + lanes, vld1q_f32(last));
+        vst1q_f32(last, x);
+
+        if (n == PA_BIQUAD_CASCADE_LANES)
+            vst1q_f32(dst + i * bc->channels + first, x);
+        else {
+            vst1q_f32(tmp, x);
+            for (c = 0; c < n; c++)
+                dst[i * bc->channels + first + c] = tmp[c];
+        }
+    }
+}
+
+static void process_neon(pa_biquad_cascade *bc, float *dst, const float *src, unsigned n_frames) {
+    unsigned first;
+
+    for (first = 0; first < bc->channels; first += PA_BIQUAD_CASCADE_LANES)
+        process_group_neon(bc, first, dst, src, n_frames);
+}
+
+void pa_biquad_cascade_func_init_neon(pa_cpu_arm_flag_t flags) {
+    pa_log_info("Initialising ARM NEON optimized biquad cascade.");
+    pa_set_biquad_cascade_func(process_neon);
+}
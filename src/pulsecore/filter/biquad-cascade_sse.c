@@ -0,0 +1,98 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/cpu-x86.h>
+
+#include "biquad-cascade.h"
+
+#if (defined (__i386__) || defined (__amd64__)) && defined (__SSE__)
+
+#include <xmmintrin.h>
+
+/* Runs all stages over four channels, starting at channel first. */
+static void process_group_sse(pa_biquad_cascade *bc, unsigned first, float *dst, const float *src, unsigned n_frames) {
+    const unsigned lanes = bc->lanes;
+    const unsigned n = PA_MIN(bc->channels - first, (unsigned) PA_BIQUAD_CASCADE_LANES);
+    float *last = bc->state + bc->stages * 2 * lanes + first;
+    PA_DECLARE_ALIGNED(16, float, tmp[PA_BIQUAD_CASCADE_LANES]) = { 0, 0, 0, 0 };
+    unsigned i, s, c;
+
+    for (i = 0; i < n_frames; i++) {
+        __m128 x, y;
+
+        if (n == PA_BIQUAD_CASCADE_LANES)
+            x = _mm_loadu_ps(src + i * bc->channels + first);
+        else {
+            for (c = 0; c < n; c++)
+                tmp[c] = src[i * bc->channels + first + c];
+            x = _mm_load_ps(tmp);
+        }
+
+        for (s = 0; s < bc->stages; s++) {
+            const float *k = bc->coeffs + s * 5 * lanes + first;
+            float *in = bc->state + s * 2 * lanes + first;
+            float *out = in + 2 * lanes;
+            __m128 x1 = _mm_loadu_ps(in);
+            __m128 x2 = _mm_loadu_ps(in + lanes);
+
+            y = _mm_mul_ps(_mm_loadu_ps(k), x);
+            y = _mm_add_ps(y, _mm_mul_ps(_mm_loadu_ps(k + lanes), x1));
+            y = _mm_add_ps(y, _mm_mul_ps(_mm_loadu_ps(k + 2 * lanes), x2));
+            y = _mm_sub_ps(y, _mm_mul_ps(_mm_loadu_ps(k + 3 * lanes), _mm_loadu_ps(out)));
+            y = _mm_sub_ps(y, _mm_mul_ps(_mm_loadu_ps(k + 4 * lanes), _mm_loadu_ps(out + lanes)));
+
+            _mm_storeu_ps(in + lanes, x1);
+            _mm_storeu_ps(in, x);
+            x = y;
+        }
+
+        _mm_storeu_ps(last + lanes, _mm_loadu_ps(last));
+        _mm_storeu_ps(last, x);
+
+        if (n == PA_BIQUAD_CASCADE_LANES)
+            _mm_storeu_ps(dst + i * bc->channels + first, x);
+        else {
+            _mm_store_ps(tmp, x);
+            for (c = 0; c < n; c++)
+                dst[i * bc->channels + first + c] = tmp[c];
+        }
+    }
+}
+
+static void process_sse(pa_biquad_cascade *bc, float *dst, const float *src, unsigned n_frames) {
+    unsigned first;
+
+    for (first = 0; first < bc->channels; first += PA_BIQUAD_CASCADE_LANES)
+        process_group_sse(bc, first, dst, src, n_frames);
+}
+
+#endif /* (defined (__i386__) || defined (__amd64__)) && defined (__SSE__) */
+
+void pa_biquad_cascade_func_init_sse(pa_cpu_x86_flag_t flags) {
+#if (defined (__i386__) || defined (__amd64__)) && defined (__SSE__)
+    if (flags & PA_CPU_X86_SSE) {
+        pa_log_info("Initialising SSE optimized biquad cascade.");
+        pa_set_biquad_cascade_func(process_sse);
+    }
+#endif /* (defined (__i386__) || defined (__amd64__)) && defined (__SSE__) */
+}
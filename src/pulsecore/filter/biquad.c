@@ -103,7 +103,128 @@ static void biquad_highpass(struct biquad *bq, double cutoff)
 	}
 }
 
+static void biquad_peaking(struct biquad *bq, double freq, double Q,
+			   double gain)
+{
+	double A;
+
+	/* Clip frequencies to between 0 and 1, inclusive. */
+	freq = PA_MIN(freq, 1.0);
+	freq = PA_MAX(0.0, freq);
+
+	/* Don't let Q go negative, which causes an unstable filter. */
+	Q = PA_MAX(0.0, Q);
+
+	A = pow(10.0, gain / 40);
+
+	if (freq > 0 && freq < 1) {
+		if (Q > 0) {
+			double w0 = M_PI * freq;
+			double alpha = sin(w0) / (2 * Q);
+			double k = cos(w0);
+
+			double b0 = 1 + alpha * A;
+			double b1 = -2 * k;
+			double b2 = 1 - alpha * A;
+			double a0 = 1 + alpha / A;
+			double a1 = -2 * k;
+			double a2 = 1 - alpha / A;
+
+			set_coefficient(bq, b0, b1, b2, a0, a1, a2);
+		} else {
+			/* When Q = 0, the above formulas have problems. If we
+			 * look at the z-transform, we can see that the limit
+			 * as Q->0 is A^2, so set the filter that way.
+			 */
+			set_coefficient(bq, A * A, 0, 0, 1, 0, 0);
+		}
+	} else {
+		/* When frequency is 0 or 1, the z-transform is 1. */
+		set_coefficient(bq, 1, 0, 0, 1, 0, 0);
+	}
+}
+
+static void biquad_lowshelf(struct biquad *bq, double freq, double gain)
+{
+	double A;
+
+	/* Clip frequencies to between 0 and 1, inclusive. */
+	freq = PA_MIN(freq, 1.0);
+	freq = PA_MAX(0.0, freq);
+
+	A = pow(10.0, gain / 40);
+
+	if (freq == 1) {
+		/* The z-transform is a constant gain. */
+		set_coefficient(bq, A * A, 0, 0, 1, 0, 0);
+	} else if (freq > 0) {
+		double w0 = M_PI * freq;
+		double S = 1; /* filter slope (1 is max value) */
+		double alpha = 0.5 * sin(w0) *
+			sqrt((A + 1 / A) * (1 / S - 1) + 2);
+		double k = cos(w0);
+		double k2 = 2 * sqrt(A) * alpha;
+		double a_plus_one = A + 1;
+		double a_minus_one = A - 1;
+
+		double b0 = A * (a_plus_one - a_minus_one * k + k2);
+		double b1 = 2 * A * (a_minus_one - a_plus_one * k);
+		double b2 = A * (a_plus_one - a_minus_one * k - k2);
+		double a0 = a_plus_one + a_minus_one * k + k2;
+		double a1 = -2 * (a_minus_one + a_plus_one * k);
+		double a2 = a_plus_one + a_minus_one * k - k2;
+
+		set_coefficient(bq, b0, b1, b2, a0, a1, a2);
+	} else {
+		/* When frequency is 0, the z-transform is 1. */
+		set_coefficient(bq, 1, 0, 0, 1, 0, 0);
+	}
+}
+
+static void biquad_highshelf(struct biquad *bq, double freq, double gain)
+{
+	double A;
+
+	/* Clip frequencies to between 0 and 1, inclusive. */
+	freq = PA_MIN(freq, 1.0);
+	freq = PA_MAX(0.0, freq);
+
+	A = pow(10.0, gain / 40);
+
+	if (freq == 1) {
+		/* The z-transform is 1. */
+		set_coefficient(bq, 1, 0, 0, 1, 0, 0);
+	} else if (freq > 0) {
+		double w0 = M_PI * freq;
+		double S = 1; /* filter slope (1 is max value) */
+		double alpha = 0.5 * sin(w0) *
+			sqrt((A + 1 / A) * (1 / S - 1) + 2);
+		double k = cos(w0);
+		double k2 = 2 * sqrt(A) * alpha;
+		double a_plus_one = A + 1;
+		double a_minus_one = A - 1;
+
+		double b0 = A * (a_plus_one + a_minus_one * k + k2);
+		double b1 = -2 * A * (a_minus_one + a_plus_one * k);
+		double b2 = A * (a_plus_one + a_minus_one * k - k2);
+		double a0 = a_plus_one - a_minus_one * k + k2;
+		double a1 = 2 * (a_minus_one - a_plus_one * k);
+		double a2 = a_plus_one - a_minus_one * k - k2;
+
+		set_coefficient(bq, b0, b1, b2, a0, a1, a2);
+	} else {
+		/* When frequency is 0, the filter is just a gain, A^2. */
+		set_coefficient(bq, A * A, 0, 0, 1, 0, 0);
+	}
+}
+
 void biquad_set(struct biquad *bq, enum biquad_type type, double freq)
+{
+	biquad_set_eq(bq, type, freq, 0.5 * M_SQRT2, 0);
+}
+
+void biquad_set_eq(struct biquad *bq, enum biquad_type type, double freq,
+		   double Q, double gain)
 {
 
 	switch (type) {
@@ -113,5 +234,14 @@ void biquad_set(struct biquad *bq, enum biquad_type type, double freq)
 	case BQ_HIGHPASS:
 		biquad_highpass(bq, freq);
 		break;
+	case BQ_PEAKING:
+		biquad_peaking(bq, freq, Q, gain);
+		break;
+	case BQ_LOWSHELF:
+		biquad_lowshelf(bq, freq, gain);
+		break;
+	case BQ_HIGHSHELF:
+		biquad_highshelf(bq, freq, gain);
+		break;
 	}
 }
@@ -27,6 +27,9 @@ struct biquad {
 enum biquad_type {
 	BQ_LOWPASS,
 	BQ_HIGHPASS,
+	BQ_PEAKING,
+	BQ_LOWSHELF,
+	BQ_HIGHSHELF,
 };
 
 /* Initialize a biquad filter parameters from its type and parameters.
@@ -38,6 +41,13 @@ enum biquad_type {
  */
 void biquad_set(struct biquad *bq, enum biquad_type type, double freq);
 
+/* Like biquad_set(), but with the quality factor and the gain in dB used by
+ * the equalizer filter types. Q is only used by BQ_PEAKING, the lowpass and
+ * highpass filters ignore both Q and gain.
+ */
+void biquad_set_eq(struct biquad *bq, enum biquad_type type, double freq,
+		   double Q, double gain);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
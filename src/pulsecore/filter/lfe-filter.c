@@ -26,18 +26,24 @@
 #include <pulsecore/flist.h>
 #include <pulsecore/llist.h>
 #include <pulsecore/filter/biquad.h>
-#include <pulsecore/filter/crossover.h>
+#include <pulsecore/filter/biquad-cascade.h>
+
+/* Two stages, three nodes of history with two taps each. */
+#define LFE_FILTER_STAGES 2
+#define LFE_FILTER_STATE_MAX ((LFE_FILTER_STAGES + 1) * 2 * PA_CHANNELS_MAX)
 
 struct saved_state {
     PA_LLIST_FIELDS(struct saved_state);
     pa_memchunk chunk;
     int64_t index;
-    struct lr4 lr4[PA_CHANNELS_MAX];
+    float state[LFE_FILTER_STATE_MAX];
 };
 
 PA_STATIC_FLIST_DECLARE(lfe_state, 0, pa_xfree);
 
-/* An LR4 filter, implemented as a chain of two Butterworth filters.
+/* An LR4 filter, implemented as a chain of two Butterworth filters. All
+   channels are run through a single biquad cascade, which processes several
+   channels at a time where SIMD optimizations are available.
 
    Currently the channel map is fixed so that a highpass filter is applied to all
    channels except for the LFE channel, where a lowpass filter is applied.
@@ -53,7 +59,7 @@ struct pa_lfe_filter {
     pa_sample_spec ss;
     size_t maxrewind;
     bool active;
-    struct lr4 lr4[PA_CHANNELS_MAX];
+    pa_biquad_cascade *bc;
 };
 
 static void remove_state(pa_lfe_filter_t *f, struct saved_state *s) {
@@ -69,6 +75,8 @@ pa_lfe_filter_t * pa_lfe_filter_new(const pa_sample_spec* ss, const pa_channel_m
     f->cm = *cm;
     f->ss = *ss;
     f->maxrewind = maxrewind;
+    f->bc = pa_biquad_cascade_new(cm->channels, LFE_FILTER_STAGES);
+    pa_assert(pa_biquad_cascade_state_size(f->bc) <= sizeof(((struct saved_state *) NULL)->state));
     pa_lfe_filter_update_rate(f, ss->rate);
     return f;
 }
@@ -77,6 +85,7 @@ void pa_lfe_filter_free(pa_lfe_filter_t *f) {
     while (f->saved)
         remove_state(f, f->saved);
 
+    pa_biquad_cascade_free(f->bc);
     pa_xfree(f);
 }
 
@@ -90,17 +99,13 @@ static void process_block(pa_lfe_filter_t *f, pa_memchunk *buf, bool store_resul
     void *garbage = store_result ? NULL : pa_xmalloc(buf->length);
 
     if (f->ss.format == PA_SAMPLE_FLOAT32NE) {
-        int i;
         float *data = pa_memblock_acquire_chunk(buf);
-        for (i = 0; i < f->cm.channels; i++)
-            lr4_process_float32(&f->lr4[i], samples, f->cm.channels, &data[i], garbage ? garbage : &data[i]);
+        pa_biquad_cascade_process_float32(f->bc, garbage ? garbage : data, data, samples);
         pa_memblock_release(buf->memblock);
     }
     else if (f->ss.format == PA_SAMPLE_S16NE) {
-        int i;
-        short *data = pa_memblock_acquire_chunk(buf);
-        for (i = 0; i < f->cm.channels; i++)
-            lr4_process_s16(&f->lr4[i], samples, f->cm.channels, &data[i], garbage ? garbage : &data[i]);
+        int16_t *data = pa_memblock_acquire_chunk(buf);
+        pa_biquad_cascade_process_s16(f->bc, garbage ? garbage : data, data, samples);
         pa_memblock_release(buf->memblock);
     }
     else pa_assert_not_reached();
@@ -138,7 +143,7 @@ pa_memchunk * pa_lfe_filter_process(pa_lfe_filter_t *f, pa_memchunk *buf) {
     pa_mempool_unref(pool), pool = NULL;
 
     s->index = f->index;
-    memcpy(s->lr4, f->lr4, sizeof(struct lr4) * f->cm.channels);
+    pa_biquad_cascade_save(f->bc, s->state);
     PA_LLIST_PREPEND(struct saved_state, f->saved, s);
 
     process_block(f, buf, true);
@@ -146,6 +151,7 @@ pa_memchunk * pa_lfe_filter_process(pa_lfe_filter_t *f, pa_memchunk *buf) {
 }
 
 void pa_lfe_filter_update_rate(pa_lfe_filter_t *f, uint32_t new_rate) {
+    struct biquad lowpass, highpass;
     int i;
     float biquad_freq = f->crossover / (new_rate / 2);
 
@@ -160,8 +166,17 @@ void pa_lfe_filter_update_rate(pa_lfe_filter_t *f, uint32_t new_rate) {
         return;
     }
 
-    for (i = 0; i < f->cm.channels; i++)
-        lr4_set(&f->lr4[i], f->cm.map[i] == PA_CHANNEL_POSITION_LFE ? BQ_LOWPASS : BQ_HIGHPASS, biquad_freq);
+    biquad_set(&lowpass, BQ_LOWPASS, biquad_freq);
+    biquad_set(&highpass, BQ_HIGHPASS, biquad_freq);
+
+    for (i = 0; i < f->cm.channels; i++) {
+        const struct biquad *bq = f->cm.map[i] == PA_CHANNEL_POSITION_LFE ? &lowpass : &highpass;
+        unsigned stage;
+
+        for (stage = 0; stage < LFE_FILTER_STAGES; stage++)
+            pa_biquad_cascade_set(f->bc, i, stage, bq);
+    }
+    pa_biquad_cascade_reset(f->bc);
 
     f->active = true;
 }
@@ -185,7 +200,7 @@ void pa_lfe_filter_rewind(pa_lfe_filter_t *f, size_t amount) {
     }
     pa_log_debug("Rewinding LFE filter %zu samples to position %lli. Found saved state at position %lli",
         samples, (long long) f->index, (long long) s->index);
-    memcpy(f->lr4, s->lr4, sizeof(struct lr4) * f->cm.channels);
+    pa_biquad_cascade_restore(f->bc, s->state);
 
     /* now fast forward to the actual position */
     if (f->index > s->index) {
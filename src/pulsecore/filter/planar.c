@@ -0,0 +1,103 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulse/xmalloc.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/sample-util.h>
+
+#include "planar.h"
+
+/* Planes allocated by pa_planar_alloc() start a multiple of this many
+ * frames apart, i.e. 16 bytes for SSE and NEON. */
+#define PLANE_ALIGN_FRAMES 4
+
+void pa_planar_init(pa_planar *p, unsigned channels, size_t length, float *data, size_t stride) {
+    unsigned c;
+
+    pa_assert(p);
+    pa_assert(channels > 0);
+    pa_assert(channels <= PA_CHANNELS_MAX);
+    pa_assert(data);
+    pa_assert(stride >= length);
+
+    p->channels = channels;
+    p->length = length;
+    p->data = NULL;
+
+    for (c = 0; c < channels; c++)
+        p->plane[c] = data + c * stride;
+
+    for (; c < PA_CHANNELS_MAX; c++)
+        p->plane[c] = NULL;
+}
+
+void pa_planar_alloc(pa_planar *p, unsigned channels, size_t length) {
+    size_t stride;
+    float *data;
+
+    pa_assert(p);
+    pa_assert(length > 0);
+
+    stride = PA_ROUND_UP(length, PLANE_ALIGN_FRAMES);
+    data = pa_xnew0(float, stride * channels);
+
+    pa_planar_init(p, channels, length, data, stride);
+    p->data = data;
+}
+
+void pa_planar_free(pa_planar *p) {
+    pa_assert(p);
+
+    pa_xfree(p->data);
+    p->data = NULL;
+}
+
+void pa_planar_import(const pa_planar *p, size_t offset, const float *src, size_t n) {
+    void *planes[PA_CHANNELS_MAX];
+    unsigned c;
+
+    pa_assert(p);
+    pa_assert(src);
+    pa_assert(offset + n <= p->length);
+
+    for (c = 0; c < p->channels; c++)
+        planes[c] = p->plane[c] + offset;
+
+    pa_deinterleave(src, planes, p->channels, sizeof(float), (unsigned) n);
+
+    for (c = 0; c < p->channels; c++)
+        pa_sample_clamp(PA_SAMPLE_FLOAT32NE, planes[c], sizeof(float), planes[c], sizeof(float), (unsigned) n);
+}
+
+void pa_planar_export(const pa_planar *p, size_t offset, float *dst, size_t n) {
+    const void *planes[PA_CHANNELS_MAX];
+    unsigned c;
+
+    pa_assert(p);
+    pa_assert(dst);
+    pa_assert(offset + n <= p->length);
+
+    for (c = 0; c < p->channels; c++)
+        planes[c] = p->plane[c] + offset;
+
+    pa_interleave(planes, p->channels, dst, sizeof(float), (unsigned) n);
+    pa_sample_clamp(PA_SAMPLE_FLOAT32NE, dst, sizeof(float), dst, sizeof(float), (unsigned) (n * p->channels));
+}
@@ -0,0 +1,59 @@
+#ifndef fooplanarhfoo
+#define fooplanarhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stddef.h>
+
+#include <pulse/sample.h>
+
+/* Float audio with the samples of every channel stored contiguously.
+ *
+ * Filter stages hand blocks to each other in this form, so audio coming
+ * from a memchunk is deinterleaved once when it enters a chain of stages
+ * and interleaved once when it leaves it, instead of around every stage.
+ * Plane c holds length frames starting at plane[c]. */
+
+typedef struct pa_planar {
+    unsigned channels;
+    size_t length;
+    float *plane[PA_CHANNELS_MAX];
+
+    /* The memory behind the planes if it was allocated by
+     * pa_planar_alloc(), NULL otherwise */
+    float *data;
+} pa_planar;
+
+/* Lets p describe channels planes of length frames in caller owned memory,
+ * plane c starting at data + c * stride. */
+void pa_planar_init(pa_planar *p, unsigned channels, size_t length, float *data, size_t stride);
+
+/* Allocates silent planes, spaced so that every plane is as aligned as the
+ * first one. */
+void pa_planar_alloc(pa_planar *p, unsigned channels, size_t length);
+void pa_planar_free(pa_planar *p);
+
+/* Deinterleaves n float frames from src into frames offset to offset + n
+ * of the planes, clamping them to [-1, 1]. */
+void pa_planar_import(const pa_planar *p, size_t offset, const float *src, size_t n);
+
+/* Interleaves frames offset to offset + n of the planes into dst, clamping
+ * them to [-1, 1]. The planes are left untouched. */
+void pa_planar_export(const pa_planar *p, size_t offset, float *dst, size_t n);
+
+#endif
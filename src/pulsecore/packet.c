@@ -30,15 +30,13 @@
 
 #include "packet.h"
 
-#define MAX_APPENDED_SIZE 128
-
 struct pa_packet {
     PA_REFCNT_DECLARE;
     enum { PA_PACKET_APPENDED, PA_PACKET_DYNAMIC } type;
     size_t length;
     uint8_t *data;
     union {
-        uint8_t appended[MAX_APPENDED_SIZE];
+        uint8_t appended[PA_PACKET_APPENDED_SIZE];
     } per_type;
 };
 
@@ -53,7 +51,7 @@ pa_packet* pa_packet_new(size_t length) {
         p = pa_xnew(pa_packet, 1);
     PA_REFCNT_INIT(p);
     p->length = length;
-    if (length > MAX_APPENDED_SIZE) {
+    if (length > PA_PACKET_APPENDED_SIZE) {
         p->data = pa_xmalloc(length);
         p->type = PA_PACKET_DYNAMIC;
     } else {
@@ -25,6 +25,9 @@
 
 typedef struct pa_packet pa_packet;
 
+/* Packets up to this size store their data inline */
+#define PA_PACKET_APPENDED_SIZE 128
+
 /* create empty packet (either of type appended or dynamic depending
  * on length) */
 pa_packet* pa_packet_new(size_t length);
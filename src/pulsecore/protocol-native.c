@@ -57,6 +57,8 @@
 #include <pulsecore/ipacl.h>
 #include <pulsecore/thread-mq.h>
 #include <pulsecore/mem.h>
+#include <pulsecore/llist.h>
+#include <pulsecore/flist.h>
 
 #include "protocol-native.h"
 
@@ -73,8 +75,26 @@
 #define DEFAULT_PROCESS_MSEC 20   /* 20ms */
 #define DEFAULT_FRAGSIZE_MSEC DEFAULT_TLENGTH_MSEC
 
+/* By default subscription events are only collected until the next
+ * main loop iteration */
+#define DEFAULT_SUBSCRIPTION_COALESCE_MSEC 0
+#define MAX_SUBSCRIPTION_COALESCE_MSEC 1000
+
+/* Timing info is attached to at most one PA_COMMAND_REQUEST per
+ * interval, since taking it means querying the sink's latency */
+#define REQUEST_TIMING_INTERVAL_USEC (100*PA_USEC_PER_MSEC)
+
 struct pa_native_protocol;
 
+/* A subscription event that has been dispatched by the core but not
+ * yet sent to the client, see subscription_cb() */
+typedef struct pending_subscription_event {
+    pa_subscription_event_type_t type;
+    uint32_t index;
+
+    PA_LLIST_FIELDS(struct pending_subscription_event);
+} pending_subscription_event;
+
 typedef struct record_stream {
     pa_msgobject parent;
 
@@ -126,7 +146,9 @@ typedef struct playback_stream {
 
     bool is_underrun:1;
     bool drain_request:1;
+    bool send_timing_info:1;
     uint32_t drain_tag;
+    pa_usec_t timing_sent_at;
     uint32_t syncid;
 
     /* Optimization to avoid too many rewinds with a lot of small blocks */
@@ -150,6 +172,20 @@ typedef struct playback_stream {
 #define PLAYBACK_STREAM(o) (playback_stream_cast(o))
 PA_DEFINE_PRIVATE_CLASS(playback_stream, output_stream);
 
+/* Timing parameters captured in the IO thread and attached to
+ * PA_COMMAND_REQUEST, PA_COMMAND_STARTED and PA_COMMAND_UNDERFLOW for
+ * clients >= 33, laid out like the reply to
+ * PA_COMMAND_GET_PLAYBACK_LATENCY */
+typedef struct playback_stream_timing {
+    pa_usec_t sink_usec;
+    bool playing;
+    struct timeval timestamp;
+    int64_t read_index, write_index;
+    uint64_t underrun_for, playing_for;
+} playback_stream_timing;
+
+PA_STATIC_FLIST_DECLARE(playback_stream_timings, 0, pa_xfree);
+
 typedef struct upload_stream {
     output_stream parent;
 
@@ -167,6 +203,22 @@ typedef struct upload_stream {
 #define UPLOAD_STREAM(o) (upload_stream_cast(o))
 PA_DEFINE_PRIVATE_CLASS(upload_stream, output_stream);
 
+/* The info list types we keep reply size estimates for */
+enum {
+    INFO_LIST_SINK,
+    INFO_LIST_SOURCE,
+    INFO_LIST_CLIENT,
+    INFO_LIST_CARD,
+    INFO_LIST_MODULE,
+    INFO_LIST_SINK_INPUT,
+    INFO_LIST_SOURCE_OUTPUT,
+    INFO_LIST_SAMPLE,
+    INFO_LIST_MAX
+};
+
+/* Tagged command and tag of a reply */
+#define INFO_LIST_HEADER_SIZE 10
+
 struct pa_native_connection {
     pa_msgobject parent;
     pa_native_protocol *protocol;
@@ -188,6 +240,19 @@ struct pa_native_connection {
     pa_subscription *subscription;
     pa_time_event *auth_timeout_event;
     pa_srbchannel *srbpending;
+
+    /* Subscription events waiting to be coalesced and sent */
+    PA_LLIST_HEAD(pending_subscription_event, subscription_pending);
+    pending_subscription_event *subscription_pending_last;
+    pa_time_event *subscription_flush_event;
+
+    uint64_t n_subscription_events_sent;
+    uint64_t n_subscription_events_suppressed;
+    uint64_t n_subscription_packets_sent;
+
+    /* Average serialized size of an entry in the last info list reply
+     * of each type, used to preallocate the next reply */
+    size_t info_list_entry_size[INFO_LIST_MAX];
 };
 
 #define PA_NATIVE_CONNECTION(o) (pa_native_connection_cast(o))
@@ -656,6 +721,64 @@ static void playback_stream_free(pa_object* o) {
     pa_xfree(s);
 }
 
+/* Called from IO context. With rate_limit set NULL is returned if
+ * timing info was already taken less than REQUEST_TIMING_INTERVAL_USEC
+ * ago. */
+static playback_stream_timing* playback_stream_timing_new(playback_stream *s, bool rate_limit) {
+    playback_stream_timing *timing;
+    pa_sink_input *i = s->sink_input;
+    pa_usec_t now;
+
+    if (!s->send_timing_info)
+        return NULL;
+
+    now = pa_rtclock_now();
+    if (rate_limit && s->timing_sent_at > 0 && now < s->timing_sent_at + REQUEST_TIMING_INTERVAL_USEC)
+        return NULL;
+
+    s->timing_sent_at = now;
+
+    if (!(timing = pa_flist_pop(PA_STATIC_FLIST_GET(playback_stream_timings))))
+        timing = pa_xnew(playback_stream_timing, 1);
+
+    /* Same values as SINK_INPUT_MESSAGE_UPDATE_LATENCY collects, but
+     * taken right here so no extra round trip to this thread is needed */
+    timing->sink_usec =
+        pa_sink_get_latency_within_thread(i->sink) +
+        pa_bytes_to_usec(pa_memblockq_get_length(i->thread_info.render_memblockq), &i->sink->sample_spec);
+    timing->playing =
+        i->thread_info.playing_for > 0 &&
+        i->sink->thread_info.state == PA_SINK_RUNNING &&
+        i->thread_info.state == PA_SINK_INPUT_RUNNING;
+    pa_gettimeofday(&timing->timestamp);
+    timing->read_index = pa_memblockq_get_read_index(s->memblockq);
+    timing->write_index = pa_memblockq_get_write_index(s->memblockq);
+    timing->underrun_for = i->thread_info.underrun_for;
+    timing->playing_for = i->thread_info.playing_for;
+
+    return timing;
+}
+
+/* Called from main context, when the message carrying it is done */
+static void playback_stream_timing_free(void *timing) {
+    if (!timing)
+        return;
+
+    if (pa_flist_push(PA_STATIC_FLIST_GET(playback_stream_timings), timing) < 0)
+        pa_xfree(timing);
+}
+
+/* Called from main context */
+static void playback_stream_put_timing(pa_tagstruct *t, const playback_stream_timing *timing) {
+    pa_tagstruct_put_usec(t, timing->sink_usec);
+    pa_tagstruct_put_boolean(t, timing->playing);
+    pa_tagstruct_put_timeval(t, &timing->timestamp);
+    pa_tagstruct_puts64(t, timing->write_index);
+    pa_tagstruct_puts64(t, timing->read_index);
+    pa_tagstruct_putu64(t, timing->underrun_for);
+    pa_tagstruct_putu64(t, timing->playing_for);
+}
+
 /* Called from main context */
 static int playback_stream_process_msg(pa_msgobject *o, int code, void*userdata, int64_t offset, pa_memchunk *chunk) {
     playback_stream *s = PLAYBACK_STREAM(o);
@@ -683,6 +806,8 @@ static int playback_stream_process_msg(pa_msgobject *o, int code, void*userdata,
             pa_tagstruct_putu32(t, (uint32_t) -1); /* tag */
             pa_tagstruct_putu32(t, s->index);
             pa_tagstruct_putu32(t, (uint32_t) l);
+            if (userdata)
+                playback_stream_put_timing(t, userdata);
             pa_pstream_send_tagstruct(s->connection->pstream, t);
 
 #ifdef PROTOCOL_NATIVE_DEBUG
@@ -705,6 +830,8 @@ static int playback_stream_process_msg(pa_msgobject *o, int code, void*userdata,
             pa_tagstruct_putu32(t, s->index);
             if (s->connection->version >= 23)
                 pa_tagstruct_puts64(t, offset);
+            if (userdata)
+                playback_stream_put_timing(t, userdata);
             pa_pstream_send_tagstruct(s->connection->pstream, t);
             break;
         }
@@ -731,6 +858,8 @@ static int playback_stream_process_msg(pa_msgobject *o, int code, void*userdata,
                 pa_tagstruct_putu32(t, PA_COMMAND_STARTED);
                 pa_tagstruct_putu32(t, (uint32_t) -1); /* tag */
                 pa_tagstruct_putu32(t, s->index);
+                if (userdata)
+                    playback_stream_put_timing(t, userdata);
                 pa_pstream_send_tagstruct(s->connection->pstream, t);
             }
 
@@ -1043,6 +1172,8 @@ static playback_stream* playback_stream_new(
     s->sink_input = sink_input;
     s->is_underrun = true;
     s->drain_request = false;
+    s->send_timing_info = c->version >= 33;
+    s->timing_sent_at = 0;
     pa_atomic_store(&s->missing, 0);
     s->buffer_attr_req = *a;
     s->adjust_latency = adjust_latency;
@@ -1132,7 +1263,8 @@ static void playback_stream_request_bytes(playback_stream *s) {
 #endif
 
     if (pa_atomic_add(&s->missing, (int) m) <= 0)
-        pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(s), PLAYBACK_STREAM_MESSAGE_REQUEST_DATA, NULL, 0, NULL, NULL);
+        pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(s), PLAYBACK_STREAM_MESSAGE_REQUEST_DATA,
+                          playback_stream_timing_new(s, true), 0, NULL, playback_stream_timing_free);
 }
 
 /* Called from main context */
@@ -1169,6 +1301,17 @@ static int native_connection_process_msg(pa_msgobject *o, int code, void*userdat
     return 0;
 }
 
+static void free_pending_subscription_event(pa_native_connection *c, pending_subscription_event *e) {
+    pa_assert(c);
+    pa_assert(e);
+
+    if (!e->next)
+        c->subscription_pending_last = e->prev;
+
+    PA_LLIST_REMOVE(pending_subscription_event, c->subscription_pending, e);
+    pa_xfree(e);
+}
+
 /* Called from main context */
 static void native_connection_unlink(pa_native_connection *c) {
     record_stream *r;
@@ -1207,6 +1350,20 @@ static void native_connection_unlink(pa_native_connection *c) {
         c->auth_timeout_event = NULL;
     }
 
+    while (c->subscription_pending)
+        free_pending_subscription_event(c, c->subscription_pending);
+
+    if (c->subscription_flush_event) {
+        c->protocol->core->mainloop->time_free(c->subscription_flush_event);
+        c->subscription_flush_event = NULL;
+    }
+
+    if (c->n_subscription_events_sent > 0 || c->n_subscription_events_suppressed > 0)
+        pa_log_debug("Sent %llu subscription events in %llu packets, %llu events coalesced.",
+                     (unsigned long long) c->n_subscription_events_sent,
+                     (unsigned long long) c->n_subscription_packets_sent,
+                     (unsigned long long) c->n_subscription_events_suppressed);
+
     pa_assert_se(pa_idxset_remove_by_data(c->protocol->connections, c, NULL) == c);
     c->protocol = NULL;
     pa_native_connection_unref(c);
@@ -1479,7 +1636,8 @@ static bool handle_input_underrun(playback_stream *s, bool force) {
          pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(s), PLAYBACK_STREAM_MESSAGE_DRAIN_ACK, PA_UINT_TO_PTR(s->drain_tag), 0, NULL, NULL);
          pa_log_debug("Drain acknowledged of '%s'", pa_strnull(pa_proplist_gets(s->sink_input->proplist, PA_PROP_MEDIA_NAME)));
     } else if (!s->is_underrun) {
-         pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(s), PLAYBACK_STREAM_MESSAGE_UNDERFLOW, NULL, pa_memblockq_get_read_index(s->memblockq), NULL, NULL);
+         pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(s), PLAYBACK_STREAM_MESSAGE_UNDERFLOW,
+                           playback_stream_timing_new(s, false), pa_memblockq_get_read_index(s->memblockq), NULL, playback_stream_timing_free);
     }
     s->is_underrun = true;
     playback_stream_request_bytes(s);
@@ -1521,7 +1679,8 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
     chunk->length = PA_MIN(nbytes, chunk->length);
 
     if (i->thread_info.underrun_for > 0)
-        pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(s), PLAYBACK_STREAM_MESSAGE_STARTED, NULL, 0, NULL, NULL);
+        pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(s), PLAYBACK_STREAM_MESSAGE_STARTED,
+                          playback_stream_timing_new(s, false), 0, NULL, playback_stream_timing_free);
 
     pa_memblockq_drop(s->memblockq, chunk->length);
     playback_stream_request_bytes(s);
@@ -1830,15 +1989,19 @@ if (!(expression)) { \
 } \
 } while(0);
 
-static pa_tagstruct *reply_new(uint32_t tag) {
+static pa_tagstruct *reply_new_sized(uint32_t tag, size_t size_hint) {
     pa_tagstruct *reply;
 
-    reply = pa_tagstruct_new();
+    reply = pa_tagstruct_new_sized(size_hint);
     pa_tagstruct_putu32(reply, PA_COMMAND_REPLY);
     pa_tagstruct_putu32(reply, tag);
     return reply;
 }
 
+static pa_tagstruct *reply_new(uint32_t tag) {
+    return reply_new_sized(tag, 0);
+}
+
 static void command_create_playback_stream(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
     pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
     playback_stream *s;
@@ -3570,12 +3733,35 @@ static void command_get_info(pa_pdispatch *pd, uint32_t command, uint32_t tag, p
     pa_pstream_send_tagstruct(c->pstream, reply);
 }
 
+static size_t *info_list_hint_get(pa_native_connection *c, uint32_t command) {
+    switch (command) {
+        case PA_COMMAND_GET_SINK_INFO_LIST:
+            return &c->info_list_entry_size[INFO_LIST_SINK];
+        case PA_COMMAND_GET_SOURCE_INFO_LIST:
+            return &c->info_list_entry_size[INFO_LIST_SOURCE];
+        case PA_COMMAND_GET_CLIENT_INFO_LIST:
+            return &c->info_list_entry_size[INFO_LIST_CLIENT];
+        case PA_COMMAND_GET_CARD_INFO_LIST:
+            return &c->info_list_entry_size[INFO_LIST_CARD];
+        case PA_COMMAND_GET_MODULE_INFO_LIST:
+            return &c->info_list_entry_size[INFO_LIST_MODULE];
+        case PA_COMMAND_GET_SINK_INPUT_INFO_LIST:
+            return &c->info_list_entry_size[INFO_LIST_SINK_INPUT];
+        case PA_COMMAND_GET_SOURCE_OUTPUT_INFO_LIST:
+            return &c->info_list_entry_size[INFO_LIST_SOURCE_OUTPUT];
+        default:
+            pa_assert(command == PA_COMMAND_GET_SAMPLE_INFO_LIST);
+            return &c->info_list_entry_size[INFO_LIST_SAMPLE];
+    }
+}
+
 static void command_get_info_list(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
     pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
     pa_idxset *i;
-    uint32_t idx;
+    uint32_t idx, n;
     void *p;
     pa_tagstruct *reply;
+    size_t *hint;
 
     pa_native_connection_assert_ref(c);
     pa_assert(t);
@@ -3587,8 +3773,6 @@ static void command_get_info_list(pa_pdispatch *pd, uint32_t command, uint32_t t
 
     CHECK_VALIDITY(c->pstream, c->authorized, tag, PA_ERR_ACCESS);
 
-    reply = reply_new(tag);
-
     if (command == PA_COMMAND_GET_SINK_INFO_LIST)
         i = c->protocol->core->sinks;
     else if (command == PA_COMMAND_GET_SOURCE_INFO_LIST)
@@ -3608,6 +3792,13 @@ static void command_get_info_list(pa_pdispatch *pd, uint32_t command, uint32_t t
         i = c->protocol->core->scache;
     }
 
+    /* Size the reply buffer from what an entry of this type took the
+     * last time, so that large lists are serialized into a single
+     * allocation which is then handed to the packet without a copy */
+    hint = info_list_hint_get(c, command);
+    n = i ? pa_idxset_size(i) : 0;
+    reply = reply_new_sized(tag, *hint > 0 ? INFO_LIST_HEADER_SIZE + n * *hint : 0);
+
     if (i) {
         PA_IDXSET_FOREACH(p, i, idx) {
             if (command == PA_COMMAND_GET_SINK_INFO_LIST)
@@ -3631,6 +3822,14 @@ static void command_get_info_list(pa_pdispatch *pd, uint32_t command, uint32_t t
         }
     }
 
+    if (n > 0) {
+        size_t length;
+
+        pa_tagstruct_data(reply, &length);
+        /* Round up a bit, entries of the same type vary in size */
+        *hint = PA_ROUND_UP((length - INFO_LIST_HEADER_SIZE + n - 1) / n, 64);
+    }
+
     pa_pstream_send_tagstruct(c->pstream, reply);
 }
 
@@ -3680,18 +3879,105 @@ static void command_get_server_info(pa_pdispatch *pd, uint32_t command, uint32_t
     pa_pstream_send_tagstruct(c->pstream, reply);
 }
 
+/* Called from main context */
+static void flush_subscription_events(pa_native_connection *c) {
+    pa_tagstruct *t = NULL;
+
+    pa_native_connection_assert_ref(c);
+
+    if (c->subscription_flush_event) {
+        c->protocol->core->mainloop->time_free(c->subscription_flush_event);
+        c->subscription_flush_event = NULL;
+    }
+
+    while (c->subscription_pending) {
+        pending_subscription_event *e = c->subscription_pending;
+
+        /* Starting with protocol version 33 a single SUBSCRIBE_EVENT
+         * packet may carry an arbitrary number of events. Older
+         * clients get one packet per event. */
+        if (!t) {
+            t = pa_tagstruct_new();
+            pa_tagstruct_putu32(t, PA_COMMAND_SUBSCRIBE_EVENT);
+            pa_tagstruct_putu32(t, (uint32_t) -1);
+        }
+
+        pa_tagstruct_putu32(t, e->type);
+        pa_tagstruct_putu32(t, e->index);
+        c->n_subscription_events_sent++;
+
+        free_pending_subscription_event(c, e);
+
+        if (c->version < 33) {
+            pa_pstream_send_tagstruct(c->pstream, t);
+            c->n_subscription_packets_sent++;
+            t = NULL;
+        }
+    }
+
+    if (t) {
+        pa_pstream_send_tagstruct(c->pstream, t);
+        c->n_subscription_packets_sent++;
+    }
+}
+
+static void subscription_flush_cb(pa_mainloop_api *m, pa_time_event *e, const struct timeval *t, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+
+    pa_assert(m);
+    pa_native_connection_assert_ref(c);
+    pa_assert(c->subscription_flush_event == e);
+
+    flush_subscription_events(c);
+}
+
+/* Subscription events are not sent right away, but collected for
+ * options->subscription_coalesce_usec (or at least until the next
+ * main loop iteration), so that repeated change events for the same
+ * object are merged and the rest can be sent in a single packet. */
 static void subscription_cb(pa_core *core, pa_subscription_event_type_t e, uint32_t idx, void *userdata) {
-    pa_tagstruct *t;
     pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+    pending_subscription_event *p;
 
     pa_native_connection_assert_ref(c);
 
-    t = pa_tagstruct_new();
-    pa_tagstruct_putu32(t, PA_COMMAND_SUBSCRIBE_EVENT);
-    pa_tagstruct_putu32(t, (uint32_t) -1);
-    pa_tagstruct_putu32(t, e);
-    pa_tagstruct_putu32(t, idx);
-    pa_pstream_send_tagstruct(c->pstream, t);
+    if ((e & PA_SUBSCRIPTION_EVENT_TYPE_MASK) != PA_SUBSCRIPTION_EVENT_NEW) {
+        pending_subscription_event *i, *n;
+
+        for (i = c->subscription_pending_last; i; i = n) {
+            n = i->prev;
+
+            if (((e ^ i->type) & PA_SUBSCRIPTION_EVENT_FACILITY_MASK) || i->index != idx)
+                continue;
+
+            if ((e & PA_SUBSCRIPTION_EVENT_TYPE_MASK) == PA_SUBSCRIPTION_EVENT_REMOVE) {
+                /* The object is going away, the client doesn't need
+                 * to hear about any earlier changes. */
+                free_pending_subscription_event(c, i);
+                c->n_subscription_events_suppressed++;
+                continue;
+            }
+
+            if ((e & PA_SUBSCRIPTION_EVENT_TYPE_MASK) == PA_SUBSCRIPTION_EVENT_CHANGE) {
+                /* A "new" or "change" event for this object is still
+                 * pending, that one covers this change as well. */
+                c->n_subscription_events_suppressed++;
+                return;
+            }
+        }
+    }
+
+    p = pa_xnew(pending_subscription_event, 1);
+    p->type = e;
+    p->index = idx;
+
+    PA_LLIST_INSERT_AFTER(pending_subscription_event, c->subscription_pending, c->subscription_pending_last, p);
+    c->subscription_pending_last = p;
+
+    if (!c->subscription_flush_event)
+        c->subscription_flush_event = pa_core_rttime_new(c->protocol->core,
+                                                         pa_rtclock_now() + c->options->subscription_coalesce_usec,
+                                                         subscription_flush_cb, c);
 }
 
 static void command_subscribe(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
@@ -5191,6 +5477,15 @@ void pa_native_protocol_connect(pa_native_protocol *p, pa_iochannel *io, pa_nati
     c->rrobin_index = PA_IDXSET_INVALID;
     c->subscription = NULL;
 
+    PA_LLIST_HEAD_INIT(pending_subscription_event, c->subscription_pending);
+    c->subscription_pending_last = NULL;
+    c->subscription_flush_event = NULL;
+    c->n_subscription_events_sent = 0;
+    c->n_subscription_events_suppressed = 0;
+    c->n_subscription_packets_sent = 0;
+
+    memset(c->info_list_entry_size, 0, sizeof(c->info_list_entry_size));
+
     pa_idxset_put(p->connections, c, NULL);
 
 #ifdef HAVE_CREDS
@@ -5373,6 +5668,7 @@ void pa_native_options_unref(pa_native_options *o) {
 int pa_native_options_parse(pa_native_options *o, pa_core *c, pa_modargs *ma) {
     bool enabled;
     const char *acl;
+    uint32_t coalesce_msec;
 
     pa_assert(o);
     pa_assert(PA_REFCNT_VALUE(o) >= 1);
@@ -5384,6 +5680,14 @@ int pa_native_options_parse(pa_native_options *o, pa_core *c, pa_modargs *ma) {
         return -1;
     }
 
+    coalesce_msec = DEFAULT_SUBSCRIPTION_COALESCE_MSEC;
+    if (pa_modargs_get_value_u32(ma, "subscription-coalesce-msec", &coalesce_msec) < 0 ||
+        coalesce_msec > MAX_SUBSCRIPTION_COALESCE_MSEC) {
+        pa_log("subscription-coalesce-msec= expects a value between 0 and %u.", MAX_SUBSCRIPTION_COALESCE_MSEC);
+        return -1;
+    }
+    o->subscription_coalesce_usec = (pa_usec_t) coalesce_msec * PA_USEC_PER_MSEC;
+
     if (pa_modargs_get_value_boolean(ma, "auth-anonymous", &o->auth_anonymous) < 0) {
         pa_log("auth-anonymous= expects a boolean argument.");
         return -1;
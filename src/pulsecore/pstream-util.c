@@ -39,8 +39,18 @@ static void pa_pstream_send_tagstruct_with_ancil_data(pa_pstream *p, pa_tagstruc
     pa_assert(t);
 
     pa_assert_se(data = pa_tagstruct_data(t, &length));
-    pa_assert_se(packet = pa_packet_new_data(data, length));
-    pa_tagstruct_free(t);
+
+    /* Large tagstructs already live in their own heap buffer, hand it
+     * over to the packet instead of copying it */
+    if (length > PA_PACKET_APPENDED_SIZE) {
+        uint8_t *d;
+
+        pa_assert_se(d = pa_tagstruct_free_data(t, &length));
+        pa_assert_se(packet = pa_packet_new_dynamic(d, length));
+    } else {
+        pa_assert_se(packet = pa_packet_new_data(data, length));
+        pa_tagstruct_free(t);
+    }
 
     pa_pstream_send_packet(p, packet, ancil_data);
     pa_packet_unref(packet);
@@ -1364,12 +1364,11 @@ static pa_memchunk *convert_from_work_format(pa_resampler *r, pa_memchunk *input
     return &r->from_work_format_buf;
 }
 
-void pa_resampler_run(pa_resampler *r, const pa_memchunk *in, pa_memchunk *out) {
+static pa_memchunk *process(pa_resampler *r, const pa_memchunk *in) {
     pa_memchunk *buf;
 
     pa_assert(r);
     pa_assert(in);
-    pa_assert(out);
     pa_assert(in->length);
     pa_assert(in->memblock);
     pa_assert(in->length % r->i_fz == 0);
@@ -1390,8 +1389,20 @@ void pa_resampler_run(pa_resampler *r, const pa_memchunk *in, pa_memchunk *out)
     if (r->lfe_filter)
         buf = pa_lfe_filter_process(r->lfe_filter, buf);
 
-    if (buf->length) {
+    if (buf->length)
         buf = convert_from_work_format(r, buf);
+
+    return buf;
+}
+
+void pa_resampler_run(pa_resampler *r, const pa_memchunk *in, pa_memchunk *out) {
+    pa_memchunk *buf;
+
+    pa_assert(out);
+
+    buf = process(r, in);
+
+    if (buf->length) {
         *out = *buf;
 
         if (buf == in)
@@ -1402,6 +1413,30 @@ void pa_resampler_run(pa_resampler *r, const pa_memchunk *in, pa_memchunk *out)
         pa_memchunk_reset(out);
 }
 
+void pa_resampler_run_into(pa_resampler *r, const pa_memchunk *in, pa_memchunk *out) {
+    pa_memchunk *buf;
+    void *src, *dst;
+
+    pa_assert(out);
+    pa_assert(out->memblock);
+
+    buf = process(r, in);
+
+    /* The work buffers are kept, so once they have grown large enough
+     * nothing is allocated here anymore. */
+    if (buf->length) {
+        pa_assert(out->index + buf->length <= pa_memblock_get_length(out->memblock));
+
+        src = pa_memblock_acquire_chunk(buf);
+        dst = (uint8_t *) pa_memblock_acquire(out->memblock) + out->index;
+        memcpy(dst, src, buf->length);
+        pa_memblock_release(out->memblock);
+        pa_memblock_release(buf->memblock);
+    }
+
+    out->length = buf->length;
+}
+
 /*** copy (noop) implementation ***/
 
 static int copy_init(pa_resampler *r) {
@@ -136,6 +136,11 @@ size_t pa_resampler_max_block_size(pa_resampler *r);
 /* Pass the specified memory chunk to the resampler and return the newly resampled data */
 void pa_resampler_run(pa_resampler *r, const pa_memchunk *in, pa_memchunk *out);
 
+/* Like pa_resampler_run(), but writes the result to out->memblock at
+ * out->index instead of allocating a new block, and sets out->length. The
+ * block needs to have room for pa_resampler_result() bytes. */
+void pa_resampler_run_into(pa_resampler *r, const pa_memchunk *in, pa_memchunk *out);
+
 /* Change the input rate of the resampler object */
 void pa_resampler_set_input_rate(pa_resampler *r, uint32_t rate);
 
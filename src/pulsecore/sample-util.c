@@ -121,7 +121,62 @@ bool pa_frame_aligned(size_t l, const pa_sample_spec *ss) {
     return l % fs == 0;
 }
 
+static pa_interleave_func_t interleave_table[2][PA_INTERLEAVE_MAX_CHANNELS + 1];
+static pa_deinterleave_func_t deinterleave_table[2][PA_INTERLEAVE_MAX_CHANNELS + 1];
+
+/* Index into the (de)interleave tables for ss, -1 if there is none */
+static int interleave_index(size_t ss, unsigned channels) {
+    if (channels > PA_INTERLEAVE_MAX_CHANNELS)
+        return -1;
+
+    switch (ss) {
+        case 2:
+            return 0;
+        case 4:
+            return 1;
+        default:
+            return -1;
+    }
+}
+
+pa_interleave_func_t pa_get_interleave_func(size_t ss, unsigned channels) {
+    int i;
+
+    if ((i = interleave_index(ss, channels)) < 0)
+        return NULL;
+
+    return interleave_table[i][channels];
+}
+
+void pa_set_interleave_func(size_t ss, unsigned channels, pa_interleave_func_t func) {
+    int i;
+
+    pa_assert(channels > 0);
+    pa_assert_se((i = interleave_index(ss, channels)) >= 0);
+
+    interleave_table[i][channels] = func;
+}
+
+pa_deinterleave_func_t pa_get_deinterleave_func(size_t ss, unsigned channels) {
+    int i;
+
+    if ((i = interleave_index(ss, channels)) < 0)
+        return NULL;
+
+    return deinterleave_table[i][channels];
+}
+
+void pa_set_deinterleave_func(size_t ss, unsigned channels, pa_deinterleave_func_t func) {
+    int i;
+
+    pa_assert(channels > 0);
+    pa_assert_se((i = interleave_index(ss, channels)) >= 0);
+
+    deinterleave_table[i][channels] = func;
+}
+
 void pa_interleave(const void *src[], unsigned channels, void *dst, size_t ss, unsigned n) {
+    pa_interleave_func_t func;
     unsigned c;
     size_t fs;
 
@@ -131,6 +186,11 @@ void pa_interleave(const void *src[], unsigned channels, void *dst, size_t ss, u
     pa_assert(ss > 0);
     pa_assert(n > 0);
 
+    if ((func = pa_get_interleave_func(ss, channels))) {
+        func(src, dst, n);
+        return;
+    }
+
     fs = ss * channels;
 
     for (c = 0; c < channels; c++) {
@@ -150,6 +210,7 @@ void pa_interleave(const void *src[], unsigned channels, void *dst, size_t ss, u
 }
 
 void pa_deinterleave(const void *src, void *dst[], unsigned channels, size_t ss, unsigned n) {
+    pa_deinterleave_func_t func;
     size_t fs;
     unsigned c;
 
@@ -159,6 +220,11 @@ void pa_deinterleave(const void *src, void *dst[], unsigned channels, size_t ss,
     pa_assert(ss > 0);
     pa_assert(n > 0);
 
+    if ((func = pa_get_deinterleave_func(ss, channels))) {
+        func(src, dst, n);
+        return;
+    }
+
     fs = ss * channels;
 
     for (c = 0; c < channels; c++) {
@@ -272,13 +338,36 @@ pa_memchunk* pa_silence_memchunk_get(pa_silence_cache *cache, pa_mempool *pool,
     return ret;
 }
 
+static void sample_clamp_c(float *dst, const float *src, unsigned n) {
+    for (; n > 0; n--) {
+        float f;
+
+        f = *(src++);
+        *(dst++) = PA_CLAMP_UNLIKELY(f, -1.0f, 1.0f);
+    }
+}
+
+static pa_sample_clamp_func_t sample_clamp_func = sample_clamp_c;
+
+pa_sample_clamp_func_t pa_get_sample_clamp_func(void) {
+    return sample_clamp_func;
+}
+
+void pa_set_sample_clamp_func(pa_sample_clamp_func_t func) {
+    pa_assert(func);
+
+    sample_clamp_func = func;
+}
+
 void pa_sample_clamp(pa_sample_format_t format, void *dst, size_t dstr, const void *src, size_t sstr, unsigned n) {
     const float *s;
     float *d;
 
     s = src; d = dst;
 
-    if (format == PA_SAMPLE_FLOAT32NE) {
+    if (format == PA_SAMPLE_FLOAT32NE && dstr == sizeof(float) && sstr == sizeof(float))
+        sample_clamp_func(d, s, n);
+    else if (format == PA_SAMPLE_FLOAT32NE) {
         for (; n > 0; n--) {
             float f;
 
@@ -52,8 +52,29 @@ bool pa_frame_aligned(size_t l, const pa_sample_spec *ss) PA_GCC_PURE;
 void pa_interleave(const void *src[], unsigned channels, void *dst, size_t ss, unsigned n);
 void pa_deinterleave(const void *src, void *dst[], unsigned channels, size_t ss, unsigned n);
 
+/* pa_interleave() and pa_deinterleave() use these for samples of 2 or 4
+ * bytes and up to PA_INTERLEAVE_MAX_CHANNELS channels if set, and a generic
+ * loop otherwise. */
+#define PA_INTERLEAVE_MAX_CHANNELS 8
+
+typedef void (*pa_interleave_func_t) (const void *src[], void *dst, unsigned n);
+typedef void (*pa_deinterleave_func_t) (const void *src, void *dst[], unsigned n);
+
+pa_interleave_func_t pa_get_interleave_func(size_t ss, unsigned channels);
+void pa_set_interleave_func(size_t ss, unsigned channels, pa_interleave_func_t func);
+
+pa_deinterleave_func_t pa_get_deinterleave_func(size_t ss, unsigned channels);
+void pa_set_deinterleave_func(size_t ss, unsigned channels, pa_deinterleave_func_t func);
+
 void pa_sample_clamp(pa_sample_format_t format, void *dst, size_t dstr, const void *src, size_t sstr, unsigned n);
 
+/* pa_sample_clamp() uses this for native endian floats without gaps
+ * between the samples. */
+typedef void (*pa_sample_clamp_func_t) (float *dst, const float *src, unsigned n);
+
+pa_sample_clamp_func_t pa_get_sample_clamp_func(void);
+void pa_set_sample_clamp_func(pa_sample_clamp_func_t func);
+
 static inline int32_t pa_mult_s16_volume(int16_t v, int32_t cv) {
 #ifdef HAVE_FAST_64BIT_OPERATIONS
     /* Multiply with 64 bit integers on 64 bit platforms */
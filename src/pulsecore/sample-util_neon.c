@@ -0,0 +1,237 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "cpu-arm.h"
+#include "sample-util.h"
+
+#include <arm_neon.h>
+
+/* vld2/vld4 and vst2/vst4 (de)interleave 2 and 4 channels directly. 6 and
+ * 8 channels are loaded as 3 and 4 channels of two frames each, whose lanes
+ * hold channels c and c + 3 (or c + 4) alternately; vuzp and vzip sort
+ * those out. Every iteration handles as many frames as a q register has
+ * lanes, the rest is copied sample by sample. The samples are only moved,
+ * so floats go through the unsigned integer variants. */
+
+#define DEFINE_INTERLEAVE_NEON(bits, lanes)                                                     \
+                                                                                                \
+static void interleave_##bits##_2ch_neon(const void *src[], void *dst, unsigned n) {            \
+    const uint##bits##_t *s0 = src[0], *s1 = src[1];                                            \
+    uint##bits##_t *d = dst;                                                                    \
+    uint##bits##x##lanes##x2_t v;                                                               \
+                                                                                                \
+    for (; n >= lanes; n -= lanes, s0 += lanes, s1 += lanes, d += 2 * lanes) {                  \
+        v.val[0] = vld1q_u##bits(s0);                                                           \
+        v.val[1] = vld1q_u##bits(s1);                                                           \
+        vst2q_u##bits(d, v);                                                                    \
+    }                                                                                           \
+                                                                                                \
+    for (; n > 0; n--, d += 2) {                                                                \
+        d[0] = *(s0++);                                                                         \
+        d[1] = *(s1++);                                                                         \
+    }                                                                                           \
+}                                                                                               \
+                                                                                                \
+static void deinterleave_##bits##_2ch_neon(const void *src, void *dst[], unsigned n) {          \
+    const uint##bits##_t *s = src;                                                              \
+    uint##bits##_t *d0 = dst[0], *d1 = dst[1];                                                  \
+    uint##bits##x##lanes##x2_t v;                                                               \
+                                                                                                \
+    for (; n >= lanes; n -= lanes, s += 2 * lanes, d0 += lanes, d1 += lanes) {                  \
+        v = vld2q_u##bits(s);                                                                   \
+        vst1q_u##bits(d0, v.val[0]);                                                            \
+        vst1q_u##bits(d1, v.val[1]);                                                            \
+    }                                                                                           \
+                                                                                                \
+    for (; n > 0; n--, s += 2) {                                                                \
+        *(d0++) = s[0];                                                                         \
+        *(d1++) = s[1];                                                                         \
+    }                                                                                           \
+}                                                                                               \
+                                                                                                \
+static void interleave_##bits##_4ch_neon(const void *src[], void *dst, unsigned n) {            \
+    const uint##bits##_t *s[4] = { src[0], src[1], src[2], src[3] };                            \
+    uint##bits##_t *d = dst;                                                                    \
+    uint##bits##x##lanes##x4_t v;                                                               \
+    unsigned i = 0, c;                                                                          \
+                                                                                                \
+    for (; i + lanes <= n; i += lanes, d += 4 * lanes) {                                        \
+        for (c = 0; c < 4; c++)                                                                 \
+            v.val[c] = vld1q_u##bits(s[c] + i);                                                 \
+        vst4q_u##bits(d, v);                                                                    \
+    }                                                                                           \
+                                                                                                \
+    for (; i < n; i++, d += 4)                                                                  \
+        for (c = 0; c < 4; c++)                                                                 \
+            d[c] = s[c][i];                                                                     \
+}                                                                                               \
+                                                                                                \
+static void deinterleave_##bits##_4ch_neon(const void *src, void *dst[], unsigned n) {          \
+    const uint##bits##_t *s = src;                                                              \
+    uint##bits##_t *d[4] = { dst[0], dst[1], dst[2], dst[3] };                                  \
+    uint##bits##x##lanes##x4_t v;                                                               \
+    unsigned i = 0, c;                                                                          \
+                                                                                                \
+    for (; i + lanes <= n; i += lanes, s += 4 * lanes) {                                        \
+        v = vld4q_u##bits(s);                                                                   \
+        for (c = 0; c < 4; c++)                                                                 \
+            vst1q_u##bits(d[c] + i, v.val[c]);                                                  \
+    }                                                                                           \
+                                                                                                \
+    for (; i < n; i++, s += 4)                                                                  \
+        for (c = 0; c < 4; c++)                                                                 \
+            d[c][i] = s[c];                                                                     \
+}                                                                                               \
+                                                                                                \
+static void interleave_##bits##_6ch_neon(const void *src[], void *dst, unsigned n) {            \
+    const uint##bits##_t *s[6] = { src[0], src[1], src[2], src[3], src[4], src[5] };            \
+    uint##bits##_t *d = dst;                                                                    \
+    uint##bits##x##lanes##x3_t a, b;                                                            \
+    uint##bits##x##lanes##x2_t z;                                                               \
+    unsigned i = 0, c;                                                                          \
+                                                                                                \
+    for (; i + lanes <= n; i += lanes, d += 6 * lanes) {                                        \
+        for (c = 0; c < 3; c++) {                                                               \
+            z = vzipq_u##bits(vld1q_u##bits(s[c] + i), vld1q_u##bits(s[c + 3] + i));            \
+            a.val[c] = z.val[0];                                                                \
+            b.val[c] = z.val[1];                                                                \
+        }                                                                                       \
+        vst3q_u##bits(d, a);                                                                    \
+        vst3q_u##bits(d + 3 * lanes, b);                                                        \
+    }                                                                                           \
+                                                                                                \
+    for (; i < n; i++, d += 6)                                                                  \
+        for (c = 0; c < 6; c++)                                                                 \
+            d[c] = s[c][i];                                                                     \
+}                                                                                               \
+                                                                                                \
+static void deinterleave_##bits##_6ch_neon(const void *src, void *dst[], unsigned n) {          \
+    const uint##bits##_t *s = src;                                                              \
+    uint##bits##_t *d[6] = { dst[0], dst[1], dst[2], dst[3], dst[4], dst[5] };                  \
+    uint##bits##x##lanes##x3_t a, b;                                                            \
+    uint##bits##x##lanes##x2_t z;                                                               \
+    unsigned i = 0, c;                                                                          \
+                                                                                                \
+    for (; i + lanes <= n; i += lanes, s += 6 * lanes) {                                        \
+        a = vld3q_u##bits(s);                                                                   \
+        b = vld3q_u##bits(s + 3 * lanes);                                                       \
+        for (c = 0; c < 3; c++) {                                                               \
+            z = vuzpq_u##bits(a.val[c], b.val[c]);                                              \
+            vst1q_u##bits(d[c] + i, z.val[0]);                                                  \
+            vst1q_u##bits(d[c + 3] + i, z.val[1]);                                              \
+        }                                                                                       \
+    }                                                                                           \
+                                                                                                \
+    for (; i < n; i++, s += 6)                                                                  \
+        for (c = 0; c < 6; c++)                                                                 \
+            d[c][i] = s[c];                                                                     \
+}                                                                                               \
+                                                                                                \
+static void interleave_##bits##_8ch_neon(const void *src[], void *dst, unsigned n) {            \
+    const uint##bits##_t *s[8] = { src[0], src[1], src[2], src[3],                              \
+                                   src[4], src[5], src[6], src[7] };                            \
+    uint##bits##_t *d = dst;                                                                    \
+    uint##bits##x##lanes##x4_t a, b;                                                            \
+    uint##bits##x##lanes##x2_t z;                                                               \
+    unsigned i = 0, c;                                                                          \
+                                                                                                \
+    for (; i + lanes <= n; i += lanes, d += 8 * lanes) {                                        \
+        for (c = 0; c < 4; c++) {                                                               \
+            z = vzipq_u##bits(vld1q_u##bits(s[c] + i), vld1q_u##bits(s[c + 4] + i));            \
+            a.val[c] = z.val[0];                                                                \
+            b.val[c] = z.val[1];                                                                \
+        }                                                                                       \
+        vst4q_u##bits(d, a);                                                                    \
+        vst4q_u##bits(d + 4 * lanes, b);                                                        \
+    }                                                                                           \
+                                                                                                \
+    for (; i < n; i++, d += 8)                                                                  \
+        for (c = 0; c < 8; c++)                                                                 \
+            d[c] = s[c][i];                                                                     \
+}                                                                                               \
+                                                                                                \
+static void deinterleave_##bits##_8ch_neon(const void *src, void *dst[], unsigned n) {          \
+    const uint##bits##_t *s = src;                                                              \
+    uint##bits##_t *d[8] = { dst[0], dst[1], dst[2], dst[3], dst[4], dst[5], dst[6], dst[7] };  \
+    uint##bits##x##lanes##x4_t a, b;                                                            \
+    uint##bits##x##lanes##x2_t z;                                                               \
+    unsigned i = 0, c;                                                                          \
+                                                                                                \
+    for (; i + lanes <= n; i += lanes, s += 8 * lanes) {                                        \
+        a = vld4q_u##bits(s);                                                                   \
+        b = vld4q_u##bits(s + 4 * lanes);                                                       \
+        for (c = 0; c < 4; c++) {                                                               \
+            z = vuzpq_u##bits(a.val[c], b.val[c]);                                              \
+            vst1q_u##bits(d[c] + i, z.val[0]);                                                  \
+            vst1q_u##bits(d[c + 4] + i, z.val[1]);                                              \
+        }                                                                                       \
+    }                                                                                           \
+                                                                                                \
+    for (; i < n; i++, s += 8)                                                                  \
+        for (c = 0; c < 8; c++)                                                                 \
+            d[c][i] = s[c];                                                                     \
+}
+
+DEFINE_INTERLEAVE_NEON(16, 8)
+DEFINE_INTERLEAVE_NEON(32, 4)
+
+static void sample_clamp_neon(float *dst, const float *src, unsigned n) {
+    const float32x4_t lo = vdupq_n_f32(-1.0f);
+    const float32x4_t hi = vdupq_n_f32(1.0f);
+
+    /* NaN comes out as the default NaN, which is still NaN. */
+    for (; n >= 4; n -= 4, src += 4, dst += 4)
+        vst1q_f32(dst, vminq_f32(vmaxq_f32(vld1q_f32(src), lo), hi));
+
+    for (; n > 0; n--) {
+        float f;
+
+        f = *(src++);
+        *(dst++) = PA_CLAMP_UNLIKELY(f, -1.0f, 1.0f);
+    }
+}
+
+void pa_sample_util_func_init_neon(pa_cpu_arm_flag_t flags) {
+    pa_log_info("Initialising ARM NEON optimized interleaving and clamping.");
+
+    pa_set_interleave_func(2, 2, interleave_16_2ch_neon);
+    pa_set_interleave_func(2, 4, interleave_16_4ch_neon);
+    pa_set_interleave_func(2, 6, interleave_16_6ch_neon);
+    pa_set_interleave_func(2, 8, interleave_16_8ch_neon);
+    pa_set_interleave_func(4, 2, interleave_32_2ch_neon);
+    pa_set_interleave_func(4, 4, interleave_32_4ch_neon);
+    pa_set_interleave_func(4, 6, interleave_32_6ch_neon);
+    pa_set_interleave_func(4, 8, interleave_32_8ch_neon);
+
+    pa_set_deinterleave_func(2, 2, deinterleave_16_2ch_neon);
+    pa_set_deinterleave_func(2, 4, deinterleave_16_4ch_neon);
+    pa_set_deinterleave_func(2, 6, deinterleave_16_6ch_neon);
+    pa_set_deinterleave_func(2, 8, deinterleave_16_8ch_neon);
+    pa_set_deinterleave_func(4, 2, deinterleave_32_2ch_neon);
+    pa_set_deinterleave_func(4, 4, deinterleave_32_4ch_neon);
+    pa_set_deinterleave_func(4, 6, deinterleave_32_6ch_neon);
+    pa_set_deinterleave_func(4, 8, deinterleave_32_8ch_neon);
+
+    pa_set_sample_clamp_func(sample_clamp_neon);
+}
@@ -0,0 +1,337 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "cpu-x86.h"
+#include "sample-util.h"
+
+#if (defined (__i386__) || defined (__amd64__)) && defined (__SSE__)
+
+#include <xmmintrin.h>
+
+/* Channels are (de)interleaved four frames at a time, in groups of four
+ * channels that are transposed as 4x4 blocks, plus a pair of channels left
+ * over with 2 and 6 channels. channels is a constant in all callers, so the
+ * compiler drops the branches that don't apply. */
+
+static inline void interleave_32_sse(const void *src[], void *dst, unsigned channels, unsigned n) {
+    const uint32_t *s[PA_INTERLEAVE_MAX_CHANNELS];
+    uint32_t *d = dst;
+    unsigned i, c;
+
+    for (c = 0; c < channels; c++)
+        s[c] = src[c];
+
+    for (i = 0; i + 4 <= n; i += 4, d += 4 * channels) {
+        for (c = 0; c + 4 <= channels; c += 4) {
+            __m128 r0 = _mm_loadu_ps((const float *) (s[c] + i));
+            __m128 r1 = _mm_loadu_ps((const float *) (s[c + 1] + i));
+            __m128 r2 = _mm_loadu_ps((const float *) (s[c + 2] + i));
+            __m128 r3 = _mm_loadu_ps((const float *) (s[c + 3] + i));
+
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+            _mm_storeu_ps((float *) (d + c), r0);
+            _mm_storeu_ps((float *) (d + channels + c), r1);
+            _mm_storeu_ps((float *) (d + 2 * channels + c), r2);
+            _mm_storeu_ps((float *) (d + 3 * channels + c), r3);
+        }
+
+        if (c < channels) {
+            __m128 a = _mm_loadu_ps((const float *) (s[c] + i));
+            __m128 b = _mm_loadu_ps((const float *) (s[c + 1] + i));
+            __m128 lo = _mm_unpacklo_ps(a, b);
+            __m128 hi = _mm_unpackhi_ps(a, b);
+
+            if (channels == 2) {
+                _mm_storeu_ps((float *) d, lo);
+                _mm_storeu_ps((float *) (d + 4), hi);
+            } else {
+                _mm_storel_pi((__m64 *) (d + c), lo);
+                _mm_storeh_pi((__m64 *) (d + channels + c), lo);
+                _mm_storel_pi((__m64 *) (d + 2 * channels + c), hi);
+                _mm_storeh_pi((__m64 *) (d + 3 * channels + c), hi);
+            }
+        }
+    }
+
+    for (; i < n; i++, d += channels)
+        for (c = 0; c < channels; c++)
+            d[c] = s[c][i];
+}
+
+static inline void deinterleave_32_sse(const void *src, void *dst[], unsigned channels, unsigned n) {
+    const uint32_t *s = src;
+    uint32_t *d[PA_INTERLEAVE_MAX_CHANNELS];
+    unsigned i, c;
+
+    for (c = 0; c < channels; c++)
+        d[c] = dst[c];
+
+    for (i = 0; i + 4 <= n; i += 4, s += 4 * channels) {
+        for (c = 0; c + 4 <= channels; c += 4) {
+            __m128 r0 = _mm_loadu_ps((const float *) (s + c));
+            __m128 r1 = _mm_loadu_ps((const float *) (s + channels + c));
+            __m128 r2 = _mm_loadu_ps((const float *) (s + 2 * channels + c));
+            __m128 r3 = _mm_loadu_ps((const float *) (s + 3 * channels + c));
+
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+            _mm_storeu_ps((float *) (d[c] + i), r0);
+            _mm_storeu_ps((float *) (d[c + 1] + i), r1);
+            _mm_storeu_ps((float *) (d[c + 2] + i), r2);
+            _mm_storeu_ps((float *) (d[c + 3] + i), r3);
+        }
+
+        if (c < channels) {
+            __m128 x0, x1;
+
+            if (channels == 2) {
+                x0 = _mm_loadu_ps((const float *) s);
+                x1 = _mm_loadu_ps((const float *) (s + 4));
+            } else {
+                x0 = _mm_loadl_pi(_mm_setzero_ps(), (const __m64 *) (s + c));
+                x0 = _mm_loadh_pi(x0, (const __m64 *) (s + channels + c));
+                x1 = _mm_loadl_pi(_mm_setzero_ps(), (const __m64 *) (s + 2 * channels + c));
+                x1 = _mm_loadh_pi(x1, (const __m64 *) (s + 3 * channels + c));
+            }
+
+            _mm_storeu_ps((float *) (d[c] + i), _mm_shuffle_ps(x0, x1, _MM_SHUFFLE(2, 0, 2, 0)));
+            _mm_storeu_ps((float *) (d[c + 1] + i), _mm_shuffle_ps(x0, x1, _MM_SHUFFLE(3, 1, 3, 1)));
+        }
+    }
+
+    for (; i < n; i++, s += channels)
+        for (c = 0; c < channels; c++)
+            d[c][i] = s[c];
+}
+
+static void sample_clamp_sse(float *dst, const float *src, unsigned n) {
+    const __m128 lo = _mm_set1_ps(-1.0f);
+    const __m128 hi = _mm_set1_ps(1.0f);
+
+    /* maxps and minps return their second operand if either is NaN, so NaN
+     * passes through like it does in the C version. */
+    for (; n >= 4; n -= 4, src += 4, dst += 4)
+        _mm_storeu_ps(dst, _mm_min_ps(hi, _mm_max_ps(lo, _mm_loadu_ps(src))));
+
+    for (; n > 0; n--) {
+        float f;
+
+        f = *(src++);
+        *(dst++) = PA_CLAMP_UNLIKELY(f, -1.0f, 1.0f);
+    }
+}
+
+#define DEFINE_INTERLEAVE_32(channels) \
+    static void interleave_32_##channels##ch_sse(const void *src[], void *dst, unsigned n) { \
+        interleave_32_sse(src, dst, channels, n); \
+    } \
+    static void deinterleave_32_##channels##ch_sse(const void *src, void *dst[], unsigned n) { \
+        deinterleave_32_sse(src, dst, channels, n); \
+    }
+
+DEFINE_INTERLEAVE_32(2)
+DEFINE_INTERLEAVE_32(4)
+DEFINE_INTERLEAVE_32(6)
+DEFINE_INTERLEAVE_32(8)
+
+#endif /* (defined (__i386__) || defined (__amd64__)) && defined (__SSE__) */
+
+#if (defined (__i386__) || defined (__amd64__)) && defined (__SSE2__)
+
+#include <emmintrin.h>
+
+static inline void store_32(void *p, __m128i x) {
+    uint32_t v = (uint32_t) _mm_cvtsi128_si32(x);
+
+    memcpy(p, &v, sizeof(v));
+}
+
+static inline int32_t load_32(const void *p) {
+    int32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/* The same scheme with 16 bit samples. A group of four channels is one 64
+ * bit word per frame, a pair one 32 bit word. */
+
+static inline void interleave_16_sse2(const void *src[], void *dst, unsigned channels, unsigned n) {
+    const int16_t *s[PA_INTERLEAVE_MAX_CHANNELS];
+    int16_t *d = dst;
+    unsigned i, c;
+
+    for (c = 0; c < channels; c++)
+        s[c] = src[c];
+
+    for (i = 0; i + 4 <= n; i += 4, d += 4 * channels) {
+        for (c = 0; c + 4 <= channels; c += 4) {
+            __m128i a = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *) (s[c] + i)),
+                                           _mm_loadl_epi64((const __m128i *) (s[c + 1] + i)));
+            __m128i b = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *) (s[c + 2] + i)),
+                                           _mm_loadl_epi64((const __m128i *) (s[c + 3] + i)));
+            __m128i q0 = _mm_unpacklo_epi32(a, b);
+            __m128i q1 = _mm_unpackhi_epi32(a, b);
+
+            if (channels == 4) {
+                _mm_storeu_si128((__m128i *) d, q0);
+                _mm_storeu_si128((__m128i *) (d + 8), q1);
+            } else {
+                _mm_storel_epi64((__m128i *) (d + c), q0);
+                _mm_storel_epi64((__m128i *) (d + channels + c), _mm_unpackhi_epi64(q0, q0));
+                _mm_storel_epi64((__m128i *) (d + 2 * channels + c), q1);
+                _mm_storel_epi64((__m128i *) (d + 3 * channels + c), _mm_unpackhi_epi64(q1, q1));
+            }
+        }
+
+        if (c < channels) {
+            __m128i p = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *) (s[c] + i)),
+                                           _mm_loadl_epi64((const __m128i *) (s[c + 1] + i)));
+
+            if (channels == 2)
+                _mm_storeu_si128((__m128i *) d, p);
+            else {
+                store_32(d + c, p);
+                store_32(d + channels + c, _mm_srli_si128(p, 4));
+                store_32(d + 2 * channels + c, _mm_srli_si128(p, 8));
+                store_32(d + 3 * channels + c, _mm_srli_si128(p, 12));
+            }
+        }
+    }
+
+    for (; i < n; i++, d += channels)
+        for (c = 0; c < channels; c++)
+            d[c] = s[c][i];
+}
+
+static inline void deinterleave_16_sse2(const void *src, void *dst[], unsigned channels, unsigned n) {
+    const int16_t *s = src;
+    int16_t *d[PA_INTERLEAVE_MAX_CHANNELS];
+    unsigned i, c;
+
+    for (c = 0; c < channels; c++)
+        d[c] = dst[c];
+
+    for (i = 0; i + 4 <= n; i += 4, s += 4 * channels) {
+        for (c = 0; c + 4 <= channels; c += 4) {
+            __m128i q0, q1, t0, t1, u0, u1;
+
+            if (channels == 4) {
+                q0 = _mm_loadu_si128((const __m128i *) s);
+                q1 = _mm_loadu_si128((const __m128i *) (s + 8));
+            } else {
+                q0 = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *) (s + c)),
+                                        _mm_loadl_epi64((const __m128i *) (s + channels + c)));
+                q1 = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *) (s + 2 * channels + c)),
+                                        _mm_loadl_epi64((const __m128i *) (s + 3 * channels + c)));
+            }
+
+            t0 = _mm_unpacklo_epi16(q0, q1);
+            t1 = _mm_unpackhi_epi16(q0, q1);
+            u0 = _mm_unpacklo_epi16(t0, t1);
+            u1 = _mm_unpackhi_epi16(t0, t1);
+
+            _mm_storel_epi64((__m128i *) (d[c] + i), u0);
+            _mm_storel_epi64((__m128i *) (d[c + 1] + i), _mm_unpackhi_epi64(u0, u0));
+            _mm_storel_epi64((__m128i *) (d[c + 2] + i), u1);
+            _mm_storel_epi64((__m128i *) (d[c + 3] + i), _mm_unpackhi_epi64(u1, u1));
+        }
+
+        if (c < channels) {
+            __m128i x, even, odd;
+
+            if (channels == 2)
+                x = _mm_loadu_si128((const __m128i *) s);
+            else
+                x = _mm_setr_epi32(load_32(s + c), load_32(s + channels + c),
+                                   load_32(s + 2 * channels + c), load_32(s + 3 * channels + c));
+
+            /* Sign extend both halves of every 32 bit word, so that packing
+             * them again doesn't saturate. */
+            even = _mm_srai_epi32(_mm_slli_epi32(x, 16), 16);
+            odd = _mm_srai_epi32(x, 16);
+
+            _mm_storel_epi64((__m128i *) (d[c] + i), _mm_packs_epi32(even, even));
+            _mm_storel_epi64((__m128i *) (d[c + 1] + i), _mm_packs_epi32(odd, odd));
+        }
+    }
+
+    for (; i < n; i++, s += channels)
+        for (c = 0; c < channels; c++)
+            d[c][i] = s[c];
+}
+
+#define DEFINE_INTERLEAVE_16(channels) \
+    static void interleave_16_##channels##ch_sse2(const void *src[], void *dst, unsigned n) { \
+        interleave_16_sse2(src, dst, channels, n); \
+    } \
+    static void deinterleave_16_##channels##ch_sse2(const void *src, void *dst[], unsigned n) { \
+        deinterleave_16_sse2(src, dst, channels, n); \
+    }
+
+DEFINE_INTERLEAVE_16(2)
+DEFINE_INTERLEAVE_16(4)
+DEFINE_INTERLEAVE_16(6)
+DEFINE_INTERLEAVE_16(8)
+
+#endif /* (defined (__i386__) || defined (__amd64__)) && defined (__SSE2__) */
+
+void pa_sample_util_func_init_sse(pa_cpu_x86_flag_t flags) {
+#if (defined (__i386__) || defined (__amd64__)) && defined (__SSE__)
+    if (flags & PA_CPU_X86_SSE) {
+        pa_log_info("Initialising SSE optimized interleaving and clamping.");
+
+        pa_set_interleave_func(4, 2, interleave_32_2ch_sse);
+        pa_set_interleave_func(4, 4, interleave_32_4ch_sse);
+        pa_set_interleave_func(4, 6, interleave_32_6ch_sse);
+        pa_set_interleave_func(4, 8, interleave_32_8ch_sse);
+
+        pa_set_deinterleave_func(4, 2, deinterleave_32_2ch_sse);
+        pa_set_deinterleave_func(4, 4, deinterleave_32_4ch_sse);
+        pa_set_deinterleave_func(4, 6, deinterleave_32_6ch_sse);
+        pa_set_deinterleave_func(4, 8, deinterleave_32_8ch_sse);
+
+        pa_set_sample_clamp_func(sample_clamp_sse);
+    }
+#endif /* (defined (__i386__) || defined (__amd64__)) && defined (__SSE__) */
+
+#if (defined (__i386__) || defined (__amd64__)) && defined (__SSE2__)
+    if (flags & PA_CPU_X86_SSE2) {
+        pa_log_info("Initialising SSE2 optimized 16 bit interleaving.");
+
+        pa_set_interleave_func(2, 2, interleave_16_2ch_sse2);
+        pa_set_interleave_func(2, 4, interleave_16_4ch_sse2);
+        pa_set_interleave_func(2, 6, interleave_16_6ch_sse2);
+        pa_set_interleave_func(2, 8, interleave_16_8ch_sse2);
+
+        pa_set_deinterleave_func(2, 2, deinterleave_16_2ch_sse2);
+        pa_set_deinterleave_func(2, 4, deinterleave_16_4ch_sse2);
+        pa_set_deinterleave_func(2, 6, deinterleave_16_6ch_sse2);
+        pa_set_deinterleave_func(2, 8, deinterleave_16_8ch_sse2);
+    }
+#endif /* (defined (__i386__) || defined (__amd64__)) && defined (__SSE2__) */
+}
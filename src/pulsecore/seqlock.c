@@ -0,0 +1,90 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <pulsecore/macro.h>
+#include <pulsecore/thread.h>
+
+#include "seqlock.h"
+
+/* The sequence number is odd while the writer is modifying the data. */
+
+void pa_seqlock_init(pa_seqlock *l) {
+    pa_assert(l);
+
+    pa_atomic_store(&l->sequence, 0);
+}
+
+unsigned pa_seqlock_read_begin(pa_seqlock *l) {
+    unsigned s;
+
+    pa_assert(l);
+
+    /* pa_atomic_load() only orders what came before it, while
+     * pa_atomic_add() is a full barrier, so that reading the data can't
+     * happen before reading the sequence number. */
+    while ((s = (unsigned) pa_atomic_add(&l->sequence, 0)) & 1)
+        pa_thread_yield();
+
+    return s;
+}
+
+bool pa_seqlock_read_retry(pa_seqlock *l, unsigned sequence) {
+    pa_assert(l);
+
+    return (unsigned) pa_atomic_load(&l->sequence) != sequence;
+}
+
+void pa_seqlock_write_begin(pa_seqlock *l) {
+    pa_assert(l);
+
+    pa_assert_se(!(pa_atomic_inc(&l->sequence) & 1));
+}
+
+void pa_seqlock_write_end(pa_seqlock *l) {
+    pa_assert(l);
+
+    pa_assert_se(pa_atomic_inc(&l->sequence) & 1);
+}
+
+void pa_seqlock_write(pa_seqlock *l, void *data, const void *src, size_t size) {
+    pa_assert(l);
+    pa_assert(data);
+    pa_assert(src);
+
+    pa_seqlock_write_begin(l);
+    memcpy(data, src, size);
+    pa_seqlock_write_end(l);
+}
+
+void pa_seqlock_read(pa_seqlock *l, const void *data, void *dst, size_t size) {
+    unsigned s;
+
+    pa_assert(l);
+    pa_assert(data);
+    pa_assert(dst);
+
+    do {
+        s = pa_seqlock_read_begin(l);
+        memcpy(dst, data, size);
+    } while (pa_seqlock_read_retry(l, s));
+}
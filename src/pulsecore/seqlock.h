@@ -0,0 +1,96 @@
+#ifndef foopulseseqlockhfoo
+#define foopulseseqlockhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stddef.h>
+
+#include <pulsecore/atomic.h>
+
+typedef struct pa_seqlock {
+    pa_atomic_t sequence;
+} pa_seqlock;
+
+#define PA_SEQLOCK_INIT { .sequence = PA_ATOMIC_INIT(0) }
+
+void pa_seqlock_init(pa_seqlock *l);
+
+/* Will return the sequence number to pass to pa_seqlock_read_retry() */
+unsigned pa_seqlock_read_begin(pa_seqlock *l);
+
+/* Will return true if the data read since the matching
+ * pa_seqlock_read_begin() call may have been modified in the meantime,
+ * in which case it has to be read again */
+bool pa_seqlock_read_retry(pa_seqlock *l, unsigned sequence);
+
+void pa_seqlock_write_begin(pa_seqlock *l);
+void pa_seqlock_write_end(pa_seqlock *l);
+
+/* Copies size bytes from src to the data protected by l */
+void pa_seqlock_write(pa_seqlock *l, void *data, const void *src, size_t size);
+
+/* Copies size bytes of the data protected by l to dst */
+void pa_seqlock_read(pa_seqlock *l, const void *data, void *dst, size_t size);
+
+/*
+ * This infrastructure allows one thread ('the writer') to publish a
+ * small data structure, such as a timing snapshot, that other threads
+ * ('the readers') can read without locking. Unlike with pa_aupdate
+ * the writer never waits: it just marks the data as being modified
+ * while it updates it. Readers instead check whether the data was
+ * modified while they were copying it, and if so copy it again.
+ *
+ * This is intended to be used for cases where the writer is a real-time
+ * thread updating the data often, and the readers only need to look at
+ * it now and then.
+ *
+ * There may only be one writer at a time, but any number of readers.
+ * Readers must only copy the data, never follow pointers in it, since
+ * they may see it half updated until pa_seqlock_read_retry() tells
+ * them otherwise.
+ *
+ * Usage is like this:
+ *
+ * static struct foo bar;
+ * static pa_seqlock l = PA_SEQLOCK_INIT;
+ *
+ * reader() {
+ *     struct foo copy;
+ *     unsigned s;
+ *
+ *     do {
+ *         s = pa_seqlock_read_begin(&l);
+ *         copy = bar;
+ *     } while (pa_seqlock_read_retry(&l, s));
+ *
+ *     ... use copy ...
+ * }
+ *
+ * writer() {
+ *     pa_seqlock_write_begin(&l);
+ *
+ *     ... update bar ...
+ *
+ *     pa_seqlock_write_end(&l);
+ * }
+ *
+ * pa_seqlock_read() and pa_seqlock_write() do the same for data that
+ * can be copied with memcpy().
+ */
+
+#endif
@@ -73,6 +73,22 @@ pa_tagstruct *pa_tagstruct_new(void) {
     return t;
 }
 
+pa_tagstruct *pa_tagstruct_new_sized(size_t length) {
+    pa_tagstruct*t;
+
+    if (length <= MAX_APPENDED_SIZE)
+        return pa_tagstruct_new();
+
+    if (!(t = pa_flist_pop(PA_STATIC_FLIST_GET(tagstructs))))
+        t = pa_xnew(pa_tagstruct, 1);
+    t->data = pa_xmalloc(length);
+    t->allocated = length;
+    t->length = t->rindex = 0;
+    t->type = PA_TAGSTRUCT_DYNAMIC;
+
+    return t;
+}
+
 pa_tagstruct *pa_tagstruct_new_fixed(const uint8_t* data, size_t length) {
     pa_tagstruct*t;
 
@@ -97,18 +113,44 @@ void pa_tagstruct_free(pa_tagstruct*t) {
         pa_xfree(t);
 }
 
+uint8_t* pa_tagstruct_free_data(pa_tagstruct*t, size_t *l) {
+    uint8_t *p;
+
+    pa_assert(t);
+    pa_assert(t->type != PA_TAGSTRUCT_FIXED);
+    pa_assert(l);
+
+    *l = t->length;
+
+    if (t->type == PA_TAGSTRUCT_DYNAMIC)
+        p = t->data;
+    else
+        p = t->length > 0 ? pa_xmemdup(t->per_type.appended, t->length) : NULL;
+
+    if (pa_flist_push(PA_STATIC_FLIST_GET(tagstructs), t) < 0)
+        pa_xfree(t);
+
+    return p;
+}
+
 static inline void extend(pa_tagstruct*t, size_t l) {
+    size_t n;
+
     pa_assert(t);
     pa_assert(t->type != PA_TAGSTRUCT_FIXED);
 
     if (t->length+l <= t->allocated)
         return;
 
+    /* Grow geometrically, so that building large replies (e.g. info
+     * lists with many entries) doesn't realloc() for every entry */
+    n = PA_MAX(t->length + l + GROW_TAG_SIZE, t->allocated * 2);
+
     if (t->type == PA_TAGSTRUCT_DYNAMIC)
-        t->data = pa_xrealloc(t->data, t->allocated = t->length + l + GROW_TAG_SIZE);
+        t->data = pa_xrealloc(t->data, t->allocated = n);
     else if (t->type == PA_TAGSTRUCT_APPENDED) {
         t->type = PA_TAGSTRUCT_DYNAMIC;
-        t->data = pa_xmalloc(t->allocated = t->length + l + GROW_TAG_SIZE);
+        t->data = pa_xmalloc(t->allocated = n);
         memcpy(t->data, t->per_type.appended, t->length);
     }
 }
@@ -61,8 +61,13 @@ enum {
 };
 
 pa_tagstruct *pa_tagstruct_new(void);
+/* Preallocate length bytes, for replies whose size is roughly known in advance */
+pa_tagstruct *pa_tagstruct_new_sized(size_t length);
 pa_tagstruct *pa_tagstruct_new_fixed(const uint8_t* data, size_t length);
 void pa_tagstruct_free(pa_tagstruct*t);
+/* Free the tagstruct, but hand ownership of the serialized data (which
+ * must be pa_xfree()d) to the caller instead of copying it */
+uint8_t* pa_tagstruct_free_data(pa_tagstruct*t, size_t *l);
 
 int pa_tagstruct_eof(pa_tagstruct*t);
 const uint8_t* pa_tagstruct_data(pa_tagstruct*t, size_t *l);
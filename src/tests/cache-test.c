@@ -0,0 +1,315 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <check.h>
+
+#include <pulse/pulseaudio.h>
+#include <pulse/cache.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/macro.h>
+
+/* Checks the object cache against a running daemon:
+ *
+ *  - once ready, it holds the same sinks and modules as the info lists,
+ *  - loading a null sink shows up as NEW events for the sink and module,
+ *  - a burst of volume changes is coalesced into a few queries and leaves
+ *    the last volume in the cache,
+ *  - unloading the sink shows up as REMOVE events. */
+
+#define SINK_NAME "cache_test_sink"
+#define N_VOLUMES 20
+
+enum {
+    STEP_INITIAL,
+    STEP_LOAD,
+    STEP_VOLUME,
+    STEP_UNLOAD,
+    STEP_DONE
+};
+
+static pa_context *context = NULL;
+static pa_cache *cache = NULL;
+static pa_mainloop_api *mainloop_api = NULL;
+static const char *bname = NULL;
+
+static int step = STEP_INITIAL;
+static unsigned n_ready = 0;
+static unsigned n_listed = 0;
+static uint32_t module_index = PA_INVALID_INDEX;
+static uint32_t sink_index = PA_INVALID_INDEX;
+static bool module_removed, sink_removed;
+static unsigned n_volume_changes = 0;
+static pa_volume_t last_volume;
+
+static unsigned count_sinks(void) {
+    void *state = NULL;
+    unsigned n = 0;
+
+    while (pa_cache_iterate_sink_info(cache, &state))
+        n++;
+
+    return n;
+}
+
+static unsigned count_modules(void) {
+    void *state = NULL;
+    unsigned n = 0;
+
+    while (pa_cache_iterate_module_info(cache, &state))
+        n++;
+
+    return n;
+}
+
+static void finish_step(void);
+
+static void set_volumes(void) {
+    pa_cvolume v;
+    unsigned i;
+
+    /* All of these are sent before the first resulting event is read */
+    for (i = 1; i <= N_VOLUMES; i++) {
+        last_volume = PA_VOLUME_NORM * i / N_VOLUMES;
+        pa_cvolume_set(&v, pa_cache_get_sink_info_by_index(cache, sink_index)->volume.channels, last_volume);
+        pa_operation_unref(pa_context_set_sink_volume_by_index(context, sink_index, &v, NULL, NULL));
+    }
+}
+
+static void load_module_cb(pa_context *c, uint32_t idx, void *userdata) {
+    fail_unless(idx != PA_INVALID_INDEX);
+
+    module_index = idx;
+    finish_step();
+}
+
+static void unload_module_cb(pa_context *c, int success, void *userdata) {
+    fail_unless(success);
+}
+
+static void finish_step(void) {
+    const pa_sink_info *i;
+
+    switch (step) {
+        case STEP_LOAD:
+            /* Wait for the load reply and both NEW events */
+            if (module_index == PA_INVALID_INDEX || sink_index == PA_INVALID_INDEX ||
+                !pa_cache_get_module_info(cache, module_index))
+                return;
+
+            fail_unless(pa_streq(pa_cache_get_module_info(cache, module_index)->name, "module-null-sink"));
+            fail_unless(pa_cache_get_sink_info_by_index(cache, sink_index)->owner_module == module_index);
+
+            step = STEP_VOLUME;
+            set_volumes();
+            break;
+
+        case STEP_VOLUME:
+            i = pa_cache_get_sink_info_by_index(cache, sink_index);
+            fail_unless(i != NULL);
+
+            if (pa_cvolume_max(&i->volume) != last_volume)
+                return;
+
+            fprintf(stderr, "%u volume changes led to %u change callbacks\n", N_VOLUMES, n_volume_changes);
+            fail_unless(n_volume_changes > 0);
+            fail_unless(n_volume_changes < N_VOLUMES / 2);
+
+            step = STEP_UNLOAD;
+            pa_operation_unref(pa_context_unload_module(context, module_index, unload_module_cb, NULL));
+            break;
+
+        case STEP_UNLOAD:
+            if (!module_removed || !sink_removed)
+                return;
+
+            fail_unless(pa_cache_get_module_info(cache, module_index) == NULL);
+            fail_unless(pa_cache_get_sink_info_by_index(cache, sink_index) == NULL);
+            fail_unless(pa_cache_get_sink_info_by_name(cache, SINK_NAME) == NULL);
+
+            step = STEP_DONE;
+            pa_cache_free(cache);
+            cache = NULL;
+            pa_context_disconnect(context);
+            break;
+
+        default:
+            pa_assert_not_reached();
+    }
+}
+
+static void change_cb(pa_cache *ca, pa_subscription_event_type_t t, uint32_t idx, void *userdata) {
+    pa_subscription_event_type_t facility = t & PA_SUBSCRIPTION_EVENT_FACILITY_MASK;
+    pa_subscription_event_type_t type = t & PA_SUBSCRIPTION_EVENT_TYPE_MASK;
+
+    fail_unless(ca == cache);
+    fail_unless(pa_cache_is_ready(cache));
+    fail_unless(step != STEP_INITIAL);
+
+    if (facility == PA_SUBSCRIPTION_EVENT_SINK) {
+        const pa_sink_info *i = pa_cache_get_sink_info_by_index(cache, idx);
+
+        /* The cache is up to date before we are told */
+        fail_unless((type == PA_SUBSCRIPTION_EVENT_REMOVE) == (i == NULL));
+
+        if (type == PA_SUBSCRIPTION_EVENT_NEW && pa_streq(i->name, SINK_NAME)) {
+            fail_unless(pa_cache_get_sink_info_by_name(cache, SINK_NAME) == i);
+            sink_index = idx;
+        } else if (idx == sink_index && type == PA_SUBSCRIPTION_EVENT_CHANGE)
+            n_volume_changes++;
+        else if (idx == sink_index && type == PA_SUBSCRIPTION_EVENT_REMOVE)
+            sink_removed = true;
+
+    } else if (facility == PA_SUBSCRIPTION_EVENT_MODULE) {
+        fail_unless((type == PA_SUBSCRIPTION_EVENT_REMOVE) == (pa_cache_get_module_info(cache, idx) == NULL));
+
+        if (idx == module_index && type == PA_SUBSCRIPTION_EVENT_REMOVE)
+            module_removed = true;
+    } else
+        fail();
+
+    if (step != STEP_DONE)
+        finish_step();
+}
+
+/* Every object of the lists must be in the cache, and nothing else */
+static void sink_info_cb(pa_context *c, const pa_sink_info *i, int eol, void *userdata) {
+    const pa_sink_info *j;
+
+    if (eol) {
+        fail_unless(count_sinks() == n_listed);
+        return;
+    }
+
+    n_listed++;
+    fail_unless((j = pa_cache_get_sink_info_by_index(cache, i->index)) != NULL);
+    fail_unless(pa_streq(j->name, i->name));
+    fail_unless(pa_cache_get_sink_info_by_name(cache, i->name) == j);
+}
+
+static void module_info_cb(pa_context *c, const pa_module_info *i, int eol, void *userdata) {
+    const pa_module_info *j;
+
+    if (eol) {
+        fail_unless(count_modules() == n_listed);
+
+        step = STEP_LOAD;
+        pa_operation_unref(pa_context_load_module(context, "module-null-sink", "sink_name=" SINK_NAME, load_module_cb, NULL));
+        return;
+    }
+
+    n_listed++;
+    fail_unless((j = pa_cache_get_module_info(cache, i->index)) != NULL);
+    fail_unless(pa_streq(j->name, i->name));
+}
+
+static void sink_list_done_cb(pa_context *c, const pa_sink_info *i, int eol, void *userdata) {
+    sink_info_cb(c, i, eol, userdata);
+
+    if (eol) {
+        n_listed = 0;
+        pa_operation_unref(pa_context_get_module_info_list(context, module_info_cb, NULL));
+    }
+}
+
+static void ready_cb(pa_cache *ca, void *userdata) {
+    fail_unless(ca == cache);
+    fail_unless(pa_cache_is_ready(cache));
+    fail_unless(++n_ready == 1);
+
+    n_listed = 0;
+    pa_operation_unref(pa_context_get_sink_info_list(context, sink_list_done_cb, NULL));
+}
+
+static void context_state_callback(pa_context *c, void *userdata) {
+    switch (pa_context_get_state(c)) {
+        case PA_CONTEXT_CONNECTING:
+        case PA_CONTEXT_AUTHORIZING:
+        case PA_CONTEXT_SETTING_NAME:
+            break;
+
+        case PA_CONTEXT_READY:
+            fail_unless((cache = pa_cache_new(c, PA_SUBSCRIPTION_MASK_SINK|PA_SUBSCRIPTION_MASK_MODULE)) != NULL);
+            fail_unless(pa_cache_get_context(cache) == c);
+            fail_unless(!pa_cache_is_ready(cache));
+
+            pa_cache_set_ready_callback(cache, ready_cb, NULL);
+            pa_cache_set_change_callback(cache, change_cb, NULL);
+            break;
+
+        case PA_CONTEXT_TERMINATED:
+            mainloop_api->quit(mainloop_api, 0);
+            break;
+
+        case PA_CONTEXT_FAILED:
+        default:
+            fprintf(stderr, "Context error: %s\n", pa_strerror(pa_context_errno(c)));
+            fail();
+    }
+}
+
+START_TEST (cache_test) {
+    pa_mainloop *m;
+    int ret = 1;
+
+    fail_unless((m = pa_mainloop_new()) != NULL);
+    mainloop_api = pa_mainloop_get_api(m);
+
+    context = pa_context_new(mainloop_api, bname);
+    fail_unless(context != NULL);
+
+    pa_context_set_state_callback(context, context_state_callback, NULL);
+
+    fail_unless(pa_context_connect(context, NULL, 0, NULL) >= 0);
+    fail_unless(pa_mainloop_run(m, &ret) >= 0);
+    fail_unless(ret == 0);
+    fail_unless(step == STEP_DONE);
+    fail_unless(n_ready == 1);
+
+    pa_context_unref(context);
+    pa_mainloop_free(m);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    bname = argv[0];
+
+    s = suite_create("Object cache");
+    tc = tcase_create("cache");
+    tcase_add_test(tc, cache_test);
+    tcase_set_timeout(tc, 20);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,274 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+#include <math.h>
+
+#include <pulse/sample.h>
+#include <pulsecore/cpu.h>
+#include <pulsecore/cpu-arm.h>
+#include <pulsecore/cpu-x86.h>
+#include <pulsecore/random.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/filter/biquad.h>
+#include <pulsecore/filter/biquad-cascade.h>
+#include <pulsecore/filter/crossover.h>
+
+#include "runtime-test-util.h"
+
+#define FRAMES 1024
+#define MAX_CHANNELS 8
+#define TIMES 100
+#define TIMES2 100
+
+/* Crossover at 120 Hz for 48 kHz */
+#define FREQ (120.0 / 24000.0)
+
+static void fill_input(float *data, unsigned n) {
+    int16_t s[FRAMES * MAX_CHANNELS];
+    unsigned i;
+
+    pa_assert(n <= PA_ELEMENTSOF(s));
+
+    pa_random(s, n * sizeof(int16_t));
+    for (i = 0; i < n; i++)
+        data[i] = s[i] / (float) 0x8000;
+}
+
+/* Lowpass on the last channel and highpass on all others, like the LFE
+ * filter does for a map with the LFE channel last. */
+static pa_biquad_cascade *new_lr4_cascade(unsigned channels) {
+    pa_biquad_cascade *bc;
+    struct biquad lowpass, highpass;
+    unsigned c;
+
+    biquad_set(&lowpass, BQ_LOWPASS, FREQ);
+    biquad_set(&highpass, BQ_HIGHPASS, FREQ);
+
+    bc = pa_biquad_cascade_new(channels, 2);
+    for (c = 0; c < channels; c++) {
+        pa_biquad_cascade_set(bc, c, 0, c == channels - 1 ? &lowpass : &highpass);
+        pa_biquad_cascade_set(bc, c, 1, c == channels - 1 ? &lowpass : &highpass);
+    }
+
+    return bc;
+}
+
+static void check_output(const float *out, const float *out_ref, unsigned channels, const char *what) {
+    unsigned i;
+
+    for (i = 0; i < FRAMES * channels; i++) {
+        if (fabsf(out[i] - out_ref[i]) > 0.0001f) {
+            pa_log_debug("Correctness test failed against %s: channels=%u, frame=%u", what, channels, i / channels);
+            pa_log_debug("%d: %.24f != %.24f", i, out[i], out_ref[i]);
+            ck_abort();
+        }
+    }
+}
+
+/* The generic cascade must match struct lr4, also across block boundaries. */
+static void run_lr4_test(unsigned channels) {
+    float in[FRAMES * MAX_CHANNELS];
+    float out[FRAMES * MAX_CHANNELS];
+    float out_ref[FRAMES * MAX_CHANNELS];
+    struct lr4 lr4[MAX_CHANNELS];
+    pa_biquad_cascade *bc;
+    unsigned c;
+
+    fill_input(in, FRAMES * channels);
+
+    bc = new_lr4_cascade(channels);
+    for (c = 0; c < channels; c++)
+        lr4_set(&lr4[c], c == channels - 1 ? BQ_LOWPASS : BQ_HIGHPASS, FREQ);
+
+    pa_biquad_cascade_process_float32(bc, out, in, FRAMES / 2);
+    pa_biquad_cascade_process_float32(bc, out + FRAMES / 2 * channels, in + FRAMES / 2 * channels, FRAMES / 2);
+    for (c = 0; c < channels; c++)
+        lr4_process_float32(&lr4[c], FRAMES, channels, &in[c], &out_ref[c]);
+
+    check_output(out, out_ref, channels, "lr4");
+
+    pa_biquad_cascade_free(bc);
+}
+
+static void run_biquad_cascade_test(
+        pa_biquad_cascade_func_t func,
+        pa_biquad_cascade_func_t orig_func,
+        unsigned channels,
+        bool perf) {
+
+    float in[FRAMES * MAX_CHANNELS];
+    float out[FRAMES * MAX_CHANNELS];
+    float out_ref[FRAMES * MAX_CHANNELS];
+    pa_biquad_cascade *bc, *bc_ref;
+
+    fill_input(in, FRAMES * channels);
+
+    bc = new_lr4_cascade(channels);
+    bc_ref = new_lr4_cascade(channels);
+
+    /* Twice, so that the history carried over is checked as well. */
+    func(bc, out, in, FRAMES);
+    orig_func(bc_ref, out_ref, in, FRAMES);
+    check_output(out, out_ref, channels, "generic code");
+
+    func(bc, out, in, FRAMES);
+    orig_func(bc_ref, out_ref, in, FRAMES);
+    check_output(out, out_ref, channels, "generic code");
+
+    if (perf) {
+        pa_log_debug("Testing biquad cascade performance with %u channels", channels);
+
+        PA_RUNTIME_TEST_RUN_START("func", TIMES, TIMES2) {
+            func(bc, out, in, FRAMES);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("orig", TIMES, TIMES2) {
+            orig_func(bc_ref, out_ref, in, FRAMES);
+        } PA_RUNTIME_TEST_RUN_STOP
+    }
+
+    pa_biquad_cascade_free(bc);
+    pa_biquad_cascade_free(bc_ref);
+}
+
+static void run_biquad_cascade_tests(pa_biquad_cascade_func_t func, pa_biquad_cascade_func_t orig_func) {
+    unsigned channels;
+
+    for (channels = 1; channels <= MAX_CHANNELS; channels++)
+        run_biquad_cascade_test(func, orig_func, channels, channels == 2 || channels == 6 || channels == 8);
+}
+
+START_TEST (biquad_cascade_lr4_test) {
+    unsigned channels;
+
+    for (channels = 1; channels <= MAX_CHANNELS; channels++)
+        run_lr4_test(channels);
+}
+END_TEST
+
+START_TEST (biquad_cascade_s16_test) {
+    int16_t in[FRAMES * 6];
+    int16_t out[FRAMES * 6];
+    short out_ref[FRAMES * 6];
+    struct lr4 lr4[6];
+    pa_biquad_cascade *bc;
+    unsigned c, i;
+
+    pa_random(in, sizeof(in));
+
+    bc = new_lr4_cascade(6);
+    for (c = 0; c < 6; c++)
+        lr4_set(&lr4[c], c == 5 ? BQ_LOWPASS : BQ_HIGHPASS, FREQ);
+
+    pa_biquad_cascade_process_s16(bc, out, in, FRAMES);
+    for (c = 0; c < 6; c++)
+        lr4_process_s16(&lr4[c], FRAMES, 6, (short *) &in[c], &out_ref[c]);
+
+    for (i = 0; i < PA_ELEMENTSOF(out); i++) {
+        if (abs(out[i] - out_ref[i]) > 1) {
+            pa_log_debug("Correctness test failed: %d: %d != %d", i, out[i], out_ref[i]);
+            ck_abort();
+        }
+    }
+
+    pa_biquad_cascade_free(bc);
+}
+END_TEST
+
+#if defined (__i386__) || defined (__amd64__)
+START_TEST (biquad_cascade_sse_test) {
+    pa_cpu_x86_flag_t flags = 0;
+    pa_biquad_cascade_func_t orig_func, sse_func;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_SSE)) {
+        pa_log_info("SSE not supported. Skipping");
+        return;
+    }
+
+    orig_func = pa_get_biquad_cascade_func();
+    pa_biquad_cascade_func_init_sse(flags);
+    sse_func = pa_get_biquad_cascade_func();
+
+    pa_log_debug("Checking SSE biquad cascade");
+    run_biquad_cascade_tests(sse_func, orig_func);
+
+    pa_set_biquad_cascade_func(orig_func);
+}
+END_TEST
+#endif /* defined (__i386__) || defined (__amd64__) */
+
+#if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
+START_TEST (biquad_cascade_neon_test) {
+    pa_cpu_arm_flag_t flags = 0;
+    pa_biquad_cascade_func_t orig_func, neon_func;
+
+    pa_cpu_get_arm_flags(&flags);
+
+    if (!(flags & PA_CPU_ARM_NEON)) {
+        pa_log_info("NEON not supported. Skipping");
+        return;
+    }
+
+    orig_func = pa_get_biquad_cascade_func();
+    pa_biquad_cascade_func_init_neon(flags);
+    neon_func = pa_get_biquad_cascade_func();
+
+    pa_log_debug("Checking NEON biquad cascade");
+    run_biquad_cascade_tests(neon_func, orig_func);
+
+    pa_set_biquad_cascade_func(orig_func);
+}
+END_TEST
+#endif /* defined (__arm__) && defined (__linux__) && defined (HAVE_NEON) */
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("CPU");
+
+    tc = tcase_create("biquad-cascade");
+    tcase_add_test(tc, biquad_cascade_lr4_test);
+    tcase_add_test(tc, biquad_cascade_s16_test);
+#if defined (__i386__) || defined (__amd64__)
+    tcase_add_test(tc, biquad_cascade_sse_test);
+#endif
+#if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
+    tcase_add_test(tc, biquad_cascade_neon_test);
+#endif
+    tcase_set_timeout(tc, 120);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
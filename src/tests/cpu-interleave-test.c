@@ -0,0 +1,262 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+#include <math.h>
+#include <string.h>
+
+#include <pulse/sample.h>
+#include <pulsecore/cpu.h>
+#include <pulsecore/cpu-arm.h>
+#include <pulsecore/cpu-x86.h>
+#include <pulsecore/random.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/sample-util.h>
+
+#include "runtime-test-util.h"
+
+/* Not a multiple of any SIMD width, so the leftover frames are checked too */
+#define FRAMES 1027
+#define TIMES 1000
+#define TIMES2 100
+
+static const unsigned channel_counts[] = { 2, 4, 6, 8 };
+static const size_t sample_sizes[] = { 2, 4 };
+
+/* Compares the optimized (de)interleaving for ss and channels against the
+ * generic loop. The buffers are offset by one sample, so that nothing is
+ * aligned. */
+static void run_interleave_test(size_t ss, unsigned channels, bool perf) {
+    PA_DECLARE_ALIGNED(16, uint8_t, in[PA_INTERLEAVE_MAX_CHANNELS][(FRAMES + 1) * 4]);
+    PA_DECLARE_ALIGNED(16, uint8_t, out[PA_INTERLEAVE_MAX_CHANNELS][(FRAMES + 1) * 4]);
+    PA_DECLARE_ALIGNED(16, uint8_t, out_ref[PA_INTERLEAVE_MAX_CHANNELS][(FRAMES + 1) * 4]);
+    PA_DECLARE_ALIGNED(16, uint8_t, buf[(FRAMES + 1) * PA_INTERLEAVE_MAX_CHANNELS * 4]);
+    PA_DECLARE_ALIGNED(16, uint8_t, buf_ref[(FRAMES + 1) * PA_INTERLEAVE_MAX_CHANNELS * 4]);
+    const void *src[PA_INTERLEAVE_MAX_CHANNELS];
+    void *dst[PA_INTERLEAVE_MAX_CHANNELS], *dst_ref[PA_INTERLEAVE_MAX_CHANNELS];
+    pa_interleave_func_t interleave_func;
+    pa_deinterleave_func_t deinterleave_func;
+    unsigned c;
+
+    interleave_func = pa_get_interleave_func(ss, channels);
+    deinterleave_func = pa_get_deinterleave_func(ss, channels);
+
+    if (!interleave_func || !deinterleave_func) {
+        pa_log_info("No optimized function for %u channels of %u bytes. Skipping", channels, (unsigned) ss);
+        return;
+    }
+
+    pa_random(in, sizeof(in));
+    pa_random(buf, sizeof(buf));
+    memcpy(buf_ref, buf, sizeof(buf));
+    memset(out, 0, sizeof(out));
+    memset(out_ref, 0, sizeof(out_ref));
+
+    for (c = 0; c < channels; c++) {
+        src[c] = in[c] + ss;
+        dst[c] = out[c] + ss;
+        dst_ref[c] = out_ref[c] + ss;
+    }
+
+    /* Without a function in the table the generic loop runs. */
+    pa_set_interleave_func(ss, channels, NULL);
+    pa_set_deinterleave_func(ss, channels, NULL);
+
+    interleave_func(src, buf + ss, FRAMES);
+    pa_interleave(src, channels, buf_ref + ss, ss, FRAMES);
+
+    if (memcmp(buf, buf_ref, sizeof(buf))) {
+        pa_log_debug("Interleaving failed: channels=%u, sample size=%u", channels, (unsigned) ss);
+        ck_abort();
+    }
+
+    deinterleave_func(buf + ss, dst, FRAMES);
+    pa_deinterleave(buf_ref + ss, dst_ref, channels, ss, FRAMES);
+
+    if (memcmp(out, out_ref, sizeof(out))) {
+        pa_log_debug("Deinterleaving failed: channels=%u, sample size=%u", channels, (unsigned) ss);
+        ck_abort();
+    }
+
+    if (perf) {
+        pa_log_debug("Testing interleave performance with %u channels of %u bytes", channels, (unsigned) ss);
+
+        PA_RUNTIME_TEST_RUN_START("func", TIMES, TIMES2) {
+            interleave_func(src, buf, FRAMES);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("orig", TIMES, TIMES2) {
+            pa_interleave(src, channels, buf_ref, ss, FRAMES);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        pa_log_debug("Testing deinterleave performance with %u channels of %u bytes", channels, (unsigned) ss);
+
+        PA_RUNTIME_TEST_RUN_START("func", TIMES, TIMES2) {
+            deinterleave_func(buf, dst, FRAMES);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("orig", TIMES, TIMES2) {
+            pa_deinterleave(buf_ref, dst_ref, channels, ss, FRAMES);
+        } PA_RUNTIME_TEST_RUN_STOP
+    }
+
+    pa_set_interleave_func(ss, channels, interleave_func);
+    pa_set_deinterleave_func(ss, channels, deinterleave_func);
+}
+
+static void run_sample_clamp_test(pa_sample_clamp_func_t func, pa_sample_clamp_func_t orig_func, bool perf) {
+    PA_DECLARE_ALIGNED(16, float, in[FRAMES + 1]);
+    PA_DECLARE_ALIGNED(16, float, out[FRAMES + 1]);
+    PA_DECLARE_ALIGNED(16, float, out_ref[FRAMES + 1]);
+    int16_t s[FRAMES];
+    unsigned i;
+
+    /* Up to twice full scale, so that about half of the samples clip */
+    pa_random(s, sizeof(s));
+    for (i = 0; i < FRAMES; i++)
+        in[i + 1] = s[i] / (float) 0x4000;
+
+    func(out + 1, in + 1, FRAMES);
+    orig_func(out_ref + 1, in + 1, FRAMES);
+
+    for (i = 1; i <= FRAMES; i++) {
+        if (out[i] != out_ref[i]) {
+            pa_log_debug("Clamping failed: %u: %.24f != %.24f", i, out[i], out_ref[i]);
+            ck_abort();
+        }
+    }
+
+    if (perf) {
+        pa_log_debug("Testing clamp performance");
+
+        PA_RUNTIME_TEST_RUN_START("func", TIMES, TIMES2) {
+            func(out, in, FRAMES);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("orig", TIMES, TIMES2) {
+            orig_func(out_ref, in, FRAMES);
+        } PA_RUNTIME_TEST_RUN_STOP
+    }
+}
+
+static void run_interleave_tests(void) {
+    unsigned i, j;
+
+    for (i = 0; i < PA_ELEMENTSOF(sample_sizes); i++)
+        for (j = 0; j < PA_ELEMENTSOF(channel_counts); j++)
+            run_interleave_test(sample_sizes[i], channel_counts[j], channel_counts[j] != 4);
+}
+
+/* Puts the generic code back for the next test. */
+static void reset_funcs(pa_sample_clamp_func_t orig_clamp_func) {
+    unsigned i, j;
+
+    for (i = 0; i < PA_ELEMENTSOF(sample_sizes); i++)
+        for (j = 0; j < PA_ELEMENTSOF(channel_counts); j++) {
+            pa_set_interleave_func(sample_sizes[i], channel_counts[j], NULL);
+            pa_set_deinterleave_func(sample_sizes[i], channel_counts[j], NULL);
+        }
+
+    pa_set_sample_clamp_func(orig_clamp_func);
+}
+
+#if defined (__i386__) || defined (__amd64__)
+START_TEST (interleave_sse_test) {
+    pa_cpu_x86_flag_t flags = 0;
+    pa_sample_clamp_func_t orig_func, sse_func;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_SSE)) {
+        pa_log_info("SSE not supported. Skipping");
+        return;
+    }
+
+    orig_func = pa_get_sample_clamp_func();
+    pa_sample_util_func_init_sse(flags);
+    sse_func = pa_get_sample_clamp_func();
+
+    pa_log_debug("Checking SSE interleaving");
+    run_interleave_tests();
+
+    pa_log_debug("Checking SSE clamping");
+    run_sample_clamp_test(sse_func, orig_func, true);
+
+    reset_funcs(orig_func);
+}
+END_TEST
+#endif /* defined (__i386__) || defined (__amd64__) */
+
+#if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
+START_TEST (interleave_neon_test) {
+    pa_cpu_arm_flag_t flags = 0;
+    pa_sample_clamp_func_t orig_func, neon_func;
+
+    pa_cpu_get_arm_flags(&flags);
+
+    if (!(flags & PA_CPU_ARM_NEON)) {
+        pa_log_info("NEON not supported. Skipping");
+        return;
+    }
+
+    orig_func = pa_get_sample_clamp_func();
+    pa_sample_util_func_init_neon(flags);
+    neon_func = pa_get_sample_clamp_func();
+
+    pa_log_debug("Checking NEON interleaving");
+    run_interleave_tests();
+
+    pa_log_debug("Checking NEON clamping");
+    run_sample_clamp_test(neon_func, orig_func, true);
+
+    reset_funcs(orig_func);
+}
+END_TEST
+#endif /* defined (__arm__) && defined (__linux__) && defined (HAVE_NEON) */
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("CPU");
+
+    tc = tcase_create("interleave");
+#if defined (__i386__) || defined (__amd64__)
+    tcase_add_test(tc, interleave_sse_test);
+#endif
+#if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
+    tcase_add_test(tc, interleave_neon_test);
+#endif
+    tcase_set_timeout(tc, 120);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,366 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <check.h>
+#include <ltdl.h>
+
+#include <pulse/format.h>
+#include <pulse/mainloop.h>
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core.h>
+#include <pulsecore/core-error.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/modargs.h>
+#include <pulsecore/module.h>
+#include <pulsecore/namereg.h>
+#include <pulsecore/sink.h>
+#include <pulsecore/sink-input.h>
+
+#include "../modules/droid/droid-stub-hal.h"
+
+/* Plays an MPEG passthrough stream to droid sink on the compressed
+ * offload output of the stub HAL and checks that
+ *
+ *  - the offload stream is closed again if the sink input is not created
+ *    after it was opened, or is never put,
+ *  - the encoded payload is written to the offload stream and nothing to
+ *    the PCM stream,
+ *  - removing the stream drains the offload stream without blocking the
+ *    main thread, after which the sink plays PCM and accepts passthrough
+ *    streams again. */
+
+#define SINK_NAME "offload_sink"
+#define RATE 48000
+
+/* One IEC61937 MPEG-1 layer 3 burst every 1152 frames, with a payload
+ * that plays in real time at 128 kbit/s. The stub HAL plays at half that
+ * rate, so that it has a full buffer to drain at the end. */
+#define BURST_BYTES (1152 * 4)
+#define PAYLOAD_BYTES 384
+#define STUB_HAL_CONFIG "offload_bitrate=64000"
+
+#define IEC61937_SYNC1 (0xF872)
+#define IEC61937_SYNC2 (0x4E1F)
+#define IEC61937_MPEG1_LAYER23 (0x0005)
+
+static const char audio_policy_conf[] =
+    "global_configuration {\n"
+    "  attached_output_devices AUDIO_DEVICE_OUT_SPEAKER\n"
+    "  default_output_device AUDIO_DEVICE_OUT_SPEAKER\n"
+    "  attached_input_devices AUDIO_DEVICE_IN_BUILTIN_MIC\n"
+    "}\n"
+    "audio_hw_modules {\n"
+    "  primary {\n"
+    "    outputs {\n"
+    "      primary {\n"
+    "        sampling_rates 48000\n"
+    "        channel_masks AUDIO_CHANNEL_OUT_STEREO\n"
+    "        formats AUDIO_FORMAT_PCM_16_BIT\n"
+    "        devices AUDIO_DEVICE_OUT_SPEAKER\n"
+    "        flags AUDIO_OUTPUT_FLAG_PRIMARY\n"
+    "      }\n"
+    "    }\n"
+    "    inputs {\n"
+    "      primary {\n"
+    "        sampling_rates 48000\n"
+    "        channel_masks AUDIO_CHANNEL_IN_STEREO\n"
+    "        formats AUDIO_FORMAT_PCM_16_BIT\n"
+    "        devices AUDIO_DEVICE_IN_BUILTIN_MIC\n"
+    "      }\n"
+    "    }\n"
+    "  }\n"
+    "}\n";
+
+static pa_mainloop *mainloop = NULL;
+static pa_core *core = NULL;
+static pa_memchunk burst;
+static size_t peek_index;
+
+static char *write_config(void) {
+    char *fn;
+    int fd;
+
+    fn = pa_sprintf_malloc("%s/droid-offload-test-XXXXXX", pa_get_temp_dir());
+    fail_unless((fd = mkstemp(fn)) >= 0);
+    fail_unless(pa_loop_write(fd, audio_policy_conf, sizeof(audio_policy_conf) - 1, NULL) >= 0);
+    pa_close(fd);
+
+    return fn;
+}
+
+static void make_burst(void) {
+    uint8_t *d;
+    size_t i;
+
+    burst.memblock = pa_memblock_new(core->mempool, BURST_BYTES);
+    burst.index = 0;
+    burst.length = BURST_BYTES;
+
+    d = pa_memblock_acquire(burst.memblock);
+    memset(d, 0, BURST_BYTES);
+
+    /* Preamble, as little endian 16 bit words */
+    d[0] = IEC61937_SYNC1 & 0xff; d[1] = IEC61937_SYNC1 >> 8;
+    d[2] = IEC61937_SYNC2 & 0xff; d[3] = IEC61937_SYNC2 >> 8;
+    d[4] = IEC61937_MPEG1_LAYER23; d[5] = 0;
+    d[6] = (PAYLOAD_BYTES * 8) & 0xff; d[7] = (PAYLOAD_BYTES * 8) >> 8;
+
+    for (i = 0; i < PAYLOAD_BYTES; i++)
+        d[8 + i] = (uint8_t) (i + 1);
+
+    pa_memblock_release(burst.memblock);
+}
+
+static void time_cb(pa_mainloop_api *a, pa_time_event *e, const struct timeval *tv, void *userdata) {
+    *(bool *) userdata = true;
+}
+
+static void run_mainloop(pa_usec_t usec) {
+    pa_time_event *e;
+    bool done = false;
+
+    e = pa_core_rttime_new(core, pa_rtclock_now() + usec, time_cb, &done);
+
+    while (!done)
+        fail_unless(pa_mainloop_iterate(mainloop, true, NULL) >= 0);
+
+    core->mainloop->time_free(e);
+}
+
+/* True if the sink offers passthrough, i.e. its offload stream is free */
+static bool offload_available(pa_sink *s) {
+    pa_idxset *formats;
+    pa_format_info *f;
+    uint32_t idx;
+    bool available = false;
+
+    formats = pa_sink_get_formats(s);
+
+    PA_IDXSET_FOREACH(f, formats, idx)
+        if (f->encoding == PA_ENCODING_MPEG_IEC61937)
+            available = true;
+
+    pa_idxset_free(formats, (pa_free_cb_t) pa_format_info_free);
+
+    return available;
+}
+
+static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk) {
+    *chunk = burst;
+    pa_memblock_ref(chunk->memblock);
+
+    chunk->index += peek_index;
+    chunk->length -= peek_index;
+
+    peek_index = 0;
+
+    return 0;
+}
+
+static void sink_input_process_rewind_cb(pa_sink_input *i, size_t nbytes) {
+    nbytes %= burst.length;
+
+    if (peek_index >= nbytes)
+        peek_index -= nbytes;
+    else
+        peek_index = burst.length + peek_index - nbytes;
+}
+
+static void sink_input_update_max_rewind_cb(pa_sink_input *i, size_t nbytes) {
+}
+
+static void sink_input_kill_cb(pa_sink_input *i) {
+    fail();
+}
+
+static pa_hook_result_t cancel_fixate_cb(pa_core *c, pa_sink_input_new_data *data, void *userdata) {
+    return PA_HOOK_CANCEL;
+}
+
+static pa_sink_input *new_passthrough_input(pa_sink *s) {
+    pa_sink_input_new_data data;
+    pa_sink_input *i = NULL;
+    pa_format_info *f;
+    pa_idxset *formats;
+
+    pa_sink_input_new_data_init(&data);
+    data.driver = __FILE__;
+    pa_proplist_sets(data.proplist, PA_PROP_MEDIA_NAME, "MPEG passthrough");
+    pa_sink_input_new_data_set_sink(&data, s, false);
+
+    f = pa_format_info_new();
+    f->encoding = PA_ENCODING_MPEG_IEC61937;
+    pa_format_info_set_rate(f, RATE);
+    pa_format_info_set_channels(f, 2);
+
+    formats = pa_idxset_new(NULL, NULL);
+    pa_idxset_put(formats, f, NULL);
+    pa_sink_input_new_data_set_formats(&data, formats);
+
+    pa_sink_input_new(&i, core, &data);
+    pa_sink_input_new_data_done(&data);
+
+    if (!i)
+        return NULL;
+
+    i->pop = sink_input_pop_cb;
+    i->process_rewind = sink_input_process_rewind_cb;
+    i->update_max_rewind = sink_input_update_max_rewind_cb;
+    i->kill = sink_input_kill_cb;
+
+    return i;
+}
+
+START_TEST (offload_test) {
+    pa_module *m;
+    pa_sink *s;
+    pa_sink_input *i;
+    pa_hook_slot *slot;
+    pa_droid_stub_hal_stats stats;
+    pa_usec_t begin, blocked, latency;
+    char *config, *args;
+
+    config = write_config();
+    setenv(DROID_STUB_HAL_ENV, STUB_HAL_CONFIG, 1);
+
+    fail_unless((mainloop = pa_mainloop_new()) != NULL);
+    fail_unless((core = pa_core_new(pa_mainloop_get_api(mainloop), false, false, 0)) != NULL);
+
+    args = pa_sprintf_malloc("module_id=primary config=%s sink_name=" SINK_NAME " rate=%u "
+                             "flags=AUDIO_OUTPUT_FLAG_COMPRESS_OFFLOAD", config, RATE);
+    m = pa_module_load(core, "module-droid-sink", args);
+    pa_xfree(args);
+
+    fail_unless(m != NULL);
+    fail_unless((s = pa_namereg_get(core, SINK_NAME, PA_NAMEREG_SINK)) != NULL);
+    fail_unless(offload_available(s));
+
+    make_burst();
+
+    /* Creation fails after the offload stream was opened in FIXATE */
+    slot = pa_hook_connect(&core->hooks[PA_CORE_HOOK_SINK_INPUT_FIXATE], PA_HOOK_LATE + 10,
+                           (pa_hook_cb_t) cancel_fixate_cb, NULL);
+    fail_unless(new_passthrough_input(s) == NULL);
+    pa_hook_slot_free(slot);
+
+    fail_unless(!offload_available(s));
+    run_mainloop(10 * PA_USEC_PER_MSEC);
+    fail_unless(offload_available(s));
+
+    /* The sink input is created but never put */
+    fail_unless((i = new_passthrough_input(s)) != NULL);
+    pa_sink_input_unlink(i);
+    pa_sink_input_unref(i);
+
+    run_mainloop(10 * PA_USEC_PER_MSEC);
+    fail_unless(offload_available(s));
+
+    /* Play for two seconds, which fills the stub HAL buffer */
+    fail_unless((i = new_passthrough_input(s)) != NULL);
+    pa_sink_input_put(i);
+    pa_droid_stub_hal_reset_stats();
+
+    run_mainloop(2 * PA_USEC_PER_SEC);
+
+    pa_droid_stub_hal_get_stats(&stats);
+    fail_unless(!offload_available(s));
+    fail_unless(stats.writes == 0);
+    fail_unless(stats.offload_writes > 0);
+    /* Only the payload is written, at least a second of it */
+    fail_unless(stats.offload_bytes >= PAYLOAD_BYTES * RATE / 1152);
+    fail_unless(stats.offload_bytes <= 3 * PAYLOAD_BYTES * RATE / 1152);
+
+    /* The IO thread must not wait for the drain, which would take about
+     * as long as the second of audio the stub HAL buffers. */
+    pa_sink_input_unlink(i);
+    pa_sink_input_unref(i);
+    pa_droid_stub_hal_reset_stats();
+
+    begin = pa_rtclock_now();
+    fail_unless(pa_asyncmsgq_send(s->asyncmsgq, PA_MSGOBJECT(s), PA_SINK_MESSAGE_GET_LATENCY, &latency, 0, NULL) == 0);
+    blocked = pa_rtclock_now() - begin;
+
+    fprintf(stderr, "Main thread blocked for %llu usec after removing the offloaded stream\n",
+            (unsigned long long) blocked);
+    fail_unless(blocked < PA_USEC_PER_SEC / 2);
+    fail_unless(!offload_available(s));
+
+    begin = pa_rtclock_now();
+    while (!offload_available(s)) {
+        fail_unless(pa_rtclock_now() - begin < 5 * PA_USEC_PER_SEC);
+        run_mainloop(10 * PA_USEC_PER_MSEC);
+    }
+
+    fprintf(stderr, "Drain finished after %llu usec\n", (unsigned long long) (pa_rtclock_now() - begin));
+
+    pa_droid_stub_hal_get_stats(&stats);
+    fail_unless(stats.drains == 1);
+    fail_unless(stats.writes > 0);
+
+    pa_memblock_unref(burst.memblock);
+    pa_module_unload(m, true);
+    pa_core_unref(core);
+    pa_mainloop_free(mainloop);
+
+    unlink(config);
+    pa_xfree(config);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    pa_assert_se(lt_dlinit() == 0);
+    lt_dlsetsearchpath(PA_BUILDDIR);
+
+    s = suite_create("Droid offload");
+    tc = tcase_create("droid-offload");
+#ifdef DROID_HAVE_COMPRESS_OFFLOAD
+    tcase_add_test(tc, offload_test);
+#endif
+    tcase_set_timeout(tc, 20);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    lt_dlexit();
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,376 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include <ltdl.h>
+
+#include <pulse/mainloop.h>
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core.h>
+#include <pulsecore/core-error.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/modargs.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/module.h>
+#include <pulsecore/card.h>
+
+#include "../modules/droid/droid-stub-hal.h"
+
+/* Runs droid sink and droid source on top of the stub audio HAL, one at
+ * a time and then both at once as during a call, and reports for each
+ *
+ *   - wakeups per second of the threads calling the HAL, and context
+ *     switches per second of the whole process,
+ *   - the average and maximum time between two HAL write() or read()
+ *     calls, which for droid sink is the render-to-write latency,
+ *   - CPU time used per second of audio.
+ *
+ * Usage: droid-stub-benchmark [seconds]
+ *
+ * The stub HAL can be tuned with the PULSE_DROID_STUB_HAL environment
+ * variable, see modules/droid/droid-stub-hal.h. */
+
+#define DEFAULT_SECONDS 10
+
+static const char audio_policy_conf[] =
+    "global_configuration {\n"
+    "  attached_output_devices AUDIO_DEVICE_OUT_SPEAKER\n"
+    "  default_output_device AUDIO_DEVICE_OUT_SPEAKER\n"
+    "  attached_input_devices AUDIO_DEVICE_IN_BUILTIN_MIC\n"
+    "}\n"
+    "audio_hw_modules {\n"
+    "  primary {\n"
+    "    outputs {\n"
+    "      primary {\n"
+    "        sampling_rates 48000\n"
+    "        channel_masks AUDIO_CHANNEL_OUT_STEREO\n"
+    "        formats AUDIO_FORMAT_PCM_16_BIT\n"
+    "        devices AUDIO_DEVICE_OUT_SPEAKER\n"
+    "        flags AUDIO_OUTPUT_FLAG_PRIMARY\n"
+    "      }\n"
+    "    }\n"
+    "    inputs {\n"
+    "      primary {\n"
+    "        sampling_rates 48000\n"
+    "        channel_masks AUDIO_CHANNEL_IN_STEREO\n"
+    "        formats AUDIO_FORMAT_PCM_16_BIT\n"
+    "        devices AUDIO_DEVICE_IN_BUILTIN_MIC\n"
+    "      }\n"
+    "    }\n"
+    "  }\n"
+    "}\n";
+
+static pa_mainloop *mainloop = NULL;
+
+static char *write_config(void) {
+    char *fn;
+    int fd;
+
+    fn = pa_sprintf_malloc("%s/droid-stub-benchmark-XXXXXX", pa_get_temp_dir());
+
+    if ((fd = mkstemp(fn)) < 0) {
+        pa_log("mkstemp() failed: %s", pa_cstrerror(errno));
+        pa_xfree(fn);
+        return NULL;
+    }
+
+    if (pa_loop_write(fd, audio_policy_conf, sizeof(audio_policy_conf) - 1, NULL) < 0) {
+        pa_log("Failed to write %s: %s", fn, pa_cstrerror(errno));
+        pa_close(fd);
+        unlink(fn);
+        pa_xfree(fn);
+        return NULL;
+    }
+
+    pa_close(fd);
+
+    return fn;
+}
+
+static void time_cb(pa_mainloop_api *a, pa_time_event *e, const struct timeval *tv, void *userdata) {
+    *(bool *) userdata = true;
+}
+
+/* pa_mainloop_quit() can't be undone, so iterate until the timer fires. */
+static void run_mainloop(pa_core *c, pa_usec_t usec) {
+    pa_time_event *e;
+    bool done = false;
+
+    e = pa_core_rttime_new(c, pa_rtclock_now() + usec, time_cb, &done);
+
+    while (!done)
+        pa_assert_se(pa_mainloop_iterate(mainloop, true, NULL) >= 0);
+
+    c->mainloop->time_free(e);
+}
+
+static pa_usec_t rusage_cpu(const struct rusage *ru) {
+    return pa_timeval_load(&ru->ru_utime) + pa_timeval_load(&ru->ru_stime);
+}
+
+static long rusage_switches(const struct rusage *ru) {
+    return ru->ru_nvcsw + ru->ru_nivcsw;
+}
+
+/* Voluntary context switches of one thread of this process, i.e. how
+ * often it went to sleep (in poll() or in the HAL) and was woken up
+ * again. Returns 0 if the thread is unknown. */
+static long thread_wakeups(pid_t tid) {
+    char *fn, line[128];
+    FILE *f;
+    long n = 0;
+
+    if (tid <= 0)
+        return 0;
+
+    fn = pa_sprintf_malloc("/proc/self/task/%i/status", (int) tid);
+    f = fopen(fn, "r");
+    pa_xfree(fn);
+
+    if (!f)
+        return 0;
+
+    while (fgets(line, sizeof(line), f))
+        if (sscanf(line, "voluntary_ctxt_switches: %li", &n) == 1)
+            break;
+
+    fclose(f);
+
+    return n;
+}
+
+/* The sink and source IO threads, counted once if they are the same */
+static long hal_thread_wakeups(const pa_droid_stub_hal_stats *stats) {
+    long n = thread_wakeups(stats->output_tid);
+
+    if (stats->input_tid != stats->output_tid)
+        n += thread_wakeups(stats->input_tid);
+
+    return n;
+}
+
+static int run(pa_core *c, const char *name, const char *args, bool output, unsigned seconds) {
+    pa_module *m;
+    struct rusage before, after;
+    pa_droid_stub_hal_stats stats;
+    pa_usec_t cpu, audio_usec;
+    uint64_t calls, bytes;
+    pa_usec_t gap_sum, gap_max;
+    long wakeups;
+
+    if (!(m = pa_module_load(c, name, args))) {
+        pa_log("Failed to load %s %s", name, args);
+        return -1;
+    }
+
+    /* Let the IO thread settle before we start measuring. */
+    run_mainloop(c, PA_USEC_PER_SEC / 2);
+
+    pa_droid_stub_hal_reset_stats();
+    pa_droid_stub_hal_get_stats(&stats);
+    wakeups = -hal_thread_wakeups(&stats);
+    getrusage(RUSAGE_SELF, &before);
+
+    run_mainloop(c, seconds * PA_USEC_PER_SEC);
+
+    getrusage(RUSAGE_SELF, &after);
+    pa_droid_stub_hal_get_stats(&stats);
+    wakeups += hal_thread_wakeups(&stats);
+
+    pa_module_unload(m, true);
+
+    if (output) {
+        calls = stats.writes;
+        bytes = stats.write_bytes;
+        gap_sum = stats.write_gap_sum;
+        gap_max = stats.write_gap_max;
+        audio_usec = pa_bytes_to_usec(bytes, &stats.output_spec);
+    } else {
+        calls = stats.reads;
+        bytes = stats.read_bytes;
+        gap_sum = stats.read_gap_sum;
+        gap_max = stats.read_gap_max;
+        audio_usec = pa_bytes_to_usec(bytes, &stats.input_spec);
+    }
+
+    if (calls == 0 || audio_usec == 0) {
+        pa_log("%s didn't %s any audio.", name, output ? "write" : "read");
+        return -1;
+    }
+
+    cpu = rusage_cpu(&after) - rusage_cpu(&before);
+
+    printf("%s:\n", name);
+    printf("  %s() calls:             %llu (%llu bytes, %0.2f s of audio)\n",
+           output ? "write" : "read",
+           (unsigned long long) calls, (unsigned long long) bytes, (double) audio_usec / PA_USEC_PER_SEC);
+    printf("  %s:               %llu, failures %llu\n",
+           output ? "underruns" : "overruns ",
+           (unsigned long long) (output ? stats.underruns : stats.overruns),
+           (unsigned long long) (output ? stats.write_failures : stats.read_failures));
+    printf("  IO thread wakeups/s:      %0.1f\n", (double) wakeups / seconds);
+    printf("  process ctx switches/s:   %0.1f\n",
+           (double) (rusage_switches(&after) - rusage_switches(&before)) / seconds);
+    printf("  %s latency:     avg %llu usec, max %llu usec\n",
+           output ? "render-to-write" : "read-to-post   ",
+           (unsigned long long) (gap_sum / calls), (unsigned long long) gap_max);
+    printf("  CPU per second of audio:  %llu usec\n",
+           (unsigned long long) (cpu * PA_USEC_PER_SEC / audio_usec));
+
+    return 0;
+}
+
+/* Sink and source on the same hw module, with and without the shared
+ * wakeup clock. */
+static int run_duplex(pa_core *c, const char *config, bool wakeup_clock, unsigned seconds) {
+    pa_module *sink, *source;
+    struct rusage before, after;
+    pa_droid_stub_hal_stats stats;
+    char *args;
+    long wakeups;
+
+    args = pa_sprintf_malloc("module_id=primary config=%s sink_name=stub_sink wakeup_clock=%s",
+                             config, pa_yes_no(wakeup_clock));
+    sink = pa_module_load(c, "module-droid-sink", args);
+    pa_xfree(args);
+
+    if (!sink) {
+        pa_log("Failed to load module-droid-sink");
+        return -1;
+    }
+
+    args = pa_sprintf_malloc("module_id=primary source_name=stub_source wakeup_clock=%s", pa_yes_no(wakeup_clock));
+    source = pa_module_load(c, "module-droid-source", args);
+    pa_xfree(args);
+
+    if (!source) {
+        pa_log("Failed to load module-droid-source");
+        pa_module_unload(sink, true);
+        return -1;
+    }
+
+    run_mainloop(c, PA_USEC_PER_SEC / 2);
+
+    pa_droid_stub_hal_reset_stats();
+    pa_droid_stub_hal_get_stats(&stats);
+    wakeups = -hal_thread_wakeups(&stats);
+    getrusage(RUSAGE_SELF, &before);
+
+    run_mainloop(c, seconds * PA_USEC_PER_SEC);
+
+    getrusage(RUSAGE_SELF, &after);
+    pa_droid_stub_hal_get_stats(&stats);
+    wakeups += hal_thread_wakeups(&stats);
+
+    pa_module_unload(source, true);
+    pa_module_unload(sink, true);
+
+    if (stats.writes == 0 || stats.reads == 0) {
+        pa_log("Duplex run didn't %s any audio.", stats.writes == 0 ? "write" : "read");
+        return -1;
+    }
+
+    printf("sink and source, wakeup clock %s:\n", wakeup_clock ? "on" : "off");
+    printf("  write() / read() calls:   %llu / %llu\n",
+           (unsigned long long) stats.writes, (unsigned long long) stats.reads);
+    printf("  underruns / overruns:     %llu / %llu\n",
+           (unsigned long long) stats.underruns, (unsigned long long) stats.overruns);
+    printf("  IO thread wakeups/s:      %0.1f\n", (double) wakeups / seconds);
+    printf("  process ctx switches/s:   %0.1f\n",
+           (double) (rusage_switches(&after) - rusage_switches(&before)) / seconds);
+    printf("  CPU per second:           %llu usec\n",
+           (unsigned long long) ((rusage_cpu(&after) - rusage_cpu(&before)) / seconds));
+
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    pa_core *c = NULL;
+    char *config = NULL;
+    char *args;
+    unsigned seconds = DEFAULT_SECONDS;
+    int ret = 1;
+
+    if (argc > 1 && (pa_atou(argv[1], &seconds) < 0 || seconds == 0)) {
+        fprintf(stderr, "Usage: %s [seconds]\n", argv[0]);
+        return 1;
+    }
+
+    pa_log_set_level(PA_LOG_WARN);
+
+    pa_assert_se(lt_dlinit() == 0);
+    lt_dlsetsearchpath(PA_BUILDDIR);
+
+    if (!(config = write_config()))
+        goto finish;
+
+    pa_assert_se(mainloop = pa_mainloop_new());
+
+    if (!(c = pa_core_new(pa_mainloop_get_api(mainloop), false, false, 0)))
+        goto finish;
+
+    args = pa_sprintf_malloc("module_id=primary config=%s sink_name=stub_sink", config);
+    ret = run(c, "module-droid-sink", args, true, seconds);
+    pa_xfree(args);
+
+    if (ret < 0)
+        goto finish;
+
+    /* The sink closed the hw module, so the source opens it again. */
+    args = pa_sprintf_malloc("module_id=primary config=%s source_name=stub_source", config);
+    ret = run(c, "module-droid-source", args, false, seconds);
+    pa_xfree(args);
+
+    if (ret < 0)
+        goto finish;
+
+    if ((ret = run_duplex(c, config, false, seconds)) < 0)
+        goto finish;
+
+    ret = run_duplex(c, config, true, seconds);
+
+finish:
+    if (c) {
+        pa_module_unload_all(c);
+        pa_core_unref(c);
+    }
+
+    if (mainloop)
+        pa_mainloop_free(mainloop);
+
+    if (config) {
+        unlink(config);
+        pa_xfree(config);
+    }
+
+    lt_dlexit();
+
+    return ret < 0 ? 1 : ret;
+}
@@ -0,0 +1,141 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <check.h>
+
+#include <pulse/mainloop.h>
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/modargs.h>
+
+#include "../modules/droid/droid-util.h"
+
+/* Checks the grid of the shared wakeup clock of a stub HAL hw module. An
+ * IO thread that woke up on a grid point must stay on the grid, both when
+ * it rounds early (sinks) and late (sources). */
+
+#define PERIOD (10 * PA_USEC_PER_MSEC)
+
+static const char audio_policy_conf[] =
+    "audio_hw_modules {\n"
+    "  primary {\n"
+    "    outputs {\n"
+    "      primary {\n"
+    "        sampling_rates 48000\n"
+    "        channel_masks AUDIO_CHANNEL_OUT_STEREO\n"
+    "        formats AUDIO_FORMAT_PCM_16_BIT\n"
+    "        devices AUDIO_DEVICE_OUT_SPEAKER\n"
+    "        flags AUDIO_OUTPUT_FLAG_PRIMARY\n"
+    "      }\n"
+    "    }\n"
+    "  }\n"
+    "}\n";
+
+START_TEST (wakeup_clock_test) {
+    pa_mainloop *mainloop;
+    pa_core *core;
+    pa_modargs *ma;
+    pa_droid_config_audio *config;
+    pa_droid_hw_module *hw;
+    pa_usec_t now, wakeup;
+    char *fn, *args;
+    int fd;
+
+    fn = pa_sprintf_malloc("%s/droid-wakeup-clock-test-XXXXXX", pa_get_temp_dir());
+    fail_unless((fd = mkstemp(fn)) >= 0);
+    fail_unless(pa_loop_write(fd, audio_policy_conf, sizeof(audio_policy_conf) - 1, NULL) >= 0);
+    pa_close(fd);
+
+    fail_unless((mainloop = pa_mainloop_new()) != NULL);
+    fail_unless((core = pa_core_new(pa_mainloop_get_api(mainloop), false, false, 0)) != NULL);
+
+    args = pa_sprintf_malloc("config=%s", fn);
+    fail_unless((ma = pa_modargs_new(args, NULL)) != NULL);
+    fail_unless((config = pa_droid_config_load(ma)) != NULL);
+    fail_unless((hw = pa_droid_hw_module_get(core, config, "primary")) != NULL);
+
+    /* Nobody joined, nothing is moved. */
+    fail_unless(pa_droid_hw_wakeup_clock_align(hw, 12345, 0, true) == 12345);
+    fail_unless(pa_droid_hw_wakeup_clock_align(hw, 12345, 0, false) == 12345);
+
+    /* The shortest joined period is the grid. */
+    pa_droid_hw_wakeup_clock_join(hw, 2 * PERIOD);
+    pa_droid_hw_wakeup_clock_join(hw, PERIOD);
+
+    fail_unless(pa_droid_hw_wakeup_clock_align(hw, 3 * PERIOD, 0, true) == 3 * PERIOD);
+    fail_unless(pa_droid_hw_wakeup_clock_align(hw, 3 * PERIOD, 0, false) == 3 * PERIOD);
+    fail_unless(pa_droid_hw_wakeup_clock_align(hw, 2 * PERIOD + 5000, PERIOD, true) == 2 * PERIOD);
+    fail_unless(pa_droid_hw_wakeup_clock_align(hw, 2 * PERIOD + 5000, PERIOD, false) == 3 * PERIOD);
+    /* The previous grid point is in the past, don't wake up late. */
+    fail_unless(pa_droid_hw_wakeup_clock_align(hw, 2 * PERIOD + 5000, 2 * PERIOD + 1000, true) == 2 * PERIOD + 5000);
+
+    /* Woken up on a grid point, every wakeup requested within the next
+     * period stays on the grid. */
+    for (now = PERIOD; now < 10 * PERIOD; now += PERIOD)
+        for (wakeup = now; wakeup < now + PERIOD; wakeup += 100) {
+            fail_unless(pa_droid_hw_wakeup_clock_align(hw, wakeup, now, true) == now);
+            fail_unless(pa_droid_hw_wakeup_clock_align(hw, wakeup + 100, now, false) == now + PERIOD);
+        }
+
+    pa_droid_hw_wakeup_clock_leave(hw);
+    pa_droid_hw_wakeup_clock_leave(hw);
+    fail_unless(pa_droid_hw_wakeup_clock_align(hw, 12345, 0, true) == 12345);
+
+    pa_droid_hw_module_unref(hw);
+    pa_modargs_free(ma);
+    pa_xfree(args);
+    pa_core_unref(core);
+    pa_mainloop_free(mainloop);
+
+    unlink(fn);
+    pa_xfree(fn);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Droid wakeup clock");
+    tc = tcase_create("droid-wakeup-clock");
+    tcase_add_test(tc, wakeup_clock_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
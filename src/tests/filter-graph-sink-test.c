@@ -0,0 +1,198 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <check.h>
+#include <ltdl.h>
+
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/filter/biquad-cascade.h>
+
+#include "filter-sink-test-util.h"
+
+/* Runs module-filter-graph-sink in the filter sink test harness and
+ * compares what the master played with the stages run by hand. This covers
+ *
+ *  - the gain and delay stages,
+ *  - the latency the delay stage adds,
+ *  - filters= as passed by module-filter-apply,
+ *  - rewinds, which restore the saved state of all stages and fast forward
+ *    from it. */
+
+#define RATE PA_FILTER_SINK_TEST_RATE
+#define CHANNELS PA_FILTER_SINK_TEST_CHANNELS
+
+#define BANDS "peaking:1000:2:-6,highpass:40"
+#define DELAY_MSEC 10
+#define DELAY_STAGE "delay:10"
+#define DELAY_FRAMES (RATE * DELAY_MSEC / 1000)
+
+static pa_filter_sink_test test;
+
+/* args selects the stages, with stages= or filters= */
+static void setup(const char *args) {
+    char *t;
+
+    t = pa_sprintf_malloc("sink_master=" PA_FILTER_SINK_TEST_MASTER " sink_name=graph %s", args);
+    pa_filter_sink_test_setup(&test, "module-filter-graph-sink", t, "graph");
+    pa_xfree(t);
+}
+
+static void rewind_frames(unsigned frames) {
+    /* Everything asked for must be rewritten, or there is nothing to test. */
+    fail_unless(pa_filter_sink_test_rewind(&test, frames) == frames);
+}
+
+/* Compares the recording with the noise run through bands (if given), then
+ * delayed by delay frames and scaled by gain_db. */
+static void check_record(const char *bands, unsigned delay, double gain_db) {
+    pa_biquad_cascade *bc = NULL;
+    float *x, *y;
+    float factor = (float) pow(10.0, gain_db / 20.0);
+    unsigned k, c, n;
+
+    n = test.record_frames;
+    fail_unless(n > delay);
+
+    x = pa_xnew(float, n * CHANNELS);
+    y = pa_xnew0(float, n * CHANNELS);
+
+    for (k = 0; k < n; k++)
+        for (c = 0; c < CHANNELS; c++)
+            x[k * CHANNELS + c] = pa_filter_sink_test_sample(k, c);
+
+    if (bands) {
+        fail_unless((bc = pa_biquad_cascade_new_from_bands(bands, CHANNELS, RATE)) != NULL);
+        pa_biquad_cascade_process_float32(bc, x, x, n);
+        pa_biquad_cascade_free(bc);
+    }
+
+    for (k = delay; k < n; k++)
+        for (c = 0; c < CHANNELS; c++)
+            y[k * CHANNELS + c] = PA_CLAMP_UNLIKELY(x[(k - delay) * CHANNELS + c] * factor, -1.0f, 1.0f);
+
+    for (k = 0; k < n; k++)
+        for (c = 0; c < CHANNELS; c++)
+            fail_unless(fabsf(test.record[k * CHANNELS + c] - y[k * CHANNELS + c]) < 1e-4f,
+                        "Frame %u channel %u is %f instead of %f", k, c,
+                        test.record[k * CHANNELS + c], y[k * CHANNELS + c]);
+
+    pa_xfree(x);
+    pa_xfree(y);
+}
+
+START_TEST (gain_test) {
+    setup("stages=gain:-6");
+
+    pa_filter_sink_test_render(&test, 8);
+    check_record(NULL, 0, -6.0);
+
+    pa_filter_sink_test_teardown(&test);
+}
+END_TEST
+
+START_TEST (delay_test) {
+    pa_usec_t latency, delay_usec, block_usec;
+
+    setup("stages=" DELAY_STAGE);
+
+    pa_filter_sink_test_render(&test, 8);
+
+    /* The master reports none, so this is the delay plus whatever the sink
+     * input of the graph has rendered ahead. */
+    delay_usec = (pa_usec_t) DELAY_MSEC * PA_USEC_PER_MSEC;
+    block_usec = pa_bytes_to_usec(PA_FILTER_SINK_TEST_BLOCK_FRAMES * PA_FILTER_SINK_TEST_FRAME_SIZE, &test.sink->sample_spec);
+    latency = pa_sink_get_latency(test.sink);
+    fail_unless(latency >= delay_usec && latency < delay_usec + block_usec,
+                "Latency is %llu usec, expected %llu", (unsigned long long) latency, (unsigned long long) delay_usec);
+
+    check_record(NULL, DELAY_FRAMES, 0.0);
+
+    pa_filter_sink_test_teardown(&test);
+}
+END_TEST
+
+START_TEST (rewind_test) {
+    setup("stages=\"peq:" BANDS "|" DELAY_STAGE "|gain:-3\"");
+
+    pa_filter_sink_test_render(&test, 16);
+    /* Further back than the saved states are apart, then less. Both reach
+     * back past what the delay holds. */
+    rewind_frames(1000);
+    pa_filter_sink_test_render(&test, 8);
+    rewind_frames(600);
+    pa_filter_sink_test_render(&test, 8);
+
+    check_record(BANDS, DELAY_FRAMES, -3.0);
+
+    pa_filter_sink_test_teardown(&test);
+}
+END_TEST
+
+START_TEST (filters_test) {
+    setup("filters=\"parametric-eq-sink:" BANDS "\"");
+
+    fail_unless(pa_safe_streq(pa_proplist_gets(test.sink->proplist, "device.filter_graph.filters"), "parametric-eq-sink:" BANDS));
+    fail_unless(pa_safe_streq(pa_proplist_gets(test.sink->proplist, "device.filter_graph.stages"), "peq"));
+
+    pa_filter_sink_test_render(&test, 8);
+    check_record(BANDS, 0, 0.0);
+
+    pa_filter_sink_test_teardown(&test);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    pa_assert_se(lt_dlinit() == 0);
+    lt_dlsetsearchpath(PA_BUILDDIR);
+
+    s = suite_create("Filter graph sink");
+    tc = tcase_create("filter-graph-sink");
+    tcase_add_test(tc, gain_test);
+    tcase_add_test(tc, delay_test);
+    tcase_add_test(tc, rewind_test);
+    tcase_add_test(tc, filters_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    lt_dlexit();
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,215 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+
+#include <ltdl.h>
+
+#include <pulse/mainloop.h>
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/module.h>
+#include <pulsecore/namereg.h>
+#include <pulsecore/sink.h>
+
+/* Plays a sine through an equalizer filter sink on top of a null sink and
+ * reports for module-parametric-eq-sink and module-equalizer-sink
+ *
+ *   - CPU time used per second of audio, null sink and sine included,
+ *   - the latency the filter sink adds on top of the null sink,
+ *
+ * for stereo and 5.1 at 44.1, 48 and 96 kHz.
+ *
+ * Usage: filter-sink-benchmark [seconds]
+ *
+ * module-equalizer-sink is skipped if it isn't built. */
+
+#define DEFAULT_SECONDS 5
+
+#define PEQ_BANDS "lowshelf:80::4,peaking:250:1:-2,peaking:500:1:1,peaking:1000:1:-3,peaking:2000:1:2," \
+                  "peaking:3000:1:-1,peaking:4000:1:1,peaking:6000:1:-2,peaking:8000:1:1,highshelf:12000::3"
+
+static pa_mainloop *mainloop = NULL;
+
+static void time_cb(pa_mainloop_api *a, pa_time_event *e, const struct timeval *tv, void *userdata) {
+    *(bool *) userdata = true;
+}
+
+/* pa_mainloop_quit() can't be undone, so iterate until the timer fires. */
+static void run_mainloop(pa_core *c, pa_usec_t usec) {
+    pa_time_event *e;
+    bool done = false;
+
+    e = pa_core_rttime_new(c, pa_rtclock_now() + usec, time_cb, &done);
+
+    while (!done)
+        pa_assert_se(pa_mainloop_iterate(mainloop, true, NULL) >= 0);
+
+    c->mainloop->time_free(e);
+}
+
+static pa_usec_t rusage_cpu(const struct rusage *ru) {
+    return pa_timeval_load(&ru->ru_utime) + pa_timeval_load(&ru->ru_stime);
+}
+
+/* Returns the CPU time per second of audio of the null sink and sine alone
+ * if filter is NULL. */
+static int run(pa_core *c, const char *filter, const char *filter_args, uint32_t rate, unsigned channels,
+               unsigned seconds, pa_usec_t *cpu, pa_usec_t *latency) {
+    pa_module *null_sink, *filter_sink = NULL, *sine;
+    pa_sink *master, *sink;
+    struct rusage before, after;
+    pa_usec_t start, audio_usec;
+    char *args;
+    int ret = -1;
+
+    args = pa_sprintf_malloc("sink_name=benchmark_null rate=%u channels=%u", rate, channels);
+    null_sink = pa_module_load(c, "module-null-sink", args);
+    pa_xfree(args);
+
+    if (!null_sink) {
+        pa_log("Failed to load module-null-sink");
+        return -1;
+    }
+
+    if (filter) {
+        args = pa_sprintf_malloc("sink_name=benchmark_filter %s", filter_args);
+        filter_sink = pa_module_load(c, filter, args);
+        pa_xfree(args);
+
+        if (!filter_sink) {
+            pa_log_info("Failed to load %s", filter);
+            goto finish;
+        }
+    }
+
+    if (!(sine = pa_module_load(c, "module-sine", filter ? "sink=benchmark_filter" : "sink=benchmark_null"))) {
+        pa_log("Failed to load module-sine");
+        goto finish;
+    }
+
+    run_mainloop(c, PA_USEC_PER_SEC / 2);
+
+    start = pa_rtclock_now();
+    getrusage(RUSAGE_SELF, &before);
+
+    run_mainloop(c, seconds * PA_USEC_PER_SEC);
+
+    getrusage(RUSAGE_SELF, &after);
+    audio_usec = pa_rtclock_now() - start;
+
+    *cpu = (rusage_cpu(&after) - rusage_cpu(&before)) * PA_USEC_PER_SEC / audio_usec;
+
+    *latency = 0;
+    if (filter) {
+        pa_assert_se(master = pa_namereg_get(c, "benchmark_null", PA_NAMEREG_SINK));
+        pa_assert_se(sink = pa_namereg_get(c, "benchmark_filter", PA_NAMEREG_SINK));
+
+        *latency = pa_sink_get_latency(sink);
+        *latency = *latency > pa_sink_get_latency(master) ? *latency - pa_sink_get_latency(master) : 0;
+    }
+
+    pa_module_unload(sine, true);
+    ret = 0;
+
+finish:
+    if (filter_sink)
+        pa_module_unload(filter_sink, true);
+
+    pa_module_unload(null_sink, true);
+
+    return ret;
+}
+
+static int run_all(pa_core *c, uint32_t rate, unsigned channels, unsigned seconds) {
+    pa_usec_t base_cpu, cpu, latency;
+
+    printf("%u channels at %u Hz:\n", channels, rate);
+
+    if (run(c, NULL, NULL, rate, channels, seconds, &base_cpu, &latency) < 0)
+        return -1;
+
+    printf("  null sink and sine:            %llu usec CPU per second\n", (unsigned long long) base_cpu);
+
+    if (run(c, "module-parametric-eq-sink", "master=benchmark_null bands=\"" PEQ_BANDS "\"", rate, channels, seconds, &cpu, &latency) < 0)
+        return -1;
+
+    printf("  module-parametric-eq-sink:     %llu usec CPU per second, %llu usec added latency\n",
+           (unsigned long long) (cpu > base_cpu ? cpu - base_cpu : 0), (unsigned long long) latency);
+
+    if (run(c, "module-equalizer-sink", "sink_master=benchmark_null", rate, channels, seconds, &cpu, &latency) < 0)
+        printf("  module-equalizer-sink:         not available\n");
+    else
+        printf("  module-equalizer-sink:         %llu usec CPU per second, %llu usec added latency\n",
+               (unsigned long long) (cpu > base_cpu ? cpu - base_cpu : 0), (unsigned long long) latency);
+
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    pa_core *c = NULL;
+    unsigned seconds = DEFAULT_SECONDS;
+    static const uint32_t rates[] = { 44100, 48000, 96000 };
+    static const unsigned channels[] = { 2, 6 };
+    unsigned i, j;
+    int ret = 1;
+
+    if (argc > 1 && (pa_atou(argv[1], &seconds) < 0 || seconds == 0)) {
+        fprintf(stderr, "Usage: %s [seconds]\n", argv[0]);
+        return 1;
+    }
+
+    pa_log_set_level(PA_LOG_WARN);
+
+    pa_assert_se(lt_dlinit() == 0);
+    lt_dlsetsearchpath(PA_BUILDDIR);
+
+    pa_assert_se(mainloop = pa_mainloop_new());
+
+    if (!(c = pa_core_new(pa_mainloop_get_api(mainloop), false, false, 0)))
+        goto finish;
+
+    for (i = 0; i < PA_ELEMENTSOF(channels); i++)
+        for (j = 0; j < PA_ELEMENTSOF(rates); j++)
+            if ((ret = run_all(c, rates[j], channels[i], seconds)) < 0)
+                goto finish;
+
+finish:
+    if (c) {
+        pa_module_unload_all(c);
+        pa_core_unref(c);
+    }
+
+    if (mainloop)
+        pa_mainloop_free(mainloop);
+
+    lt_dlexit();
+
+    return ret < 0 ? 1 : ret;
+}
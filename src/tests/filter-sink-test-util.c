@@ -0,0 +1,253 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/namereg.h>
+
+#include "filter-sink-test-util.h"
+
+#define CHANNELS PA_FILTER_SINK_TEST_CHANNELS
+#define FRAME_SIZE PA_FILTER_SINK_TEST_FRAME_SIZE
+
+enum {
+    MASTER_MESSAGE_RENDER = PA_SINK_MESSAGE_MAX,
+    MASTER_MESSAGE_REWIND
+};
+
+float pa_filter_sink_test_sample(uint64_t frame, unsigned channel) {
+    uint32_t x = (uint32_t) (frame * CHANNELS + channel) * 2654435761U;
+
+    x ^= x >> 15;
+    x *= 0x2c1b3c6dU;
+    x ^= x >> 12;
+
+    return (float) (x >> 8) / (float) (1 << 24) - 0.5f;
+}
+
+/* Called from I/O thread context */
+static int master_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
+    pa_sink *s = PA_SINK(o);
+    pa_filter_sink_test *t = s->userdata;
+
+    switch (code) {
+        case MASTER_MESSAGE_RENDER: {
+            pa_memchunk result;
+            const float *p;
+
+            /* The master can't take anything back that it played. */
+            if (s->thread_info.rewind_requested)
+                pa_sink_process_rewind(s, 0);
+
+            pa_sink_render_full(s, (size_t) offset, &result);
+            pa_assert_se(t->record_frames + result.length / FRAME_SIZE <= PA_FILTER_SINK_TEST_MAX_FRAMES);
+
+            p = pa_memblock_acquire_chunk(&result);
+            memcpy(t->record + t->record_frames * CHANNELS, p, result.length);
+            pa_memblock_release(result.memblock);
+            pa_memblock_unref(result.memblock);
+
+            t->record_frames += result.length / FRAME_SIZE;
+            return 0;
+        }
+
+        case PA_SINK_MESSAGE_GET_LATENCY:
+            /* Only the filter sink adds latency. */
+            *((pa_usec_t*) data) = 0;
+            return 0;
+
+        case MASTER_MESSAGE_REWIND: {
+            size_t *nbytes = data;
+
+            /* Rewrite the last nbytes the way a client seeking back does. */
+            pa_sink_input_request_rewind(t->input, *nbytes, true, false, false);
+
+            *nbytes = PA_MIN(*nbytes, s->thread_info.rewind_nbytes);
+            pa_sink_process_rewind(s, *nbytes);
+
+            t->record_frames -= *nbytes / FRAME_SIZE;
+            return 0;
+        }
+    }
+
+    return pa_sink_process_msg(o, code, data, offset, chunk);
+}
+
+static void thread_func(void *userdata) {
+    pa_filter_sink_test *t = userdata;
+
+    pa_thread_mq_install(&t->thread_mq);
+
+    /* Nothing to do but to process messages until shut down. */
+    while (pa_rtpoll_run(t->rtpoll) > 0)
+        ;
+}
+
+/* Called from I/O thread context */
+static int input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk) {
+    pa_filter_sink_test *t = i->userdata;
+    float *d;
+    unsigned n, k, c;
+
+    n = (unsigned) (PA_MIN(nbytes, pa_mempool_block_size_max(i->sink->core->mempool)) / FRAME_SIZE);
+
+    chunk->memblock = pa_memblock_new(i->sink->core->mempool, n * FRAME_SIZE);
+    chunk->index = 0;
+    chunk->length = n * FRAME_SIZE;
+
+    d = pa_memblock_acquire(chunk->memblock);
+    for (k = 0; k < n; k++)
+        for (c = 0; c < CHANNELS; c++)
+            d[k * CHANNELS + c] = pa_filter_sink_test_sample(t->input_frame + k, c);
+    pa_memblock_release(chunk->memblock);
+
+    t->input_frame += n;
+
+    return 0;
+}
+
+/* Called from I/O thread context */
+static void input_process_rewind_cb(pa_sink_input *i, size_t nbytes) {
+    pa_filter_sink_test *t = i->userdata;
+
+    t->input_frame -= nbytes / FRAME_SIZE;
+}
+
+static void input_kill_cb(pa_sink_input *i) {
+    pa_assert_not_reached();
+}
+
+void pa_filter_sink_test_setup(pa_filter_sink_test *t, const char *module_name, const char *args, const char *sink_name) {
+    pa_sample_spec ss;
+    pa_channel_map map;
+    pa_sink_new_data sink_data;
+    pa_sink_input_new_data input_data;
+
+    pa_assert(t);
+    pa_assert(module_name);
+    pa_assert(sink_name);
+
+    ss.format = PA_SAMPLE_FLOAT32NE;
+    ss.rate = PA_FILTER_SINK_TEST_RATE;
+    ss.channels = CHANNELS;
+    pa_channel_map_init_stereo(&map);
+
+    t->input_frame = 0;
+    t->record_frames = 0;
+
+    pa_assert_se(t->mainloop = pa_mainloop_new());
+    pa_assert_se(t->core = pa_core_new(pa_mainloop_get_api(t->mainloop), false, false, 0));
+
+    t->rtpoll = pa_rtpoll_new();
+    pa_assert_se(pa_thread_mq_init(&t->thread_mq, t->core->mainloop, t->rtpoll) == 0);
+
+    pa_sink_new_data_init(&sink_data);
+    sink_data.driver = __FILE__;
+    pa_sink_new_data_set_name(&sink_data, PA_FILTER_SINK_TEST_MASTER);
+    pa_sink_new_data_set_sample_spec(&sink_data, &ss);
+    pa_sink_new_data_set_channel_map(&sink_data, &map);
+    t->master = pa_sink_new(t->core, &sink_data, PA_SINK_LATENCY);
+    pa_sink_new_data_done(&sink_data);
+    pa_assert_se(t->master);
+
+    t->master->parent.process_msg = master_process_msg;
+    t->master->userdata = t;
+    pa_sink_set_asyncmsgq(t->master, t->thread_mq.inq);
+    pa_sink_set_rtpoll(t->master, t->rtpoll);
+    pa_sink_set_max_request(t->master, PA_FILTER_SINK_TEST_BLOCK_FRAMES * FRAME_SIZE);
+    pa_sink_set_max_rewind(t->master, PA_FILTER_SINK_TEST_MAX_FRAMES * FRAME_SIZE);
+
+    pa_assert_se(t->thread = pa_thread_new("test-master", thread_func, t));
+    pa_sink_put(t->master);
+
+    pa_assert_se(t->module = pa_module_load(t->core, module_name, args));
+    pa_assert_se(t->sink = pa_namereg_get(t->core, sink_name, PA_NAMEREG_SINK));
+
+    pa_sink_input_new_data_init(&input_data);
+    input_data.driver = __FILE__;
+    pa_proplist_sets(input_data.proplist, PA_PROP_MEDIA_NAME, "Noise");
+    pa_sink_input_new_data_set_sink(&input_data, t->sink, false);
+    pa_sink_input_new_data_set_sample_spec(&input_data, &ss);
+    pa_sink_input_new_data_set_channel_map(&input_data, &map);
+    pa_sink_input_new(&t->input, t->core, &input_data);
+    pa_sink_input_new_data_done(&input_data);
+    pa_assert_se(t->input);
+
+    t->input->pop = input_pop_cb;
+    t->input->process_rewind = input_process_rewind_cb;
+    t->input->kill = input_kill_cb;
+    t->input->userdata = t;
+    pa_sink_input_put(t->input);
+}
+
+void pa_filter_sink_test_teardown(pa_filter_sink_test *t) {
+    pa_assert(t);
+
+    pa_sink_input_unlink(t->input);
+    pa_sink_input_unref(t->input);
+    t->input = NULL;
+
+    pa_module_unload(t->module, true);
+    t->module = NULL;
+    t->sink = NULL;
+
+    pa_sink_unlink(t->master);
+
+    pa_asyncmsgq_send(t->thread_mq.inq, NULL, PA_MESSAGE_SHUTDOWN, NULL, 0, NULL);
+    pa_thread_free(t->thread);
+    t->thread = NULL;
+
+    pa_thread_mq_done(&t->thread_mq);
+    pa_rtpoll_free(t->rtpoll);
+    t->rtpoll = NULL;
+
+    pa_sink_unref(t->master);
+    t->master = NULL;
+
+    pa_core_unref(t->core);
+    t->core = NULL;
+    pa_mainloop_free(t->mainloop);
+    t->mainloop = NULL;
+}
+
+void pa_filter_sink_test_render(pa_filter_sink_test *t, unsigned blocks) {
+    pa_assert(t);
+
+    for (; blocks > 0; blocks--)
+        pa_assert_se(pa_asyncmsgq_send(t->master->asyncmsgq, PA_MSGOBJECT(t->master), MASTER_MESSAGE_RENDER,
+                                       NULL, PA_FILTER_SINK_TEST_BLOCK_FRAMES * FRAME_SIZE, NULL) == 0);
+}
+
+unsigned pa_filter_sink_test_rewind(pa_filter_sink_test *t, unsigned frames) {
+    size_t nbytes = frames * FRAME_SIZE;
+
+    pa_assert(t);
+
+    pa_assert_se(pa_asyncmsgq_send(t->master->asyncmsgq, PA_MSGOBJECT(t->master), MASTER_MESSAGE_REWIND,
+                                   &nbytes, 0, NULL) == 0);
+
+    return (unsigned) (nbytes / FRAME_SIZE);
+}
@@ -0,0 +1,84 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifndef foofiltersinktestutilhfoo
+#define foofiltersinktestutilhfoo
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulse/mainloop.h>
+
+#include <pulsecore/core.h>
+#include <pulsecore/module.h>
+#include <pulsecore/rtpoll.h>
+#include <pulsecore/sink.h>
+#include <pulsecore/sink-input.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/thread-mq.h>
+
+/* Runs a filter sink module on a master sink that only renders when told
+ * to, and feeds it noise that can be regenerated after a rewind. Tests then
+ * compare what the master played with the filter run by hand. */
+
+#define PA_FILTER_SINK_TEST_RATE 48000
+#define PA_FILTER_SINK_TEST_CHANNELS 2
+#define PA_FILTER_SINK_TEST_FRAME_SIZE (PA_FILTER_SINK_TEST_CHANNELS * sizeof(float))
+#define PA_FILTER_SINK_TEST_BLOCK_FRAMES 256
+#define PA_FILTER_SINK_TEST_MAX_FRAMES PA_FILTER_SINK_TEST_RATE
+
+/* The name of the master sink, for the arguments of the module */
+#define PA_FILTER_SINK_TEST_MASTER "test_master"
+
+typedef struct pa_filter_sink_test {
+    /* These are set by pa_filter_sink_test_setup() */
+    pa_core *core;
+    pa_module *module;
+    pa_sink *master;
+    /* The sink of the module, which the noise plays to */
+    pa_sink *sink;
+    pa_sink_input *input;
+
+    /* What the master played so far. Only accessed from the master's I/O
+     * thread while the main thread waits for a message to it. */
+    float record[PA_FILTER_SINK_TEST_MAX_FRAMES * PA_FILTER_SINK_TEST_CHANNELS];
+    unsigned record_frames;
+
+    /* Internal */
+    pa_mainloop *mainloop;
+    pa_rtpoll *rtpoll;
+    pa_thread_mq thread_mq;
+    pa_thread *thread;
+    uint64_t input_frame;
+} pa_filter_sink_test;
+
+/* Loads module_name with args on the master and starts playing noise to
+ * the sink called sink_name. */
+void pa_filter_sink_test_setup(pa_filter_sink_test *t, const char *module_name, const char *args, const char *sink_name);
+void pa_filter_sink_test_teardown(pa_filter_sink_test *t);
+
+/* Has the master play blocks of PA_FILTER_SINK_TEST_BLOCK_FRAMES frames */
+void pa_filter_sink_test_render(pa_filter_sink_test *t, unsigned blocks);
+/* Has the master rewrite the last frames it played, the way a client
+ * seeking back does. Returns how many frames were rewritten. */
+unsigned pa_filter_sink_test_rewind(pa_filter_sink_test *t, unsigned frames);
+
+/* The noise played, which only depends on the position in the stream */
+float pa_filter_sink_test_sample(uint64_t frame, unsigned channel);
+
+#endif
@@ -33,8 +33,25 @@
 
 #include <check.h>
 
+#include <pulsecore/core-util.h>
+
 #include "lo-test-util.h"
 
+/* Plays a square pulse every second and prints how long it takes to show
+ * up on the capture side. Given a number of pulses, it stops after that
+ * many and prints the average and maximum latency.
+ *
+ * This also measures module-echo-cancel without any hardware, e.g.
+ *
+ *   load-module module-null-sink sink_name=ec_null
+ *   load-module module-echo-cancel aec_method=null sink_master=ec_null source_master=ec_null.monitor
+ *
+ * and TEST_SINK=ec_null.echo-cancel TEST_SOURCE=ec_null.monitor.echo-cancel.
+ * The null canceller passes the capture samples through, so running once
+ * with and once without low_latency=1 shows what it saves.
+ *
+ * Usage: lo-latency-test [pulses] */
+
 #define SAMPLE_HZ 44100
 #define CHANNELS 2
 #define N_OUT (SAMPLE_HZ * 1)
@@ -43,8 +60,11 @@ static float out[N_OUT][CHANNELS];
 
 pa_lo_test_context test_ctx;
 static const char *context_name = NULL;
+static unsigned n_pulses = 0;
 
 static struct timeval tv_out, tv_in;
+static unsigned n_latencies = 0;
+static pa_usec_t latency_sum = 0, latency_max = 0;
 
 static void nop_free_cb(void *p) {
 }
@@ -124,8 +144,17 @@ static void read_cb(pa_stream *s, size_t nbytes, void *userdata) {
          * definition of 1 tight in this case and detect the transition in the
          * next round. */
         if (cur - last > 0.4f) {
+            pa_usec_t latency;
+
             pa_gettimeofday(&tv_in);
-            fprintf(stderr, "Latency %llu\n", (unsigned long long) pa_timeval_diff(&tv_in, &tv_out));
+            latency = pa_timeval_diff(&tv_in, &tv_out);
+            fprintf(stderr, "Latency %llu\n", (unsigned long long) latency);
+
+            latency_sum += latency;
+            latency_max = PA_MAX(latency_max, latency);
+
+            if (++n_latencies == n_pulses)
+                pa_mainloop_quit(ctx->mainloop, 0);
         }
 
         last = cur;
@@ -161,6 +190,10 @@ START_TEST (loopback_test) {
     fail_unless(pa_lo_test_init(&test_ctx) == 0);
     fail_unless(pa_lo_test_run(&test_ctx) == 0);
     pa_lo_test_deinit(&test_ctx);
+
+    if (n_latencies > 0)
+        printf("Latency over %u pulses: %llu usec average, %llu usec max\n", n_latencies,
+               (unsigned long long) (latency_sum / n_latencies), (unsigned long long) latency_max);
 }
 END_TEST
 
@@ -172,6 +205,11 @@ int main(int argc, char *argv[]) {
 
     context_name = argv[0];
 
+    if (argc > 1 && (pa_atou(argv[1], &n_pulses) < 0 || n_pulses == 0)) {
+        fprintf(stderr, "Usage: %s [pulses]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
     s = suite_create("Loopback latency");
     tc = tcase_create("loopback latency");
     tcase_add_test(tc, loopback_test);
@@ -0,0 +1,220 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <check.h>
+#include <ltdl.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/filter/biquad-cascade.h>
+
+#include "filter-sink-test-util.h"
+
+/* Runs module-parametric-eq-sink in the filter sink test harness and
+ * compares what the master played with the output of the same cascade run
+ * by hand. This covers
+ *
+ *  - rewinds, which restore a saved filter state and fast forward from it,
+ *  - the crossfade when the bands change at runtime,
+ *  - the device.peq.bands property, which rejects invalid bands. */
+
+#define RATE PA_FILTER_SINK_TEST_RATE
+#define CHANNELS PA_FILTER_SINK_TEST_CHANNELS
+#define FADE_FRAMES (RATE / 50)
+
+#define PEQ_BANDS_PROPERTY "device.peq.bands"
+
+#define BANDS_A "lowshelf:100::6,peaking:1000:2:-6,highpass:40"
+#define BANDS_B "peaking:3000:1:9,lowpass:8000"
+
+static pa_filter_sink_test test;
+
+static void setup(const char *bands) {
+    char *args;
+
+    args = pa_sprintf_malloc("master=" PA_FILTER_SINK_TEST_MASTER " sink_name=peq bands=%s", bands);
+    pa_filter_sink_test_setup(&test, "module-parametric-eq-sink", args, "peq");
+    pa_xfree(args);
+}
+
+static void rewind_frames(unsigned frames) {
+    /* Everything asked for must be rewritten, or there is nothing to test. */
+    fail_unless(pa_filter_sink_test_rewind(&test, frames) == frames);
+}
+
+static void set_bands(const char *bands) {
+    pa_proplist *pl;
+
+    pl = pa_proplist_new();
+    pa_proplist_sets(pl, PEQ_BANDS_PROPERTY, bands);
+    pa_sink_update_proplist(test.sink, PA_UPDATE_REPLACE, pl);
+    pa_proplist_free(pl);
+}
+
+/* Compares the recording with bands_a filtering the noise, crossfaded to
+ * bands_b from switch_frame on if bands_b is given. */
+static void check_record(const char *bands_a, const char *bands_b, unsigned switch_frame) {
+    pa_biquad_cascade *a, *b = NULL;
+    float *x, *ya, *yb;
+    unsigned k, c, n;
+
+    n = test.record_frames;
+    fail_unless(n > 0);
+
+    x = pa_xnew(float, n * CHANNELS);
+    ya = pa_xnew(float, n * CHANNELS);
+    yb = pa_xnew(float, n * CHANNELS);
+
+    for (k = 0; k < n; k++)
+        for (c = 0; c < CHANNELS; c++)
+            x[k * CHANNELS + c] = pa_filter_sink_test_sample(k, c);
+
+    fail_unless((a = pa_biquad_cascade_new_from_bands(bands_a, CHANNELS, RATE)) != NULL);
+
+    if (!bands_b)
+        switch_frame = n;
+
+    pa_biquad_cascade_process_float32(a, ya, x, switch_frame);
+
+    if (bands_b) {
+        fail_unless((b = pa_biquad_cascade_new_from_bands(bands_b, CHANNELS, RATE)) != NULL);
+        pa_biquad_cascade_copy_state(b, a);
+
+        pa_biquad_cascade_process_float32(a, ya + switch_frame * CHANNELS, x + switch_frame * CHANNELS, n - switch_frame);
+        pa_biquad_cascade_process_float32(b, yb + switch_frame * CHANNELS, x + switch_frame * CHANNELS, n - switch_frame);
+
+        for (k = switch_frame; k < n; k++)
+            for (c = 0; c < CHANNELS; c++) {
+                float g = k - switch_frame < FADE_FRAMES ? (float) (FADE_FRAMES - (k - switch_frame)) / FADE_FRAMES : 0.0f;
+                ya[k * CHANNELS + c] = yb[k * CHANNELS + c] * (1.0f - g) + ya[k * CHANNELS + c] * g;
+            }
+
+        pa_biquad_cascade_free(b);
+    }
+
+    for (k = 0; k < n; k++)
+        for (c = 0; c < CHANNELS; c++)
+            fail_unless(fabsf(test.record[k * CHANNELS + c] - ya[k * CHANNELS + c]) < 1e-4f,
+                        "Frame %u channel %u is %f instead of %f", k, c,
+                        test.record[k * CHANNELS + c], ya[k * CHANNELS + c]);
+
+    pa_biquad_cascade_free(a);
+    pa_xfree(x);
+    pa_xfree(ya);
+    pa_xfree(yb);
+}
+
+START_TEST (rewind_test) {
+    setup(BANDS_A);
+
+    pa_filter_sink_test_render(&test, 16);
+    /* Further back than the saved states are apart, then less. */
+    rewind_frames(1000);
+    pa_filter_sink_test_render(&test, 8);
+    rewind_frames(100);
+    pa_filter_sink_test_render(&test, 8);
+
+    check_record(BANDS_A, NULL, 0);
+
+    pa_filter_sink_test_teardown(&test);
+}
+END_TEST
+
+START_TEST (crossfade_test) {
+    unsigned switch_frame;
+
+    setup(BANDS_A);
+
+    pa_filter_sink_test_render(&test, 8);
+    switch_frame = test.record_frames;
+
+    set_bands(BANDS_B);
+    fail_unless(pa_streq(pa_proplist_gets(test.sink->proplist, PEQ_BANDS_PROPERTY), BANDS_B));
+
+    /* Well past the end of the fade */
+    pa_filter_sink_test_render(&test, 16);
+
+    check_record(BANDS_A, BANDS_B, switch_frame);
+
+    pa_filter_sink_test_teardown(&test);
+}
+END_TEST
+
+START_TEST (proplist_test) {
+    setup(BANDS_A);
+
+    fail_unless(pa_streq(pa_proplist_gets(test.sink->proplist, PEQ_BANDS_PROPERTY), BANDS_A));
+
+    pa_filter_sink_test_render(&test, 4);
+
+    /* Invalid bands are replaced by the current ones again, and the
+     * filters are left alone. */
+    set_bands("lowshelf:100:2:3");
+    fail_unless(pa_streq(pa_proplist_gets(test.sink->proplist, PEQ_BANDS_PROPERTY), BANDS_A));
+    set_bands("lowpass:1000::3");
+    fail_unless(pa_streq(pa_proplist_gets(test.sink->proplist, PEQ_BANDS_PROPERTY), BANDS_A));
+    set_bands("notch:1000");
+    fail_unless(pa_streq(pa_proplist_gets(test.sink->proplist, PEQ_BANDS_PROPERTY), BANDS_A));
+    set_bands("peaking:30000:1:3");
+    fail_unless(pa_streq(pa_proplist_gets(test.sink->proplist, PEQ_BANDS_PROPERTY), BANDS_A));
+
+    pa_filter_sink_test_render(&test, 4);
+
+    check_record(BANDS_A, NULL, 0);
+
+    pa_filter_sink_test_teardown(&test);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    pa_assert_se(lt_dlinit() == 0);
+    lt_dlsetsearchpath(PA_BUILDDIR);
+
+    s = suite_create("Parametric EQ sink");
+    tc = tcase_create("parametric-eq-sink");
+    tcase_add_test(tc, rewind_test);
+    tcase_add_test(tc, crossfade_test);
+    tcase_add_test(tc, proplist_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    lt_dlexit();
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,124 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+
+#include <check.h>
+
+#include <pulsecore/atomic.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/seqlock.h>
+#include <pulsecore/thread.h>
+
+#define N_WRITES 1000000
+#define N_WORDS 16
+
+/* Every word holds the same value, so a torn read shows up as a mismatch. */
+struct data {
+    uint64_t words[N_WORDS];
+};
+
+static pa_seqlock lock = PA_SEQLOCK_INIT;
+static struct data shared;
+static pa_atomic_t done = PA_ATOMIC_INIT(0);
+
+static void writer(void *userdata) {
+    struct data d;
+    uint64_t i;
+    unsigned j;
+
+    for (i = 1; i <= N_WRITES; i++) {
+        for (j = 0; j < N_WORDS; j++)
+            d.words[j] = i;
+
+        /* Alternate between the two ways of writing */
+        if (i & 1)
+            pa_seqlock_write(&lock, &shared, &d, sizeof(d));
+        else {
+            pa_seqlock_write_begin(&lock);
+            for (j = 0; j < N_WORDS; j++)
+                shared.words[j] = i;
+            pa_seqlock_write_end(&lock);
+        }
+    }
+
+    pa_atomic_store(&done, 1);
+}
+
+static void reader(void *userdata) {
+    struct data d;
+    uint64_t last = 0;
+    unsigned j, reads = 0;
+
+    while (!pa_atomic_load(&done)) {
+        pa_seqlock_read(&lock, &shared, &d, sizeof(d));
+
+        for (j = 1; j < N_WORDS; j++)
+            fail_unless(d.words[j] == d.words[0]);
+
+        /* There's one writer, so what we see never goes back in time */
+        fail_unless(d.words[0] >= last);
+        last = d.words[0];
+        reads++;
+    }
+
+    pa_seqlock_read(&lock, &shared, &d, sizeof(d));
+    fail_unless(d.words[0] == N_WRITES);
+
+    pa_log_debug("%u consistent reads", reads);
+}
+
+START_TEST (seqlock_test) {
+    pa_thread *t1, *t2;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    t1 = pa_thread_new("reader", reader, NULL);
+    fail_unless(t1 != NULL);
+    t2 = pa_thread_new("writer", writer, NULL);
+    fail_unless(t2 != NULL);
+
+    pa_thread_free(t1);
+    pa_thread_free(t2);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    s = suite_create("Sequence Lock");
+    tc = tcase_create("seqlock");
+    tcase_add_test(tc, seqlock_test);
+    tcase_set_timeout(tc, 60);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
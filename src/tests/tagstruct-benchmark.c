@@ -0,0 +1,349 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+
+#include <pulse/xmalloc.h>
+#include <pulse/proplist.h>
+#include <pulse/format.h>
+#include <pulse/def.h>
+
+#include <pulsecore/socket.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/tagstruct.h>
+#include <pulsecore/packet.h>
+
+#include "runtime-test-util.h"
+
+/* Times building a GET_SINK_INPUT_INFO_LIST style reply the way
+ * pa_pstream_send_tagstruct() used to, growing the tagstruct by
+ * GROW_TAG_SIZE bytes whenever it is full and then copying it into a new
+ * packet, against the geometric growth and the preallocated, zero-copy
+ * paths used now.
+ *
+ * Usage: tagstruct-benchmark [entries] */
+
+#define DEFAULT_ENTRIES 1000
+#define TIMES 20
+#define TIMES2 10
+
+/* The writing half of pulsecore/tagstruct.c as it was before the buffer
+ * grew geometrically */
+
+#define OLD_MAX_APPENDED_SIZE 128
+#define OLD_GROW_TAG_SIZE 100
+
+typedef struct old_tagstruct {
+    uint8_t *data;
+    size_t length, allocated;
+    bool dynamic;
+    uint8_t appended[OLD_MAX_APPENDED_SIZE];
+} old_tagstruct;
+
+static old_tagstruct *old_tagstruct_new(void) {
+    old_tagstruct *t;
+
+    t = pa_xnew(old_tagstruct, 1);
+    t->data = t->appended;
+    t->allocated = OLD_MAX_APPENDED_SIZE;
+    t->length = 0;
+    t->dynamic = false;
+
+    return t;
+}
+
+static void old_tagstruct_free(old_tagstruct *t) {
+    if (t->dynamic)
+        pa_xfree(t->data);
+    pa_xfree(t);
+}
+
+static inline void old_extend(old_tagstruct *t, size_t l) {
+    if (t->length+l <= t->allocated)
+        return;
+
+    if (t->dynamic)
+        t->data = pa_xrealloc(t->data, t->allocated = t->length + l + OLD_GROW_TAG_SIZE);
+    else {
+        t->dynamic = true;
+        t->data = pa_xmalloc(t->allocated = t->length + l + OLD_GROW_TAG_SIZE);
+        memcpy(t->data, t->appended, t->length);
+    }
+}
+
+static void old_write_u8(old_tagstruct *t, uint8_t u) {
+    old_extend(t, 1);
+    t->data[t->length++] = u;
+}
+
+static void old_write_u32(old_tagstruct *t, uint32_t u) {
+    old_extend(t, 4);
+    u = htonl(u);
+    memcpy(t->data + t->length, &u, 4);
+    t->length += 4;
+}
+
+static void old_write_u64(old_tagstruct *t, uint64_t u) {
+    old_write_u32(t, u >> 32);
+    old_write_u32(t, u);
+}
+
+static void old_write_arbitrary(old_tagstruct *t, const void *p, size_t len) {
+    old_extend(t, len);
+
+    if (len > 0)
+        memcpy(t->data + t->length, p, len);
+
+    t->length += len;
+}
+
+static void old_puts(old_tagstruct *t, const char *s) {
+    if (s) {
+        old_write_u8(t, PA_TAG_STRING);
+        old_write_arbitrary(t, s, strlen(s)+1);
+    } else
+        old_write_u8(t, PA_TAG_STRING_NULL);
+}
+
+static void old_putu32(old_tagstruct *t, uint32_t i) {
+    old_write_u8(t, PA_TAG_U32);
+    old_write_u32(t, i);
+}
+
+static void old_putu8(old_tagstruct *t, uint8_t c) {
+    old_write_u8(t, PA_TAG_U8);
+    old_write_u8(t, c);
+}
+
+static void old_put_sample_spec(old_tagstruct *t, const pa_sample_spec *ss) {
+    old_write_u8(t, PA_TAG_SAMPLE_SPEC);
+    old_write_u8(t, ss->format);
+    old_write_u8(t, ss->channels);
+    old_write_u32(t, ss->rate);
+}
+
+static void old_put_arbitrary(old_tagstruct *t, const void *p, size_t length) {
+    old_write_u8(t, PA_TAG_ARBITRARY);
+    old_write_u32(t, length);
+    old_write_arbitrary(t, p, length);
+}
+
+static void old_put_boolean(old_tagstruct *t, bool b) {
+    old_write_u8(t, b ? PA_TAG_BOOLEAN_TRUE : PA_TAG_BOOLEAN_FALSE);
+}
+
+static void old_put_usec(old_tagstruct *t, pa_usec_t u) {
+    old_write_u8(t, PA_TAG_USEC);
+    old_write_u64(t, u);
+}
+
+static void old_put_channel_map(old_tagstruct *t, const pa_channel_map *map) {
+    unsigned i;
+
+    old_write_u8(t, PA_TAG_CHANNEL_MAP);
+    old_write_u8(t, map->channels);
+
+    for (i = 0; i < map->channels; i ++)
+        old_write_u8(t, map->map[i]);
+}
+
+static void old_put_cvolume(old_tagstruct *t, const pa_cvolume *cvolume) {
+    unsigned i;
+
+    old_write_u8(t, PA_TAG_CVOLUME);
+    old_write_u8(t, cvolume->channels);
+
+    for (i = 0; i < cvolume->channels; i ++)
+        old_write_u32(t, cvolume->values[i]);
+}
+
+static void old_put_proplist(old_tagstruct *t, pa_proplist *p) {
+    void *state = NULL;
+
+    old_write_u8(t, PA_TAG_PROPLIST);
+
+    for (;;) {
+        const char *k;
+        const void *d;
+        size_t l;
+
+        if (!(k = pa_proplist_iterate(p, &state)))
+            break;
+
+        old_puts(t, k);
+        pa_assert_se(pa_proplist_get(p, k, &d, &l) >= 0);
+        old_putu32(t, (uint32_t) l);
+        old_put_arbitrary(t, d, l);
+    }
+
+    old_puts(t, NULL);
+}
+
+static void old_put_format_info(old_tagstruct *t, pa_format_info *f) {
+    old_write_u8(t, PA_TAG_FORMAT_INFO);
+    old_putu8(t, (uint8_t) f->encoding);
+    old_put_proplist(t, f->plist);
+}
+
+static unsigned n_entries = DEFAULT_ENTRIES;
+static pa_proplist *proplist;
+static pa_format_info *format;
+static pa_sample_spec ss = { PA_SAMPLE_S16LE, 44100, 2 };
+static pa_channel_map map;
+static pa_cvolume volume;
+
+/* Roughly what sink_input_fill_tagstruct() in protocol-native.c puts on the
+ * wire for a v32 client, once through each implementation */
+#define FILL_SINK_INPUT_LIST(t, prefix)                                 \
+    do {                                                                \
+        unsigned _i;                                                    \
+                                                                        \
+        prefix##putu32(t, 2); /* PA_COMMAND_REPLY */                    \
+        prefix##putu32(t, 4711);                                        \
+                                                                        \
+        for (_i = 0; _i < n_entries; _i++) {                            \
+            prefix##putu32(t, _i);                                      \
+            prefix##puts(t, "Playback Stream");                         \
+            prefix##putu32(t, PA_INVALID_INDEX);                        \
+            prefix##putu32(t, _i);                                      \
+            prefix##putu32(t, 0);                                       \
+            prefix##put_sample_spec(t, &ss);                            \
+            prefix##put_channel_map(t, &map);                           \
+            prefix##put_cvolume(t, &volume);                            \
+            prefix##put_usec(t, 23220);                                 \
+            prefix##put_usec(t, 2000);                                  \
+            prefix##puts(t, "speex-float-1");                           \
+            prefix##puts(t, "protocol-native.c");                       \
+            prefix##put_boolean(t, false);                              \
+            prefix##put_proplist(t, proplist);                          \
+            prefix##put_boolean(t, false);                              \
+            prefix##put_boolean(t, true);                               \
+            prefix##put_boolean(t, true);                               \
+            prefix##put_format_info(t, format);                         \
+        }                                                               \
+    } while (0)
+
+/* What pa_pstream_send_tagstruct() used to do */
+static pa_packet *build_old(void) {
+    old_tagstruct *t;
+    pa_packet *p;
+
+    t = old_tagstruct_new();
+    FILL_SINK_INPUT_LIST(t, old_);
+
+    p = pa_packet_new_data(t->data, t->length);
+    old_tagstruct_free(t);
+
+    return p;
+}
+
+/* Geometric growth, buffer handed over to the packet */
+static pa_packet *build_grow(void) {
+    pa_tagstruct *t;
+    uint8_t *data;
+    size_t length;
+
+    t = pa_tagstruct_new();
+    FILL_SINK_INPUT_LIST(t, pa_tagstruct_);
+
+    data = pa_tagstruct_free_data(t, &length);
+    return pa_packet_new_dynamic(data, length);
+}
+
+/* Preallocated from a size hint, as protocol-native.c does for list replies */
+static pa_packet *build_sized(size_t hint) {
+    pa_tagstruct *t;
+    uint8_t *data;
+    size_t length;
+
+    t = pa_tagstruct_new_sized(hint);
+    FILL_SINK_INPUT_LIST(t, pa_tagstruct_);
+
+    data = pa_tagstruct_free_data(t, &length);
+    return pa_packet_new_dynamic(data, length);
+}
+
+int main(int argc, char *argv[]) {
+    pa_packet *p1, *p2, *p3;
+    const void *d1, *d2, *d3;
+    size_t l1, l2, l3;
+
+    if (argc > 1 && (pa_atou(argv[1], &n_entries) < 0 || n_entries == 0)) {
+        fprintf(stderr, "Usage: %s [entries]\n", argv[0]);
+        return 1;
+    }
+
+    pa_log_set_level(PA_LOG_DEBUG);
+
+    pa_channel_map_init_stereo(&map);
+    pa_cvolume_reset(&volume, ss.channels);
+
+    proplist = pa_proplist_new();
+    pa_proplist_sets(proplist, PA_PROP_MEDIA_NAME, "Playback Stream");
+    pa_proplist_sets(proplist, PA_PROP_APPLICATION_NAME, "tagstruct-benchmark");
+    pa_proplist_sets(proplist, PA_PROP_APPLICATION_PROCESS_BINARY, "tagstruct-benchmark");
+    pa_proplist_sets(proplist, PA_PROP_MEDIA_ROLE, "music");
+
+    format = pa_format_info_new();
+    format->encoding = PA_ENCODING_PCM;
+
+    /* All three must put the same bytes on the wire */
+    p1 = build_old();
+    d1 = pa_packet_data(p1, &l1);
+    p2 = build_grow();
+    d2 = pa_packet_data(p2, &l2);
+    p3 = build_sized(l1);
+    d3 = pa_packet_data(p3, &l3);
+
+    pa_assert_se(l1 == l2 && l1 == l3);
+    pa_assert_se(memcmp(d1, d2, l1) == 0 && memcmp(d1, d3, l1) == 0);
+
+    pa_packet_unref(p1);
+    pa_packet_unref(p2);
+    pa_packet_unref(p3);
+
+    pa_log_debug("GET_SINK_INPUT_INFO_LIST reply with %u entries: %zu bytes, %u replies per run", n_entries, l1, TIMES);
+
+    PA_RUNTIME_TEST_RUN_START("old: grow by 100 bytes and copy", TIMES, TIMES2) {
+        pa_packet_unref(build_old());
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    PA_RUNTIME_TEST_RUN_START("grow geometrically, zero-copy", TIMES, TIMES2) {
+        pa_packet_unref(build_grow());
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    PA_RUNTIME_TEST_RUN_START("preallocated, zero-copy", TIMES, TIMES2) {
+        pa_packet_unref(build_sized(l1));
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    pa_format_info_free(format);
+    pa_proplist_free(proplist);
+
+    return 0;
+}
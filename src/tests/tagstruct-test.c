@@ -0,0 +1,210 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+
+#include <pulse/xmalloc.h>
+#include <pulse/proplist.h>
+#include <pulse/format.h>
+#include <pulse/def.h>
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/tagstruct.h>
+#include <pulsecore/packet.h>
+
+#define N_SINK_INPUTS 1000
+
+static pa_proplist *proplist;
+static pa_format_info *format;
+
+/* Serialize roughly what sink_input_fill_tagstruct() in
+ * protocol-native.c puts on the wire for a v32 client */
+static void fill_sink_input_list(pa_tagstruct *t) {
+    pa_sample_spec ss = { PA_SAMPLE_S16LE, 44100, 2 };
+    pa_channel_map map;
+    pa_cvolume v;
+    unsigned i;
+
+    pa_channel_map_init_stereo(&map);
+    pa_cvolume_reset(&v, ss.channels);
+
+    pa_tagstruct_putu32(t, 2); /* PA_COMMAND_REPLY */
+    pa_tagstruct_putu32(t, 4711);
+
+    for (i = 0; i < N_SINK_INPUTS; i++) {
+        pa_tagstruct_putu32(t, i);
+        pa_tagstruct_puts(t, "Playback Stream");
+        pa_tagstruct_putu32(t, PA_INVALID_INDEX);
+        pa_tagstruct_putu32(t, i);
+        pa_tagstruct_putu32(t, 0);
+        pa_tagstruct_put_sample_spec(t, &ss);
+        pa_tagstruct_put_channel_map(t, &map);
+        pa_tagstruct_put_cvolume(t, &v);
+        pa_tagstruct_put_usec(t, 23220);
+        pa_tagstruct_put_usec(t, 2000);
+        pa_tagstruct_puts(t, "speex-float-1");
+        pa_tagstruct_puts(t, "protocol-native.c");
+        pa_tagstruct_put_boolean(t, false);
+        pa_tagstruct_put_proplist(t, proplist);
+        pa_tagstruct_put_boolean(t, false);
+        pa_tagstruct_put_boolean(t, true);
+        pa_tagstruct_put_boolean(t, true);
+        pa_tagstruct_put_format_info(t, format);
+    }
+}
+
+/* Grow the tagstruct on demand, then copy it into a new packet */
+static pa_packet *build_copy(void) {
+    pa_tagstruct *t;
+    pa_packet *p;
+    const uint8_t *data;
+    size_t length;
+
+    t = pa_tagstruct_new();
+    fill_sink_input_list(t);
+
+    data = pa_tagstruct_data(t, &length);
+    p = pa_packet_new_data(data, length);
+    pa_tagstruct_free(t);
+
+    return p;
+}
+
+/* Preallocate from a size hint and hand the buffer over to the packet */
+static pa_packet *build_sized(size_t hint) {
+    pa_tagstruct *t;
+    uint8_t *data;
+    size_t length;
+
+    t = pa_tagstruct_new_sized(hint);
+    fill_sink_input_list(t);
+
+    data = pa_tagstruct_free_data(t, &length);
+    return pa_packet_new_dynamic(data, length);
+}
+
+START_TEST (tagstruct_free_data_test) {
+    pa_tagstruct *t;
+    uint8_t *data;
+    size_t length;
+    uint32_t u;
+    const char *s;
+    unsigned i;
+
+    /* Small tagstructs store their data inline and must be copied */
+    t = pa_tagstruct_new();
+    pa_tagstruct_putu32(t, 42);
+    data = pa_tagstruct_free_data(t, &length);
+    fail_unless(length == 5);
+
+    t = pa_tagstruct_new_fixed(data, length);
+    fail_unless(pa_tagstruct_getu32(t, &u) >= 0);
+    fail_unless(u == 42);
+    fail_unless(pa_tagstruct_eof(t));
+    pa_tagstruct_free(t);
+    pa_xfree(data);
+
+    /* Large ones grow out of a preallocated buffer */
+    t = pa_tagstruct_new_sized(256);
+    for (i = 0; i < 1000; i++)
+        pa_tagstruct_puts(t, "foobar");
+    data = pa_tagstruct_free_data(t, &length);
+    fail_unless(length == 1000 * 8);
+
+    t = pa_tagstruct_new_fixed(data, length);
+    for (i = 0; i < 1000; i++) {
+        fail_unless(pa_tagstruct_gets(t, &s) >= 0);
+        fail_unless(pa_streq(s, "foobar"));
+    }
+    fail_unless(pa_tagstruct_eof(t));
+    pa_tagstruct_free(t);
+    pa_xfree(data);
+}
+END_TEST
+
+START_TEST (tagstruct_list_reply_test) {
+    pa_packet *p1, *p2;
+    const void *d1, *d2;
+    size_t l1, l2;
+
+    proplist = pa_proplist_new();
+    pa_proplist_sets(proplist, PA_PROP_MEDIA_NAME, "Playback Stream");
+    pa_proplist_sets(proplist, PA_PROP_APPLICATION_NAME, "tagstruct-test");
+    pa_proplist_sets(proplist, PA_PROP_APPLICATION_PROCESS_BINARY, "tagstruct-test");
+    pa_proplist_sets(proplist, PA_PROP_MEDIA_ROLE, "music");
+
+    format = pa_format_info_new();
+    format->encoding = PA_ENCODING_PCM;
+
+    p1 = build_copy();
+    d1 = pa_packet_data(p1, &l1);
+    p2 = build_sized(l1);
+    d2 = pa_packet_data(p2, &l2);
+
+    fail_unless(l1 == l2);
+    fail_unless(memcmp(d1, d2, l1) == 0);
+
+    pa_log_debug("GET_SINK_INPUT_INFO_LIST reply with %u entries: %zu bytes", N_SINK_INPUTS, l1);
+
+    pa_packet_unref(p1);
+    pa_packet_unref(p2);
+
+    /* A hint that is too small must only cost reallocations */
+    p1 = build_copy();
+    d1 = pa_packet_data(p1, &l1);
+    p2 = build_sized(l1 / 3);
+    d2 = pa_packet_data(p2, &l2);
+
+    fail_unless(l1 == l2);
+    fail_unless(memcmp(d1, d2, l1) == 0);
+
+    pa_packet_unref(p1);
+    pa_packet_unref(p2);
+
+    pa_format_info_free(format);
+    pa_proplist_free(proplist);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Tagstruct");
+    tc = tcase_create("tagstruct");
+    tcase_add_test(tc, tagstruct_free_data_test);
+    tcase_add_test(tc, tagstruct_list_reply_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,270 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <check.h>
+
+#include <pulse/pulseaudio.h>
+#include <pulse/mainloop.h>
+#include <pulse/internal.h>
+
+#include <pulsecore/macro.h>
+#include <pulsecore/memblock.h>
+#include <pulsecore/pstream.h>
+
+/* Plays the same sine wave twice, once rendered into a private buffer
+ * and handed to pa_stream_write() (which copies it into a memblock),
+ * and once rendered directly into memory allocated with
+ * pa_context_new_write_buffer(). Reports how many bytes per second of
+ * audio had to be copied on the client side in both cases.
+ *
+ * Copies are counted as the memory libpulse allocates from the context
+ * memory pool while writing, plus everything that is written to the
+ * socket instead of being passed as a shared memory reference. */
+
+#define SINE_HZ 440
+#define SAMPLE_HZ 48000
+#define CHANNELS 2
+#define PLAY_MSEC 500
+
+enum {
+    MODE_COPY,
+    MODE_BUFFER,
+    MODE_MAX
+};
+
+static const char *mode_name[MODE_MAX] = {
+    [MODE_COPY] = "pa_stream_write()",
+    [MODE_BUFFER] = "pa_stream_write_buffer()",
+};
+
+static pa_context *context = NULL;
+static pa_stream *stream = NULL;
+static pa_mainloop_api *mainloop_api = NULL;
+static const char *bname = NULL;
+
+static int mode;
+static size_t frames_written;
+static uint64_t bytes_copied[MODE_MAX];
+static pa_usec_t render_usec[MODE_MAX];
+
+static float scratch[SAMPLE_HZ * CHANNELS];
+
+static const pa_sample_spec sample_spec = {
+    .format = PA_SAMPLE_FLOAT32,
+    .rate = SAMPLE_HZ,
+    .channels = CHANNELS
+};
+
+static void start_stream(void);
+
+static uint64_t pool_accumulated_size(void) {
+    return (uint64_t) pa_atomic_load(&pa_mempool_get_stat(context->mempool)->accumulated_size);
+}
+
+static uint64_t count_copies(uint64_t accumulated_before, size_t nbytes) {
+    uint64_t n = pool_accumulated_size() - accumulated_before;
+
+    /* Without SHM the pstream copies everything into the socket */
+    if (!pa_pstream_get_shm(context->pstream))
+        n += nbytes;
+
+    return n;
+}
+
+static void render(float *d, size_t n_frames) {
+    size_t i;
+    unsigned c;
+
+    for (i = 0; i < n_frames; i++, frames_written++) {
+        float v = sinf((float) frames_written / SAMPLE_HZ * SINE_HZ * 2.0f * (float) M_PI) * 0.1f;
+
+        for (c = 0; c < CHANNELS; c++)
+            *(d++) = v;
+    }
+}
+
+static void drain_cb(pa_stream *s, int success, void *userdata) {
+    fail_unless(success);
+
+    pa_stream_disconnect(s);
+    pa_stream_unref(s);
+    stream = NULL;
+
+    if (++mode < MODE_MAX)
+        start_stream();
+    else
+        mainloop_api->quit(mainloop_api, 0);
+}
+
+static void write_cb(pa_stream *s, size_t nbytes, void *userdata) {
+    size_t frame_size = pa_frame_size(&sample_spec);
+    size_t n_frames;
+    pa_usec_t begin;
+    uint64_t accumulated;
+
+    if (frames_written >= (size_t) SAMPLE_HZ * PLAY_MSEC / 1000)
+        return;
+
+    n_frames = PA_MIN(nbytes / frame_size, (size_t) SAMPLE_HZ * PLAY_MSEC / 1000 - frames_written);
+    n_frames = PA_MIN(n_frames, (size_t) SAMPLE_HZ);
+    if (n_frames == 0)
+        return;
+
+    begin = pa_rtclock_now();
+
+    if (mode == MODE_COPY) {
+        render(scratch, n_frames);
+
+        /* Without a free callback the data is always copied */
+        accumulated = pool_accumulated_size();
+        fail_unless(pa_stream_write(s, scratch, n_frames * frame_size, NULL, 0, PA_SEEK_RELATIVE) == 0);
+        bytes_copied[mode] += count_copies(accumulated, n_frames * frame_size);
+
+    } else {
+        pa_write_buffer *b;
+
+        fail_unless((b = pa_context_new_write_buffer(context, n_frames * frame_size)) != NULL);
+        n_frames = PA_MIN(n_frames, pa_write_buffer_get_length(b) / frame_size);
+
+        render(pa_write_buffer_get_data(b), n_frames);
+
+        accumulated = pool_accumulated_size();
+        fail_unless(pa_stream_write_buffer(s, b, 0, n_frames * frame_size, 0, PA_SEEK_RELATIVE) == 0);
+        bytes_copied[mode] += count_copies(accumulated, n_frames * frame_size);
+        pa_write_buffer_unref(b);
+    }
+
+    render_usec[mode] += pa_rtclock_now() - begin;
+
+    if (frames_written >= (size_t) SAMPLE_HZ * PLAY_MSEC / 1000)
+        pa_operation_unref(pa_stream_drain(s, drain_cb, NULL));
+}
+
+static void stream_state_callback(pa_stream *s, void *userdata) {
+    switch (pa_stream_get_state(s)) {
+        case PA_STREAM_UNCONNECTED:
+        case PA_STREAM_CREATING:
+        case PA_STREAM_TERMINATED:
+        case PA_STREAM_READY:
+            break;
+
+        default:
+        case PA_STREAM_FAILED:
+            fprintf(stderr, "Stream error: %s\n", pa_strerror(pa_context_errno(pa_stream_get_context(s))));
+            fail();
+    }
+}
+
+static void start_stream(void) {
+    frames_written = 0;
+
+    fail_unless((stream = pa_stream_new(context, mode_name[mode], &sample_spec, NULL)) != NULL);
+
+    pa_stream_set_state_callback(stream, stream_state_callback, NULL);
+    pa_stream_set_write_callback(stream, write_cb, NULL);
+
+    fail_unless(pa_stream_connect_playback(stream, NULL, NULL, 0, NULL, NULL) == 0);
+}
+
+static void context_state_callback(pa_context *c, void *userdata) {
+    switch (pa_context_get_state(c)) {
+        case PA_CONTEXT_CONNECTING:
+        case PA_CONTEXT_AUTHORIZING:
+        case PA_CONTEXT_SETTING_NAME:
+            break;
+
+        case PA_CONTEXT_READY:
+            mode = MODE_COPY;
+            start_stream();
+            break;
+
+        case PA_CONTEXT_TERMINATED:
+            mainloop_api->quit(mainloop_api, 0);
+            break;
+
+        case PA_CONTEXT_FAILED:
+        default:
+            fprintf(stderr, "Context error: %s\n", pa_strerror(pa_context_errno(c)));
+            fail();
+    }
+}
+
+START_TEST (write_buffer_test) {
+    pa_mainloop *m;
+    int ret = 1, i;
+
+    fail_unless((m = pa_mainloop_new()) != NULL);
+    mainloop_api = pa_mainloop_get_api(m);
+
+    context = pa_context_new(mainloop_api, bname);
+    fail_unless(context != NULL);
+
+    pa_context_set_state_callback(context, context_state_callback, NULL);
+
+    fail_unless(pa_context_connect(context, NULL, 0, NULL) >= 0);
+    fail_unless(pa_mainloop_run(m, &ret) >= 0);
+    fail_unless(ret == 0);
+
+    for (i = 0; i < MODE_MAX; i++)
+        fprintf(stderr, "%-26s copied %8llu bytes/s, rendering and writing took %6llu usec/s\n",
+                mode_name[i],
+                (unsigned long long) (bytes_copied[i] * 1000 / PLAY_MSEC),
+                (unsigned long long) (render_usec[i] * 1000 / PLAY_MSEC));
+
+    /* The copy counting must see the copies of pa_stream_write() */
+    fail_unless(bytes_copied[MODE_COPY] >= (uint64_t) SAMPLE_HZ * PLAY_MSEC / 1000 * pa_frame_size(&sample_spec));
+
+    if (pa_pstream_get_shm(context->pstream))
+        fail_unless(bytes_copied[MODE_BUFFER] == 0);
+    else
+        fprintf(stderr, "Not using shared memory, both modes copy into the socket\n");
+
+    pa_context_unref(context);
+    pa_mainloop_free(m);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    bname = argv[0];
+
+    s = suite_create("Write buffer");
+    tc = tcase_create("writebuffer");
+    tcase_add_test(tc, write_buffer_test);
+    /* 2 x 500 ms playback plus some slack */
+    tcase_set_timeout(tc, 5);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}